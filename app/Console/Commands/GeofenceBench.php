@@ -0,0 +1,155 @@
+<?php
+
+namespace App\Console\Commands;
+
+use App\Services\GeofenceNative;
+use App\Services\GeofencingService;
+use Illuminate\Console\Command;
+
+class GeofenceBench extends Command
+{
+    protected $signature = 'geofence:bench
+                            {--points=20000 : Points to check}
+                            {--fences=16 : Random polygons the points are spread over}
+                            {--vertices=48 : Vertices per polygon}';
+
+    protected $description = 'Compare per-check GeoJSON geofencing with compiled PHP and native (FFI) batch checks';
+
+    public function handle(GeofencingService $geofencing)
+    {
+        $pointCount = max(1, (int)$this->option('points'));
+        $fenceCount = max(1, (int)$this->option('fences'));
+        $vertexCount = max(3, (int)$this->option('vertices'));
+
+        mt_srand(42);
+        [$polygons, $centers] = $this->randomFences($fenceCount, $vertexCount);
+        $points = $this->randomPoints($pointCount, $centers);
+
+        $rows = [];
+
+        // What every check did before: dig the ring out of the GeoJSON and ray cast
+        $start = hrtime(true);
+        $legacy = [];
+        foreach ($points as $point) {
+            $legacy[] = $this->legacyCheck($point['lat'], $point['lng'], $polygons[$point['fence']]);
+        }
+        $legacyNs = hrtime(true) - $start;
+        $rows[] = $this->row('GeoJSON per check (previous)', $legacyNs, $legacyNs, $pointCount, $legacy, $legacy);
+
+        // Compiled once, then checked point by point in PHP
+        $start = hrtime(true);
+        $compiled = array_map(fn ($polygon) => $geofencing->compile($polygon), $polygons);
+        $php = [];
+        foreach ($points as $point) {
+            $php[] = $geofencing->containsCompiled($compiled[$point['fence']], $point['lat'], $point['lng']);
+        }
+        $rows[] = $this->row('Compiled, PHP', hrtime(true) - $start, $legacyNs, $pointCount, $php, $legacy);
+
+        // The whole batch through checkBatch(): one native call with libgeofence
+        $start = hrtime(true);
+        $batch = $geofencing->checkBatch($points, $polygons);
+        $native = GeofenceNative::available();
+        $rows[] = $this->row($native ? 'checkBatch, native (FFI)' : 'checkBatch, PHP (no FFI library)', hrtime(true) - $start, $legacyNs, $pointCount, $batch, $legacy);
+
+        $this->table(['Path', 'Total', 'Per check', 'Speedup', 'Inside', 'Differs from previous'], $rows);
+        $this->line("{$pointCount} points, {$fenceCount} fences of {$vertexCount} vertices. Differences are points exactly on an edge, which now count as inside.");
+        if (!$native) {
+            $this->components->warn('Set GEOFENCE_FFI_LIBRARY to libgeofence.so (arduino/sensor-monitor/tools/geofence_ffi.cpp) and enable ext-ffi to measure the native path');
+        }
+
+        return Command::SUCCESS;
+    }
+
+    private function row(string $path, int $ns, int $baselineNs, int $count, array $results, array $baseline): array
+    {
+        $differs = 0;
+        foreach ($results as $i => $inside) {
+            $differs += $inside !== $baseline[$i] ? 1 : 0;
+        }
+
+        return [
+            $path,
+            number_format($ns / 1e6, 1) . ' ms',
+            number_format($ns / $count) . ' ns',
+            number_format($baselineNs / max(1, $ns), 1) . 'x',
+            count(array_filter($results)),
+            $differs,
+        ];
+    }
+
+    // Star-shaped polygons around random centres, as GeoJSON feature collections
+    private function randomFences(int $count, int $vertices): array
+    {
+        $polygons = [];
+        $centers = [];
+
+        for ($f = 0; $f < $count; $f++) {
+            $center = ['lat' => 39.3 + mt_rand() / mt_getrandmax() * 0.4, 'lng' => -107.9 + mt_rand() / mt_getrandmax() * 0.4];
+            $ring = [];
+            for ($v = 0; $v < $vertices; $v++) {
+                $angle = 2 * M_PI * $v / $vertices;
+                $radius = 0.005 + mt_rand() / mt_getrandmax() * 0.01;
+                $ring[] = [$center['lng'] + cos($angle) * $radius, $center['lat'] + sin($angle) * $radius];
+            }
+            $ring[] = $ring[0];
+
+            $polygons["bench:{$f}"] = [
+                'type' => 'FeatureCollection',
+                'features' => [['type' => 'Feature', 'properties' => [], 'geometry' => ['type' => 'Polygon', 'coordinates' => [$ring]]]],
+            ];
+            $centers["bench:{$f}"] = $center;
+        }
+
+        return [$polygons, $centers];
+    }
+
+    // Around a random fence, roughly half of them inside it
+    private function randomPoints(int $count, array $centers): array
+    {
+        $keys = array_keys($centers);
+        $points = [];
+
+        for ($i = 0; $i < $count; $i++) {
+            $key = $keys[mt_rand(0, count($keys) - 1)];
+            $points[] = [
+                'lat' => $centers[$key]['lat'] + (mt_rand() / mt_getrandmax() - 0.5) * 0.03,
+                'lng' => $centers[$key]['lng'] + (mt_rand() / mt_getrandmax() - 0.5) * 0.03,
+                'fence' => $key,
+            ];
+        }
+
+        return $points;
+    }
+
+    // GeofencingService::isPointInsidePolygon() as it was before the shared core
+    private function legacyCheck($lat, $lng, $polygon): bool
+    {
+        if (!isset($polygon['features'][0]['geometry']['coordinates'][0])) {
+            return false;
+        }
+        $vertices = $polygon['features'][0]['geometry']['coordinates'][0];
+
+        $inside = false;
+        $n = count($vertices);
+        $j = $n - 1;
+
+        for ($i = 0; $i < $n; $i++) {
+            $xi = (float)$vertices[$i][0];
+            $yi = (float)$vertices[$i][1];
+            $xj = (float)$vertices[$j][0];
+            $yj = (float)$vertices[$j][1];
+
+            if ($xi == $lng && $yi == $lat) {
+                return true;
+            }
+
+            if ((($yi > $lat) !== ($yj > $lat)) &&
+                ($lng < ($xj - $xi) * ($lat - $yi) / ($yj - $yi) + $xi)) {
+                $inside = !$inside;
+            }
+            $j = $i;
+        }
+
+        return $inside;
+    }
+}
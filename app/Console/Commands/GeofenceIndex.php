@@ -0,0 +1,37 @@
+<?php
+
+namespace App\Console\Commands;
+
+use App\Models\Land;
+use App\Services\GeofencingService;
+use Illuminate\Console\Command;
+
+class GeofenceIndex extends Command
+{
+    protected $signature = 'geofence:index
+                            {land_id?* : Lands to index (all lands when omitted)}';
+
+    protected $description = 'Rebuild the geohash cell index used to find candidate lands for a GPS fix';
+
+    public function handle(GeofencingService $geofencing)
+    {
+        $ids = $this->argument('land_id');
+        $lands = $ids ? Land::whereIn('id', $ids)->get() : Land::all();
+
+        if ($lands->isEmpty()) {
+            $this->components->error('No matching lands');
+            return Command::FAILURE;
+        }
+
+        // Saving a land keeps its cells current; this is for existing lands
+        foreach ($lands as $land) {
+            $cells = $geofencing->indexLand($land);
+            $this->components->twoColumnDetail(
+                "{$land->id} <fg=gray>{$land->land_name}</>",
+                $cells ? "{$cells} cells" : '<fg=yellow>no fence</>'
+            );
+        }
+
+        return Command::SUCCESS;
+    }
+}
@@ -0,0 +1,113 @@
+<?php
+
+namespace App\Console\Commands;
+
+use App\Models\Device;
+use App\Models\MqttBroker;
+use App\Services\MqttDeviceService;
+use Illuminate\Console\Command;
+
+class MqttBrokerList extends Command
+{
+    protected $signature = 'mqtt:broker-list
+                            {device_id?* : Devices to configure (all devices when omitted)}
+                            {--broker=* : Broker ids or names in priority order (default: the device broker, then the other active ones)}
+                            {--reset : Drop the pushed list, devices return to their built-in broker}
+                            {--report : Only show the broker each device last reported}';
+
+    protected $description = 'Push failover broker lists to devices and report which broker they use';
+
+    // Entries the firmware keeps (BROKER_POOL_MAX)
+    private const MAX_BROKERS = 4;
+
+    public function handle(MqttDeviceService $deviceService)
+    {
+        $ids = $this->argument('device_id');
+        $devices = $ids ? Device::whereIn('device_unique_id', $ids)->get() : Device::all();
+
+        if ($devices->isEmpty()) {
+            $this->components->error('No matching devices');
+            return Command::FAILURE;
+        }
+
+        if ($this->option('report')) {
+            $this->report($devices);
+            return Command::SUCCESS;
+        }
+
+        $chosen = collect();
+        foreach ($this->option('broker') as $key) {
+            $broker = MqttBroker::where('id', $key)->orWhere('name', $key)->first();
+            if (!$broker) {
+                $this->components->error("Unknown broker {$key}");
+                return Command::FAILURE;
+            }
+            $chosen->push($broker);
+        }
+
+        $failed = 0;
+        foreach ($devices as $device) {
+            $list = $this->option('reset') ? [] : $this->brokerList($device, $chosen);
+            $ok = $deviceService->publishDeviceConfig($device->device_unique_id, 'brokers', ['brokers' => $list]);
+            $hosts = $list ? implode(', ', array_map(fn ($b) => "{$b['host']}:{$b['port']}", $list)) : 'built-in';
+            $this->components->twoColumnDetail("{$device->device_unique_id} <fg=gray>{$hosts}</>", $ok ? '<fg=green>sent</>' : '<fg=red>failed</>');
+            $failed += $ok ? 0 : 1;
+        }
+
+        return $failed ? Command::FAILURE : Command::SUCCESS;
+    }
+
+    /**
+     * Brokers the device can reach over plain MQTT/MQTTS, highest priority first
+     */
+    private function brokerList(Device $device, $chosen): array
+    {
+        $brokers = $chosen->isNotEmpty()
+            ? $chosen
+            : collect([$device->effective_mqtt_broker])
+                ->merge(MqttBroker::active()->orderByDesc('is_default')->orderBy('id')->get())
+                ->filter()
+                ->unique('id');
+
+        return $brokers
+            ->filter(fn (MqttBroker $b) => in_array($b->protocol, ['mqtt', 'mqtts']))
+            ->take(self::MAX_BROKERS)
+            ->map(fn (MqttBroker $b) => ['host' => $b->host, 'port' => (int)$b->port])
+            ->values()
+            ->all();
+    }
+
+    private function report($devices): void
+    {
+        $rows = [];
+        $totals = ['failovers' => 0, 'switches' => 0];
+
+        foreach ($devices as $device) {
+            $broker = $device->application_data['broker'] ?? null;
+            if (!$broker) {
+                $rows[] = [$device->device_unique_id, '-', '-', '-', '-', 'never reported'];
+                continue;
+            }
+
+            $candidates = collect($broker['candidates'] ?? [])->map(function ($c) {
+                $latency = ($c['latency_ms'] ?? -1) < 0 ? '?' : $c['latency_ms'] . ' ms';
+                return "{$c['host']}:{$c['port']} {$latency}" . (($c['failures'] ?? 0) ? " ({$c['failures']} failed)" : '');
+            })->implode("\n");
+
+            $rows[] = [
+                $device->device_unique_id,
+                isset($broker['host']) ? "{$broker['host']}:{$broker['port']}" : '-',
+                $candidates,
+                $broker['failovers'] ?? 0,
+                $broker['switches'] ?? 0,
+                $broker['reported_at'] ?? '',
+            ];
+            $totals['failovers'] += $broker['failovers'] ?? 0;
+            $totals['switches'] += $broker['switches'] ?? 0;
+        }
+
+        $this->table(['Device', 'Active', 'Candidates', 'Failovers', 'Switches', 'Reported'], $rows);
+        $this->components->twoColumnDetail('Fleet failovers', $totals['failovers']);
+        $this->components->twoColumnDetail('Fleet switches to a faster broker', $totals['switches']);
+    }
+}
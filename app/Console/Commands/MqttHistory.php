@@ -0,0 +1,76 @@
+<?php
+
+namespace App\Console\Commands;
+
+use App\Models\Device;
+use App\Services\MqttDeviceService;
+use Carbon\Carbon;
+use Illuminate\Console\Command;
+
+class MqttHistory extends Command
+{
+    protected $signature = 'mqtt:history
+                            {device_id : Device to fetch from}
+                            {--from= : Start of the range (anything Carbon parses, default one hour ago)}
+                            {--to= : End of the range (default now)}
+                            {--field=* : Sensor types to include (all when omitted)}
+                            {--max= : Stop after this many records}
+                            {--wait=60 : Seconds to wait for the last chunk}
+                            {--csv= : Write the records to this file instead of printing them}';
+
+    protected $description = 'Fetch full-resolution sample history from a device\'s flash log';
+
+    public function handle(MqttDeviceService $deviceService)
+    {
+        $deviceId = $this->argument('device_id');
+        if (!Device::where('device_unique_id', $deviceId)->exists()) {
+            $this->components->error("Unknown device {$deviceId}");
+            return Command::FAILURE;
+        }
+
+        $from = Carbon::parse($this->option('from') ?? '-1 hour');
+        $to = Carbon::parse($this->option('to') ?? 'now');
+        $max = $this->option('max') !== null ? (int)$this->option('max') : null;
+
+        $requestId = $deviceService->publishHistoryRequest($deviceId, $from->timestamp, $to->timestamp, $this->option('field'), $max);
+        if (!$requestId) {
+            $this->components->error('Request could not be published');
+            return Command::FAILURE;
+        }
+        $this->components->info("Requested {$from->toDateTimeString()} .. {$to->toDateTimeString()} ({$requestId})");
+
+        // The listener (mqtt:listen) assembles the chunks in the cache
+        $deadline = microtime(true) + (int)$this->option('wait');
+        do {
+            usleep(250000);
+            $result = $deviceService->getHistoryResult($requestId);
+        } while ($result && in_array($result['status'], ['pending', 'streaming'], true) && microtime(true) < $deadline);
+
+        if (!$result || $result['status'] === 'pending') {
+            $this->components->error('No answer; is mqtt:listen running and the device online?');
+            return Command::FAILURE;
+        }
+
+        $records = $result['records'];
+        $this->components->twoColumnDetail('Status', $result['status']);
+        $this->components->twoColumnDetail('Records', count($records) . " in {$result['chunks']} chunks");
+
+        if ($this->option('csv')) {
+            $handle = fopen($this->option('csv'), 'w');
+            fputcsv($handle, ['time', 'sensor_type', 'value']);
+            foreach ($records as $record) {
+                fputcsv($handle, [Carbon::createFromTimestampMs($record['time'])->toISOString(), $record['sensor_type'], $record['value']]);
+            }
+            fclose($handle);
+            $this->components->twoColumnDetail('Written to', $this->option('csv'));
+        } else {
+            $this->table(['Time', 'Sensor', 'Value'], array_map(fn ($record) => [
+                Carbon::createFromTimestampMs($record['time'])->format('Y-m-d H:i:s.v'),
+                $record['sensor_type'],
+                $record['value'],
+            ], $records));
+        }
+
+        return in_array($result['status'], ['complete', 'truncated'], true) ? Command::SUCCESS : Command::FAILURE;
+    }
+}
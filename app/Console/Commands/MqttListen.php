@@ -4,6 +4,7 @@ namespace App\Console\Commands;
 
 use Illuminate\Console\Command;
 use App\Services\MqttDeviceService;
+use App\Services\MqttPayloadCodec;
 use App\Models\MqttBroker;
 use PhpMqtt\Client\MqttClient;
 use PhpMqtt\Client\ConnectionSettings;
@@ -174,6 +175,7 @@ class MqttListen extends Command
             'devices/+/status' => 'status',
             'devices/+/gps' => 'gps',
             'devices/+/control/response' => 'control_response',
+            'devices/+/history/data' => 'history',
             'devices/discover/all' => 'global_discovery'
         ];
         
@@ -198,6 +200,12 @@ class MqttListen extends Command
     
     private function handleMessage(string $type, string $topic, string $message, MqttDeviceService $service, MqttBroker $broker, bool $debug, $device = null): void
     {
+        // Large payloads arrive LZ4-compressed
+        $message = MqttPayloadCodec::decode($message);
+        if ($message === '') {
+            return;
+        }
+
         if ($debug) {
             $emoji = match($type) {
                 'discovery' => '📥',
@@ -205,6 +213,7 @@ class MqttListen extends Command
                 'status' => '💓',
                 'gps' => '📍',
                 'control_response' => '🎛️',
+                'history' => '🗄️',
                 'global_discovery' => '🔍',
                 'custom' => '🔧',
                 default => '📨'
@@ -235,6 +244,8 @@ class MqttListen extends Command
             'data' => $service->handleDeviceData($topic, $message),
             'status' => $service->handleDeviceStatus($topic, $message),
             'gps' => $service->handleDeviceGPS($topic, $message),
+            'control_response' => $service->handleControlResponse($topic, $message),
+            'history' => $service->handleHistoryData($topic, $message),
             'global_discovery' => $service->handleGlobalDiscovery($topic, $message),
             'custom' => $this->handleCustomMessage($topic, $message, $device),
             default => null
@@ -0,0 +1,98 @@
+<?php
+
+namespace App\Console\Commands;
+
+use App\Models\Device;
+use App\Services\MqttDeviceService;
+use Illuminate\Console\Command;
+
+class MqttLowPower extends Command
+{
+    protected $signature = 'mqtt:low-power
+                            {device_id?* : Devices to configure (all devices when omitted)}
+                            {--enable : Modem sleep, idle CPU clock and the longer keepalive}
+                            {--disable : Radio always awake, full clock, 60 s keepalive}
+                            {--idle-mhz= : CPU clock while idle (80, 160 or 240)}
+                            {--keepalive= : Keepalive in seconds, a little under the broker or NAT idle timeout}
+                            {--report : Only show the last reported low-power state and latencies}';
+
+    protected $description = 'Switch devices to connected low-power mode and report its latency cost';
+
+    public function handle(MqttDeviceService $deviceService)
+    {
+        $ids = $this->argument('device_id');
+        $devices = $ids ? Device::whereIn('device_unique_id', $ids)->get() : Device::all();
+
+        if ($devices->isEmpty()) {
+            $this->components->error('No matching devices');
+            return Command::FAILURE;
+        }
+
+        if ($this->option('report')) {
+            $this->report($devices);
+            return Command::SUCCESS;
+        }
+
+        $mode = [];
+        if ($this->option('enable') || $this->option('disable')) {
+            $mode['enabled'] = (bool)$this->option('enable');
+        }
+        if ($this->option('idle-mhz') !== null) {
+            $mode['idle_mhz'] = (int)$this->option('idle-mhz');
+            if (!in_array($mode['idle_mhz'], [80, 160, 240], true)) {
+                $this->components->error('--idle-mhz must be 80, 160 or 240');
+                return Command::FAILURE;
+            }
+        }
+        if ($this->option('keepalive') !== null) {
+            $mode['keepalive'] = (int)$this->option('keepalive');
+            if ($mode['keepalive'] < 10 || $mode['keepalive'] > 3600) {
+                $this->components->error('--keepalive must be between 10 and 3600 seconds');
+                return Command::FAILURE;
+            }
+        }
+
+        if (!$mode) {
+            $this->components->error('Nothing to push, pass --enable/--disable, --idle-mhz or --keepalive');
+            return Command::FAILURE;
+        }
+
+        $failed = 0;
+        foreach ($devices as $device) {
+            $ok = $deviceService->publishDeviceConfig($device->device_unique_id, 'lowpower', $mode);
+            $this->components->twoColumnDetail($device->device_unique_id, $ok ? '<fg=green>sent</>' : '<fg=red>failed</>');
+            $failed += $ok ? 0 : 1;
+        }
+
+        return $failed ? Command::FAILURE : Command::SUCCESS;
+    }
+
+    private function report($devices): void
+    {
+        $rows = [];
+
+        foreach ($devices as $device) {
+            $lowpower = $device->application_data['lowpower'] ?? null;
+            if (!$lowpower) {
+                $rows[] = [$device->device_unique_id, '-', '-', '-', '-', '-', '-', 'never reported'];
+                continue;
+            }
+
+            $rows[] = [
+                $device->device_unique_id,
+                ($lowpower['enabled'] ?? false) ? 'on for ' . round(($lowpower['active_s'] ?? 0) / 60) . ' min' : 'off',
+                ($lowpower['cpu_mhz'] ?? '?') . ' MHz',
+                ($lowpower['keepalive'] ?? '?') . ' s',
+                ($lowpower['wake_to_publish_ms'] ?? '?') . ' / ' . ($lowpower['wake_to_publish_max_ms'] ?? '?') . ' ms',
+                ($lowpower['commands_missed'] ?? 0) . ' of ' . (($lowpower['commands_received'] ?? 0) + ($lowpower['commands_missed'] ?? 0)),
+                $lowpower['session_drops'] ?? 0,
+                $lowpower['reported_at'] ?? '',
+            ];
+        }
+
+        $this->table(
+            ['Device', 'Mode', 'CPU', 'Keepalive', 'Wake to publish (avg / max)', 'Commands missed', 'Session drops', 'Reported'],
+            $rows
+        );
+    }
+}
@@ -0,0 +1,181 @@
+<?php
+
+namespace App\Console\Commands;
+
+use App\Models\Device;
+use Illuminate\Console\Command;
+use Illuminate\Support\Facades\Log;
+use PhpMqtt\Client\MqttClient;
+use PhpMqtt\Client\ConnectionSettings;
+
+class MqttOtaPush extends Command
+{
+    protected $signature = 'mqtt:ota
+                            {device_id : Device to update}
+                            {patch : Delta patch built with arduino/sensor-monitor/tools/delta_tool}
+                            {target : New firmware .bin the patch produces}
+                            {--base= : Firmware .bin currently running on the device (enables base check)}
+                            {--firmware-version= : Version string of the new firmware}
+                            {--chunk=2048 : Patch bytes per MQTT message}
+                            {--window=32768 : Unacknowledged bytes allowed in flight}
+                            {--stall=10 : Seconds without progress before rewinding}
+                            {--timeout=600 : Overall timeout in seconds}';
+
+    protected $description = 'Stream a delta firmware update to a device over MQTT';
+
+    private ?array $progress = null;
+    private float $lastProgressAt = 0;
+
+    public function handle()
+    {
+        $deviceId = $this->argument('device_id');
+        $device = Device::where('device_unique_id', $deviceId)->first();
+        $broker = $device?->effective_mqtt_broker;
+
+        if (!$device || !$broker) {
+            $this->components->error("Device {$deviceId} not found or has no MQTT broker");
+            return Command::FAILURE;
+        }
+
+        $patch = @file_get_contents($this->argument('patch'));
+        $target = $this->argument('target');
+        if ($patch === false || !is_file($target)) {
+            $this->components->error('Cannot read patch or target firmware');
+            return Command::FAILURE;
+        }
+
+        $chunkSize = max(256, (int)$this->option('chunk'));
+        $window = max($chunkSize, (int)$this->option('window'));
+        $stall = (int)$this->option('stall');
+        $version = $this->option('firmware-version') ?? pathinfo($target, PATHINFO_FILENAME);
+
+        $begin = [
+            'version' => $version,
+            'target_size' => filesize($target),
+            'target_md5' => md5_file($target),
+            'patch_size' => strlen($patch),
+        ];
+        if ($this->option('base')) {
+            $begin['base_md5'] = md5_file($this->option('base'));
+        }
+
+        $this->components->twoColumnDetail('Device', $deviceId);
+        $this->components->twoColumnDetail('Broker', $broker->connection_string);
+        $this->components->twoColumnDetail('Patch', strlen($patch) . ' bytes');
+        $this->components->twoColumnDetail('Target image', $begin['target_size'] . ' bytes (' .
+            round(100 * strlen($patch) / max(1, $begin['target_size']), 1) . '% sent)');
+
+        $mqtt = $this->connect($broker);
+        $mqtt->subscribe("devices/{$deviceId}/ota/progress", function (string $topic, string $message) {
+            $this->progress = json_decode($message, true);
+            $this->lastProgressAt = microtime(true);
+        }, 1);
+
+        $beginTopic = "devices/{$deviceId}/ota/begin";
+        $chunkTopic = "devices/{$deviceId}/ota/chunk";
+        $startTime = microtime(true);
+        $acked = 0;
+        $sendOffset = 0;
+
+        $mqtt->publish($beginTopic, json_encode($begin), 1);
+        $this->lastProgressAt = microtime(true);
+
+        $this->output->progressStart(strlen($patch));
+
+        try {
+            while (microtime(true) - $startTime < (int)$this->option('timeout')) {
+                $mqtt->loop(false, true);
+
+                if ($this->progress) {
+                    $state = $this->progress['state'] ?? '';
+                    if ($state === 'complete') {
+                        break;
+                    }
+                    if ($state === 'error') {
+                        throw new \Exception('Device reported: ' . ($this->progress['error'] ?? 'unknown error'));
+                    }
+
+                    // The device reports the next offset it expects; rewind on gaps
+                    $offset = (int)($this->progress['offset'] ?? 0);
+                    if ($offset < $sendOffset && ($this->progress['version'] ?? null) === $version) {
+                        $sendOffset = $offset;
+                    }
+                    if ($offset > $acked) {
+                        $this->output->progressAdvance($offset - $acked);
+                        $acked = $offset;
+                    }
+                    $this->progress = null;
+                }
+
+                // Nothing heard for a while: re-announce, the device answers with its offset
+                if (microtime(true) - $this->lastProgressAt > $stall) {
+                    $mqtt->publish($beginTopic, json_encode($begin), 1);
+                    $sendOffset = $acked;
+                    $this->lastProgressAt = microtime(true);
+                }
+
+                while ($sendOffset < strlen($patch) && $sendOffset - $acked < $window) {
+                    $chunk = substr($patch, $sendOffset, $chunkSize);
+                    $mqtt->publish($chunkTopic, pack('V', $sendOffset) . $chunk, 0);
+                    $sendOffset += strlen($chunk);
+                }
+
+                usleep(10000);
+            }
+
+            $this->output->progressFinish();
+
+            if (($this->progress['state'] ?? null) !== 'complete' && $acked < strlen($patch)) {
+                throw new \Exception('Timed out waiting for the device');
+            }
+
+            $duration = round(microtime(true) - $startTime, 1);
+            $this->components->info("✅ {$deviceId} accepted firmware {$version} in {$duration}s, rebooting");
+
+            Log::channel('mqtt')->info('OTA update completed', [
+                'device_id' => $deviceId,
+                'version' => $version,
+                'patch_size' => strlen($patch),
+                'target_size' => $begin['target_size'],
+                'duration_seconds' => $duration
+            ]);
+
+        } catch (\Exception $e) {
+            $this->newLine();
+            $this->components->error('OTA failed: ' . $e->getMessage());
+
+            Log::channel('mqtt')->error('OTA update failed', [
+                'device_id' => $deviceId,
+                'version' => $version,
+                'acked_bytes' => $acked,
+                'exception' => $e->getMessage()
+            ]);
+
+            return Command::FAILURE;
+
+        } finally {
+            $mqtt->disconnect();
+        }
+
+        return Command::SUCCESS;
+    }
+
+    private function connect($broker): MqttClient
+    {
+        $connectionSettings = new ConnectionSettings();
+
+        if ($broker->username) {
+            $connectionSettings->setUsername($broker->username);
+            $connectionSettings->setPassword($broker->password);
+        }
+
+        $connectionSettings->setKeepAliveInterval($broker->keep_alive);
+        $connectionSettings->setConnectTimeout($broker->connect_timeout);
+        $connectionSettings->setUseTls($broker->tls_enabled);
+
+        $mqtt = new MqttClient($broker->host, $broker->port, $broker->generateClientId('ota_' . getmypid()));
+        $mqtt->connect($connectionSettings, true);
+
+        return $mqtt;
+    }
+}
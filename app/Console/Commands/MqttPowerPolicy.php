@@ -0,0 +1,111 @@
+<?php
+
+namespace App\Console\Commands;
+
+use App\Models\Device;
+use App\Services\MqttDeviceService;
+use Illuminate\Console\Command;
+
+class MqttPowerPolicy extends Command
+{
+    protected $signature = 'mqtt:power-policy
+                            {device_id?* : Devices to configure (all devices when omitted)}
+                            {--enable : Turn the adaptive duty cycle on}
+                            {--disable : Turn it off, devices return to full rate}
+                            {--battery-low= : Battery % below which intervals stretch by --low-scale}
+                            {--battery-critical= : Battery % below which intervals stretch by --critical-scale}
+                            {--low-scale= : Interval multiplier at low battery}
+                            {--critical-scale= : Interval multiplier at critical battery}
+                            {--rssi-weak= : Average RSSI (dBm) below which publishes batch by --weak-batch}
+                            {--rssi-poor= : Average RSSI (dBm) below which publishes batch by --poor-batch}
+                            {--weak-batch= : Extra publish interval multiplier on a weak link}
+                            {--poor-batch= : Extra publish interval multiplier on a poor link}
+                            {--report : Only show the last reported duty cycle decisions}';
+
+    protected $description = 'Push adaptive duty cycle thresholds to devices and report their decisions';
+
+    private const OPTIONS = [
+        'battery-low' => 'battery_low',
+        'battery-critical' => 'battery_critical',
+        'low-scale' => 'low_scale',
+        'critical-scale' => 'critical_scale',
+        'rssi-weak' => 'rssi_weak',
+        'rssi-poor' => 'rssi_poor',
+        'weak-batch' => 'weak_batch',
+        'poor-batch' => 'poor_batch',
+    ];
+
+    public function handle(MqttDeviceService $deviceService)
+    {
+        $ids = $this->argument('device_id');
+        $devices = $ids ? Device::whereIn('device_unique_id', $ids)->get() : Device::all();
+
+        if ($devices->isEmpty()) {
+            $this->components->error('No matching devices');
+            return Command::FAILURE;
+        }
+
+        if ($this->option('report')) {
+            $this->report($devices);
+            return Command::SUCCESS;
+        }
+
+        $policy = [];
+        if ($this->option('enable') || $this->option('disable')) {
+            $policy['enabled'] = (bool)$this->option('enable');
+        }
+        foreach (self::OPTIONS as $option => $key) {
+            if ($this->option($option) !== null) {
+                $policy[$key] = (float)$this->option($option);
+            }
+        }
+
+        if (!$policy) {
+            $this->components->error('Nothing to push, pass at least one threshold or --enable/--disable');
+            return Command::FAILURE;
+        }
+
+        $failed = 0;
+        foreach ($devices as $device) {
+            $ok = $deviceService->publishDeviceConfig($device->device_unique_id, 'power', $policy);
+            $this->components->twoColumnDetail($device->device_unique_id, $ok ? '<fg=green>sent</>' : '<fg=red>failed</>');
+            $failed += $ok ? 0 : 1;
+        }
+
+        return $failed ? Command::FAILURE : Command::SUCCESS;
+    }
+
+    private function report($devices): void
+    {
+        $rows = [];
+        $totals = ['samples_saved' => 0, 'publishes_saved' => 0];
+
+        foreach ($devices as $device) {
+            $power = $device->application_data['power'] ?? null;
+            if (!$power) {
+                $rows[] = [$device->device_unique_id, '-', '-', '-', '-', '-', '-', 'never reported'];
+                continue;
+            }
+
+            $rows[] = [
+                $device->device_unique_id,
+                ($power['battery'] ?? '?') . '% / ' . ($power['rssi_avg'] ?? '?') . ' dBm',
+                ($power['battery_tier'] ?? 0) . ' / ' . ($power['link_tier'] ?? 0),
+                'x' . ($power['sample_scale'] ?? 1) . ' / x' . ($power['publish_scale'] ?? 1),
+                round(($power['reduced_s'] ?? 0) / 60) . ' min',
+                $power['samples_saved'] ?? 0,
+                $power['publishes_saved'] ?? 0,
+                $power['reported_at'] ?? '',
+            ];
+            $totals['samples_saved'] += $power['samples_saved'] ?? 0;
+            $totals['publishes_saved'] += $power['publishes_saved'] ?? 0;
+        }
+
+        $this->table(
+            ['Device', 'Battery / RSSI', 'Tiers', 'Sample / publish', 'Reduced for', 'Samples saved', 'Publishes saved', 'Reported'],
+            $rows
+        );
+        $this->components->twoColumnDetail('Fleet samples saved', $totals['samples_saved']);
+        $this->components->twoColumnDetail('Fleet publishes saved', $totals['publishes_saved']);
+    }
+}
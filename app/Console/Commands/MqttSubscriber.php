@@ -3,6 +3,7 @@
 namespace App\Console\Commands;
 
 use App\Services\MqttDeviceService;
+use App\Services\MqttPayloadCodec;
 use App\Models\MqttBroker;
 use App\Models\Device;
 use Illuminate\Console\Command;
@@ -174,7 +175,9 @@ class MqttSubscriber extends Command
             'devices/+/data' => 'data', 
             'devices/+/status' => 'status',
             'devices/+/gps' => 'gps',
+            'devices/+/alerts' => 'alert',
             'devices/+/control/response' => 'control_response',
+            'devices/+/history/data' => 'history',
             'devices/discover/all' => 'global_discovery'
         ];
         
@@ -199,13 +202,21 @@ class MqttSubscriber extends Command
     
     private function handleMessage(string $type, string $topic, string $message, MqttDeviceService $service, MqttBroker $broker, bool $debug, Device $device = null)
     {
+        // Large payloads arrive LZ4-compressed
+        $message = MqttPayloadCodec::decode($message);
+        if ($message === '') {
+            return;
+        }
+
         if ($debug) {
             $emoji = match($type) {
                 'discovery' => '📥',
                 'data' => '📊', 
                 'status' => '💓',
                 'gps' => '📍',
+                'alert' => '🚨',
                 'control_response' => '🎛️',
+                'history' => '🗄️',
                 'global_discovery' => '🔍',
                 'custom' => '🔧',
                 default => '📨'
@@ -228,6 +239,9 @@ class MqttSubscriber extends Command
             'data' => $service->handleDeviceData($topic, $message),
             'status' => $service->handleDeviceStatus($topic, $message),
             'gps' => $service->handleDeviceGPS($topic, $message),
+            'alert' => $service->handleDeviceAlert($topic, $message),
+            'control_response' => $service->handleControlResponse($topic, $message),
+            'history' => $service->handleHistoryData($topic, $message),
             'global_discovery' => $service->handleGlobalDiscovery($topic, $message),
             'custom' => $this->handleCustomMessage($topic, $message, $device),
             default => null
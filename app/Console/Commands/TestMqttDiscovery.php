@@ -6,6 +6,7 @@ use Illuminate\Console\Command;
 use PhpMqtt\Client\Facades\MQTT;
 use Illuminate\Support\Facades\Log;
 use App\Services\MqttDeviceService;
+use App\Services\MqttPayloadCodec;
 use Illuminate\Support\Facades\Cache;
 
 class TestMqttDiscovery extends Command
@@ -146,6 +147,8 @@ class TestMqttDiscovery extends Command
     
     private function handleDiscoveryResponse(string $topic, string $message, bool $showJson = false)
     {
+        $message = MqttPayloadCodec::decode($message);
+
         // Extract device ID from topic (format: devices/{device_id}/discovery/response)
         $topicParts = explode('/', $topic);
         $deviceId = $topicParts[1] ?? 'unknown';
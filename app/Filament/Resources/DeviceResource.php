@@ -389,12 +389,13 @@ class DeviceResource extends Resource
                                 'from_filament' => true
                             ]);
                             
-                            $mqtt = \PhpMqtt\Client\Facades\MQTT::connection();
-                            $mqtt->publish('devices/discover/all', 'discover');
+                            if (!app(\App\Services\MqttDeviceService::class)->discoverAllDevices()) {
+                                throw new \Exception('Broadcast could not be published');
+                            }
                             
                             Notification::make()
                                 ->title('Global discovery request sent')
-                                ->body('All connected devices will respond with their information')
+                                ->body('Connected devices will respond over the discovery window')
                                 ->success()
                                 ->send();
                         } catch (\Exception $e) {
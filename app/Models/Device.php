@@ -204,6 +204,7 @@ class Device extends Model
             'data' => "devices/{$deviceId}/data",
             'status' => "devices/{$deviceId}/status",
             'gps' => "devices/{$deviceId}/gps",
+            'alerts' => "devices/{$deviceId}/alerts",
             'commands' => "devices/{$deviceId}/commands",
             'control_response' => "devices/{$deviceId}/control/response",
         ];
@@ -322,6 +323,7 @@ class Device extends Model
             'speed_kmh' => $locationData['speed_kmh'] ?? null,
             'satellites' => $locationData['satellites'] ?? null,
             'hdop' => $locationData['hdop'] ?? null,
+            'geohash' => $locationData['geohash'] ?? null,
             'timestamp' => $locationData['timestamp'] ?? now()->toISOString(),
             'updated_at' => now()->toISOString(),
         ];
@@ -2,6 +2,7 @@
 
 namespace App\Models;
 
+use App\Services\GeofencingService;
 use Illuminate\Database\Eloquent\Factories\HasFactory;
 use Illuminate\Database\Eloquent\Model;
 use Illuminate\Database\Eloquent\Relations\BelongsTo;
@@ -35,6 +36,16 @@ class Land extends Model
         'deleted_at',
     ];
 
+    protected static function booted(): void
+    {
+        // Keep the geohash cell index in step with the fence
+        static::saved(function (Land $land) {
+            if ($land->wasRecentlyCreated || $land->wasChanged(['location', 'enabled'])) {
+                app(GeofencingService::class)->indexLand($land);
+            }
+        });
+    }
+
     public function user(): BelongsTo
     {
         return $this->belongsTo(User::class, 'user_id');
@@ -44,4 +55,27 @@ class Land extends Model
     {
         return $this->hasMany(Device::class, 'land_id');
     }
+
+    public function cells(): HasMany
+    {
+        return $this->hasMany(LandCell::class, 'land_id');
+    }
+
+    /**
+     * GeoJSON polygon the land is fenced by, null when it has none
+     */
+    public function fencePolygon(): ?array
+    {
+        $polygon = $this->location['geojson'] ?? null;
+
+        return is_array($polygon) ? $polygon : null;
+    }
+
+    /**
+     * Cache key of the compiled fence; changes whenever the land is saved
+     */
+    public function fenceKey(): string
+    {
+        return "land:{$this->id}:" . ($this->updated_at?->timestamp ?? 0);
+    }
 }
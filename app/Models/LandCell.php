@@ -0,0 +1,23 @@
+<?php
+
+namespace App\Models;
+
+use Illuminate\Database\Eloquent\Model;
+use Illuminate\Database\Eloquent\Relations\BelongsTo;
+
+class LandCell extends Model
+{
+    protected $table = 'land_cells';
+
+    public $timestamps = false;
+
+    protected $fillable = [
+        'land_id',
+        'cell',
+    ];
+
+    public function land(): BelongsTo
+    {
+        return $this->belongsTo(Land::class, 'land_id');
+    }
+}
@@ -23,6 +23,7 @@ class Sensor extends Model
         'unit',
         'thresholds',
         'value',
+        'window_stats',
         'accuracy',
         'reading_timestamp',
         'enabled',
@@ -36,6 +37,7 @@ class Sensor extends Model
     protected $casts = [
         'thresholds' => 'array',
         'value' => 'float',
+        'window_stats' => 'array',
         'accuracy' => 'float',
         'reading_timestamp' => 'datetime',
         'enabled' => 'boolean',
@@ -155,21 +157,18 @@ class Sensor extends Model
             return false; // No GPS data available
         }
 
-        // Location is already an array, no need to json_decode
-        $locationData = $land->location;
-        if (!isset($locationData['geojson'])) {
+        $geojsonData = $land->fencePolygon();
+        if (!$geojsonData) {
             return false;
         }
 
-        // Extract the geojson from the location data
-        $geojsonData = $locationData['geojson'];
-
         // Use the GeofencingService
         $geofencingService = new GeofencingService();
         return $geofencingService->isPointInsidePolygon(
             $coordinates['lat'], 
             $coordinates['lng'], 
-            $geojsonData
+            $geojsonData,
+            $land->fenceKey()
         );
     }
 
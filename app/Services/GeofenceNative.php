@@ -0,0 +1,124 @@
+<?php
+
+namespace App\Services;
+
+use Illuminate\Support\Facades\Log;
+
+/**
+ * Native geofence checks through FFI.
+ *
+ * Wraps libgeofence.so, the firmware's geofence.h behind a C interface
+ * (arduino/sensor-monitor/tools/geofence_ffi.cpp). Fences are compiled into
+ * the native set once per process and addressed by the caller's key, so a
+ * long-running listener only pays for a polygon the first time it sees it.
+ * Without the library every method reports unavailable and
+ * GeofencingService runs the identical PHP path.
+ */
+class GeofenceNative
+{
+    private static ?\FFI $ffi = null;
+    private static $set = null;
+    private static bool $failed = false;
+
+    /** @var array<string, int> fence key => index in the native set */
+    private static array $fences = [];
+
+    // A changed polygon is added under a new key; start over past this many
+    private const MAX_FENCES = 4096;
+
+    public static function available(): bool
+    {
+        if (self::$ffi !== null) {
+            return true;
+        }
+        if (self::$failed) {
+            return false;
+        }
+
+        $library = config('services.geofence.ffi_library');
+        $header = config('services.geofence.ffi_header');
+        if (!$library || !extension_loaded('ffi') || !is_file($library) || !is_file($header)) {
+            self::$failed = true;
+            return false;
+        }
+
+        try {
+            self::$ffi = \FFI::cdef(file_get_contents($header), $library);
+            self::$set = self::$ffi->geofence_create();
+        } catch (\Throwable $e) {
+            Log::warning('Geofence library unavailable, using PHP checks', ['exception' => $e->getMessage()]);
+            self::$ffi = null;
+            self::$failed = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Index of a compiled fence (see GeofencingService::compile) in the
+     * native set, adding it on first use; null when it is rejected
+     */
+    public static function fence(string $key, array $compiled): ?int
+    {
+        if (isset(self::$fences[$key])) {
+            return self::$fences[$key];
+        }
+
+        if (count(self::$fences) >= self::MAX_FENCES) {
+            self::$ffi->geofence_clear(self::$set);
+            self::$fences = [];
+        }
+
+        $flat = array_merge(...$compiled['rings']);
+        $sizes = array_map(fn ($ring) => intdiv(count($ring), 2), $compiled['rings']);
+
+        $lngLat = self::doubles($flat);
+        $ringSizes = self::$ffi->new('uint32_t[' . count($sizes) . ']');
+        foreach ($sizes as $i => $size) {
+            $ringSizes[$i] = $size;
+        }
+
+        $index = self::$ffi->geofence_add(self::$set, 0, $lngLat, $ringSizes, count($sizes));
+        if ($index < 0) {
+            return null;
+        }
+
+        return self::$fences[$key] = $index;
+    }
+
+    /**
+     * Point i against fence index $fences[i], in one native call
+     *
+     * @return bool[]
+     */
+    public static function containsPairs(array $lats, array $lngs, array $fences): array
+    {
+        $count = count($lats);
+        if ($count === 0) {
+            return [];
+        }
+
+        $fenceIndexes = self::$ffi->new("uint32_t[{$count}]");
+        foreach (array_values($fences) as $i => $index) {
+            $fenceIndexes[$i] = $index;
+        }
+        $inside = self::$ffi->new("uint8_t[{$count}]");
+
+        self::$ffi->geofence_contains_pairs(self::$set, self::doubles($lats), self::doubles($lngs), $fenceIndexes, $count, $inside);
+
+        return array_map(fn ($byte) => $byte === 1, array_values(unpack('C*', \FFI::string($inside, $count))));
+    }
+
+    // PHP floats into a C double[], copied in one go
+    private static function doubles(array $values)
+    {
+        $count = count($values);
+        $array = self::$ffi->new('double[' . max(1, $count) . ']');
+        if ($count > 0) {
+            \FFI::memcpy($array, pack('d*', ...array_values($values)), $count * 8);
+        }
+
+        return $array;
+    }
+}
@@ -2,60 +2,307 @@
 
 namespace App\Services;
 
+use App\Models\Land;
+use App\Models\LandCell;
+use Illuminate\Support\Collection;
+use Illuminate\Support\Facades\DB;
+
 class GeofencingService
 {
+    // Longest geohash cell stored for a land, about 1.2 x 0.6 km
+    public const CELL_PRECISION = 6;
+
+    // Large lands are indexed with coarser cells rather than more of them
+    private const MAX_CELLS_PER_LAND = 64;
+
+    private const GEOHASH_ALPHABET = '0123456789bcdefghjkmnpqrstuvwxyz';
+
+    /** @var array<string, array|null> compiled fences by caller key */
+    private static array $compiled = [];
+
     /**
      * Check if a GPS coordinate is inside a polygon (geofence)
+     *
+     * With a $key (e.g. "land:{id}:{updated_at}") the polygon is compiled
+     * once per process instead of on every check.
      */
-    public function isPointInsidePolygon($latitude, $longitude, $polygon)
+    public function isPointInsidePolygon($latitude, $longitude, $polygon, ?string $key = null)
     {
-        if (!$polygon || !is_array($polygon)) {
+        $fence = $key !== null ? $this->compiledFence($key, $polygon) : $this->compile($polygon);
+        if (!$fence) {
             return false;
         }
 
+        return $this->containsCompiled($fence, (float)$latitude, (float)$longitude);
+    }
+
+    /**
+     * Compile a GeoJSON polygon (first feature; outer ring, then holes) into
+     * the flat form geofence.h uses: rings of [lng, lat, lng, lat, ...]
+     * without the closing vertex, an edge table and the outer bounding box.
+     * Null when there is no polygon or a ring has fewer than three vertices.
+     */
+    public function compile($polygon): ?array
+    {
+        if (!$polygon || !is_array($polygon)) {
+            return null;
+        }
+
         // Extract coordinates from GeoJSON polygon
-        if (!isset($polygon['features'][0]['geometry']['coordinates'][0])) {
-            return false;
+        $coordinates = $polygon['features'][0]['geometry']['coordinates'] ?? null;
+        if (!is_array($coordinates) || !isset($coordinates[0]) || !is_array($coordinates[0])) {
+            return null;
         }
 
-        $coordinates = $polygon['features'][0]['geometry']['coordinates'][0];
-        
-        return $this->pointInPolygon((float)$latitude, (float)$longitude, $coordinates);
+        $rings = [];
+        $edges = [];
+        $bbox = null;
+
+        foreach ($coordinates as $r => $vertices) {
+            $n = count($vertices);
+            if ($n > 1 && $vertices[0][0] == $vertices[$n - 1][0] && $vertices[0][1] == $vertices[$n - 1][1]) {
+                $n--;
+            }
+            if ($n < 3) {
+                return null;
+            }
+
+            $ring = [];
+            for ($i = 0; $i < $n; $i++) {
+                // Vertices are [lng, lat] format in GeoJSON
+                $lng1 = (float)$vertices[$i][0];
+                $lat1 = (float)$vertices[$i][1];
+                $lng2 = (float)$vertices[($i + 1) % $n][0];
+                $lat2 = (float)$vertices[($i + 1) % $n][1];
+                $ring[] = $lng1;
+                $ring[] = $lat1;
+                $edges[] = [$lng1, $lat1, $lng2, $lat2, $lat1 == $lat2 ? 0.0 : ($lng2 - $lng1) / ($lat2 - $lat1)];
+
+                if ($r === 0) {
+                    $bbox = $bbox === null
+                        ? [$lat1, $lng1, $lat1, $lng1]
+                        : [min($bbox[0], $lat1), min($bbox[1], $lng1), max($bbox[2], $lat1), max($bbox[3], $lng1)];
+                }
+            }
+            $rings[] = $ring;
+        }
+
+        return ['rings' => $rings, 'edges' => $edges, 'bbox' => $bbox];
     }
 
     /**
-     * Ray casting algorithm to determine if point is inside polygon
-     * Uses the standard ray casting algorithm with proper edge case handling
+     * Same test as geofenceContains() in geofence.h, operation for operation:
+     * a point on an edge or vertex is inside, otherwise even-odd crossings of
+     * a ray towards +lng (holes included)
      */
-    private function pointInPolygon($lat, $lng, $vertices)
+    public function containsCompiled(array $fence, float $lat, float $lng): bool
     {
+        [$minLat, $minLng, $maxLat, $maxLng] = $fence['bbox'];
+        if ($lat < $minLat || $lat > $maxLat || $lng < $minLng || $lng > $maxLng) {
+            return false;
+        }
+
         $inside = false;
-        $n = count($vertices);
-        $j = $n - 1;
-
-        for ($i = 0; $i < $n; $i++) {
-            // Vertices are [lng, lat] format in GeoJSON
-            $xi = (float)$vertices[$i][0]; // longitude
-            $yi = (float)$vertices[$i][1]; // latitude
-            $xj = (float)$vertices[$j][0]; // longitude
-            $yj = (float)$vertices[$j][1]; // latitude
-
-            // Check if point is exactly on a vertex
-            if ($xi == $lng && $yi == $lat) {
+        foreach ($fence['edges'] as [$lng1, $lat1, $lng2, $lat2, $slope]) {
+            // Only edges spanning or touching the point's latitude matter
+            $above1 = $lat1 > $lat;
+            $above2 = $lat2 > $lat;
+            if ($above1 === $above2 && $lat != $lat1 && $lat != $lat2) {
+                continue;
+            }
+
+            // On the edge: collinear and within its extent
+            if (!(($lng < $lng1 && $lng < $lng2) || ($lng > $lng1 && $lng > $lng2)) &&
+                ($lng2 - $lng1) * ($lat - $lat1) == ($lat2 - $lat1) * ($lng - $lng1)) {
                 return true;
             }
 
-            // Ray casting test
-            if ((($yi > $lat) !== ($yj > $lat)) && 
-                ($lng < ($xj - $xi) * ($lat - $yi) / ($yj - $yi) + $xi)) {
+            if ($above1 !== $above2 && $lng < $lng1 + ($lat - $lat1) * $slope) {
                 $inside = !$inside;
             }
-            $j = $i;
         }
 
         return $inside;
     }
 
+    /**
+     * Check a whole batch of points, each against its own fence, in one
+     * native call when libgeofence is configured (PHP otherwise).
+     *
+     * $points: [['lat' => .., 'lng' => .., 'fence' => key], ...]
+     * $polygons: key => GeoJSON polygon
+     * Returns one bool per point, null where the fence is missing or invalid.
+     */
+    public function checkBatch(array $points, array $polygons): array
+    {
+        $fences = [];
+        foreach ($polygons as $key => $polygon) {
+            $fences[$key] = $this->compiledFence((string)$key, $polygon);
+        }
+
+        $results = array_fill(0, count($points), null);
+        $native = GeofenceNative::available();
+        $lats = $lngs = $indexes = $positions = [];
+
+        foreach (array_values($points) as $i => $point) {
+            $fence = $fences[$point['fence']] ?? null;
+            if (!$fence) {
+                continue;
+            }
+
+            if ($native && ($index = GeofenceNative::fence((string)$point['fence'], $fence)) !== null) {
+                $lats[] = (float)$point['lat'];
+                $lngs[] = (float)$point['lng'];
+                $indexes[] = $index;
+                $positions[] = $i;
+            } else {
+                $results[$i] = $this->containsCompiled($fence, (float)$point['lat'], (float)$point['lng']);
+            }
+        }
+
+        if ($positions) {
+            foreach (GeofenceNative::containsPairs($lats, $lngs, $indexes) as $n => $inside) {
+                $results[$positions[$n]] = $inside;
+            }
+        }
+
+        return $results;
+    }
+
+    private function compiledFence(string $key, $polygon): ?array
+    {
+        if (!array_key_exists($key, self::$compiled)) {
+            // Edited polygons come back under new keys; drop the stale ones now and then
+            if (count(self::$compiled) >= 1024) {
+                self::$compiled = [];
+            }
+            self::$compiled[$key] = $this->compile($polygon);
+        }
+
+        return self::$compiled[$key];
+    }
+
+    /**
+     * Geohash of a point, bit for bit what geohash.h computes on the device:
+     * each axis as an integer fraction of its range in 1e-7 degrees, bits
+     * interleaved longitude first
+     */
+    public function geohash(float $lat, float $lng, int $precision = 9): string
+    {
+        $precision = max(1, min(12, $precision));
+
+        return $this->geohashFromAxes($this->geohashAxis($lat, 90), $this->geohashAxis($lng, 180), $precision);
+    }
+
+    /**
+     * Enabled lands whose fence contains the point. Candidates come from the
+     * land_cells index by the prefixes of the point's geohash (the device
+     * sends one, see publishGPSData); only those get the exact check.
+     */
+    public function landsAt(float $lat, float $lng, ?string $geohash = null): Collection
+    {
+        if ($geohash === null || !preg_match('/^[0-9b-hjkmnp-z]{' . self::CELL_PRECISION . ',12}$/', $geohash)) {
+            $geohash = $this->geohash($lat, $lng, self::CELL_PRECISION);
+        }
+
+        $prefixes = [];
+        for ($n = 1; $n <= self::CELL_PRECISION; $n++) {
+            $prefixes[] = substr($geohash, 0, $n);
+        }
+
+        $landIds = LandCell::whereIn('cell', $prefixes)->distinct()->pluck('land_id');
+        if ($landIds->isEmpty()) {
+            return collect();
+        }
+
+        return Land::whereIn('id', $landIds)
+            ->where('enabled', true)
+            ->get()
+            ->filter(fn (Land $land) => $this->isPointInsidePolygon($lat, $lng, $land->fencePolygon(), $land->fenceKey()))
+            ->values();
+    }
+
+    /**
+     * Rebuild a land's cells from the bounding box of its fence. Disabled
+     * lands and lands without a valid polygon end up with none.
+     */
+    public function indexLand(Land $land): int
+    {
+        $fence = $land->enabled ? $this->compile($land->fencePolygon()) : null;
+        $cells = $fence ? $this->coverCells($fence['bbox']) : [];
+
+        DB::transaction(function () use ($land, $cells) {
+            LandCell::where('land_id', $land->id)->delete();
+            LandCell::insert(array_map(fn ($cell) => ['land_id' => $land->id, 'cell' => $cell], $cells));
+        });
+
+        return count($cells);
+    }
+
+    /**
+     * Geohash cells covering a [minLat, minLng, maxLat, maxLng] box, at the
+     * finest precision up to CELL_PRECISION that needs at most
+     * MAX_CELLS_PER_LAND of them
+     */
+    public function coverCells(array $bbox): array
+    {
+        [$minLat, $minLng, $maxLat, $maxLng] = $bbox;
+        $lat = [$this->geohashAxis($minLat, 90), $this->geohashAxis($maxLat, 90)];
+        $lng = [$this->geohashAxis($minLng, 180), $this->geohashAxis($maxLng, 180)];
+
+        for ($precision = self::CELL_PRECISION; ; $precision--) {
+            // Longitude gets the extra bit of an odd bit count
+            $latShift = 30 - intdiv($precision * 5, 2);
+            $lngShift = 30 - intdiv($precision * 5 + 1, 2);
+            $rows = ($lat[1] >> $latShift) - ($lat[0] >> $latShift) + 1;
+            $columns = ($lng[1] >> $lngShift) - ($lng[0] >> $lngShift) + 1;
+            if ($precision === 1 || $rows * $columns <= self::MAX_CELLS_PER_LAND) {
+                break;
+            }
+        }
+
+        $cells = [];
+        for ($y = $lat[0] >> $latShift; $y <= $lat[1] >> $latShift; $y++) {
+            for ($x = $lng[0] >> $lngShift; $x <= $lng[1] >> $lngShift; $x++) {
+                $cells[] = $this->geohashFromAxes($y << $latShift, $x << $lngShift, $precision);
+            }
+        }
+
+        return $cells;
+    }
+
+    // floor((v - min) * 2^30 / range) from 1e-7 degrees; the device keeps 32
+    // bits, of which a hash of precision 12 uses the top 30
+    private function geohashAxis(float $degrees, int $limit): int
+    {
+        $offset = (int)round($degrees * 1e7) + $limit * 10000000;
+        $range = 2 * $limit * 10000000;
+        if ($offset <= 0) {
+            return 0;
+        }
+        if ($offset >= $range) {
+            return (1 << 30) - 1;
+        }
+
+        return intdiv($offset << 30, $range);
+    }
+
+    private function geohashFromAxes(int $lat, int $lng, int $precision): string
+    {
+        $hash = '';
+        $value = 0;
+        for ($bit = 0; $bit < $precision * 5; $bit++) {
+            $axis = $bit % 2 === 0 ? $lng : $lat;
+            $value = ($value << 1) | (($axis >> (29 - intdiv($bit, 2))) & 1);
+            if ($bit % 5 === 4) {
+                $hash .= self::GEOHASH_ALPHABET[$value];
+                $value = 0;
+            }
+        }
+
+        return $hash;
+    }
+
     /**
      * Calculate distance between two GPS points (in meters)
      * Useful for debugging and validation
@@ -6,12 +6,22 @@ use App\Models\Device;
 use App\Models\Sensor;
 use App\Models\MqttBroker;
 use Carbon\Carbon;
+use Illuminate\Support\Facades\Cache;
 use Illuminate\Support\Facades\Log;
 use PhpMqtt\Client\MqttClient;
 use PhpMqtt\Client\ConnectionSettings;
+use PhpMqtt\Client\Facades\MQTT;
 
 class MqttDeviceService
 {
+    // Status objects kept in application_data under their own key: power (duty
+    // cycle), broker (failover), lowpower, retries (reconnect backoff),
+    // discovery (pacing), boot (profile and boot-to-first-publish timing)
+    private const STATUS_REPORTS = ['power', 'broker', 'lowpower', 'retries', 'discovery', 'boot'];
+
+    // Window summary a device sends next to an aggregated value
+    private const WINDOW_STATS = ['min', 'max', 'stddev', 'samples'];
+
     private $connections = [];
     private $defaultQos;
 
@@ -145,9 +155,175 @@ class MqttDeviceService
     }
 
     /**
-     * Publish device discovery request using device's broker
+     * Publish several operations as one commands message. The device runs them
+     * in order and answers once on control/response with the same request_id;
+     * the acknowledgement is read back with getCommandResult().
+     *
+     * $operations: [['op' => 'green_led', 'value' => 1], ['op' => 'config/sensors', 'value' => [...]], ['op' => 'status']]
+     */
+    public function publishDeviceCommands($deviceId, array $operations)
+    {
+        try {
+            $device = Device::where('device_unique_id', $deviceId)->first();
+            if (!$device) {
+                throw new \Exception("Device {$deviceId} not found");
+            }
+
+            $topics = $device->mqtt_topics;
+            $topic = $topics['commands'] ?? "devices/{$deviceId}/commands";
+            $requestId = uniqid('cmd_');
+
+            // Numbered per device so it can count batches that never arrived
+            $payload = json_encode([
+                'request_id' => $requestId,
+                'seq' => Cache::increment("mqtt_command_seq:{$deviceId}"),
+                'commands' => array_values($operations),
+                'timestamp' => time()
+            ]);
+
+            $mqtt = $this->getConnectionForDevice($device);
+            $qos = $device->effective_mqtt_broker->qos ?? $this->defaultQos;
+            $mqtt->publish($topic, $payload, $qos);
+
+            Cache::put("mqtt_command:{$requestId}", [
+                'device_id' => $deviceId,
+                'status' => 'pending',
+                'operations' => count($operations),
+                'sent_at' => now()->toISOString()
+            ], now()->addHour());
+
+            Log::channel('mqtt')->info('Device command batch published', [
+                'device_id' => $deviceId,
+                'request_id' => $requestId,
+                'operations' => count($operations),
+                'topic' => $topic,
+                'broker' => $device->effective_mqtt_broker->name
+            ]);
+
+            return $requestId;
+
+        } catch (\Exception $e) {
+            Log::error('Failed to publish device command batch', [
+                'device_id' => $deviceId,
+                'exception' => $e->getMessage()
+            ]);
+            return null;
+        }
+    }
+
+    /**
+     * Acknowledgement of a command batch: pending until the device answers
+     */
+    public function getCommandResult(string $requestId): ?array
+    {
+        return Cache::get("mqtt_command:{$requestId}");
+    }
+
+    /**
+     * Ask a device for its flash history between two epoch-second times.
+     * Chunks arrive on devices/<id>/history/data and are assembled by
+     * handleHistoryData(); read them with getHistoryResult().
+     */
+    public function publishHistoryRequest($deviceId, int $from, int $to, array $fields = [], ?int $maxRecords = null)
+    {
+        try {
+            $device = Device::where('device_unique_id', $deviceId)->first();
+            if (!$device) {
+                throw new \Exception("Device {$deviceId} not found");
+            }
+
+            $requestId = uniqid('hist_');
+            $request = array_filter([
+                'request_id' => $requestId,
+                'from' => $from,
+                'to' => $to,
+                'fields' => array_values($fields),
+                'max_records' => $maxRecords,
+            ], fn ($value) => $value !== null && $value !== []);
+
+            Cache::put("mqtt_history:{$requestId}", [
+                'device_id' => $deviceId,
+                'status' => 'pending',
+                'from' => $from,
+                'to' => $to,
+                'fields' => null,
+                'chunks' => 0,
+                'records' => [],
+                'requested_at' => now()->toISOString()
+            ], now()->addHour());
+
+            $mqtt = $this->getConnectionForDevice($device);
+            $qos = $device->effective_mqtt_broker->qos ?? $this->defaultQos;
+            $mqtt->publish("devices/{$deviceId}/history/request", json_encode($request), $qos);
+
+            Log::channel('mqtt')->info('Device history requested', [
+                'device_id' => $deviceId,
+                'request_id' => $requestId,
+                'from' => $from,
+                'to' => $to,
+                'fields' => $fields
+            ]);
+
+            return $requestId;
+
+        } catch (\Exception $e) {
+            Log::error('Failed to request device history', [
+                'device_id' => $deviceId,
+                'exception' => $e->getMessage()
+            ]);
+            return null;
+        }
+    }
+
+    /**
+     * History request state and the records assembled so far
+     */
+    public function getHistoryResult(string $requestId): ?array
+    {
+        return Cache::get("mqtt_history:{$requestId}");
+    }
+
+    /**
+     * Publish a configuration section (devices/{id}/config/{section}) to a device
+     */
+    public function publishDeviceConfig($deviceId, string $section, array $config)
+    {
+        try {
+            $device = Device::where('device_unique_id', $deviceId)->first();
+            if (!$device) {
+                throw new \Exception("Device {$deviceId} not found");
+            }
+
+            $topic = "devices/{$deviceId}/config/{$section}";
+
+            $mqtt = $this->getConnectionForDevice($device);
+            $qos = $device->effective_mqtt_broker->qos ?? $this->defaultQos;
+            $mqtt->publish($topic, json_encode($config), $qos);
+
+            Log::channel('mqtt')->info('Device config published', [
+                'device_id' => $deviceId,
+                'section' => $section,
+                'config' => $config,
+                'broker' => $device->effective_mqtt_broker->name
+            ]);
+
+            return true;
+
+        } catch (\Exception $e) {
+            Log::error('Failed to publish device config', [
+                'device_id' => $deviceId,
+                'section' => $section,
+                'exception' => $e->getMessage()
+            ]);
+            return false;
+        }
+    }
+
+    /**
+     * Publish device discovery request using device's broker. With a window
+     * (s) the device answers at its own offset into it instead of at once.
      */
-    public function publishDeviceDiscovery($deviceId, $userId = null, $userEmail = null)
+    public function publishDeviceDiscovery($deviceId, $userId = null, $userEmail = null, ?int $window = null)
     {
         try {
             $device = Device::where('device_unique_id', $deviceId)->first();
@@ -158,12 +334,13 @@ class MqttDeviceService
             $topics = $device->mqtt_topics;
             $topic = $topics['discovery_request'] ?? "devices/{$deviceId}/discover";
             
-            $payload = json_encode([
+            $payload = json_encode(array_filter([
                 'action' => 'discover',
                 'timestamp' => time(),
                 'initiated_by' => $userEmail ?? auth()->user()->email ?? 'system',
-                'request_id' => uniqid('disc_')
-            ]);
+                'request_id' => uniqid('disc_'),
+                'window' => $window,
+            ], fn ($value) => $value !== null));
 
             // Store user context for discovery response handling
             if ($userId) {
@@ -271,6 +448,10 @@ class MqttDeviceService
                 $this->syncSensorsFromArduino($device, $data['available_sensors']);
             }
 
+            if (isset($data['telemetry_schema']['fields']) && is_array($data['telemetry_schema']['fields'])) {
+                $this->storeTelemetrySchema($device, $data['telemetry_schema']);
+            }
+
             cache()->forget("mqtt_user_context");
 
             Log::channel('mqtt')->info('Device discovery processed', [
@@ -287,7 +468,13 @@ class MqttDeviceService
     {
         try {
             $data = json_decode($message, true);
-            if (!$data || !isset($data['device_id'])) {
+            if (!$data) {
+                return;
+            }
+
+            // Compact telemetry leaves the device id to the topic (devices/{id}/data)
+            $data['device_id'] ??= explode('/', $topic)[1] ?? null;
+            if (!$data['device_id']) {
                 return;
             }
             
@@ -296,9 +483,13 @@ class MqttDeviceService
                 return;
             }
 
+            $this->trackDelivery($device, 'data', $data);
+
             $device->update(['status' => 'online', 'last_seen_at' => now()]);
 
-            if (isset($data['sensors']) && is_array($data['sensors'])) {
+            if (isset($data['d']) && is_array($data['d'])) {
+                $this->updateSensorReadingsFromArray($device, $data['d']);
+            } elseif (isset($data['sensors']) && is_array($data['sensors'])) {
                 // Check if sensors is an array of objects (Arduino format)
                 if (isset($data['sensors'][0]) && is_array($data['sensors'][0])) {
                     $this->updateSensorReadingsFromArray($device, $data['sensors']);
@@ -325,11 +516,28 @@ class MqttDeviceService
             if (!$device) {
                 return;
             }
+
+            $this->trackDelivery($device, 'status', $data);
             
-            $device->update([
+            $update = [
                 'status' => $data['status'] === 'online' ? 'online' : 'offline',
                 'last_seen_at' => now(),
-            ]);
+            ];
+
+            // Status sub-reports kept with the device, each stamped with when it arrived
+            $applicationData = $device->application_data ?? [];
+            $reported = false;
+            foreach (self::STATUS_REPORTS as $key) {
+                if (isset($data[$key]) && is_array($data[$key])) {
+                    $applicationData[$key] = $data[$key] + ['reported_at' => now()->toIso8601String()];
+                    $reported = true;
+                }
+            }
+            if ($reported) {
+                $update['application_data'] = $applicationData;
+            }
+
+            $device->update($update);
 
         } catch (\Exception $e) {
             Log::error('Error processing device status.', ['topic' => $topic, 'exception' => $e->getMessage()]);
@@ -352,11 +560,14 @@ class MqttDeviceService
                 return;
             }
 
+            $this->trackDelivery($device, 'gps', $data);
+
             // Update device status and location in application_data
             $device->update(['status' => 'online', 'last_seen_at' => now()]);
             
             if (isset($data['location']) && is_array($data['location'])) {
                 $device->updateLocationFromMqtt($data['location']);
+                $this->tagGeofences($device, $data['location']);
                 $device->save();
                 
                 // Also store as sensor data
@@ -368,18 +579,235 @@ class MqttDeviceService
         }
     }
 
+    /**
+     * Record which lands a fix falls in, found through the geohash cell index
+     */
+    private function tagGeofences(Device $device, array $location): void
+    {
+        if (!isset($location['latitude'], $location['longitude'])) {
+            return;
+        }
+
+        $lands = app(GeofencingService::class)->landsAt(
+            (float)$location['latitude'],
+            (float)$location['longitude'],
+            $location['geohash'] ?? null
+        );
+
+        $applicationData = $device->application_data ?? [];
+        $applicationData['geofence'] = [
+            'land_ids' => $lands->pluck('id')->all(),
+            'inside_assigned_land' => $device->land_id ? $lands->contains('id', $device->land_id) : null,
+            'checked_at' => now()->toISOString(),
+        ];
+        $device->application_data = $applicationData;
+    }
+
+    /**
+     * Handle threshold/geofence alerts evaluated on the device
+     */
+    public function handleDeviceAlert(string $topic, string $message)
+    {
+        try {
+            $data = json_decode($message, true);
+            if (!$data || !isset($data['device_id'])) {
+                return;
+            }
+
+            $device = Device::where('device_unique_id', $data['device_id'])->first();
+            if (!$device) {
+                return;
+            }
+
+            $this->trackDelivery($device, 'alerts', $data);
+
+            $applicationData = $device->application_data ?? [];
+            $applicationData['alerts'][$data['rule_id'] ?? 'rule'] = [
+                'state' => $data['state'] ?? null,
+                'sensor_type' => $data['sensor_type'] ?? null,
+                'value' => $data['value'] ?? null,
+                'threshold' => $data['threshold'] ?? null,
+                'fence' => $data['fence'] ?? null,
+                'received_at' => now()->toISOString(),
+            ];
+
+            $device->application_data = $applicationData;
+            $device->status = 'online';
+            $device->last_seen_at = now();
+            $device->save();
+
+            Log::channel('mqtt')->warning('Device alert ' . ($data['state'] ?? 'received'), [
+                'device_id' => $data['device_id'],
+                'rule_id' => $data['rule_id'] ?? null,
+                'sensor_type' => $data['sensor_type'] ?? null,
+                'value' => $data['value'] ?? null
+            ]);
+
+        } catch (\Exception $e) {
+            Log::error('Error processing device alert.', ['topic' => $topic, 'exception' => $e->getMessage()]);
+        }
+    }
+
+    public function handleControlResponse(string $topic, string $message)
+    {
+        try {
+            $data = json_decode($message, true);
+            if (!$data || !isset($data['device_id'])) {
+                return;
+            }
+
+            $device = Device::where('device_unique_id', $data['device_id'])->first();
+            if (!$device) {
+                return;
+            }
+
+            $this->trackDelivery($device, 'control', $data);
+
+            // Single control changes carry no request_id; only batches are correlated
+            $requestId = $data['request_id'] ?? '';
+            if ($requestId === '') {
+                return;
+            }
+
+            $pending = Cache::get("mqtt_command:{$requestId}", []);
+            Cache::put("mqtt_command:{$requestId}", [
+                'device_id' => $data['device_id'],
+                'status' => $data['status'] ?? 'executed',
+                'operations' => $pending['operations'] ?? count($data['results'] ?? []),
+                'results' => $data['results'] ?? [],
+                'sent_at' => $pending['sent_at'] ?? null,
+                'acknowledged_at' => now()->toISOString()
+            ], now()->addHour());
+
+            Log::channel('mqtt')->info('Device command batch acknowledged', [
+                'device_id' => $data['device_id'],
+                'request_id' => $requestId,
+                'status' => $data['status'] ?? null,
+                'failed' => collect($data['results'] ?? [])->where('ok', false)->pluck('op')->all()
+            ]);
+
+        } catch (\Exception $e) {
+            Log::error('Error processing control response.', ['topic' => $topic, 'exception' => $e->getMessage()]);
+        }
+    }
+
+    /**
+     * One chunk of a history request: [ms after t0, field, scaled value]
+     * triples, with the field table (type, decimals) in chunk 0
+     */
+    public function handleHistoryData(string $topic, string $message)
+    {
+        try {
+            $data = json_decode($message, true);
+            if (!$data || !isset($data['device_id'], $data['request_id'])) {
+                return;
+            }
+
+            $device = Device::where('device_unique_id', $data['device_id'])->first();
+            if (!$device) {
+                return;
+            }
+
+            $this->trackDelivery($device, 'history', $data);
+
+            $key = "mqtt_history:{$data['request_id']}";
+            $result = Cache::get($key);
+            if (!$result) {
+                return; // Expired or requested elsewhere
+            }
+
+            // QoS 1 may deliver a chunk twice
+            $chunk = (int)($data['chunk'] ?? 0);
+            if ($chunk < $result['chunks']) {
+                return;
+            }
+
+            if (isset($data['fields'])) {
+                $result['fields'] = $data['fields'];
+            }
+
+            $t0 = (int)($data['t0'] ?? 0);
+            $triples = array_chunk($data['r'] ?? [], 3);
+            foreach ($triples as [$offset, $field, $raw]) {
+                [$type, $decimals] = $result['fields'][$field] ?? [$field, 0];
+                $result['records'][] = [
+                    'time' => $t0 + $offset,
+                    'sensor_type' => $type,
+                    'value' => $raw / 10 ** $decimals,
+                ];
+            }
+
+            $result['chunks'] = $chunk + 1;
+            $result['status'] = !empty($data['done']) ? ($data['status'] ?? 'complete') : 'streaming';
+            if (!empty($data['done'])) {
+                $result['completed_at'] = now()->toISOString();
+
+                Log::channel('mqtt')->info('Device history received', [
+                    'device_id' => $data['device_id'],
+                    'request_id' => $data['request_id'],
+                    'status' => $result['status'],
+                    'records' => count($result['records']),
+                    'chunks' => $result['chunks']
+                ]);
+            }
+
+            Cache::put($key, $result, now()->addHour());
+
+        } catch (\Exception $e) {
+            Log::error('Error processing device history.', ['topic' => $topic, 'exception' => $e->getMessage()]);
+        }
+    }
+
+    /**
+     * Broadcast a discovery request on the default broker; devices on other
+     * brokers get theirs from handleGlobalDiscovery when the listener sees it
+     */
+    public function discoverAllDevices(): bool
+    {
+        try {
+            $window = $this->discoveryWindow(Device::where('enabled', true)->count());
+            MQTT::connection()->publish('devices/discover/all', json_encode([
+                'action' => 'discover',
+                'timestamp' => time(),
+                'window' => $window,
+            ]));
+
+            Log::channel('mqtt')->info('Global discovery published', ['window' => $window]);
+            return true;
+
+        } catch (\Exception $e) {
+            Log::error('Failed to publish global discovery', ['exception' => $e->getMessage()]);
+            return false;
+        }
+    }
+
+    /**
+     * Seconds to spread discovery answers over so that they arrive at about
+     * MQTT_DISCOVERY_RATE per second, never less than MQTT_DISCOVERY_WINDOW
+     * (the firmware caps it at 600)
+     */
+    public function discoveryWindow(int $devices): int
+    {
+        $rate = max(1, (int)env('MQTT_DISCOVERY_RATE', 20));
+        return min(600, max((int)env('MQTT_DISCOVERY_WINDOW', 20), (int)ceil($devices / $rate)));
+    }
+
     public function handleGlobalDiscovery(string $topic, string $message)
     {
         try {
-            // Get all enabled devices and publish discovery to each using their respective brokers
+            // Get all enabled devices and publish discovery to each using their respective brokers.
+            // Each request carries the window, so the answers arrive spread over it; devices that
+            // also saw the broadcast answer once.
             $devices = Device::where('enabled', true)->with('mqttBroker')->get();
+            $window = $this->discoveryWindow($devices->count());
             
             foreach ($devices as $device) {
-                $this->publishDeviceDiscovery($device->device_unique_id);
+                $this->publishDeviceDiscovery($device->device_unique_id, null, null, $window);
             }
 
             Log::channel('mqtt')->info('Global discovery processed', [
-                'devices_count' => $devices->count()
+                'devices_count' => $devices->count(),
+                'window' => $window
             ]);
 
         } catch (\Exception $e) {
@@ -387,9 +815,76 @@ class MqttDeviceService
         }
     }
 
+    /**
+     * Track one-way latency, loss and reordering per device and topic from
+     * the boot_id / seq / sent_at stamps the firmware adds to every message
+     */
+    private function trackDelivery(Device $device, string $stream, array $data): void
+    {
+        if (!isset($data['seq'], $data['boot_id'])) {
+            return;
+        }
+
+        $key = "mqtt_delivery:{$device->device_unique_id}:{$stream}";
+        $stats = Cache::get($key);
+        $seq = (int)$data['seq'];
+
+        // First message or the device rebooted: sequence numbers start over
+        if (!$stats || $stats['boot_id'] !== $data['boot_id']) {
+            $stats = [
+                'boot_id' => $data['boot_id'],
+                'highest_seq' => $seq,
+                'received' => 0,
+                'lost' => 0,
+                'reordered' => 0,
+                'duplicates' => 0,
+                'latency_ms' => null,
+                'latency_avg_ms' => null,
+            ];
+        } elseif ($seq > $stats['highest_seq'] + 1) {
+            $stats['lost'] += $seq - $stats['highest_seq'] - 1;
+            $stats['highest_seq'] = $seq;
+
+            Log::channel('mqtt')->warning('MQTT messages missing', [
+                'device_id' => $device->device_unique_id,
+                'stream' => $stream,
+                'seq' => $seq,
+                'lost_total' => $stats['lost']
+            ]);
+        } elseif ($seq === $stats['highest_seq']) {
+            $stats['duplicates']++;
+        } elseif ($seq < $stats['highest_seq']) {
+            // A late arrival was counted as lost when the gap was seen
+            $stats['reordered']++;
+            $stats['lost'] = max(0, $stats['lost'] - 1);
+        } else {
+            $stats['highest_seq'] = $seq;
+        }
+        $stats['received']++;
+
+        // sent_at is 0 until the device clock has been set
+        $sentAt = (int)($data['sent_at'] ?? 0);
+        if ($sentAt > 0) {
+            $latency = (int)round(microtime(true) * 1000) - $sentAt;
+            $stats['latency_ms'] = $latency;
+            $stats['latency_avg_ms'] = $stats['latency_avg_ms'] === null
+                ? $latency
+                : round(0.9 * $stats['latency_avg_ms'] + 0.1 * $latency, 1);
+        }
+
+        $stats['updated_at'] = now()->toISOString();
+        Cache::put($key, $stats, now()->addDays(7));
+    }
+
     // Keep all your existing private methods unchanged
     private function updateSensorReadingsFromArray(Device $device, array $sensorsArray)
     {
+        // Compact telemetry: [schema_version, t, v0, v1, ...]
+        if (isset($sensorsArray[0]) && !is_array($sensorsArray[0])) {
+            $this->updateSensorReadingsByPosition($device, $sensorsArray);
+            return;
+        }
+
         foreach ($sensorsArray as $sensorData) {
             try {
                 if (!isset($sensorData['sensor_type']) || !isset($sensorData['value'])) {
@@ -398,6 +893,9 @@ class MqttDeviceService
 
                 $sensorType = $sensorData['sensor_type'];
                 $value = $sensorData['value'];
+                $windowStats = isset($sensorData['samples'])
+                    ? array_intersect_key($sensorData, array_flip(self::WINDOW_STATS))
+                    : null;
                 
                 $sensor = $device->sensors()->where('sensor_type', $sensorType)->first();
 
@@ -409,6 +907,7 @@ class MqttDeviceService
                         'sensor_name' => $sensorData['sensor_name'] ?? ucfirst(str_replace('_', ' ', $sensorType)),
                         'unit' => $sensorData['unit'] ?? $this->guessUnit($sensorType),
                         'value' => $value,
+                        'window_stats' => $windowStats,
                         'reading_timestamp' => isset($sensorData['reading_timestamp']) ? 
                             Carbon::parse($sensorData['reading_timestamp']) : now(),
                         'enabled' => $sensorData['enabled'] ?? true,
@@ -416,6 +915,7 @@ class MqttDeviceService
                 } else {
                     $sensor->update([
                         'value' => $value + ($sensor->calibration_offset ?? 0),
+                        'window_stats' => $this->calibrateWindowStats($windowStats, $sensor->calibration_offset),
                         'reading_timestamp' => isset($sensorData['reading_timestamp']) ? 
                             Carbon::parse($sensorData['reading_timestamp']) : now()
                     ]);
@@ -431,6 +931,118 @@ class MqttDeviceService
         }
     }
 
+    /**
+     * Map compact telemetry values onto sensors by their position in the
+     * schema the device announced with discovery. The values are followed by
+     * a group of window_stats columns per windowed field, in field order.
+     */
+    private function updateSensorReadingsByPosition(Device $device, array $values)
+    {
+        $schema = $device->application_data['telemetry_schema'] ?? null;
+        $version = (int)($values[0] ?? 0);
+
+        if (!$schema || (int)$schema['version'] !== $version) {
+            // Unknown table: have the device announce it again, at most once a minute
+            if (Cache::add("telemetry_schema_request:{$device->device_unique_id}", true, 60)) {
+                $this->publishDeviceDiscovery($device->device_unique_id);
+
+                Log::channel('mqtt')->warning('Unknown telemetry schema, discovery requested', [
+                    'device_id' => $device->device_unique_id,
+                    'schema_version' => $version,
+                    'known_version' => $schema['version'] ?? null
+                ]);
+            }
+            return;
+        }
+
+        // t is epoch ms, or 0 while the device clock is not set
+        $timestamp = !empty($values[1]) ? Carbon::createFromTimestampMs($values[1]) : now();
+        $sensors = $device->sensors()->get()->keyBy('sensor_type');
+
+        $windows = [];
+        $stats = $schema['window_stats'] ?? [];
+        $column = count($schema['fields']) + 2;
+        foreach ($schema['window'] ?? [] as $sensorType) {
+            $group = array_slice($values, $column, count($stats));
+            $column += count($stats);
+            // All null: no window behind this value (not sampled, or aggregation off)
+            if (count($group) === count($stats) && array_filter($group, fn ($v) => $v !== null)) {
+                $windows[$sensorType] = array_combine($stats, $group);
+            }
+        }
+
+        foreach ($schema['fields'] as $index => $sensorType) {
+            $value = $values[$index + 2] ?? null;
+            $sensor = $sensors[$sensorType] ?? null;
+            if ($value === null || !$sensor) {
+                continue;
+            }
+
+            $sensor->update([
+                'value' => $value + ($sensor->calibration_offset ?? 0),
+                'window_stats' => $this->calibrateWindowStats($windows[$sensorType] ?? null, $sensor->calibration_offset),
+                'reading_timestamp' => $timestamp
+            ]);
+        }
+    }
+
+    /**
+     * Shift a window's min and max by the calibration offset applied to its value
+     */
+    private function calibrateWindowStats(?array $stats, $offset)
+    {
+        if (!$stats || !$offset) {
+            return $stats;
+        }
+        foreach (['min', 'max'] as $key) {
+            if (isset($stats[$key])) {
+                $stats[$key] += $offset;
+            }
+        }
+        return $stats;
+    }
+
+    /**
+     * Remember the telemetry field order and create sensors the device reports
+     */
+    private function storeTelemetrySchema(Device $device, array $schema)
+    {
+        $fields = [];
+        $window = [];
+        foreach ($schema['fields'] as $field) {
+            if (!isset($field['sensor_type'])) {
+                continue;
+            }
+            $fields[] = $field['sensor_type'];
+            if (!empty($field['window'])) {
+                $window[] = $field['sensor_type'];
+            }
+
+            Sensor::firstOrCreate(
+                ['device_id' => $device->id, 'sensor_type' => $field['sensor_type']],
+                [
+                    'sensor_name' => $field['sensor_name'] ?? ucfirst(str_replace('_', ' ', $field['sensor_type'])),
+                    'unit' => $field['unit'] ?? $this->guessUnit($field['sensor_type']),
+                    'accuracy' => $field['accuracy'] ?? null,
+                    'location' => $field['location'] ?? null,
+                    'enabled' => true,
+                ]
+            );
+        }
+
+        $applicationData = $device->application_data ?? [];
+        $applicationData['telemetry_schema'] = [
+            'version' => (int)($schema['version'] ?? 0),
+            'fields' => $fields,
+            'window' => $window,
+            'window_stats' => isset($schema['window_stats']) && is_array($schema['window_stats'])
+                ? array_values($schema['window_stats'])
+                : self::WINDOW_STATS,
+        ];
+        $device->application_data = $applicationData;
+        $device->save();
+    }
+
     // ... Keep all other existing private methods unchanged ...
     // (storeGPSAsSensorData, syncSensorsFromArduino, createGPSSensorsFromDiscovery, 
     //  getGPSValueFromDiscovery, updateSensorReadings, guessUnit)
@@ -0,0 +1,112 @@
+<?php
+
+namespace App\Services;
+
+use Illuminate\Support\Facades\Log;
+
+/**
+ * Decodes compressed device payloads.
+ *
+ * Devices LZ4-compress large JSON messages (arduino/sensor-monitor/lz4_block.h)
+ * and prefix them with a marker byte and the raw length (uint16 LE). JSON
+ * text never starts with the marker, so anything else passes through.
+ */
+class MqttPayloadCodec
+{
+    public const LZ4_MARKER = 0x04;
+    private const HEADER_SIZE = 3;
+
+    public static function isCompressed(string $message): bool
+    {
+        return strlen($message) > self::HEADER_SIZE && ord($message[0]) === self::LZ4_MARKER;
+    }
+
+    /**
+     * Plain JSON for a payload as received; malformed blocks decode to ''
+     */
+    public static function decode(string $message): string
+    {
+        if (!self::isCompressed($message)) {
+            return $message;
+        }
+
+        $size = unpack('v', $message, 1)[1];
+        $decoded = self::lz4BlockDecode(substr($message, self::HEADER_SIZE), $size);
+
+        if ($decoded === null || strlen($decoded) !== $size) {
+            Log::channel('mqtt')->warning('Dropping malformed compressed payload', [
+                'bytes' => strlen($message),
+                'declared_size' => $size
+            ]);
+            return '';
+        }
+
+        return $decoded;
+    }
+
+    /**
+     * Raw LZ4 block format: [token][literal length+][literals][offset LE16][match length+]...
+     */
+    private static function lz4BlockDecode(string $src, int $size): ?string
+    {
+        $out = '';
+        $len = strlen($src);
+        $i = 0;
+
+        while ($i < $len) {
+            $token = ord($src[$i++]);
+
+            $literals = $token >> 4;
+            if ($literals === 15) {
+                do {
+                    if ($i >= $len) {
+                        return null;
+                    }
+                    $b = ord($src[$i++]);
+                    $literals += $b;
+                } while ($b === 255);
+            }
+            if ($i + $literals > $len) {
+                return null;
+            }
+            $out .= substr($src, $i, $literals);
+            $i += $literals;
+            if ($i >= $len) {
+                break; // last sequence carries no match
+            }
+
+            if ($i + 2 > $len) {
+                return null;
+            }
+            $offset = ord($src[$i]) | (ord($src[$i + 1]) << 8);
+            $i += 2;
+
+            $matchLength = $token & 15;
+            if ($matchLength === 15) {
+                do {
+                    if ($i >= $len) {
+                        return null;
+                    }
+                    $b = ord($src[$i++]);
+                    $matchLength += $b;
+                } while ($b === 255);
+            }
+            $matchLength += 4;
+
+            $start = strlen($out) - $offset;
+            if ($offset === 0 || $start < 0 || strlen($out) + $matchLength > $size) {
+                return null;
+            }
+
+            // A match may overlap the bytes it produces: copy at most $offset at a time
+            while ($matchLength > 0) {
+                $chunk = substr($out, $start, min($matchLength, $offset));
+                $out .= $chunk;
+                $start += strlen($chunk);
+                $matchLength -= strlen($chunk);
+            }
+        }
+
+        return $out;
+    }
+}
@@ -0,0 +1,155 @@
+// Ordered MQTT broker list with health and latency tracking.
+//
+// The sketch keeps up to BROKER_POOL_MAX brokers in priority order (pushed
+// on config/brokers). Each one carries a latency estimate from probes (TCP
+// connect round trips, smoothed) and a failure count. select() returns the
+// fastest broker that is not cooling down after a failure; list order breaks
+// ties and decides while nothing has been measured. recordPublish() counts
+// consecutive publish failures on the active broker and says when to fail
+// over; betterThanActive() says when a probe found a clearly faster one.
+// Times are passed in, so it has no Arduino dependencies and builds on the
+// host (see tools/broker_failover.cpp).
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define BROKER_POOL_MAX 4
+#define BROKER_HOST_MAX 64
+#define BROKER_FAIL_LIMIT 3           // consecutive publish failures before failing over
+#define BROKER_COOLDOWN_MS 10000      // skip a failed broker this long, doubling per failure
+#define BROKER_COOLDOWN_MAX_SHIFT 4   // ... up to 16x
+#define BROKER_SWITCH_MARGIN_MS 20    // a probed broker must win by this much and by 25%
+#define BROKER_LATENCY_UNKNOWN 0xffffffffUL
+
+struct BrokerEntry {
+    char host[BROKER_HOST_MAX];
+    uint16_t port;
+    uint32_t latencyMs;       // smoothed probe round trip, BROKER_LATENCY_UNKNOWN until probed
+    uint32_t connectMs;       // last full MQTT connect (TCP + TLS + CONNACK)
+    uint16_t failures;        // consecutive failed connects or probes
+    uint32_t failedAt;
+    uint32_t totalFailures;
+};
+
+class BrokerPool {
+public:
+    uint32_t failovers = 0;   // moves away from a failing broker
+    uint32_t switches = 0;    // moves to a faster healthy broker
+
+    void clear() {
+        count_ = 0;
+        active_ = -1;
+    }
+
+    bool add(const char* host, uint16_t port) {
+        if (count_ >= BROKER_POOL_MAX || !host || !host[0] || strlen(host) >= BROKER_HOST_MAX) return false;
+        BrokerEntry &e = entries_[count_++];
+        memset(&e, 0, sizeof(e));
+        strcpy(e.host, host);
+        e.port = port;
+        e.latencyMs = BROKER_LATENCY_UNKNOWN;
+        return true;
+    }
+
+    uint8_t count() const { return count_; }
+    const BrokerEntry &entry(uint8_t i) const { return entries_[i]; }
+    int8_t active() const { return active_; }
+
+    int8_t find(const char* host, uint16_t port) const {
+        for (uint8_t i = 0; i < count_; i++) {
+            if (entries_[i].port == port && strcmp(entries_[i].host, host) == 0) return i;
+        }
+        return -1;
+    }
+
+    // Keeps the connection's broker marked active after the list was replaced
+    void setActive(int8_t i) { active_ = i < count_ ? i : -1; }
+
+    bool healthy(uint8_t i, uint32_t now) const {
+        const BrokerEntry &e = entries_[i];
+        return e.failures == 0 || now - e.failedAt >= cooldown(e);
+    }
+
+    // Broker to connect to next. When every broker is cooling down, the one
+    // that comes out first: retrying beats idling.
+    uint8_t select(uint32_t now) const {
+        int8_t best = -1;
+        for (uint8_t i = 0; i < count_; i++) {
+            if (!healthy(i, now)) continue;
+            if (best < 0 || entries_[i].latencyMs < entries_[best].latencyMs) best = i;
+        }
+        if (best >= 0) return best;
+
+        uint32_t soonest = 0xffffffffUL;
+        for (uint8_t i = 0; i < count_; i++) {
+            uint32_t left = cooldown(entries_[i]) - (now - entries_[i].failedAt);
+            if (left < soonest) {
+                soonest = left;
+                best = i;
+            }
+        }
+        return best < 0 ? 0 : best;
+    }
+
+    void recordLatency(uint8_t i, uint32_t ms) {
+        BrokerEntry &e = entries_[i];
+        e.latencyMs = e.latencyMs == BROKER_LATENCY_UNKNOWN ? ms : (3 * e.latencyMs + ms) / 4;
+        e.failures = 0;
+    }
+
+    void recordConnect(uint8_t i, uint32_t ms) {
+        if (active_ >= 0 && active_ != i) {
+            if (entries_[active_].failures > 0) {
+                failovers++;
+            } else {
+                switches++;
+            }
+        }
+        entries_[i].connectMs = ms;
+        entries_[i].failures = 0;
+        active_ = i;
+        publishFailures_ = 0;
+    }
+
+    void recordFailure(uint8_t i, uint32_t now) {
+        BrokerEntry &e = entries_[i];
+        if (e.failures < 0xffff) e.failures++;
+        e.failedAt = now;
+        e.totalFailures++;
+    }
+
+    // Outcome of a publish on the active broker; true once failover is due
+    bool recordPublish(bool ok) {
+        if (ok) {
+            publishFailures_ = 0;
+            return false;
+        }
+        return ++publishFailures_ >= BROKER_FAIL_LIMIT;
+    }
+
+    // A healthy broker clearly faster than the active one, or -1
+    int8_t betterThanActive(uint32_t now) const {
+        if (active_ < 0) return -1;
+        uint32_t current = entries_[active_].latencyMs;
+        if (current == BROKER_LATENCY_UNKNOWN) return -1;
+        uint8_t best = select(now);
+        uint32_t candidate = entries_[best].latencyMs;
+        if (best == active_ || candidate == BROKER_LATENCY_UNKNOWN) return -1;
+        if (candidate + BROKER_SWITCH_MARGIN_MS > current || candidate * 4 > current * 3) return -1;
+        return best;
+    }
+
+private:
+    BrokerEntry entries_[BROKER_POOL_MAX];
+    uint8_t count_ = 0;
+    int8_t active_ = -1;
+    uint8_t publishFailures_ = 0;
+
+    static uint32_t cooldown(const BrokerEntry &e) {
+        uint8_t shift = e.failures > 1 ? e.failures - 1 : 0;
+        if (shift > BROKER_COOLDOWN_MAX_SHIFT) shift = BROKER_COOLDOWN_MAX_SHIFT;
+        return (uint32_t)BROKER_COOLDOWN_MS << shift;
+    }
+};
@@ -3,13 +3,21 @@ echo Configuring Arduino CLI cache...
 arduino-cli config set build_cache.path %USERPROFILE%\.arduino-cache
 arduino-cli config set build_cache.ttl 720h
 
+rem "build.bat production" leaves out the geofence test simulation
+set "buildDir=build"
+set "buildFlags="
+if /i "%~1"=="production" (
+    set "buildDir=build-production"
+    set "buildFlags=--build-property compiler.cpp.extra_flags=-DPRODUCTION_BUILD=1"
+)
+
 cd sensor-monitor
-if not exist build mkdir build
-echo Building ESP32 project (with global cache)...
-arduino-cli compile --fqbn esp32:esp32:esp32doit-devkit-v1 --build-path build --jobs %NUMBER_OF_PROCESSORS% sensor-monitor.ino
+if not exist %buildDir% mkdir %buildDir%
+echo Building ESP32 project (with global cache) into %buildDir%...
+arduino-cli compile --fqbn esp32:esp32:esp32doit-devkit-v1 --build-path %buildDir% %buildFlags% --jobs %NUMBER_OF_PROCESSORS% sensor-monitor.ino
 if %errorlevel% equ 0 (
     echo ✅ Build successful!
-    for %%f in (build\*.bin) do echo   Binary: %%~nxf [%%~zf bytes]
+    for %%f in (%buildDir%\*.bin) do echo   Binary: %%~nxf [%%~zf bytes]
 ) else (
     echo ❌ Build failed!
 )
@@ -0,0 +1,240 @@
+// Streaming delta patch applier for OTA updates.
+//
+// A patch rebuilds the new firmware image from the running one and is
+// applied as it arrives, so neither the patch nor the new image has to be
+// held in RAM. It has no Arduino dependencies and builds on the host
+// (see tools/delta_tool.cpp).
+//
+// Format (all integers are unsigned LEB128 varints):
+//   "DPT1" <target_size>
+//   then a sequence of ops:
+//     'C' <src_offset> <length>            copy bytes from the source image
+//     'A' <src_offset> <length> segments   source bytes plus a sparse diff:
+//         repeated <skip> <count> <count diff bytes> until <length> is covered;
+//         skipped bytes are copied as-is, diff bytes are added (mod 256)
+//     'I' <length> <length literal bytes>  insert new bytes
+//     'E'                                  end of patch
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class DeltaPatcher {
+public:
+    typedef bool (*ReadFn)(void* ctx, uint32_t offset, uint8_t* buf, size_t len);
+    typedef bool (*WriteFn)(void* ctx, const uint8_t* buf, size_t len);
+
+    DeltaPatcher(ReadFn readSource, WriteFn writeTarget)
+        : readSource_(readSource), writeTarget_(writeTarget) {
+        begin(nullptr);
+    }
+
+    void begin(void* ctx) {
+        ctx_ = ctx;
+        state_ = ST_MAGIC;
+        error_ = nullptr;
+        magicPos_ = 0;
+        varValue_ = 0;
+        varShift_ = 0;
+        op_ = 0;
+        srcOffset_ = 0;
+        remaining_ = 0;
+        segCount_ = 0;
+        targetSize_ = 0;
+        written_ = 0;
+    }
+
+    // Consume the next piece of patch; chunk boundaries are arbitrary.
+    bool feed(const uint8_t* data, size_t len) {
+        size_t i = 0;
+        while (i < len) {
+            switch (state_) {
+                case ST_ERROR:
+                    return false;
+
+                case ST_DONE:
+                    return fail("trailing data after end");
+
+                case ST_MAGIC:
+                    if (data[i++] != (uint8_t)"DPT1"[magicPos_++]) return fail("bad magic");
+                    if (magicPos_ == 4) state_ = ST_TARGET_SIZE;
+                    break;
+
+                case ST_OP:
+                    op_ = data[i++];
+                    if (op_ == 'C' || op_ == 'A') {
+                        state_ = ST_SRC_OFFSET;
+                    } else if (op_ == 'I') {
+                        state_ = ST_LENGTH;
+                    } else if (op_ == 'E') {
+                        if (written_ != targetSize_) return fail("target size mismatch");
+                        state_ = ST_DONE;
+                    } else {
+                        return fail("unknown op");
+                    }
+                    break;
+
+                case ST_SEG_DATA:
+                case ST_INSERT_DATA: {
+                    uint32_t want = state_ == ST_SEG_DATA ? segCount_ : remaining_;
+                    size_t n = len - i < want ? len - i : want;
+                    if (!emitData(data + i, n)) return false;
+                    i += n;
+                    break;
+                }
+
+                default: {
+                    // Varint-valued states
+                    uint8_t b = data[i++];
+                    if (varShift_ > 28) return fail("varint overflow");
+                    varValue_ |= (uint32_t)(b & 0x7f) << varShift_;
+                    if (b & 0x80) {
+                        varShift_ += 7;
+                    } else {
+                        uint32_t value = varValue_;
+                        varValue_ = 0;
+                        varShift_ = 0;
+                        if (!onVarint(value)) return false;
+                    }
+                    break;
+                }
+            }
+        }
+        return state_ != ST_ERROR;
+    }
+
+    bool finished() const { return state_ == ST_DONE; }
+    bool failed() const { return state_ == ST_ERROR; }
+    const char* error() const { return error_ ? error_ : ""; }
+    uint32_t targetSize() const { return targetSize_; }
+    uint32_t written() const { return written_; }
+
+private:
+    enum State {
+        ST_MAGIC,
+        ST_TARGET_SIZE,
+        ST_OP,
+        ST_SRC_OFFSET,
+        ST_LENGTH,
+        ST_SEG_SKIP,
+        ST_SEG_COUNT,
+        ST_SEG_DATA,
+        ST_INSERT_DATA,
+        ST_DONE,
+        ST_ERROR
+    };
+
+    static const size_t BLOCK = 256;
+
+    bool fail(const char* message) {
+        state_ = ST_ERROR;
+        error_ = message;
+        return false;
+    }
+
+    bool onVarint(uint32_t value) {
+        switch (state_) {
+            case ST_TARGET_SIZE:
+                targetSize_ = value;
+                state_ = ST_OP;
+                return true;
+
+            case ST_SRC_OFFSET:
+                srcOffset_ = value;
+                state_ = ST_LENGTH;
+                return true;
+
+            case ST_LENGTH:
+                if (value > targetSize_ - written_) return fail("op overruns target");
+                remaining_ = value;
+                if (op_ == 'C') {
+                    if (!copySource(value)) return false;
+                    state_ = ST_OP;
+                } else if (op_ == 'A') {
+                    state_ = value ? ST_SEG_SKIP : ST_OP;
+                } else {
+                    state_ = value ? ST_INSERT_DATA : ST_OP;
+                }
+                return true;
+
+            case ST_SEG_SKIP:
+                if (value > remaining_) return fail("segment overruns op");
+                if (!copySource(value)) return false;
+                state_ = remaining_ ? ST_SEG_COUNT : ST_OP;
+                return true;
+
+            case ST_SEG_COUNT:
+                if (value > remaining_) return fail("segment overruns op");
+                segCount_ = value;
+                if (value) {
+                    state_ = ST_SEG_DATA;
+                } else {
+                    state_ = remaining_ ? ST_SEG_SKIP : ST_OP;
+                }
+                return true;
+
+            default:
+                return fail("bad state");
+        }
+    }
+
+    // Copy len source bytes at srcOffset_ straight to the target
+    bool copySource(uint32_t len) {
+        while (len > 0) {
+            size_t n = len < BLOCK ? len : BLOCK;
+            if (!readSource_(ctx_, srcOffset_, buf_, n)) return fail("source read failed");
+            if (!writeTarget_(ctx_, buf_, n)) return fail("target write failed");
+            srcOffset_ += n;
+            remaining_ -= n;
+            written_ += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // Diff bytes (added to the source) or literal bytes, depending on state
+    bool emitData(const uint8_t* data, size_t len) {
+        bool isDiff = state_ == ST_SEG_DATA;
+        while (len > 0) {
+            size_t n = len < BLOCK ? len : BLOCK;
+            if (isDiff) {
+                if (!readSource_(ctx_, srcOffset_, buf_, n)) return fail("source read failed");
+                for (size_t k = 0; k < n; k++) buf_[k] += data[k];
+                srcOffset_ += n;
+                segCount_ -= n;
+            } else {
+                for (size_t k = 0; k < n; k++) buf_[k] = data[k];
+            }
+            if (!writeTarget_(ctx_, buf_, n)) return fail("target write failed");
+            remaining_ -= n;
+            written_ += n;
+            data += n;
+            len -= n;
+        }
+
+        if (isDiff) {
+            if (segCount_ == 0) state_ = remaining_ ? ST_SEG_SKIP : ST_OP;
+        } else if (remaining_ == 0) {
+            state_ = ST_OP;
+        }
+        return true;
+    }
+
+    ReadFn readSource_;
+    WriteFn writeTarget_;
+    void* ctx_;
+
+    State state_;
+    const char* error_;
+    uint8_t magicPos_;
+    uint32_t varValue_;
+    uint8_t varShift_;
+    uint8_t op_;
+    uint32_t srcOffset_;
+    uint32_t remaining_;   // bytes left in the current op
+    uint32_t segCount_;    // diff bytes left in the current segment
+    uint32_t targetSize_;
+    uint32_t written_;
+    uint8_t buf_[BLOCK];
+};
@@ -0,0 +1,103 @@
+// Paced answers to discovery requests.
+//
+// A broadcast on devices/discover/all reaches the whole fleet at once; if
+// every device answered on the spot, the broker and the server's subscriber
+// would take one discovery document per device in the same instant. Instead
+// each device answers at a fixed offset into a window: the offset is a hash of
+// its device id scaled to the window, so it is the same on every broadcast and
+// the fleet spreads evenly without any coordination. Requests that arrive
+// while an answer is pending, or within the minimum interval after one, are
+// folded into that answer: a broadcast plus the server's per-device fan-out,
+// or a reconnect right after a broadcast, cost one document. Directed
+// requests use a window of 0.
+//
+// Times are passed in, so it has no Arduino dependencies and builds on the
+// host (see tools/discovery_fleet.cpp).
+
+#pragma once
+
+#include <stdint.h>
+
+#define DISCOVERY_WINDOW_MS 20000         // default spread of broadcast answers
+#define DISCOVERY_MIN_INTERVAL_MS 30000   // default minimum time between answers
+#define DISCOVERY_WINDOW_MAX_MS 600000UL
+
+// FNV-1a of the device id, finished with the murmur3 mix: ids that differ
+// only in the last digits otherwise land in clusters
+inline uint32_t discoveryHash(const char* id) {
+    uint32_t h = 2166136261UL;
+    while (*id) {
+        h ^= (uint8_t)*id++;
+        h *= 16777619UL;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bUL;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35UL;
+    h ^= h >> 16;
+    return h;
+}
+
+class DiscoveryPacer {
+public:
+    uint32_t requests = 0;     // discovery requests received
+    uint32_t coalesced = 0;    // requests folded into a pending or recent answer
+    uint32_t answers = 0;      // discovery documents sent
+
+    void begin(const char* deviceId, uint32_t minIntervalMs = DISCOVERY_MIN_INTERVAL_MS) {
+        hash_ = discoveryHash(deviceId);
+        minIntervalMs_ = minIntervalMs;
+    }
+
+    void setMinInterval(uint32_t ms) { minIntervalMs_ = ms; }
+    uint32_t minInterval() const { return minIntervalMs_; }
+
+    // This device's place in a window of windowMs
+    uint32_t offset(uint32_t windowMs) const {
+        if (windowMs > DISCOVERY_WINDOW_MAX_MS) windowMs = DISCOVERY_WINDOW_MAX_MS;
+        return (uint32_t)(((uint64_t)hash_ * windowMs) >> 32);
+    }
+
+    // Schedules an answer offset(windowMs) from now. Returns false when the
+    // request is covered by a recent answer; a pending one keeps the earlier
+    // of the two times.
+    bool request(uint32_t now, uint32_t windowMs) {
+        requests++;
+        if (answered_ && now - lastAnswer_ < minIntervalMs_) {
+            coalesced++;
+            return false;
+        }
+        uint32_t at = now + offset(windowMs);
+        if (pending_) {
+            coalesced++;
+            if ((int32_t)(at - dueAt_) < 0) dueAt_ = at;
+            return true;
+        }
+        pending_ = true;
+        dueAt_ = at;
+        return true;
+    }
+
+    bool pending() const { return pending_; }
+    bool due(uint32_t now) const { return pending_ && (int32_t)(now - dueAt_) >= 0; }
+    uint32_t dueIn(uint32_t now) const { return due(now) || !pending_ ? 0 : dueAt_ - now; }
+
+    // Any discovery document that went out, scheduled or not
+    void sent(uint32_t now) {
+        pending_ = false;
+        answered_ = true;
+        lastAnswer_ = now;
+        answers++;
+    }
+
+    // ms since the last answer, or since boot before the first one
+    uint32_t sinceLast(uint32_t now) const { return answered_ ? now - lastAnswer_ : now; }
+
+private:
+    uint32_t hash_ = 0;
+    uint32_t minIntervalMs_ = DISCOVERY_MIN_INTERVAL_MS;
+    bool pending_ = false;
+    uint32_t dueAt_ = 0;
+    bool answered_ = false;
+    uint32_t lastAnswer_ = 0;
+};
@@ -0,0 +1,162 @@
+// Geofence core shared by the firmware and the server.
+//
+// Polygons come as rings of {lng, lat} pairs (GeoJSON order: outer ring,
+// then holes; the closing vertex is optional) and are compiled once into a
+// flat edge table: per edge its end points and inverse slope, per fence a
+// bounding box and its edge range. A test is a bounding-box reject and one
+// pass over the fence's edges without a division.
+//
+// Edge rule, identical on every side (the PHP fallback in
+// GeofencingService computes the same tests in the same precision): a point
+// on an edge or vertex is inside; otherwise even-odd crossings of a ray
+// towards +lng, which also makes holes work.
+//
+// Storage is supplied by the caller: static arrays on the ESP32, growing
+// vectors in the FFI shim for the server (tools/geofence_ffi.cpp). No heap,
+// no Arduino dependencies.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct GeofenceEdge {
+    double lng1, lat1;
+    double lng2, lat2;
+    double slope;             // d lng / d lat, 0 for horizontal edges
+};
+
+struct Geofence {
+    int32_t id;               // caller's id (land, rule, ...)
+    uint32_t firstEdge;
+    uint32_t edgeCount;
+    double minLat, minLng;    // bounding box of the outer ring
+    double maxLat, maxLng;
+};
+
+struct GeofenceSet {
+    Geofence* fences;
+    uint32_t fenceCount;
+    uint32_t fenceCap;
+    GeofenceEdge* edges;
+    uint32_t edgeCount;
+    uint32_t edgeCap;
+};
+
+inline void geofenceInit(GeofenceSet &set, Geofence* fences, uint32_t fenceCap, GeofenceEdge* edges, uint32_t edgeCap) {
+    set.fences = fences;
+    set.fenceCount = 0;
+    set.fenceCap = fenceCap;
+    set.edges = edges;
+    set.edgeCount = 0;
+    set.edgeCap = edgeCap;
+}
+
+// Edges a polygon needs: one per distinct vertex of each ring
+inline uint32_t geofenceEdgesNeeded(const double* lngLat, const uint32_t* ringSizes, uint32_t ringCount) {
+    uint32_t total = 0;
+    for (uint32_t r = 0; r < ringCount; r++) {
+        uint32_t n = ringSizes[r];
+        if (n > 1 && lngLat[0] == lngLat[2 * (n - 1)] && lngLat[1] == lngLat[2 * (n - 1) + 1]) {
+            total += n - 1;
+        } else {
+            total += n;
+        }
+        lngLat += 2 * n;
+    }
+    return total;
+}
+
+// Compile a polygon into the set. Returns its fence index, or -1 when a
+// ring has fewer than three vertices or the set is full.
+inline int geofenceAdd(GeofenceSet &set, int32_t id, const double* lngLat, const uint32_t* ringSizes, uint32_t ringCount) {
+    if (ringCount == 0 || set.fenceCount >= set.fenceCap) return -1;
+    if (geofenceEdgesNeeded(lngLat, ringSizes, ringCount) > set.edgeCap - set.edgeCount) return -1;
+
+    Geofence &fence = set.fences[set.fenceCount];
+    fence.id = id;
+    fence.firstEdge = set.edgeCount;
+    fence.minLng = fence.maxLng = lngLat[0];
+    fence.minLat = fence.maxLat = lngLat[1];
+
+    uint32_t edge = set.edgeCount;
+    for (uint32_t r = 0; r < ringCount; r++) {
+        const double* ring = lngLat;
+        uint32_t n = ringSizes[r];
+        lngLat += 2 * n;
+        if (n > 1 && ring[0] == ring[2 * (n - 1)] && ring[1] == ring[2 * (n - 1) + 1]) n--;
+        if (n < 3) return -1;
+
+        for (uint32_t i = 0; i < n; i++) {
+            const double* a = ring + 2 * i;
+            const double* b = ring + 2 * ((i + 1) % n);
+            GeofenceEdge &e = set.edges[edge++];
+            e.lng1 = a[0];
+            e.lat1 = a[1];
+            e.lng2 = b[0];
+            e.lat2 = b[1];
+            e.slope = e.lat1 == e.lat2 ? 0 : (e.lng2 - e.lng1) / (e.lat2 - e.lat1);
+
+            if (r == 0) {
+                if (a[0] < fence.minLng) fence.minLng = a[0];
+                if (a[0] > fence.maxLng) fence.maxLng = a[0];
+                if (a[1] < fence.minLat) fence.minLat = a[1];
+                if (a[1] > fence.maxLat) fence.maxLat = a[1];
+            }
+        }
+    }
+
+    fence.edgeCount = edge - set.edgeCount;
+    set.edgeCount = edge;
+    return set.fenceCount++;
+}
+
+// Point exactly on the segment (collinear and within its extent)
+inline bool geofenceOnEdge(const GeofenceEdge &e, double lat, double lng) {
+    if ((lat < e.lat1 && lat < e.lat2) || (lat > e.lat1 && lat > e.lat2)) return false;
+    if ((lng < e.lng1 && lng < e.lng2) || (lng > e.lng1 && lng > e.lng2)) return false;
+    return (e.lng2 - e.lng1) * (lat - e.lat1) == (e.lat2 - e.lat1) * (lng - e.lng1);
+}
+
+// Index of the fence added with id, or -1
+inline int geofenceFind(const GeofenceSet &set, int32_t id) {
+    for (uint32_t i = 0; i < set.fenceCount; i++) {
+        if (set.fences[i].id == id) return (int)i;
+    }
+    return -1;
+}
+
+inline bool geofenceContains(const GeofenceSet &set, uint32_t index, double lat, double lng) {
+    const Geofence &fence = set.fences[index];
+    if (lat < fence.minLat || lat > fence.maxLat || lng < fence.minLng || lng > fence.maxLng) return false;
+
+    bool inside = false;
+    const GeofenceEdge* e = set.edges + fence.firstEdge;
+    const GeofenceEdge* end = e + fence.edgeCount;
+    for (; e < end; e++) {
+        if (geofenceOnEdge(*e, lat, lng)) return true;
+        if ((e->lat1 > lat) != (e->lat2 > lat) && lng < e->lng1 + (lat - e->lat1) * e->slope) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+// inside[i] = point i against fence fenceIndex[i] (0 for an unknown fence)
+inline void geofenceContainsPairs(const GeofenceSet &set, const double* lat, const double* lng,
+                                  const uint32_t* fenceIndex, size_t count, uint8_t* inside) {
+    for (size_t i = 0; i < count; i++) {
+        inside[i] = fenceIndex[i] < set.fenceCount && geofenceContains(set, fenceIndex[i], lat[i], lng[i]);
+    }
+}
+
+// inside[i * fenceCount + f] = point i against fence f. Fence by fence, so
+// one fence's edges stay in cache while all points are tested against it.
+inline void geofenceContainsAll(const GeofenceSet &set, const double* lat, const double* lng, size_t count,
+                                uint8_t* inside) {
+    for (uint32_t f = 0; f < set.fenceCount; f++) {
+        for (size_t i = 0; i < count; i++) {
+            inside[i * set.fenceCount + f] = geofenceContains(set, f, lat[i], lng[i]);
+        }
+    }
+}
@@ -0,0 +1,63 @@
+// Geohash of a fix in integer arithmetic.
+//
+// Coordinates come in as signed 1e-7 degrees (the u-blox / TinyGPS raw
+// resolution, ~1 cm). Each axis is scaled once into an unsigned 32-bit
+// fraction of its range, floor((v - min) * 2^32 / range), which is exactly
+// the bit sequence the geohash bisection produces; the hash is those bits
+// interleaved (longitude first) with shifts and masks, five per base-32
+// character. No floating point, no tables beyond the alphabet, no Arduino
+// dependencies; it builds on the host (see tools/geohash_check.cpp).
+//
+// A cell at precision 5 is about 4.9 x 4.9 km, 7 about 153 x 153 m, 9 about
+// 4.8 x 4.8 m. A prefix of a hash is the cell that contains it, which is
+// what lets the server index fences by cell.
+
+#pragma once
+
+#include <stdint.h>
+
+#define GEOHASH_MAX_PRECISION 12
+
+static const char GEOHASH_ALPHABET[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+// (v - min) / range as a 32-bit fraction; the top edge maps to the last cell
+inline uint32_t geohashScale(int32_t value, int64_t min, int64_t range) {
+    int64_t offset = (int64_t)value - min;
+    if (offset <= 0) return 0;
+    if (offset >= range) return 0xffffffffUL;
+    return (uint32_t)(((uint64_t)offset << 32) / (uint64_t)range);
+}
+
+// Spreads the 32 bits of v to the even bit positions of a 64-bit word
+inline uint64_t geohashSpread(uint32_t v) {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+    x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x << 2)) & 0x3333333333333333ULL;
+    x = (x | (x << 1)) & 0x5555555555555555ULL;
+    return x;
+}
+
+// Interleaved bits of the hash, 5 * precision of them, right-aligned
+inline uint64_t geohashBits(int32_t latE7, int32_t lngE7, uint8_t precision) {
+    if (precision > GEOHASH_MAX_PRECISION) precision = GEOHASH_MAX_PRECISION;
+    if (precision == 0) return 0;
+    uint32_t lat = geohashScale(latE7, -900000000LL, 1800000000LL);
+    uint32_t lng = geohashScale(lngE7, -1800000000LL, 3600000000LL);
+
+    // Longitude takes the first (most significant) bit of every pair
+    uint64_t bits = (geohashSpread(lng) << 1) | geohashSpread(lat);
+    return bits >> (64 - precision * 5);
+}
+
+// Writes precision characters plus a terminator into out
+inline void geohashEncode(int32_t latE7, int32_t lngE7, uint8_t precision, char* out) {
+    if (precision > GEOHASH_MAX_PRECISION) precision = GEOHASH_MAX_PRECISION;
+    uint64_t bits = geohashBits(latE7, lngE7, precision);
+    for (int8_t i = precision - 1; i >= 0; i--) {
+        out[i] = GEOHASH_ALPHABET[bits & 0x1f];
+        bits >>= 5;
+    }
+    out[precision] = '\0';
+}
@@ -0,0 +1,210 @@
+// Command framing for configuring the GPS receiver.
+//
+// u-blox receivers take binary UBX frames and answer with ACK-ACK/ACK-NAK;
+// MediaTek (MTK) receivers take $PMTK sentences and answer with $PMTK001.
+// This file only builds and recognises those messages. The UART handling
+// lives in serviceGpsSetup() in the sketch, a step per loop pass. It has no
+// Arduino dependencies and builds on the host (see tools/nmea_bench.cpp).
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define UBX_SYNC1 0xB5
+#define UBX_SYNC2 0x62
+#define UBX_CLASS_ACK 0x05
+#define UBX_CLASS_CFG 0x06
+#define UBX_CLASS_MON 0x0A
+#define UBX_CFG_PRT 0x00
+#define UBX_CFG_MSG 0x01
+#define UBX_CFG_RATE 0x08
+#define UBX_MON_VER 0x04
+#define UBX_NMEA_CLASS 0xF0
+
+// NMEA message ids in UBX class 0xF0
+enum UbxNmeaId { UBX_NMEA_GGA = 0, UBX_NMEA_GLL = 1, UBX_NMEA_GSA = 2, UBX_NMEA_GSV = 3, UBX_NMEA_RMC = 4, UBX_NMEA_VTG = 5 };
+
+enum GpsReceiverType { GPS_RECEIVER_UNKNOWN, GPS_RECEIVER_UBLOX, GPS_RECEIVER_MTK };
+
+// Frame a UBX message into out (needs len + 8 bytes); returns the frame length
+inline size_t ubxFrame(uint8_t cls, uint8_t id, const uint8_t* payload, uint16_t len, uint8_t* out) {
+    out[0] = UBX_SYNC1;
+    out[1] = UBX_SYNC2;
+    out[2] = cls;
+    out[3] = id;
+    out[4] = len & 0xff;
+    out[5] = len >> 8;
+    if (len) memcpy(out + 6, payload, len);
+
+    // 8-bit Fletcher checksum over class, id, length and payload
+    uint8_t a = 0, b = 0;
+    for (size_t i = 2; i < 6 + (size_t)len; i++) {
+        a += out[i];
+        b += a;
+    }
+    out[6 + len] = a;
+    out[7 + len] = b;
+    return 8 + len;
+}
+
+// CFG-MSG: output rate of one NMEA sentence on the current port (0 = off)
+inline size_t ubxSetNmeaRate(uint8_t nmeaId, uint8_t rate, uint8_t* out) {
+    uint8_t payload[3] = {UBX_NMEA_CLASS, nmeaId, rate};
+    return ubxFrame(UBX_CLASS_CFG, UBX_CFG_MSG, payload, sizeof(payload), out);
+}
+
+// CFG-RATE: measurement period in ms, one navigation solution per measurement, GPS time
+inline size_t ubxSetNavRate(uint16_t periodMs, uint8_t* out) {
+    uint8_t payload[6] = {(uint8_t)(periodMs & 0xff), (uint8_t)(periodMs >> 8), 1, 0, 1, 0};
+    return ubxFrame(UBX_CLASS_CFG, UBX_CFG_RATE, payload, sizeof(payload), out);
+}
+
+// CFG-PRT for UART1: 8N1, UBX+NMEA in and out, at the given baud rate
+inline size_t ubxSetBaud(uint32_t baud, uint8_t* out) {
+    uint8_t payload[20] = {0};
+    payload[0] = 1;                  // UART1
+    payload[4] = 0xD0;               // mode: 8 data bits, no parity, 1 stop bit
+    payload[5] = 0x08;
+    for (int i = 0; i < 4; i++) payload[8 + i] = (baud >> (8 * i)) & 0xff;
+    payload[12] = 0x03;              // inProtoMask: UBX | NMEA
+    payload[14] = 0x03;              // outProtoMask: UBX | NMEA
+    return ubxFrame(UBX_CLASS_CFG, UBX_CFG_PRT, payload, sizeof(payload), out);
+}
+
+// Wrap a PMTK body ("PMTK220,200") as "$PMTK220,200*2C\r\n"; returns the length
+inline size_t pmtkSentence(const char* body, char* out, size_t size) {
+    uint8_t cs = 0;
+    for (const char* p = body; *p; p++) cs ^= (uint8_t)*p;
+    int n = snprintf(out, size, "$%s*%02X\r\n", body, cs);
+    return n > 0 && (size_t)n < size ? (size_t)n : 0;
+}
+
+// Recognises replies in a mixed NMEA/UBX byte stream
+class GpsReplyScanner {
+public:
+    // Wait for the UBX ACK of cls/id, or for a UBX frame of cls/id itself
+    void expectUbx(uint8_t cls, uint8_t id, bool ackOnly) {
+        reset();
+        ubxClass_ = cls;
+        ubxId_ = id;
+        ackOnly_ = ackOnly;
+        pmtkCommand_ = -1;
+    }
+
+    // Wait for "$PMTK001,<command>,<flag>" or any sentence starting with prefix
+    void expectPmtk(int command, const char* prefix = nullptr) {
+        reset();
+        ubxClass_ = 0xff;
+        pmtkCommand_ = command;
+        prefix_ = prefix;
+    }
+
+    // Returns 1 on acknowledgement, -1 on rejection, 0 while undecided
+    int feed(uint8_t c) {
+        int r = feedUbx(c);
+        if (r) return r;
+        return feedNmea(c);
+    }
+
+private:
+    uint8_t ubxClass_ = 0xff;
+    uint8_t ubxId_ = 0;
+    bool ackOnly_ = true;
+    int pmtkCommand_ = -1;
+    const char* prefix_ = nullptr;
+
+    uint8_t frame_[10];
+    size_t framePos_ = 0;
+    char line_[48];
+    size_t linePos_ = 0;
+
+    void reset() {
+        framePos_ = 0;
+        linePos_ = 0;
+        prefix_ = nullptr;
+    }
+
+    int feedUbx(uint8_t c) {
+        if (ubxClass_ == 0xff) return 0;
+        if (framePos_ == 0 && c != UBX_SYNC1) return 0;
+        if (framePos_ == 1 && c != UBX_SYNC2) {
+            framePos_ = c == UBX_SYNC1 ? 1 : 0;
+            return 0;
+        }
+        frame_[framePos_++] = c;
+        if (framePos_ < 4) return 0;
+
+        // Header complete: sync, sync, class, id
+        uint8_t cls = frame_[2], id = frame_[3];
+        if (!ackOnly_ && cls == ubxClass_ && id == ubxId_) {
+            framePos_ = 0;
+            return 1;
+        }
+        if (cls != UBX_CLASS_ACK) {
+            framePos_ = 0;
+            return 0;
+        }
+        // ACK payload: class and id of the acknowledged message
+        if (framePos_ < 8) return 0;
+        framePos_ = 0;
+        if (frame_[6] != ubxClass_ || frame_[7] != ubxId_) return 0;
+        return id == 0x01 ? 1 : -1;
+    }
+
+    int feedNmea(uint8_t c) {
+        if (pmtkCommand_ < 0) return 0;
+        if (c == '$') {
+            linePos_ = 0;
+        }
+        if (c == '\r' || c == '\n' || c == '*') {
+            line_[linePos_] = '\0';
+            linePos_ = 0;
+            return matchLine();
+        }
+        if (linePos_ < sizeof(line_) - 1) line_[linePos_++] = (char)c;
+        return 0;
+    }
+
+    int matchLine() {
+        if (prefix_ && strncmp(line_, prefix_, strlen(prefix_)) == 0) return 1;
+        // $PMTK001,<cmd>,<flag>: 3 = success, 0/1/2 = invalid/unsupported/failed
+        int cmd = -1, flag = -1;
+        if (sscanf(line_, "$PMTK001,%d,%d", &cmd, &flag) == 2 && cmd == pmtkCommand_) {
+            return flag == 3 ? 1 : -1;
+        }
+        return 0;
+    }
+};
+
+// Tallies NMEA sentence types to verify what the receiver actually outputs
+struct NmeaSentenceStats {
+    uint32_t rmc = 0;
+    uint32_t gga = 0;
+    uint32_t other = 0;
+    uint32_t bytes = 0;
+
+    void feed(uint8_t c) {
+        bytes++;
+        if (c == '$') {
+            pos_ = 0;
+            return;
+        }
+        if (pos_ < 5) {
+            type_[pos_++] = (char)c;
+            if (pos_ == 5) {
+                // Talker id (2 chars) then sentence type
+                if (memcmp(type_ + 2, "RMC", 3) == 0) rmc++;
+                else if (memcmp(type_ + 2, "GGA", 3) == 0) gga++;
+                else other++;
+            }
+        }
+    }
+
+    uint32_t sentences() const { return rmc + gga + other; }
+
+private:
+    char type_[5];
+    uint8_t pos_ = 5;
+};
@@ -0,0 +1,289 @@
+// Full-resolution sample history on flash.
+//
+// An append-only circular log of fixed-size 12-byte records in 4 KB sectors.
+// Each sector starts with a header carrying a sequence number and the time
+// of its first record; sectors are filled one after another and the oldest is
+// reused when the log wraps, so every sector is rewritten once per pass over
+// the log (wear spreads evenly across it). The headers double as a time
+// index: begin() reads them into a small table, and a range query starts at
+// the last sector that begins before the range instead of scanning the log.
+//
+// Nothing is erased. A record carries the low byte of its sector's sequence
+// number, so slots left over from the previous pass over a sector never
+// match; after a reset the fill of the newest sector is found by binary
+// search on that tag. The sector count must therefore not be a multiple of
+// 256.
+//
+// Storage is reached through read/write callbacks at byte offsets (a
+// LittleFS file on the ESP32, memory in tools/history_check.cpp). Records
+// are buffered and written in batches; up to HISTORY_PENDING records are
+// lost on a reset. No heap, no Arduino dependencies.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HISTORY_SECTOR_SIZE 4096
+#define HISTORY_MAGIC 0x31474c48UL    // "HLG1"
+#define HISTORY_PENDING 32            // records buffered between writes
+
+struct HistoryRecord {
+    uint32_t time;             // epoch seconds
+    uint16_t ms;
+    uint8_t field;             // row of the sketch's sensor registry
+    uint8_t tag;               // low byte of the sector sequence, set by the log
+    int32_t value;             // value * 10^decimals of the row
+};
+
+struct HistorySectorHeader {
+    uint32_t magic;
+    uint32_t seq;              // 0 = never written
+    uint32_t firstTime;
+    uint16_t schema;           // registry layout the field numbers refer to
+    uint16_t recordSize;
+};
+
+struct HistorySector {
+    uint32_t seq;
+    uint32_t firstTime;
+};
+
+static_assert(sizeof(HistoryRecord) == 12, "history records are 12 bytes on flash");
+static_assert(sizeof(HistorySectorHeader) == 16, "history sector header is 16 bytes on flash");
+
+// 10^decimals as the integer scale values are stored with
+inline int32_t historyScale(uint8_t decimals) {
+    static const int32_t SCALES[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    return SCALES[decimals < 7 ? decimals : 6];
+}
+
+// Position in a range query: the sector by sequence number, then the slot
+struct HistoryCursor {
+    uint32_t seq;
+    uint16_t slot;
+    uint32_t from;
+    uint32_t to;
+    bool done;
+};
+
+class HistoryLog {
+public:
+    typedef bool (*ReadFn)(void* ctx, uint32_t offset, uint8_t* buf, size_t len);
+    typedef bool (*WriteFn)(void* ctx, uint32_t offset, const uint8_t* buf, size_t len);
+
+    static const uint16_t RECORDS_PER_SECTOR =
+        (HISTORY_SECTOR_SIZE - sizeof(HistorySectorHeader)) / sizeof(HistoryRecord);
+
+    HistoryLog(ReadFn read, WriteFn write) : read_(read), write_(write) {}
+
+    // Rebuild the index from the sector headers and find where the last run
+    // stopped. Sectors written under another schema count as empty.
+    bool begin(void* ctx, HistorySector* index, uint16_t sectorCount, uint16_t schema) {
+        ctx_ = ctx;
+        index_ = index;
+        sectorCount_ = sectorCount;
+        schema_ = schema;
+        pendingCount_ = 0;
+        head_ = 0;
+        headSeq_ = 0;
+        headFill_ = RECORDS_PER_SECTOR;
+        writeErrors = 0;
+        if (sectorCount_ < 2 || sectorCount_ % 256 == 0) return false;
+
+        for (uint16_t i = 0; i < sectorCount_; i++) {
+            HistorySectorHeader h;
+            index_[i].seq = 0;
+            index_[i].firstTime = 0;
+            if (read_(ctx_, offsetOf(i), (uint8_t*)&h, sizeof(h)) && h.magic == HISTORY_MAGIC &&
+                h.schema == schema_ && h.recordSize == sizeof(HistoryRecord) && h.seq != 0) {
+                index_[i].seq = h.seq;
+                index_[i].firstTime = h.firstTime;
+                if (h.seq > headSeq_) {
+                    headSeq_ = h.seq;
+                    head_ = i;
+                }
+            }
+        }
+
+        // Written slots are a prefix of the newest sector
+        if (headSeq_ > 0) {
+            uint16_t lo = 0;
+            uint16_t hi = RECORDS_PER_SECTOR;
+            while (lo < hi) {
+                uint16_t mid = (lo + hi) / 2;
+                HistoryRecord r;
+                if (read_(ctx_, offsetOf(head_, mid), (uint8_t*)&r, sizeof(r)) && r.tag == (uint8_t)headSeq_) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            headFill_ = lo;
+        } else {
+            // Start the first pass at sector 0
+            head_ = sectorCount_ - 1;
+        }
+        return true;
+    }
+
+    // Buffer a record; returns false only when a forced write failed
+    bool add(const HistoryRecord &record) {
+        pending_[pendingCount_++] = record;
+        return pendingCount_ < HISTORY_PENDING || flush();
+    }
+
+    bool flush() {
+        size_t done = 0;
+        bool ok = true;
+        while (done < pendingCount_) {
+            if (headFill_ >= RECORDS_PER_SECTOR && !startSector(pending_[done].time)) {
+                ok = false;
+                break;
+            }
+            size_t n = pendingCount_ - done;
+            if (n > (size_t)(RECORDS_PER_SECTOR - headFill_)) n = RECORDS_PER_SECTOR - headFill_;
+            for (size_t i = 0; i < n; i++) {
+                pending_[done + i].tag = (uint8_t)headSeq_;
+            }
+            if (!write_(ctx_, offsetOf(head_, headFill_), (const uint8_t*)&pending_[done], n * sizeof(HistoryRecord))) {
+                ok = false;
+                break;
+            }
+            headFill_ += n;
+            done += n;
+            recordsWritten += n;
+        }
+        // A failed batch is dropped rather than retried into a worn sector forever
+        if (!ok) writeErrors++;
+        pendingCount_ = 0;
+        return ok;
+    }
+
+    // Position a cursor at the first sector that can hold records of [from, to]
+    void seek(HistoryCursor &cursor, uint32_t from, uint32_t to) const {
+        cursor.from = from;
+        cursor.to = to;
+        cursor.slot = 0;
+        cursor.seq = oldestSeq();
+        cursor.done = headSeq_ == 0;
+        if (cursor.done) return;
+
+        // First times rise with the sequence: the start is the last sector
+        // beginning at or before from
+        uint32_t lo = cursor.seq;
+        uint32_t hi = headSeq_;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+            if (index_[sectorOf(mid)].firstTime <= from) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        cursor.seq = lo;
+    }
+
+    // Next records in [from, to], up to max of them. Reads whole runs of
+    // slots at a time; returns 0 once the range is exhausted.
+    size_t read(HistoryCursor &cursor, HistoryRecord* out, size_t max) {
+        size_t count = 0;
+        while (!cursor.done && count < max) {
+            // The sector was reused under the cursor: continue with the oldest
+            if (cursor.seq < oldestSeq()) {
+                cursor.seq = oldestSeq();
+                cursor.slot = 0;
+            }
+            uint16_t sector = sectorOf(cursor.seq);
+            if (index_[sector].firstTime > cursor.to) {
+                cursor.done = true;
+                break;
+            }
+
+            uint16_t fill = cursor.seq == headSeq_ ? headFill_ : RECORDS_PER_SECTOR;
+            size_t n = fill > cursor.slot ? fill - cursor.slot : 0;
+            if (n > max - count) n = max - count;
+            // Read the run straight into out, then keep the matching records
+            if (n > 0 && read_(ctx_, offsetOf(sector, cursor.slot), (uint8_t*)(out + count), n * sizeof(HistoryRecord))) {
+                size_t base = count;
+                for (size_t i = 0; i < n; i++) {
+                    HistoryRecord r = out[base + i];
+                    if (r.tag == (uint8_t)cursor.seq && r.time >= cursor.from && r.time <= cursor.to) {
+                        out[count++] = r;
+                    }
+                }
+            }
+            cursor.slot += n;
+
+            if (cursor.slot >= fill) {
+                if (cursor.seq == headSeq_) {
+                    cursor.done = true;
+                } else {
+                    cursor.seq++;
+                    cursor.slot = 0;
+                }
+            }
+        }
+        return count;
+    }
+
+    uint32_t storedRecords() const {
+        if (headSeq_ == 0) return 0;
+        return (headSeq_ - oldestSeq()) * RECORDS_PER_SECTOR + headFill_;
+    }
+
+    uint32_t oldestTime() const {
+        return headSeq_ == 0 ? 0 : index_[sectorOf(oldestSeq())].firstTime;
+    }
+
+    uint16_t sectorsUsed() const {
+        return headSeq_ == 0 ? 0 : headSeq_ - oldestSeq() + 1;
+    }
+
+    uint16_t pending() const { return pendingCount_; }
+
+    uint32_t recordsWritten = 0;
+    uint32_t writeErrors = 0;
+
+private:
+    bool startSector(uint32_t firstTime) {
+        uint16_t next = (head_ + 1) % sectorCount_;
+        HistorySectorHeader h = {HISTORY_MAGIC, headSeq_ + 1, firstTime, schema_, sizeof(HistoryRecord)};
+        // Drop the old entry first so a failed header write leaves no stale index
+        index_[next].seq = 0;
+        if (!write_(ctx_, offsetOf(next), (const uint8_t*)&h, sizeof(h))) return false;
+        index_[next].seq = h.seq;
+        index_[next].firstTime = firstTime;
+        head_ = next;
+        headSeq_ = h.seq;
+        headFill_ = 0;
+        return true;
+    }
+
+    uint32_t oldestSeq() const {
+        return headSeq_ >= sectorCount_ ? headSeq_ - sectorCount_ + 1 : 1;
+    }
+
+    // Sequence numbers are consecutive around the ring, ending at the head
+    uint16_t sectorOf(uint32_t seq) const {
+        return (head_ + sectorCount_ - (headSeq_ - seq) % sectorCount_) % sectorCount_;
+    }
+
+    static uint32_t offsetOf(uint16_t sector, uint16_t slot = 0xffff) {
+        uint32_t base = (uint32_t)sector * HISTORY_SECTOR_SIZE;
+        return slot == 0xffff ? base : base + sizeof(HistorySectorHeader) + (uint32_t)slot * sizeof(HistoryRecord);
+    }
+
+    ReadFn read_;
+    WriteFn write_;
+    void* ctx_ = nullptr;
+    HistorySector* index_ = nullptr;
+    uint16_t sectorCount_ = 0;
+    uint16_t schema_ = 0;
+    uint16_t head_ = 0;
+    uint32_t headSeq_ = 0;
+    uint16_t headFill_ = 0;
+    HistoryRecord pending_[HISTORY_PENDING];
+    size_t pendingCount_ = 0;
+};
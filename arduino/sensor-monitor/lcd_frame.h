@@ -0,0 +1,112 @@
+// Shadow-framebuffer rendering for an HD44780 behind a PCF8574 I2C backpack.
+//
+// Rows are rendered into the wanted frame; flush() compares it with the
+// shadow of what the panel shows and sends only the cells that differ, one
+// "set DDRAM address" per run of changed cells. Each HD44780 byte is two
+// nibbles, each latched by an EN pulse, so four expander bytes; they are
+// batched into as few bus transactions as the buffer allows instead of the
+// three single-byte transactions per nibble LiquidCrystal_I2C uses. At
+// 400 kHz a batch byte takes ~22 us, so the EN timing and the 37 us command
+// time are met by the transfer itself.
+//
+// The bus is anything with TwoWire's beginTransmission(address),
+// write(data, length) and endTransmission(), so it builds on the host (see
+// tools/lcd_check.cpp).
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// PCF8574 backpack pin mapping (P0=RS, P2=EN, P3=backlight, P4-P7=D4-D7)
+#define LCD_RS 0x01
+#define LCD_EN 0x04
+#define LCD_BACKLIGHT 0x08
+
+#define LCD_BATCH_BYTES 128   // ESP32 Wire buffer size
+
+template <typename Bus, uint8_t Cols, uint8_t Rows>
+class LcdFrame {
+    static_assert(Rows <= 4 && Cols <= 40, "HD44780 addresses at most 4 rows of 40 cells");
+
+public:
+    uint32_t bytesLastFlush = 0;          // expander bytes sent by the last flush
+    uint32_t transactionsLastFlush = 0;
+
+    LcdFrame(Bus &bus, uint8_t address) : bus_(bus), address_(address) {
+        memset(frame_, ' ', sizeof(frame_));
+        memset(shadow_, ' ', sizeof(shadow_));
+    }
+
+    // What the panel shows is unknown (after init or a library clear()):
+    // the next flush redraws every cell
+    void invalidate() { memset(shadow_, 0, sizeof(shadow_)); }
+
+    // Render a row, space padded and clipped to the panel
+    void setLine(uint8_t row, const char* text) {
+        size_t len = strlen(text);
+        for (uint8_t col = 0; col < Cols; col++) {
+            frame_[row][col] = col < len ? text[col] : ' ';
+        }
+    }
+
+    // Send only the cells that differ from what the panel shows. Returns the
+    // expander bytes sent.
+    uint32_t flush() {
+        static const uint8_t rowOffsets[4] = {0x00, 0x40, Cols, 0x40 + Cols};
+        bytesLastFlush = 0;
+        transactionsLastFlush = 0;
+
+        for (uint8_t row = 0; row < Rows; row++) {
+            int cursor = -1;   // column the panel's address counter points at
+            for (uint8_t col = 0; col < Cols; col++) {
+                if (frame_[row][col] == shadow_[row][col]) continue;
+
+                // A run of changed cells needs a single "set DDRAM address"
+                if (cursor != col) {
+                    queueByte(0x80 | (rowOffsets[row] + col), 0);
+                }
+                queueByte(frame_[row][col], LCD_RS);
+                shadow_[row][col] = frame_[row][col];
+                cursor = col + 1;
+            }
+        }
+
+        send();
+        return bytesLastFlush;
+    }
+
+private:
+    void queueByte(uint8_t value, uint8_t mode) {
+        if (batchLen_ + 4 > sizeof(batch_)) {
+            send();
+        }
+
+        uint8_t high = (value & 0xF0) | mode | LCD_BACKLIGHT;
+        uint8_t low = ((value << 4) & 0xF0) | mode | LCD_BACKLIGHT;
+        batch_[batchLen_++] = high | LCD_EN;
+        batch_[batchLen_++] = high;
+        batch_[batchLen_++] = low | LCD_EN;
+        batch_[batchLen_++] = low;
+    }
+
+    void send() {
+        if (batchLen_ == 0) return;
+
+        bus_.beginTransmission(address_);
+        bus_.write(batch_, batchLen_);
+        bus_.endTransmission();
+
+        bytesLastFlush += batchLen_;
+        transactionsLastFlush++;
+        batchLen_ = 0;
+    }
+
+    Bus &bus_;
+    uint8_t address_;
+    char frame_[Rows][Cols];
+    char shadow_[Rows][Cols];
+    uint8_t batch_[LCD_BATCH_BYTES];
+    size_t batchLen_ = 0;
+};
@@ -0,0 +1,154 @@
+// LZ4 block compression for MQTT payloads.
+//
+// Raw LZ4 block format (no frame header, no checksum), so any LZ4 block
+// decoder reads the output. The compressor is the greedy single-probe
+// variant: one hash table of 16-bit positions (LZ4_HASH_SIZE entries, 2 KB)
+// supplied by the caller, no heap, inputs up to 64 KB. It has no Arduino
+// dependencies and builds on the host (see tools/lz4_bench.cpp).
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LZ4_HASH_BITS 10
+#define LZ4_HASH_SIZE (1 << LZ4_HASH_BITS)
+#define LZ4_MAX_INPUT 65535
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5     // the block must end with this many literals
+#define LZ4_MF_LIMIT 12         // no match may start closer than this to the end
+
+inline uint32_t lz4Read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t lz4Hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+// Writes the 255-run length extension; false when out of room
+inline bool lz4PutLength(uint8_t*& op, const uint8_t* end, size_t length) {
+    while (length >= 255) {
+        if (op >= end) return false;
+        *op++ = 255;
+        length -= 255;
+    }
+    if (op >= end) return false;
+    *op++ = (uint8_t)length;
+    return true;
+}
+
+// One sequence: literals [anchor, anchor + literals) then a match (matchLen 0 = last sequence)
+inline bool lz4PutSequence(uint8_t*& op, const uint8_t* end, const uint8_t* anchor, size_t literals,
+                           uint16_t offset, size_t matchLen) {
+    if (op >= end) return false;
+    uint8_t* token = op++;
+    size_t matchCode = matchLen ? matchLen - LZ4_MIN_MATCH : 0;
+    *token = (uint8_t)(((literals >= 15 ? 15 : literals) << 4) | (matchCode >= 15 ? 15 : matchCode));
+    if (literals >= 15 && !lz4PutLength(op, end, literals - 15)) return false;
+    if ((size_t)(end - op) < literals) return false;
+    memcpy(op, anchor, literals);
+    op += literals;
+    if (!matchLen) return true;
+
+    if (end - op < 2) return false;
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    if (matchCode >= 15 && !lz4PutLength(op, end, matchCode - 15)) return false;
+    return true;
+}
+
+// Compress src into dst. Returns the block size, or 0 when it does not fit
+// in dstCap (store the data uncompressed then). table: LZ4_HASH_SIZE entries.
+inline size_t lz4Compress(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstCap, uint16_t* table) {
+    if (srcLen > LZ4_MAX_INPUT) return 0;
+    uint8_t* op = dst;
+    const uint8_t* end = dst + dstCap;
+    size_t anchor = 0;
+
+    if (srcLen > LZ4_MF_LIMIT) {
+        memset(table, 0xff, LZ4_HASH_SIZE * sizeof(uint16_t));
+        size_t matchStartLimit = srcLen - LZ4_MF_LIMIT;
+        size_t matchEndLimit = srcLen - LZ4_LAST_LITERALS;
+        size_t ip = 0;
+
+        while (ip < matchStartLimit) {
+            uint32_t sequence = lz4Read32(src + ip);
+            uint32_t h = lz4Hash(sequence);
+            uint16_t ref = table[h];
+            table[h] = (uint16_t)ip;
+
+            if (ref == 0xffff || lz4Read32(src + ref) != sequence) {
+                ip++;
+                continue;
+            }
+
+            size_t matchLen = LZ4_MIN_MATCH;
+            while (ip + matchLen < matchEndLimit && src[ref + matchLen] == src[ip + matchLen]) {
+                matchLen++;
+            }
+            if (!lz4PutSequence(op, end, src + anchor, ip - anchor, (uint16_t)(ip - ref), matchLen)) return 0;
+            ip += matchLen;
+            anchor = ip;
+        }
+    }
+
+    if (!lz4PutSequence(op, end, src + anchor, srcLen - anchor, 0, 0)) return 0;
+    return op - dst;
+}
+
+// Decompress a block into dst. Returns the decoded size, or -1 on malformed
+// input or when dstCap is too small.
+inline int lz4Decompress(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstCap) {
+    const uint8_t* ip = src;
+    const uint8_t* ipEnd = src + srcLen;
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + dstCap;
+
+    while (ip < ipEnd) {
+        uint8_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ipEnd) return -1;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if ((size_t)(ipEnd - ip) < literals || (size_t)(opEnd - op) < literals) return -1;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == ipEnd) break;   // last sequence carries no match
+
+        if (ipEnd - ip < 2) return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return -1;
+
+        size_t matchLen = token & 15;
+        if (matchLen == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ipEnd) return -1;
+                b = *ip++;
+                matchLen += b;
+            } while (b == 255);
+        }
+        matchLen += LZ4_MIN_MATCH;
+        if ((size_t)(opEnd - op) < matchLen) return -1;
+
+        // Byte by byte: the match may overlap the bytes it produces
+        const uint8_t* match = op - offset;
+        for (size_t i = 0; i < matchLen; i++) {
+            op[i] = match[i];
+        }
+        op += matchLen;
+    }
+    return (int)(op - dst);
+}
@@ -0,0 +1,595 @@
+// Minimal MQTT 5 client with runtime fallback to MQTT 3.1.1.
+//
+// arduino-mqtt (lwmqtt) only speaks 3.1.1, so this implements the small
+// part of the protocol the sketch uses (CONNECT, PUBLISH QoS 0/1,
+// SUBSCRIBE, PING, DISCONNECT) behind the same method names. On MQTT 5 it
+// adds two things:
+//   - topic aliases: after the first publish on a topic, later publishes
+//     send a two-byte alias instead of the topic string
+//   - message expiry: the broker drops queued telemetry once it is stale
+// If the broker rejects protocol level 5 (CONNACK 0x84 / 3.1.1 return
+// code 1, or it closes the socket before sending any CONNACK), connect()
+// retries at level 4 and keeps using 3.1.1 with that broker; a connect to
+// another host or port (broker failover) tries level 5 again. A CONNACK that
+// is merely late (a loaded broker, a reconnect storm) is an ordinary
+// failure: the next connect tries level 5 again. It builds on the host with
+// a socket Client (see tools/mqtt_bytes.cpp).
+
+#pragma once
+
+#include <Client.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MQTT5_MAX_ALIASES 16          // topic aliases we use at most
+#define MQTT5_COMMAND_TIMEOUT 1000    // ms to wait for CONNACK/PUBACK/SUBACK
+#define MQTT5_TOPIC_SIZE 128          // longest incoming topic
+#define MQTT5_HOST_SIZE 64            // longest broker host remembered for the 3.1.1 fallback
+
+// Property identifiers (MQTT 5, section 2.2.2.2)
+#define MQTT5_PROP_MESSAGE_EXPIRY 0x02
+#define MQTT5_PROP_SESSION_EXPIRY 0x11
+#define MQTT5_PROP_SERVER_KEEP_ALIVE 0x13
+#define MQTT5_PROP_TOPIC_ALIAS 0x23
+#define MQTT5_PROP_TOPIC_ALIAS_MAX 0x22
+#define MQTT5_PROP_MAX_PACKET_SIZE 0x27
+
+class Mqtt5Client {
+public:
+    typedef void (*MessageHandler)(Mqtt5Client* client, char topic[], char bytes[], int length);
+
+    explicit Mqtt5Client(int bufSize = 128) : bufSize_(bufSize) {
+        rbuf_ = (uint8_t*)malloc(bufSize_ + 1);   // +1 to null-terminate payloads
+        wbuf_ = (uint8_t*)malloc(bufSize_);
+    }
+
+    ~Mqtt5Client() {
+        free(rbuf_);
+        free(wbuf_);
+    }
+
+    void begin(const char* host, int port, Client &net) {
+        host_ = host;
+        port_ = port;
+        net_ = &net;
+    }
+
+    void setHost(const char* host, int port) {
+        host_ = host;
+        port_ = port;
+    }
+
+    void onMessageAdvanced(MessageHandler handler) { handler_ = handler; }
+    void setKeepAlive(int seconds) { keepAlive_ = seconds; }
+    void setCleanSession(bool clean) { cleanSession_ = clean; }
+
+    // Protocol level to try first (5 or 4); resets the 3.1.1 fallback
+    void setProtocolVersion(uint8_t version) {
+        wantV5_ = version == 5;
+        preferV5_ = wantV5_;
+    }
+
+    // Negotiated protocol level: 5, or 4 for MQTT 3.1.1
+    uint8_t protocolVersion() const { return version_; }
+    uint16_t topicAliasMax() const { return aliasMax_; }
+    uint8_t aliasesUsed() const { return aliasCount_; }
+    uint32_t bytesSent() const { return bytesSent_; }
+    uint32_t aliasBytesSaved() const { return aliasBytesSaved_; }
+    int lastConnackCode() const { return connackCode_; }
+
+    bool connect(const char* clientId, const char* username = nullptr, const char* password = nullptr) {
+        if (!net_ || !rbuf_ || !wbuf_) return false;
+
+        // The fallback belongs to the broker that refused level 5. The host
+        // is compared by content: the sketch reuses broker table slots.
+        bool sameBroker = port_ == fallbackPort_ && strncmp(host_, fallbackHost_, sizeof(fallbackHost_)) == 0;
+        if (wantV5_ && !preferV5_ && !sameBroker) {
+            preferV5_ = true;
+        }
+        if (connectAs(preferV5_ ? 5 : 4, clientId, username, password)) return true;
+
+        // Broker without MQTT 5: retry at 3.1.1 and stay there while it is this one
+        if (preferV5_ && rejectedV5_) {
+            preferV5_ = false;
+            strncpy(fallbackHost_, host_, sizeof(fallbackHost_) - 1);
+            fallbackHost_[sizeof(fallbackHost_) - 1] = 0;
+            fallbackPort_ = port_;
+            return connectAs(4, clientId, username, password);
+        }
+        return false;
+    }
+
+    bool connected() {
+        return connected_ && net_->connected();
+    }
+
+    bool disconnect() {
+        if (connected_) {
+            uint8_t packet[2] = {0xE0, 0x00};
+            writePacket(packet, 2);
+        }
+        close();
+        return true;
+    }
+
+    // Process incoming packets and keep the connection alive
+    bool loop() {
+        if (!connected()) {
+            close();
+            return false;
+        }
+        while (net_->available() > 0) {
+            if (readPacket(MQTT5_COMMAND_TIMEOUT) < 0) {
+                close();
+                return false;
+            }
+        }
+
+        unsigned long now = millis();
+        if (keepAlive_ > 0) {
+            if (pingOutstanding_ && now - pingSentAt_ > (unsigned long)keepAlive_ * 1000) {
+                close();
+                return false;
+            }
+            if (!pingOutstanding_ && now - lastSent_ > (unsigned long)keepAlive_ * 1000) {
+                uint8_t packet[2] = {0xC0, 0x00};
+                if (!writePacket(packet, 2)) return false;
+                pingOutstanding_ = true;
+                pingSentAt_ = now;
+            }
+        }
+        return true;
+    }
+
+    // expiry: seconds the broker may hold the message for subscribers (MQTT 5 only, 0 = no limit)
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained = false, int qos = 0,
+                 uint32_t expiry = 0) {
+        if (!connected()) return false;
+        qos = qos > 0 ? 1 : 0;
+
+        // Known topic: alias only. New topic with a free alias: topic plus alias, which
+        // the broker remembers for this connection.
+        size_t topicLen = strlen(topic);
+        uint16_t alias = 0;
+        bool sendTopic = true;
+        if (version_ == 5) {
+            alias = findAlias(topic);
+            if (alias) {
+                sendTopic = false;
+            } else if (aliasCount_ < aliasMax_ && aliasCount_ < MQTT5_MAX_ALIASES && topicLen > 3) {
+                alias = aliasCount_ + 1;
+            }
+        }
+
+        uint8_t props[16];
+        size_t propLen = 0;
+        if (version_ == 5) {
+            if (expiry) {
+                props[propLen++] = MQTT5_PROP_MESSAGE_EXPIRY;
+                propLen += putUint32(props + propLen, expiry);
+            }
+            if (alias) {
+                props[propLen++] = MQTT5_PROP_TOPIC_ALIAS;
+                propLen += putUint16(props + propLen, alias);
+            }
+        }
+
+        size_t remaining = 2 + (sendTopic ? topicLen : 0) + (qos ? 2 : 0) + length;
+        if (version_ == 5) remaining += varintSize(propLen) + propLen;
+
+        uint16_t packetId = qos ? nextPacketId() : 0;
+        size_t pos = 0;
+        if (!startPacket(0x30 | (qos << 1) | (retained ? 1 : 0), remaining, pos)) return false;
+        pos += putString(wbuf_ + pos, sendTopic ? topic : "", sendTopic ? topicLen : 0);
+        if (qos) pos += putUint16(wbuf_ + pos, packetId);
+        if (version_ == 5) {
+            pos += putVarint(wbuf_ + pos, propLen);
+            memcpy(wbuf_ + pos, props, propLen);
+            pos += propLen;
+        }
+        memcpy(wbuf_ + pos, payload, length);
+        pos += length;
+        if (!writePacket(wbuf_, pos)) return false;
+
+        if (!sendTopic) {
+            aliasBytesSaved_ += topicLen - 3;   // the alias property costs 3 bytes
+        } else if (alias) {
+            aliasTopics_[aliasCount_++] = strdup(topic);
+        }
+        if (!qos) return true;
+        return waitFor(0x40, packetId);
+    }
+
+    bool publish(const char* topic, const char* payload, bool retained = false, int qos = 0, uint32_t expiry = 0) {
+        return publish(topic, (const uint8_t*)payload, strlen(payload), retained, qos, expiry);
+    }
+
+    bool subscribe(const char* topic, int qos = 0) {
+        if (!connected()) return false;
+        size_t topicLen = strlen(topic);
+        size_t remaining = 2 + (version_ == 5 ? 1 : 0) + 2 + topicLen + 1;
+        uint16_t packetId = nextPacketId();
+
+        size_t pos = 0;
+        if (!startPacket(0x82, remaining, pos)) return false;
+        pos += putUint16(wbuf_ + pos, packetId);
+        if (version_ == 5) wbuf_[pos++] = 0;   // no properties
+        pos += putString(wbuf_ + pos, topic, topicLen);
+        wbuf_[pos++] = qos > 0 ? 1 : 0;
+        if (!writePacket(wbuf_, pos)) return false;
+        return waitFor(0x90, packetId);
+    }
+
+#ifdef ARDUINO
+    bool publish(const String &topic, const String &payload, bool retained = false, int qos = 0, uint32_t expiry = 0) {
+        return publish(topic.c_str(), (const uint8_t*)payload.c_str(), payload.length(), retained, qos, expiry);
+    }
+
+    bool subscribe(const String &topic, int qos = 0) {
+        return subscribe(topic.c_str(), qos);
+    }
+#endif
+
+private:
+    Client* net_ = nullptr;
+    const char* host_ = nullptr;
+    int port_ = 1883;
+    MessageHandler handler_ = nullptr;
+    int keepAlive_ = 10;
+    bool cleanSession_ = true;
+
+    uint8_t* rbuf_;   // incoming packets; handlers get pointers into it
+    uint8_t* wbuf_;   // outgoing packets
+    size_t bufSize_;
+    char topic_[MQTT5_TOPIC_SIZE];
+
+    bool connected_ = false;
+    bool wantV5_ = true;      // setProtocolVersion()
+    bool preferV5_ = true;    // false while fallbackHost_ is in use
+    bool rejectedV5_ = false;
+    char fallbackHost_[MQTT5_HOST_SIZE] = {0};
+    int fallbackPort_ = 0;
+    uint8_t version_ = 5;
+    int connackCode_ = -1;
+    uint16_t packetId_ = 0;
+    unsigned long lastSent_ = 0;
+    bool pingOutstanding_ = false;
+    unsigned long pingSentAt_ = 0;
+
+    // Acknowledgements that arrived while waiting for a different one
+    uint16_t lateAcks_[4] = {0};
+    uint8_t lateAckPos_ = 0;
+
+    uint16_t aliasMax_ = 0;
+    uint8_t aliasCount_ = 0;
+    char* aliasTopics_[MQTT5_MAX_ALIASES] = {nullptr};
+
+    uint32_t bytesSent_ = 0;
+    uint32_t aliasBytesSaved_ = 0;
+
+    bool connectAs(uint8_t version, const char* clientId, const char* username, const char* password) {
+        close();
+        version_ = version;
+        rejectedV5_ = false;
+        if (!net_->connect(host_, port_)) return false;
+
+        size_t idLen = strlen(clientId);
+        size_t userLen = username ? strlen(username) : 0;
+        size_t passLen = password ? strlen(password) : 0;
+
+        // Properties: tell the broker our packet size limit; keep the session if asked
+        uint8_t props[16];
+        size_t propLen = 0;
+        if (version == 5) {
+            props[propLen++] = MQTT5_PROP_MAX_PACKET_SIZE;
+            propLen += putUint32(props + propLen, bufSize_);
+            if (!cleanSession_) {
+                props[propLen++] = MQTT5_PROP_SESSION_EXPIRY;
+                propLen += putUint32(props + propLen, 0xFFFFFFFF);
+            }
+        }
+
+        size_t remaining = 10 + 2 + idLen;
+        if (version == 5) remaining += varintSize(propLen) + propLen;
+        if (username) remaining += 2 + userLen;
+        if (password) remaining += 2 + passLen;
+
+        uint8_t flags = cleanSession_ ? 0x02 : 0x00;
+        if (username) flags |= 0x80;
+        if (password) flags |= 0x40;
+
+        size_t pos = 0;
+        if (!startPacket(0x10, remaining, pos)) return false;
+        pos += putString(wbuf_ + pos, "MQTT", 4);
+        wbuf_[pos++] = version;
+        wbuf_[pos++] = flags;
+        pos += putUint16(wbuf_ + pos, keepAlive_);
+        if (version == 5) {
+            pos += putVarint(wbuf_ + pos, propLen);
+            memcpy(wbuf_ + pos, props, propLen);
+            pos += propLen;
+        }
+        pos += putString(wbuf_ + pos, clientId, idLen);
+        if (username) pos += putString(wbuf_ + pos, username, userLen);
+        if (password) pos += putString(wbuf_ + pos, password, passLen);
+        if (!writePacket(wbuf_, pos)) return false;
+
+        connackCode_ = -1;
+        connected_ = true;   // lets readPacket() run; cleared again on failure
+        bool ok = waitFor(0x20, 0);
+        if (!ok || connackCode_ != 0) {
+            // Many 3.1.1 brokers drop the socket instead of answering; a
+            // timeout with the socket still open is not a rejection
+            bool dropped = connackCode_ == -1 && !net_->connected();
+            rejectedV5_ = version == 5 && (dropped || connackCode_ == 0x01 || connackCode_ == 0x84);
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        connected_ = false;
+        pingOutstanding_ = false;
+        for (uint8_t i = 0; i < aliasCount_; i++) {
+            free(aliasTopics_[i]);
+            aliasTopics_[i] = nullptr;
+        }
+        aliasCount_ = 0;
+        aliasMax_ = 0;
+        if (net_ && net_->connected()) net_->stop();
+    }
+
+    uint16_t findAlias(const char* topic) {
+        for (uint8_t i = 0; i < aliasCount_; i++) {
+            if (strcmp(aliasTopics_[i], topic) == 0) return i + 1;
+        }
+        return 0;
+    }
+
+    uint16_t nextPacketId() {
+        if (++packetId_ == 0) packetId_ = 1;
+        return packetId_;
+    }
+
+    // Wait for an ack of the given type (and packet id), handling other traffic meanwhile
+    bool waitFor(uint8_t type, uint16_t packetId) {
+        unsigned long start = millis();
+        while (millis() - start < MQTT5_COMMAND_TIMEOUT) {
+            for (uint8_t i = 0; i < 4; i++) {
+                if (packetId && lateAcks_[i] == packetId) {
+                    lateAcks_[i] = 0;
+                    return true;
+                }
+            }
+            if (!net_->connected() && net_->available() == 0) return false;
+            if (net_->available() > 0) {
+                int result = readPacket(MQTT5_COMMAND_TIMEOUT, type, packetId);
+                if (result < 0) return false;
+                if (result > 0) return result == 1;
+            } else {
+                delay(1);
+            }
+        }
+        return false;
+    }
+
+    // Read one packet. Returns 1/2 when it is the awaited ack (2 = rejected),
+    // 0 for any other packet and -1 on a protocol or network error.
+    int readPacket(unsigned long timeout, uint8_t awaitType = 0, uint16_t awaitId = 0) {
+        int header = readByte(timeout);
+        if (header < 0) return -1;
+
+        uint32_t length = 0;
+        for (int shift = 0; ; shift += 7) {
+            int b = readByte(timeout);
+            if (b < 0 || shift > 21) return -1;
+            length |= (uint32_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) break;
+        }
+
+        // Too large for the buffer: drain it and carry on
+        if (length > bufSize_) {
+            for (uint32_t i = 0; i < length; i++) {
+                if (readByte(timeout) < 0) return -1;
+            }
+            return 0;
+        }
+        for (uint32_t i = 0; i < length; i++) {
+            int b = readByte(timeout);
+            if (b < 0) return -1;
+            rbuf_[i] = (uint8_t)b;
+        }
+
+        uint8_t type = header & 0xF0;
+        switch (type) {
+            case 0x20:
+                return handleConnack(length, awaitType);
+            case 0x30:
+                return handlePublish(header, length) ? 0 : -1;
+            case 0x40:
+            case 0x90: {
+                if (length < 2) return -1;
+                uint16_t id = (rbuf_[0] << 8) | rbuf_[1];
+                // PUBACK reason follows the id (v5); SUBACK codes follow the properties
+                bool rejected = false;
+                if (type == 0x40) {
+                    rejected = version_ == 5 && length > 2 && rbuf_[2] >= 0x80;
+                } else {
+                    size_t p = 2;
+                    if (version_ == 5) p += skipProperties(p, length);
+                    rejected = p >= length || rbuf_[p] >= 0x80;
+                }
+                if (type == awaitType && id == awaitId) return rejected ? 2 : 1;
+                if (type == 0x40 && !rejected) {
+                    lateAcks_[lateAckPos_++ & 3] = id;
+                }
+                return 0;
+            }
+            case 0xD0:
+                pingOutstanding_ = false;
+                return 0;
+            case 0xE0:
+                // Server-initiated DISCONNECT (MQTT 5)
+                return -1;
+            default:
+                return 0;
+        }
+    }
+
+    int handleConnack(uint32_t length, uint8_t awaitType) {
+        if (length < 2) return -1;
+        connackCode_ = rbuf_[1];
+        if (version_ == 5 && length > 2) {
+            size_t p = 2;
+            uint32_t propLen = 0;
+            p += getVarint(p, length, propLen);
+            size_t end = p + propLen < length ? p + propLen : length;
+            while (p < end) {
+                uint8_t id = rbuf_[p++];
+                if (id == MQTT5_PROP_TOPIC_ALIAS_MAX && p + 2 <= end) {
+                    aliasMax_ = (rbuf_[p] << 8) | rbuf_[p + 1];
+                } else if (id == MQTT5_PROP_SERVER_KEEP_ALIVE && p + 2 <= end) {
+                    keepAlive_ = (rbuf_[p] << 8) | rbuf_[p + 1];
+                }
+                size_t n = propertySize(id, p, end);
+                if (n == 0) break;
+                p += n;
+            }
+        }
+        if (awaitType != 0x20) return 0;
+        return connackCode_ == 0 ? 1 : 2;
+    }
+
+    bool handlePublish(uint8_t header, uint32_t length) {
+        uint8_t qos = (header >> 1) & 0x03;
+        if (length < 2) return false;
+        size_t topicLen = (rbuf_[0] << 8) | rbuf_[1];
+        size_t p = 2 + topicLen;
+        if (p > length) return false;
+
+        size_t copy = topicLen < sizeof(topic_) - 1 ? topicLen : sizeof(topic_) - 1;
+        memcpy(topic_, rbuf_ + 2, copy);
+        topic_[copy] = '\0';
+
+        uint16_t packetId = 0;
+        if (qos > 0) {
+            if (p + 2 > length) return false;
+            packetId = (rbuf_[p] << 8) | rbuf_[p + 1];
+            p += 2;
+        }
+        if (version_ == 5) p += skipProperties(p, length);
+        if (p > length) return false;
+
+        // Payload sits at the end of the buffer; terminate it for String users
+        rbuf_[length] = '\0';
+        if (handler_) {
+            handler_(this, topic_, (char*)rbuf_ + p, length - p);
+        }
+
+        if (qos == 1) {
+            uint8_t ack[4] = {0x40, 0x02, (uint8_t)(packetId >> 8), (uint8_t)packetId};
+            return writePacket(ack, 4);
+        }
+        return true;
+    }
+
+    size_t skipProperties(size_t p, size_t length) {
+        uint32_t propLen = 0;
+        size_t n = getVarint(p, length, propLen);
+        return n + propLen;
+    }
+
+    // Size of one property value by identifier (MQTT 5, table 2-4)
+    size_t propertySize(uint8_t id, size_t p, size_t end) {
+        switch (id) {
+            case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+                return 1;
+            case 0x13: case 0x21: case 0x22: case 0x23:
+                return 2;
+            case 0x02: case 0x11: case 0x18: case 0x27:
+                return 4;
+            case 0x0B: {
+                uint32_t v;
+                return getVarint(p, end, v);
+            }
+            case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+                return p + 2 <= end ? 2 + ((rbuf_[p] << 8) | rbuf_[p + 1]) : 0;
+            case 0x26: {
+                if (p + 2 > end) return 0;
+                size_t keyLen = 2 + ((rbuf_[p] << 8) | rbuf_[p + 1]);
+                if (p + keyLen + 2 > end) return 0;
+                return keyLen + 2 + ((rbuf_[p + keyLen] << 8) | rbuf_[p + keyLen + 1]);
+            }
+            default:
+                return 0;
+        }
+    }
+
+    size_t getVarint(size_t p, size_t end, uint32_t &value) {
+        value = 0;
+        for (size_t i = 0; i < 4 && p + i < end; i++) {
+            value |= (uint32_t)(rbuf_[p + i] & 0x7f) << (7 * i);
+            if (!(rbuf_[p + i] & 0x80)) return i + 1;
+        }
+        return 1;
+    }
+
+    bool startPacket(uint8_t header, size_t remaining, size_t &pos) {
+        if (1 + varintSize(remaining) + remaining > bufSize_) return false;
+        wbuf_[0] = header;
+        pos = 1 + putVarint(wbuf_ + 1, remaining);
+        return true;
+    }
+
+    bool writePacket(const uint8_t* data, size_t len) {
+        if (net_->write(data, len) != len) {
+            close();
+            return false;
+        }
+        bytesSent_ += len;
+        lastSent_ = millis();
+        return true;
+    }
+
+    int readByte(unsigned long timeout) {
+        unsigned long start = millis();
+        while (net_->available() <= 0) {
+            if (!net_->connected() || millis() - start > timeout) return -1;
+            delay(1);
+        }
+        return net_->read();
+    }
+
+    static size_t varintSize(size_t v) {
+        return v < 128 ? 1 : v < 16384 ? 2 : v < 2097152 ? 3 : 4;
+    }
+
+    static size_t putVarint(uint8_t* out, size_t v) {
+        size_t n = 0;
+        do {
+            uint8_t b = v & 0x7f;
+            v >>= 7;
+            out[n++] = v ? (b | 0x80) : b;
+        } while (v);
+        return n;
+    }
+
+    static size_t putUint16(uint8_t* out, uint16_t v) {
+        out[0] = v >> 8;
+        out[1] = v & 0xff;
+        return 2;
+    }
+
+    static size_t putUint32(uint8_t* out, uint32_t v) {
+        for (int i = 0; i < 4; i++) out[i] = (v >> (24 - 8 * i)) & 0xff;
+        return 4;
+    }
+
+    static size_t putString(uint8_t* out, const char* s, size_t len) {
+        putUint16(out, len);
+        memcpy(out + 2, s, len);
+        return 2 + len;
+    }
+};
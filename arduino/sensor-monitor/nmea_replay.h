@@ -0,0 +1,98 @@
+// Pacing for recorded NMEA traces.
+//
+// A trace is plain NMEA text exactly as it came off the GPS UART, so logs
+// from the capture mode and from any other logger can be replayed. Timing
+// is taken from the UTC time field of RMC/GGA/GLL/ZDA sentences: a
+// sentence is due when the trace clock has advanced by (now - start) *
+// speed. Sentences without a time field are due together with the last
+// timed one. It has no Arduino dependencies and builds on the host
+// (see tools/nmea_bench.cpp).
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define NMEA_DAY_MS 86400000L
+
+class NmeaReplayPacer {
+public:
+    void begin(uint16_t speed) {
+        speed_ = speed ? speed : 1;
+        started_ = false;
+        traceStart_ = 0;
+        lastTime_ = 0;
+        dayOffset_ = 0;
+        lastDue_ = 0;
+    }
+
+    // Milliseconds after replay start at which this sentence should be fed
+    uint32_t dueAt(const char* sentence) {
+        long t = sentenceTime(sentence);
+        if (t < 0) {
+            return lastDue_;
+        }
+        if (!started_) {
+            started_ = true;
+            traceStart_ = t;
+            lastTime_ = t;
+        }
+        // Time of day wrapped: the trace crossed midnight UTC
+        if (t + dayOffset_ < lastTime_ - NMEA_DAY_MS / 2) {
+            dayOffset_ += NMEA_DAY_MS;
+        }
+        lastTime_ = t + dayOffset_;
+        lastDue_ = (uint32_t)((lastTime_ - traceStart_) / speed_);
+        return lastDue_;
+    }
+
+    uint16_t speed() const { return speed_; }
+
+    // Trace time covered so far, in milliseconds
+    uint32_t traceElapsed() const { return started_ ? (uint32_t)(lastTime_ - traceStart_) : 0; }
+
+    // UTC time of day of a sentence in ms, or -1 if it carries none
+    static long sentenceTime(const char* s) {
+        if (s[0] != '$' || strlen(s) < 7) return -1;
+        const char* type = s + 3;   // skip "$" and the talker id
+        int field;
+        if (strncmp(type, "RMC", 3) == 0 || strncmp(type, "GGA", 3) == 0 || strncmp(type, "ZDA", 3) == 0) {
+            field = 1;
+        } else if (strncmp(type, "GLL", 3) == 0) {
+            field = 5;
+        } else {
+            return -1;
+        }
+
+        const char* p = s;
+        for (int i = 0; i < field; i++) {
+            p = strchr(p, ',');
+            if (!p) return -1;
+            p++;
+        }
+
+        // hhmmss[.sss]
+        long value = 0;
+        for (int i = 0; i < 6; i++) {
+            if (p[i] < '0' || p[i] > '9') return -1;
+            value = value * 10 + (p[i] - '0');
+        }
+        long ms = ((value / 10000) * 3600 + (value / 100 % 100) * 60 + value % 100) * 1000;
+        if (p[6] == '.') {
+            long scale = 100;
+            for (int i = 7; p[i] >= '0' && p[i] <= '9' && scale > 0; i++) {
+                ms += (p[i] - '0') * scale;
+                scale /= 10;
+            }
+        }
+        return ms;
+    }
+
+private:
+    uint16_t speed_ = 1;
+    bool started_ = false;
+    long traceStart_ = 0;
+    long lastTime_ = 0;
+    long dayOffset_ = 0;
+    uint32_t lastDue_ = 0;
+};
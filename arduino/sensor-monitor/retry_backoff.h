@@ -0,0 +1,87 @@
+// Capped exponential backoff with decorrelated jitter for reconnects.
+//
+// A broker or access point restart drops every device in the same instant.
+// Retrying on a fixed delay keeps the fleet in lockstep, so each round hits
+// the broker as one burst of CONNECTs and most of them time out together.
+// Decorrelated jitter draws each wait between the base and three times the
+// previous wait, up to the cap: the delay grows like an exponential backoff,
+// but every device lands somewhere else in a widening range and the bursts
+// dissolve within a few rounds.
+//
+// The delay starts over only after the link has stayed up for stableMs, so a
+// broker that accepts sessions and sheds them again under load keeps its
+// clients backed off. The random source is a seeded xorshift (esp_random()
+// on the ESP32); times are passed in, so it has no Arduino dependencies and
+// builds on the host (see tools/reconnect_storm.cpp).
+
+#pragma once
+
+#include <stdint.h>
+
+#define RETRY_WIFI_BASE_MS 1000
+#define RETRY_WIFI_CAP_MS 30000
+#define RETRY_MQTT_BASE_MS 1000
+#define RETRY_MQTT_CAP_MS 60000
+#define RETRY_STABLE_MS 60000      // up this long before the delay starts over
+
+class RetryBackoff {
+public:
+    uint32_t retries = 0;      // waits handed out
+    uint32_t resets = 0;       // back to the base delay after a stable stretch
+    uint32_t waitedMs = 0;     // sum of the waits
+    uint16_t streak = 0;       // retries since the link was last stable
+    uint16_t maxStreak = 0;
+
+    RetryBackoff(uint32_t baseMs, uint32_t capMs, uint32_t stableMs)
+        : baseMs_(baseMs), capMs_(capMs), stableMs_(stableMs), delayMs_(baseMs) {}
+
+    void seed(uint32_t seed) { state_ = seed ? seed : 0x9e3779b9UL; }
+
+    // After a failed attempt or a dropped link: ms to wait before the next try
+    uint32_t next() {
+        uint64_t high = (uint64_t)delayMs_ * 3;
+        if (high > capMs_) high = capMs_;
+        if (high < baseMs_) high = baseMs_;
+        delayMs_ = baseMs_ + random() % (uint32_t)(high - baseMs_ + 1);
+
+        up_ = false;
+        retries++;
+        waitedMs += delayMs_;
+        if (streak < 0xffff) streak++;
+        if (streak > maxStreak) maxStreak = streak;
+        return delayMs_;
+    }
+
+    // The link state, every loop pass
+    void update(uint32_t now, bool up) {
+        if (!up) {
+            up_ = false;
+        } else if (!up_) {
+            up_ = true;
+            upSince_ = now;
+        } else if (streak > 0 && now - upSince_ >= stableMs_) {
+            delayMs_ = baseMs_;
+            streak = 0;
+            resets++;
+        }
+    }
+
+    // The last wait, or the base before the first one
+    uint32_t current() const { return delayMs_; }
+
+private:
+    uint32_t random() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_;
+    }
+
+    uint32_t baseMs_;
+    uint32_t capMs_;
+    uint32_t stableMs_;
+    uint32_t delayMs_;
+    uint32_t state_ = 0x9e3779b9UL;
+    bool up_ = false;
+    uint32_t upSince_ = 0;
+};
@@ -2,8 +2,29 @@
 #include <MQTT.h>
 #include <ArduinoJson.h>
 #include <DHT.h>
+#include <Wire.h>
 #include <LiquidCrystal_I2C.h>
 #include <TinyGPS++.h>
+#include <Preferences.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include "delta_patch.h"
+#include <time.h>
+#include <sys/time.h>
+#include <esp_sntp.h>
+#include <LittleFS.h>
+#include "nmea_replay.h"
+#include "gps_config.h"
+#include "sensor_registry.h"
+#include "lz4_block.h"
+#include "broker_pool.h"
+#include "geofence.h"
+#include "geohash.h"
+#include "history_log.h"
+#include "discovery_pacer.h"
+#include "retry_backoff.h"
+#include "sensor_window.h"
+#include "lcd_frame.h"
 
 // DHT22 Configuration
 #define DHTPIN 15
@@ -11,13 +32,63 @@
 DHT dht(DHTPIN, DHTTYPE);
 
 // LCD Configuration
-LiquidCrystal_I2C lcd(0x27, 16, 2);
+#define LCD_ADDRESS 0x27
+#define LCD_COLS 16
+#define LCD_ROWS 2
+LiquidCrystal_I2C lcd(LCD_ADDRESS, LCD_COLS, LCD_ROWS);
+
+// LCD shadow framebuffer: only cells that differ from what the panel shows
+// are sent over I2C
+LcdFrame<TwoWire, LCD_COLS, LCD_ROWS> lcdFrame(Wire, LCD_ADDRESS);
 
 // GPS Configuration - Using Hardware Serial
 HardwareSerial gpsSerial(2);
 static const uint32_t GPSBaud = 9600;
 TinyGPSPlus gps;
 
+// GPS receiver configuration: RMC/GGA only, faster UART, optional higher nav rate
+#define GPS_TARGET_BAUD 115200
+#ifndef GPS_NAV_RATE_HZ
+#define GPS_NAV_RATE_HZ 1            // 5-10 for vehicles
+#endif
+#define GPS_REPLY_TIMEOUT 500
+GpsReceiverType gpsReceiver = GPS_RECEIVER_UNKNOWN;
+uint32_t gpsBaud = GPSBaud;
+bool gpsConfigVerified = false;
+uint32_t gpsUartBytes = 0;           // UART bytes and fixes since boot, for bytes per fix
+uint32_t gpsUartFixes = 0;
+
+// Receiver setup runs a step per loop pass (one listen or command/ack wait
+// at a time) and holds the UART meanwhile, so MQTT and sampling keep going
+#define GPS_SETUP_SETTLE 50          // ms of noise ignored after a baud change
+#define GPS_SETUP_BAUD_WAIT 100      // ms for the receiver to switch baud
+enum GpsSetupStep {
+    GPS_SETUP_IDLE,
+    GPS_SETUP_FIND_FAST,             // listening at GPS_TARGET_BAUD
+    GPS_SETUP_FIND_DEFAULT,          // ... then at GPSBaud
+    GPS_SETUP_PROBE_UBLOX,           // MON-VER poll
+    GPS_SETUP_PROBE_MTK,             // PMTK605 query
+    GPS_SETUP_COMMANDS,              // sentence set and nav rate, one acknowledged command at a time
+    GPS_SETUP_BAUD,                  // baud change sent
+    GPS_SETUP_VERIFY_FAST,           // listening at GPS_TARGET_BAUD
+    GPS_SETUP_VERIFY_OLD             // ... or at the rate before the change
+};
+GpsSetupStep gpsSetupStep = GPS_SETUP_IDLE;
+unsigned long gpsSetupAt = 0;
+unsigned long gpsSetupDuration = 0;  // of the listen in progress; 0 while waiting for a reply
+uint8_t gpsSetupCommand = 0;
+bool gpsSetupAccepted = true;
+uint32_t gpsSetupPreviousBaud = GPSBaud;
+NmeaSentenceStats gpsSetupStats;
+GpsReplyScanner gpsSetupScanner;
+
+// Production profile: -DPRODUCTION_BUILD=1 (build.bat production) compiles
+// out the geofence-testing simulation and the boot-time waits that are only
+// there for someone watching the serial monitor or the LCD
+#ifndef PRODUCTION_BUILD
+#define PRODUCTION_BUILD 0
+#endif
+
 // Pin Definitions
 #define PHOTORESISTOR_PIN 32
 #define POTENTIOMETER_PIN 34
@@ -28,15 +99,121 @@ const char ssid[] = "Wokwi-GUEST";
 const char pass[] = "";
 
 // MQTT Configuration
-const char* mqtt_broker = "broker.emqx.io";
-const int mqtt_port = 1883;
+// Build with -DMQTT_USE_TLS=1 to connect over TLS (port 8883). The broker
+// CA is required; -DMQTT_TLS_INSECURE=1 explicitly skips server verification
+// and is refused in production builds.
+#ifndef MQTT_USE_TLS
+#define MQTT_USE_TLS 0
+#endif
+#ifndef MQTT_TLS_INSECURE
+#define MQTT_TLS_INSECURE 0
+#endif
+#if MQTT_TLS_INSECURE && PRODUCTION_BUILD
+#error "MQTT_TLS_INSECURE is for bench testing; set mqtt_ca_cert for production builds"
+#endif
+// MQTT 5 (topic aliases, message expiry) falling back to 3.1.1 at runtime;
+// 0 builds with arduino-mqtt, which only speaks 3.1.1
+#ifndef MQTT_USE_V5
+#define MQTT_USE_V5 1
+#endif
+#define MQTT_TELEMETRY_EXPIRY 300    // seconds queued sensor/GPS data stays useful
+// LZ4-compress large payloads; -DMQTT_COMPRESS=0 drops the 6 KB of buffers
+#ifndef MQTT_COMPRESS
+#define MQTT_COMPRESS 1
+#endif
+#define MQTT_COMPRESS_THRESHOLD 512  // bytes; smaller payloads gain little
+#define MQTT_COMPRESSED_MARKER 0x04  // first byte of a compressed payload, never valid JSON
+
+const char* mqtt_broker = "broker.emqx.io";   // used until config/brokers pushes a list
 const char* mqtt_username = "mqttuser";
 const char* mqtt_password = "12345678";
 
+#if MQTT_USE_TLS
+#include "tls_session_client.h"
+const int mqtt_port = 8883;
+// Broker CA certificate (PEM)
+const char mqtt_ca_cert[] = "";
+static_assert(sizeof(mqtt_ca_cert) > 1 || MQTT_TLS_INSECURE,
+              "MQTT_USE_TLS needs mqtt_ca_cert (or -DMQTT_TLS_INSECURE=1 to skip server verification)");
+TlsSessionClient net;
+#else
+const int mqtt_port = 1883;
 WiFiClient net;
-MQTTClient client(4096); 
+#endif
+#if MQTT_USE_V5
+#include "mqtt5_client.h"
+typedef Mqtt5Client MqttSession;
+#else
+typedef MQTTClient MqttSession;
+#endif
+MqttSession client(4096);
+
+// Broker failover: ordered list from config/brokers, probed for latency
+#define BROKER_PROBE_INTERVAL 300000  // ms between latency probes of all brokers
+#define BROKER_PROBE_TIMEOUT 1500     // ms per TCP connect probe
+BrokerPool brokers;
+WiFiClient probeNet;
+bool brokerReconnectPending = false;  // leave the active broker at the next loop
+bool brokerFailed = false;            // ... because it stopped taking publishes
+                                      // (a lost session alone does not count)
+unsigned long lastBrokerProbe = 0;
+
+// Payload compression: [MQTT_COMPRESSED_MARKER][raw length LE16][LZ4 block]
+bool compressionEnabled = true;
+#if MQTT_COMPRESS
+uint8_t compressBuffer[4096];
+uint16_t compressTable[LZ4_HASH_SIZE];
+#endif
+uint32_t compressedMessages = 0;
+uint32_t compressRawBytes = 0;
+uint32_t compressSentBytes = 0;
+uint32_t compressMicros = 0;
+
+// WiFi fast-reconnect cache (persisted in NVS)
+Preferences wifiPrefs;
+uint8_t cachedBssid[6] = {0};
+int32_t cachedChannel = 0;
+uint32_t cachedIp = 0;
+uint32_t cachedGateway = 0;
+uint32_t cachedSubnet = 0;
+uint32_t cachedDns = 0;
+bool wifiCacheValid = false;
+bool wifiFastJoinUsed = false;
+const unsigned long WIFI_FAST_JOIN_TIMEOUT = 1500;   // ms before falling back to full scan
+const unsigned long WIFI_FULL_SCAN_TIMEOUT = 15000;  // ms per full-scan attempt
+
+// Connection timing (ms) of the last connect
+volatile unsigned long wifiBeginAt = 0;
+volatile unsigned long wifiAssocMs = 0;
+volatile unsigned long wifiDhcpMs = 0;
+unsigned long mqttConnectMs = 0;
+
+// Boot path (ms since the app started): link up, broker up, first telemetry
+// out. Reported in every status from the first one on.
+unsigned long bootWiFiMs = 0;
+unsigned long bootMqttMs = 0;
+unsigned long bootFirstPublishMs = 0;
+// GPS receiver setup (2.4-6 s of listening and reply timeouts, spread over
+// loop passes) and the first broker probe wait until the first readings are
+// out, or this long without a broker
+const unsigned long BOOT_DEFER_MAX_MS = 30000;
+bool bootDeferredPending = true;
+bool wifiJoinStarted = false;            // a join is in progress
+bool wifiJoinFast = false;               // ... with the cached BSSID and lease
+
+// Waits between failed WiFi joins and MQTT connects, also after a dropped
+// session, so a fleet that lost its broker together does not return in step
+RetryBackoff wifiBackoff(RETRY_WIFI_BASE_MS, RETRY_WIFI_CAP_MS, RETRY_STABLE_MS);
+RetryBackoff mqttBackoff(RETRY_MQTT_BASE_MS, RETRY_MQTT_CAP_MS, RETRY_STABLE_MS);
+
+// The waits are deadlines checked from loop(), so sampling, history, GPS
+// parsing, alerts and the LCD carry on while a link is down
+bool wifiRetryPending = false;
+unsigned long wifiRetryAt = 0;
+bool mqttRetryPending = false;
+unsigned long mqttRetryAt = 0;
+
 unsigned long lastMillis = 0;
-unsigned long lastDiscovery = 0;
 unsigned long lastLcdUpdate = 0;
 unsigned long lastGpsUpdate = 0;
 
@@ -59,15 +236,71 @@ double latitude = 0.0;
 double longitude = 0.0;
 double altitude = 0.0;
 double speed_kmh = 0.0;
+double gpsCourse = NAN;          // degrees true, NAN when the receiver has none
 int satellites = 0;
 bool gpsValid = false;
 String gpsTimestamp = "";
 
+// Motion-aware GPS reporting: while moving, publish on distance travelled or
+// heading change; while parked, only a slow heartbeat. Disabled via
+// config/sensors "gps_motion", which restores the fixed publish interval.
+#define GPS_MOVING_KMH 3.0               // slower than this counts as parked
+#define GPS_REPORT_DISTANCE 50.0         // meters from the last reported fix
+#define GPS_REPORT_HEADING 15.0          // degrees of course change, only when moving
+#define GPS_MIN_REPORT_GAP 1000          // ms between reports, whatever triggers them
+#define GPS_MOVING_HEARTBEAT 60000       // longest gap while moving slowly
+#define GPS_PARKED_HEARTBEAT 300000      // longest gap while parked
+#define GPS_GEOHASH_PRECISION 9          // ~4.8 m cells; the server indexes fences on a prefix
+enum GpsTrigger {
+    GPS_TRIGGER_NONE,
+    GPS_TRIGGER_FIRST,
+    GPS_TRIGGER_DISTANCE,
+    GPS_TRIGGER_HEADING,
+    GPS_TRIGGER_STOPPED,
+    GPS_TRIGGER_HEARTBEAT,
+    GPS_TRIGGER_INTERVAL,                // fixed interval, motion mode off
+    GPS_TRIGGER_COUNT
+};
+const char* const GPS_TRIGGER_NAMES[GPS_TRIGGER_COUNT] = {"none", "first", "distance", "heading", "stopped", "heartbeat", "interval"};
+bool gpsMotionAdaptive = true;
+bool gpsReported = false;
+double gpsReportLat = 0.0;
+double gpsReportLng = 0.0;
+double gpsReportCourse = NAN;
+bool gpsReportMoving = false;
+GpsTrigger gpsLastTrigger = GPS_TRIGGER_NONE;
+uint32_t gpsTriggerCounts[GPS_TRIGGER_COUNT] = {0};
+
+// Wall clock: set by SNTP, disciplined by GPS time when there is a fix
+#define CLOCK_VALID_AFTER 1700000000L    // earlier epochs mean the clock was never set
+#define GPS_CLOCK_RESYNC 600000          // re-apply GPS time at most every 10 minutes
+enum ClockSource { CLOCK_NONE, CLOCK_SNTP, CLOCK_GPS };
+ClockSource clockSource = CLOCK_NONE;
+unsigned long lastClockSync = 0;
+
+// Outbound message stamping: per-topic sequence numbers restart with every
+// boot, so the random boot id lets the server tell a reboot from loss.
+enum OutboundTopic {
+    OUT_DATA,
+    OUT_GPS,
+    OUT_STATUS,
+    OUT_DISCOVERY,
+    OUT_CONTROL_RESPONSE,
+    OUT_ALERTS,
+    OUT_OTA_PROGRESS,
+    OUT_HISTORY,
+    OUT_TOPIC_COUNT
+};
+uint32_t outboundSeq[OUT_TOPIC_COUNT] = {0};
+uint32_t bootId = 0;
+
+#if !PRODUCTION_BUILD
 // Geofence testing variables
 bool testGeofencing = true;
 bool generateInsideGeofence = true;  // Start with inside
 unsigned long lastGeofenceToggle = 0;
 const unsigned long geofenceToggleInterval = 120000;  // 2 minutes
+#endif
 
 // Xorafi 1 polygon coordinates (Colorado)
 const double XORAFI_COORDS[][2] = {
@@ -79,6 +312,14 @@ const double XORAFI_COORDS[][2] = {
 };
 const int XORAFI_COORD_COUNT = 5;
 
+// Fences compiled once in setup(); the server runs the same geofence.h.
+// Alert rules name a fence by its id.
+const int32_t XORAFI_FENCE_ID = 1;
+Geofence fenceTable[1];
+GeofenceEdge fenceEdges[8];
+GeofenceSet fences;
+
+#if !PRODUCTION_BUILD
 // Xorafi 1 bounding box for inside generation
 const double XORAFI_MIN_LAT = 39.495387;
 const double XORAFI_MAX_LAT = 39.529577;
@@ -89,45 +330,385 @@ const double XORAFI_MAX_LNG = -107.653999;
 const double SF_BASE_LAT = 37.7749;
 const double SF_BASE_LNG = -122.4194;
 const double RADIUS_METERS = 1000.0;
+#endif
 
-bool useSimulatedGPS = false;
+bool useSimulatedGPS = false;        // never set in production builds
 unsigned long lastLocationChange = 0;
 
-// Calibration offsets
+// NMEA trace replay and capture (LittleFS on the spiffs partition)
+#define GPS_CAPTURE_MAX_BYTES 262144
+#define GPS_REPLAY_MAX_LINES 200     // per loop pass, keeps MQTT serviced at 1000x
+bool gpsFsMounted = false;
+bool gpsReplayActive = false;
+bool gpsReplayLoop = false;
+bool gpsReplayResumeSim = false;
+File gpsReplayFile;
+NmeaReplayPacer gpsReplayPacer;
+char gpsReplayLine[100];             // NMEA sentences are at most 82 characters
+bool gpsReplayPending = false;
+uint32_t gpsReplayDue = 0;
+unsigned long gpsReplayStart = 0;
+uint32_t gpsReplaySentences = 0;
+uint32_t gpsReplayFixes = 0;
+uint32_t gpsReplayChecksumBase = 0;
+bool gpsCaptureActive = false;
+File gpsCaptureFile;
+uint8_t gpsCaptureBuffer[256];
+size_t gpsCaptureLen = 0;
+uint32_t gpsCaptureBytes = 0;
+uint32_t gpsCaptureLimit = GPS_CAPTURE_MAX_BYTES;
+
+// Full-resolution sample history (history_log.h) in a fixed-size LittleFS
+// file next to the traces; LittleFS levels the wear underneath. Ranges are
+// requested on history/request and streamed back on history/data, one chunk
+// per loop pass so MQTT stays serviced.
+#define HISTORY_FILE "/history.bin"
+#define HISTORY_SECTORS 127              // 508 KB, ~43k samples; not a multiple of 256
+#define HISTORY_FLUSH_INTERVAL 30000     // ms; a reset loses at most this much
+#define HISTORY_CHUNK_RECORDS 128        // per history/data message
+bool historyReady = false;
+File historyFile;
+HistorySector historyIndex[HISTORY_SECTORS];
+unsigned long lastHistoryFlush = 0;
+bool historyQueryActive = false;
+String historyRequestId = "";
+HistoryCursor historyCursor;
+uint32_t historyFieldMask = 0;
+uint32_t historyMaxRecords = 0;
+uint32_t historySent = 0;
+uint16_t historyChunk = 0;
+uint32_t historyGpsFixTime = 0xffffffff;   // gps.time of the last logged fix
+HistoryRecord historyChunkBuffer[HISTORY_CHUNK_RECORDS];
+
+// Calibration offsets (persisted in NVS)
 float tempOffset = 0.0;
 float humOffset = 0.0;
 
+// Sensor registry: one row per published value. Reading, the data payloads,
+// discovery, the LCD sensor page and the schedule channels with their
+// default intervals are generated from it at compile time (see
+// sensor_registry.h), so a new sensor is a sample function and a row here.
+// Rows are the compact telemetry order: bump SENSOR_SCHEMA_VERSION whenever
+// one is added, removed or reordered. Channels are numbered in order of
+// first appearance, which is also the order schedules are stored in NVS.
+#define SENSOR_SCHEMA_VERSION 1
+
+// The DHT22 needs 2 s between reads; faster ones return the previous
+// reading or fail, and would be aggregated as if they were new
+const unsigned long DHT_MIN_SAMPLE_INTERVAL = 2000;
+const unsigned long MIN_SAMPLE_INTERVAL = 1000;
+
+void sampleTemperature();
+void sampleHumidity();
+void sampleLight();
+void samplePotentiometer();
+
+constexpr SensorDef SENSOR_ROWS[] = {
+    // type            name             unit       acc dec channel sample publish min (ms)                  sampler              value                                                      lcd
+    {"gps_latitude",  "GPS Latitude",  "degrees", 95, 6, "gps",     0, 15000, 0,                       nullptr,             []() -> double { return gpsValid ? latitude : NAN; },      nullptr},
+    {"gps_longitude", "GPS Longitude", "degrees", 95, 6, "gps",     0, 15000, 0,                       nullptr,             []() -> double { return gpsValid ? longitude : NAN; },     nullptr},
+    {"gps_altitude",  "GPS Altitude",  "meters",  90, 1, "gps",     0, 15000, 0,                       nullptr,             []() -> double { return gpsValid ? altitude : NAN; },      nullptr},
+    {"temperature",   "Temperature",   "°C",      98, 2, nullptr, 2000, 60000, DHT_MIN_SAMPLE_INTERVAL, sampleTemperature,   []() -> double { return temperature == -999 ? NAN : temperature; }, "T:%.1fC"},
+    {"humidity",      "Humidity",      "%",       95, 1, nullptr, 2000, 60000, DHT_MIN_SAMPLE_INTERVAL, sampleHumidity,      []() -> double { return humidity == -1 ? NAN : humidity; },  "H:%.1f%%"},
+    {"light",         "Light Level",   "percent", 90, 0, nullptr, 3000,     0, MIN_SAMPLE_INTERVAL,     sampleLight,         []() -> double { return lightLevel; },                     "L:%.0f%%"},
+    {"potentiometer", "Potentiometer", "percent", 99, 0, nullptr, 3000,     0, MIN_SAMPLE_INTERVAL,     samplePotentiometer, []() -> double { return potValue; },                       "P:%.0f%%"},
+};
+
+constexpr auto SENSORS = sensorRegistry(SENSOR_ROWS);
+constexpr size_t SENSOR_FIELD_COUNT = SENSORS.size();
+constexpr size_t SENSOR_WINDOW_FIELDS = sensorSampledCount(SENSOR_ROWS);
+static_assert(sensorRegistryValid(SENSOR_ROWS), "malformed row in SENSOR_ROWS");
+static_assert(SENSOR_FIELD_COUNT <= 32, "history field masks are 32 bits");
+
+// Schedule channels, numbered by the registry; GPS is the one the sketch names
+constexpr int SENSOR_COUNT = sensorChannelCount(SENSOR_ROWS);
+constexpr int SENSOR_GPS = sensorChannelOf(SENSOR_ROWS, "gps");
+static_assert(SENSOR_COUNT < 32, "channel masks are 32 bits wide");
+static_assert(SENSOR_GPS < SENSOR_COUNT, "SENSOR_ROWS has no gps channel");
+const uint32_t SENSOR_MASK_ALL = (1UL << SENSOR_COUNT) - 1;
+constexpr uint32_t SENSOR_CHANNEL_LAYOUT = sensorChannelLayout(SENSOR_ROWS);
+constexpr auto SENSOR_SAMPLERS = sensorChannelSamplers<SENSOR_COUNT>(SENSOR_ROWS);
+
+// Per-sensor sampling/publish schedule (ms, persisted in NVS); defaults
+// from the registry
+struct SensorSchedule {
+    const char* sensorType;
+    unsigned long sampleInterval;   // 0 = every loop (stream-driven)
+    unsigned long publishInterval;  // 0 = local only, never published
+    bool enabled;
+    unsigned long lastSample;
+    unsigned long lastPublish;
+};
+
+SensorSchedule sensorSchedule[SENSOR_COUNT];
+
+// NVS layout of one schedule entry
+struct StoredSchedule {
+    uint32_t sampleInterval;
+    uint32_t publishInterval;
+    uint8_t enabled;
+};
+
+Preferences sensorPrefs;
+
+// Windowed aggregation: streaming min/max/mean/variance per channel (Welford)
+SensorAccumulator sensorWindow[SENSOR_COUNT];
+bool aggregationEnabled = true;
+
+// Telemetry dictionary: discovery publishes the sensor registry (SENSORS)
+// with SENSOR_SCHEMA_VERSION, compact
+// data messages then carry only [schema_version, t, v0, v1, ...] followed
+// by the window summary of each sampled row: min, max, stddev, samples
+bool telemetryDictionary = true;
+
+// Alert rules pushed over config/rules, preparsed into a fixed table
+enum AlertRuleKind {
+    RULE_ABOVE,          // value > threshold
+    RULE_BELOW,          // value < threshold
+    RULE_RATE_ABOVE,     // |d(value)/dt| > threshold per second
+    RULE_OUTSIDE_FENCE   // GPS fix outside fence fenceId
+};
+
+struct AlertRule {
+    char id[16];
+    uint8_t channel;
+    uint8_t kind;
+    float threshold;
+    int32_t fenceId;               // RULE_OUTSIDE_FENCE: id in the fence table
+    uint8_t fenceIndex;            // ... and its slot there, resolved when parsed
+    unsigned long holdMs;          // condition must hold this long before firing
+    unsigned long conditionSince;  // 0 = condition currently false
+    bool active;
+    float lastValue;
+    unsigned long lastValueAt;
+};
+
+const int MAX_ALERT_RULES = 16;
+AlertRule alertRules[MAX_ALERT_RULES];
+int alertRuleCount = 0;
+
+// Adaptive duty cycle (thresholds pushed over config/power, persisted in NVS).
+// Sample and publish intervals stretch as the battery drains; on a weak link
+// publish intervals stretch further so each message carries a longer window.
+// Tiers only recover once the value clears its threshold by the hysteresis.
+struct PowerPolicy {
+    bool enabled;
+    float batteryLow;          // %
+    float batteryCritical;
+    uint8_t lowScale;          // interval multiplier at each battery tier
+    uint8_t criticalScale;
+    float batteryHysteresis;
+    float rssiWeak;            // dBm, averaged
+    float rssiPoor;
+    uint8_t weakBatch;         // extra publish interval multiplier at each link tier
+    uint8_t poorBatch;
+    float rssiHysteresis;
+};
+
+PowerPolicy powerPolicy = {true, 40, 15, 2, 4, 5, -75, -85, 2, 4, 5};
+uint8_t batteryTier = 0;          // 0 = full rate, 1 = low, 2 = critical
+uint8_t linkTier = 0;             // 0 = good, 1 = weak, 2 = poor
+uint8_t powerSampleScale = 1;
+uint16_t powerPublishScale = 1;
+float rssiAverage = NAN;
+uint32_t powerChanges = 0;
+unsigned long powerChangedAt = 0;
+unsigned long powerReducedMs = 0;  // time spent below full rate
+uint32_t samplesSaved = 0;
+uint32_t publishesSaved = 0;
+
+// Connected low-power mode (config/lowpower, persisted in NVS), for mains
+// powered but heat-sensitive enclosures. The MQTT session stays up while the
+// modem sleeps between DTIM beacons, the CPU runs at a lower clock unless a
+// handshake, OTA or trace replay needs it, and the keepalive stretches to just
+// under the broker's (or NAT's) idle timeout so pings rarely wake the radio.
+// Off pins the radio awake so inbound commands see no beacon delay.
+#define FULL_CPU_MHZ 240
+#define DEFAULT_KEEPALIVE 60             // s
+#define LOWPOWER_LOOP_DELAY 50           // ms; the GPS UART buffer holds ~90 ms at 115200
+struct LowPowerMode {
+    bool enabled;
+    uint16_t idleMhz;          // 80, 160 or 240
+    uint16_t keepAlive;        // s
+};
+
+LowPowerMode lowPower = {false, 80, 240};
+unsigned long lowPowerSince = 0;
+unsigned long lowPowerMs = 0;            // time in the mode before lowPowerSince
+bool sessionSettingsChanged = false;
+unsigned long loopWakeAt = 0;            // us, end of the last loop delay
+bool wakePublishPending = false;
+uint32_t wakePublishes = 0;
+float wakeToPublishAvg = 0;              // ms from loop wake to the first publish of that pass
+unsigned long wakeToPublishMax = 0;      // us
+uint32_t commandsReceived = 0;
+uint32_t commandsMissed = 0;             // gaps in the server's batch sequence
+uint32_t lastCommandSeq = 0;
+uint32_t sessionDrops = 0;
+
+// Discovery answers (config/discovery, persisted in NVS): broadcasts are
+// answered at this device's offset into the window, any answer at most once
+// per min_interval. A broadcast may carry its own window, sized by the server
+// to the fleet.
+#define DISCOVERY_REPUBLISH_INTERVAL 300000
+DiscoveryPacer discovery;
+uint32_t discoveryWindowMs = DISCOVERY_WINDOW_MS;
+
+// Command batches on devices/<id>/commands, acknowledged once per request_id
+const int MAX_BATCH_COMMANDS = 16;
+bool commandBatchActive = false;
+String commandBatchControl = "";
+String commandBatchValue = "";
+String lastCommandRequestId = "";
+String lastCommandAck = "";
+bool restartRequested = false;
+
+// Delta OTA: patch streamed over MQTT, applied into the inactive app partition
+const uint32_t OTA_ACK_INTERVAL = 16384;   // bytes between progress acks
+bool otaInProgress = false;
+String otaVersion = "";
+uint32_t otaPatchSize = 0;
+uint32_t otaReceived = 0;
+uint32_t otaLastAck = 0;
+unsigned long otaLastNack = 0;
+const esp_partition_t* otaSourcePartition = nullptr;
+
 // Function Declarations
-void connect();
+bool connect();
+void scheduleMqttRetry(const char* reason);
+void beginWiFi();
+bool connectWiFi();
+void serviceWiFi();
+void wifiJoined();
+void wifiFullScan();
+void wifiJoinFailed();
+bool waitForWiFi(unsigned long timeout);
+void onWiFiEvent(arduino_event_id_t event);
+void loadWiFiCache();
+void saveWiFiCache();
+void invalidateWiFiCache();
 void messageReceived(String &topic, String &payload);
+void messageReceivedAdvanced(MqttSession *mqttClient, char topic[], char bytes[], int length);
+bool dispatchAction(const String &action, String payload);
+void handleCommandBatch(const String &payload);
 void publishDeviceDiscovery();
+void requestDiscovery(const String &payload, bool broadcast);
+void handleDiscoveryConfig(String payload, bool persist = true);
+void loadDiscoveryConfig();
 void readSensors();
+void readSensor(int channel);
+void readSystemMetrics();
+void runSensorSchedule(unsigned long now);
+void publishFirstTelemetry();
+int findSensorChannel(const char* sensorType);
+unsigned long minSampleInterval(int channel);
+void loadSensorConfig();
+void saveSensorConfig();
+float sensorValue(int channel);
+void addWindowStats(JsonObject sensor, int channel);
+void addRetryStats(JsonObject out, const RetryBackoff &backoff);
+void handleRulesConfig(String payload, bool persist = true);
+bool parseAlertRules(const String &payload);
+void loadAlertRules();
+void evaluateAlertRules(int channel);
+void handlePowerConfig(String payload, bool persist = true);
+bool parsePowerPolicy(const String &payload);
+void loadPowerPolicy();
+void handleLowPowerConfig(String payload, bool persist = true);
+void loadLowPowerMode();
+void applyLowPower();
+void updateCpuClock();
+uint16_t activeKeepAlive();
+void handleBrokerConfig(String payload, bool persist = true);
+void loadBrokerList();
+void probeBrokers();
+void updatePowerPolicy();
+uint8_t powerTier(float value, float low, float critical, float hysteresis, uint8_t current);
+void publishAlert(const AlertRule &rule, float value, bool triggered);
+bool otaReadSource(void* ctx, uint32_t offset, uint8_t* buf, size_t len);
+bool otaWriteTarget(void* ctx, const uint8_t* buf, size_t len);
+void handleOtaBegin(String payload);
+void handleOtaChunk(const uint8_t* data, int length);
+void handleOtaAbort(String reason);
+void publishOtaProgress(String state, String error = "");
+void configureGPSReceiver();
+void serviceGpsSetup();
+void gpsSetupAdvance(bool ok);
+void gpsSetupNextCommand();
+void gpsSetupFinished();
+void gpsSetupSend(GpsSetupStep step, const uint8_t* data, size_t len);
+void gpsSetupListen(GpsSetupStep step, uint32_t baud, unsigned long duration);
 void readGPSData();
+bool gpsFeedByte(char c);
+void handleGpsFix();
+bool mountGpsTraceFs();
+void startGpsReplay(String payload);
+void readGPSReplay();
+void stopGpsReplay(String reason);
+void startGpsCapture(String payload);
+void captureGpsByte(uint8_t c);
+void stopGpsCapture(String reason);
+bool historyRead(void* ctx, uint32_t offset, uint8_t* buf, size_t len);
+bool historyWrite(void* ctx, uint32_t offset, const uint8_t* buf, size_t len);
+void startHistory();
+void logHistorySamples(int channel);
+void flushHistory();
+void startHistoryQuery(String payload);
+void sendHistoryChunk();
+void finishHistoryQuery(const String &requestId, const char* status);
+#if !PRODUCTION_BUILD
 void generateGPSData();
 void generateInsideXorafi();
 void generateOutsideXorafi();
-void generateSanFranciscoRandom();
+#endif
 bool isPointInPolygon(double lat, double lng);
 void generateGPSTimestamp();
-void publishSensorData();
+void startClock();
+void onClockSynced(struct timeval* tv);
+void syncClockFromGPS();
+uint64_t epochMillis();
+void stampMessage(JsonDocument &doc, OutboundTopic topic);
+void publishSensorData(uint32_t channelMask = SENSOR_MASK_ALL);
+void publishCompactSensorData(uint32_t channelMask);
+double sensorFieldValue(const SensorDef &field);
 void publishGPSData();
+GpsTrigger gpsReportTrigger(unsigned long now);
+void gpsMarkReported(GpsTrigger trigger);
+double gpsDistanceMeters(double lat1, double lng1, double lat2, double lng2);
+double gpsHeadingDelta(double from, double to);
+bool publishTelemetry(const String &topic, const String &payload);
+bool publishMessage(const String &topic, const String &payload, bool retained, int qos, uint32_t expiry = 0);
 void publishDeviceStatus(String status = "online");
 void publishControlResponse(String control, String value);
 void handleCalibrationUpdate(String payload);
 void handleSensorConfig(String payload);
 void updateLCD();
 
+HistoryLog history(historyRead, historyWrite);
+
 void setup() {
     Serial.begin(115200);
-    delay(1000);
-    
+#if !PRODUCTION_BUILD
+    delay(1000);    // time to open the serial monitor
     Serial.println("=== ESP32 GEOFENCE TESTING DEVICE ===");
+#else
+    Serial.println("=== ESP32 SENSOR MONITOR ===");
+#endif
     Serial.println("Device ID: " + device_id);
     Serial.println("Firmware: " + firmware_version);
     Serial.println("=====================================");
     
-    // Initialize random seed
+    // Initialize random seed (GPIO0 is on ADC2, unusable once WiFi runs)
     randomSeed(analogRead(0));
+    bootId = esp_random();
+    wifiBackoff.seed(esp_random());
+    mqttBackoff.seed(esp_random());
+    
+    // Associate while the peripherals come up; connectWiFi() below waits
+    // for the join this starts
+    WiFi.onEvent(onWiFiEvent);
+    loadWiFiCache();
+    beginWiFi();
     
     // Initialize pins
     pinMode(GREEN_LED_PIN, OUTPUT);
@@ -135,65 +716,132 @@ void setup() {
     digitalWrite(GREEN_LED_PIN, LOW);
     digitalWrite(BLUE_LED_PIN, LOW);
     
+    // Fences first: fence rules are resolved against the table
+    uint32_t xorafiSize = XORAFI_COORD_COUNT;
+    geofenceInit(fences, fenceTable, 1, fenceEdges, 8);
+    geofenceAdd(fences, XORAFI_FENCE_ID, &XORAFI_COORDS[0][0], &xorafiSize, 1);
+    
+    // Restore calibration, sensor schedule, alert rules and power policy
+    loadSensorConfig();
+    loadAlertRules();
+    loadPowerPolicy();
+    loadLowPowerMode();
+    discovery.begin(device_id.c_str());
+    loadDiscoveryConfig();
+    loadBrokerList();
+    startHistory();
+    
     // Initialize DHT22 sensor
     dht.begin();
     
     // Initialize GPS with Hardware Serial
+    gpsSerial.setRxBufferSize(1024);
     gpsSerial.begin(GPSBaud, SERIAL_8N1, 16, 17); // RX=16, TX=17
     Serial.println("GPS module initialized with Hardware Serial");
     
     // Initialize LCD
     lcd.init();
     lcd.backlight();
-    lcd.setCursor(0, 0);
-    lcd.print("Initializing...");
+    Wire.setClock(400000);
+    lcdFrame.setLine(0, "Initializing...");
+    lcdFrame.flush();
     
     // Configure ADC
     analogReadResolution(12);
     analogSetAttenuation(ADC_11db);
     
-    WiFi.begin(ssid, pass);
-    
+    connectWiFi();
+    applyLowPower();
+    startClock();
+    
+#if MQTT_USE_TLS
+#if MQTT_TLS_INSECURE
+    Serial.println("✗ MQTT_TLS_INSECURE build, TLS server is not verified");
+    net.setInsecure();
+#endif
+    net.setCACert(mqtt_ca_cert);
+#endif
     client.begin(mqtt_broker, mqtt_port, net);
-    client.onMessage(messageReceived);
-    client.setKeepAlive(60);
+    client.onMessageAdvanced(messageReceivedAdvanced);
     client.setCleanSession(true);
     
     connect();
     
+    digitalWrite(GREEN_LED_PIN, HIGH);
+    Serial.println("Boot: WiFi " + String(bootWiFiMs) + "ms, MQTT " + String(bootMqttMs) +
+                   "ms, first publish " + String(bootFirstPublishMs) + "ms");
+    
+#if !PRODUCTION_BUILD
     Serial.println("=== GEOFENCE TESTING MODE ACTIVE ===");
     Serial.println("Will alternate between INSIDE and OUTSIDE Xorafi 1 every 2 minutes");
     Serial.println("Current mode: " + String(generateInsideGeofence ? "INSIDE" : "OUTSIDE"));
     Serial.println("=====================================");
     
-    digitalWrite(GREEN_LED_PIN, HIGH);
-    
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("Geofence Test");
-    lcd.setCursor(0, 1);
-    lcd.print("Mode: " + String(generateInsideGeofence ? "INSIDE" : "OUTSIDE"));
+    lcdFrame.setLine(0, "Geofence Test");
+    lcdFrame.setLine(1, generateInsideGeofence ? "Mode: INSIDE" : "Mode: OUTSIDE");
+    lcdFrame.flush();
     delay(3000);
     
     // Start GPS simulation immediately for testing
     Serial.println("Starting GPS simulation for geofence testing...");
     useSimulatedGPS = true;
     generateGPSData();
+#endif
 }
 
 void loop() {
     client.loop();
-    delay(10);
-    
-    if (!client.connected()) {
-        Serial.println("MQTT disconnected, reconnecting...");
+    // The modem sleeps through the longer low-power wait
+    delay(lowPower.enabled ? LOWPOWER_LOOP_DELAY : 10);
+    loopWakeAt = micros();
+    wakePublishPending = true;
+    updateCpuClock();
+    
+    serviceWiFi();
+    bool wifiUp = WiFi.status() == WL_CONNECTED;
+    
+    if (brokerReconnectPending && wifiUp) {
+        Serial.println(brokerFailed ? "Broker stopped accepting publishes, failing over..." :
+                       sessionSettingsChanged ? "Session settings changed, reconnecting..." : "Faster broker found, switching...");
+        sessionSettingsChanged = false;
         connect();
+    } else if (!client.connected()) {
+        if (!mqttRetryPending) {
+            // A broker restart drops everyone at once: don't all come back at once
+            sessionDrops++;
+            scheduleMqttRetry("MQTT disconnected");
+        } else if (wifiUp && (long)(millis() - mqttRetryAt) >= 0) {
+            // Keepalive and NAT timeouts drop sessions routinely; connect() goes
+            // back to the same broker and only a failed reconnect counts against it
+            connect();
+        }
     }
     
     unsigned long currentTime = millis();
     
+    // Back to short retries once a link has held for a while
+    wifiBackoff.update(currentTime, WiFi.status() == WL_CONNECTED);
+    mqttBackoff.update(currentTime, client.connected());
+    
+    // Boot work kept off the path to the first publish
+    if (bootDeferredPending && (bootFirstPublishMs || currentTime > BOOT_DEFER_MAX_MS)) {
+        bootDeferredPending = false;
+        configureGPSReceiver();
+        // ... and the first broker probe right after it
+        lastBrokerProbe = millis() - BROKER_PROBE_INTERVAL;
+    }
+    
+    // Re-measure broker latency and move when another one is clearly faster
+    if (brokers.count() > 1 && currentTime - lastBrokerProbe > BROKER_PROBE_INTERVAL) {
+        probeBrokers();
+        if (brokers.betterThanActive(millis()) >= 0) {
+            brokerReconnectPending = true;
+        }
+    }
+    
+#if !PRODUCTION_BUILD
     // Toggle geofence mode every 2 minutes
-    if (currentTime - lastGeofenceToggle > geofenceToggleInterval) {
+    if (!gpsReplayActive && currentTime - lastGeofenceToggle > geofenceToggleInterval) {
         generateInsideGeofence = !generateInsideGeofence;
         lastGeofenceToggle = currentTime;
         
@@ -202,29 +850,49 @@ void loop() {
         Serial.println("===================================\n");
         
         // Update LCD to show new mode
-        lcd.clear();
-        lcd.setCursor(0, 1);
-        lcd.print("Mode: " + String(generateInsideGeofence ? "INSIDE" : "OUTSIDE"));
+        lcdFrame.setLine(0, "");
+        lcdFrame.setLine(1, generateInsideGeofence ? "Mode: INSIDE" : "Mode: OUTSIDE");
+        lcdFrame.flush();
         
         // Generate new GPS data immediately after mode switch
         generateGPSData();
     }
+#endif
+    
+    // Receiver setup deferred from boot, a step at a time
+    serviceGpsSetup();
     
     // Read GPS data (simulated for testing)
-    readGPSData();
+    if (sensorSchedule[SENSOR_GPS].enabled) {
+        readGPSData();
+    }
+    
+    // Sample and publish each sensor on its own schedule
+    runSensorSchedule(currentTime);
     
-    // Publish sensor data every 10 seconds
-    if (currentTime - lastMillis > 10000) {
+    // Publish device status every 10 seconds (stretched by the power policy)
+    if (currentTime - lastMillis > 10000UL * powerPublishScale) {
         lastMillis = currentTime;
-        readSensors();
-        publishSensorData();
+        readSystemMetrics();
         publishDeviceStatus(); 
     }
     
-    // Publish GPS data every 15 seconds (if valid)
-    if (currentTime - lastGpsUpdate > 15000 && gpsValid) {
-        lastGpsUpdate = currentTime;
-        publishGPSData();
+    // Publish GPS on movement or heartbeat (if valid); a zero publish interval keeps it local
+    if (sensorSchedule[SENSOR_GPS].enabled && sensorSchedule[SENSOR_GPS].publishInterval > 0 && gpsValid) {
+        GpsTrigger trigger = gpsReportTrigger(currentTime);
+        if (trigger != GPS_TRIGGER_NONE) {
+            lastGpsUpdate = currentTime;
+            gpsMarkReported(trigger);
+            publishGPSData();
+        }
+    }
+    
+    // Flash history: batched writes, and a requested range a chunk per pass
+    if (historyReady && history.pending() > 0 && currentTime - lastHistoryFlush > HISTORY_FLUSH_INTERVAL) {
+        flushHistory();
+    }
+    if (historyQueryActive) {
+        sendHistoryChunk();
     }
     
     // Update LCD every 3 seconds
@@ -233,78 +901,556 @@ void loop() {
         updateLCD();
     }
     
-    // Auto-republish discovery every 5 minutes
-    if (currentTime - lastDiscovery > 300000) {
-        lastDiscovery = millis();
+    // Scheduled discovery answer, and the periodic republish (its phase
+    // follows the jittered answer after connect)
+    if (discovery.due(currentTime)) {
+        publishDeviceDiscovery();
+    } else if (!discovery.pending() && discovery.sinceLast(currentTime) > DISCOVERY_REPUBLISH_INTERVAL) {
         publishDeviceDiscovery();
     }
 }
 
-void connect() {
-    Serial.print("Checking WiFi...");
-    while (WiFi.status() != WL_CONNECTED) {
-        Serial.print(".");
-        delay(1000);
+// One pass over the brokers: a lost session goes back to its broker while
+// that one is healthy, otherwise the best healthy one, moving on to healthy
+// alternatives after a failure. When none connects, loop() tries again once
+// the backoff is over.
+bool connect() {
+    if (WiFi.status() != WL_CONNECTED) {
+        // serviceWiFi() rejoins; connect as soon as the link is back
+        mqttRetryPending = true;
+        mqttRetryAt = millis();
+        return false;
+    }
+    mqttRetryPending = false;
+
+    // Leaving a broker: a failed one sits out its cooldown in select()
+    int8_t previous = brokers.active();
+    bool leaving = brokerReconnectPending;
+    if (brokerReconnectPending) {
+        if (brokerFailed && previous >= 0) {
+            brokers.recordFailure(previous, millis());
+        }
+        client.disconnect();
+        brokerReconnectPending = false;
+        brokerFailed = false;
     }
 
-    Serial.print("\nConnecting to MQTT...");
-    while (!client.connect(device_id.c_str(), mqtt_username, mqtt_password)) {
+    // Handshakes run at the full clock; the loop drops back once connected
+    if (getCpuFrequencyMhz() != FULL_CPU_MHZ) {
+        setCpuFrequencyMhz(FULL_CPU_MHZ);
+    }
+    client.setKeepAlive(activeKeepAlive());
+    
+    Serial.print("Connecting to MQTT...");
+    unsigned long mqttStart = millis();
+    int8_t broker = -1;
+    for (uint8_t attempt = 0; attempt < brokers.count(); attempt++) {
+        // A lost session resumes on its broker while that one is healthy
+        uint8_t candidate;
+        if (!leaving && previous >= 0 && brokers.healthy(previous, millis())) {
+            candidate = previous;
+        } else {
+            candidate = brokers.select(millis());
+        }
+        // After a failure, go straight to a healthy alternative; back off when none is left
+        if (attempt > 0 && !brokers.healthy(candidate, millis())) {
+            break;
+        }
+        const BrokerEntry &entry = brokers.entry(candidate);
+#if MQTT_USE_TLS
+        // A session from another broker would only be refused
+        if (candidate != previous) {
+            net.clearSession();
+        }
+#endif
+        client.setHost(entry.host, entry.port);
+        unsigned long attemptStart = millis();
+        if (client.connect(device_id.c_str(), mqtt_username, mqtt_password)) {
+            brokers.recordConnect(candidate, millis() - attemptStart);
+            broker = candidate;
+            break;
+        }
+        brokers.recordFailure(candidate, millis());
         Serial.print(".");
-        delay(1000);
+        // A stale static lease can leave us associated but unroutable;
+        // drop the cache so the next WiFi join goes through DHCP.
+        if (wifiFastJoinUsed) {
+            invalidateWiFiCache();
+        }
     }
+    if (broker < 0) {
+        scheduleMqttRetry(" failed");
+        return false;
+    }
+    mqttConnectMs = millis() - mqttStart;
+    if (!bootMqttMs) bootMqttMs = millis();
 
-    Serial.println("\nMQTT Connected!");
+    Serial.println("\nMQTT Connected to " + String(brokers.entry(broker).host) + ":" + String(brokers.entry(broker).port) +
+                   (previous >= 0 && previous != broker ? " (was " + String(brokers.entry(previous).host) + ")" : ""));
+#if MQTT_USE_V5
+    Serial.println("Protocol: MQTT " + String(client.protocolVersion() == 5 ? "5.0" : "3.1.1") +
+                   ", topic aliases: " + String(client.topicAliasMax()));
+#endif
+    Serial.println("Timing: assoc " + String(wifiAssocMs) + "ms, dhcp " + String(wifiDhcpMs) +
+                   "ms, mqtt " + String(mqttConnectMs) + "ms (" + String(wifiFastJoinUsed ? "fast join" : "full scan") + ")");
+#if MQTT_USE_TLS
+    Serial.println("TLS: " + String(net.lastResumed ? "resumed" : "full") + " handshake " +
+                   String(net.lastHandshakeMs) + "ms, " + String(net.lastHandshakeHeap) + " bytes heap");
+#endif
 
     // Subscribe to topics
     client.subscribe("devices/" + device_id + "/control/#");
     client.subscribe("devices/" + device_id + "/config/#");
+    client.subscribe("devices/" + device_id + "/commands");
+    client.subscribe("devices/" + device_id + "/history/request");
     client.subscribe("devices/" + device_id + "/discover");
     client.subscribe("devices/discover/all");
+    client.subscribe("devices/" + device_id + "/ota/begin");
+    client.subscribe("devices/" + device_id + "/ota/chunk");
+    client.subscribe("devices/" + device_id + "/ota/abort");
+    
+    // Let an interrupted update resume from where it stopped
+    if (otaInProgress) {
+        publishOtaProgress("receiving");
+    }
     
+    // Boot path: readings right away, behind the discovery document that
+    // tells the server how to decode them (a new install or schema version
+    // would otherwise be dropped); the status then carries the timing. The
+    // window below only spreads reconnects and broadcasts.
+    if (!bootFirstPublishMs) {
+        publishDeviceDiscovery();
+        publishFirstTelemetry();
+    }
     publishDeviceStatus("online");
     
-    readSensors();
-    delay(1000);
-    publishDeviceDiscovery();
+    // A broker restart reconnects the whole fleet at once: announce in this
+    // device's slot like for a broadcast
+    discovery.request(millis(), discoveryWindowMs);
+    return true;
+}
+
+void scheduleMqttRetry(const char* reason) {
+    unsigned long wait = mqttBackoff.next();
+    mqttRetryAt = millis() + wait;
+    mqttRetryPending = true;
+    Serial.println(String(reason) + ", reconnecting in " + String(wait) + "ms");
+}
+
+// OTA chunks are binary and must not go through String; everything else does
+void messageReceivedAdvanced(MqttSession *mqttClient, char topic[], char bytes[], int length) {
+    String topicStr = topic;
+    if (topicStr == "devices/" + device_id + "/ota/chunk") {
+        handleOtaChunk((const uint8_t*)bytes, length);
+        return;
+    }
+    
+    String payload = length > 0 ? String(bytes) : String();
+    messageReceived(topicStr, payload);
 }
 
 void messageReceived(String &topic, String &payload) {
     Serial.println("Received: " + topic + " - " + payload);
     
-    if(topic == "devices/" + device_id + "/control/green_led") {
-        digitalWrite(GREEN_LED_PIN, payload.toInt());
-        publishControlResponse("green_led", payload.toInt() ? "on" : "off");
+    if(topic == "devices/discover/all") {
+        requestDiscovery(payload, true);
+        return;
     }
     
-    if(topic == "devices/" + device_id + "/control/blue_led") {
+    String prefix = "devices/" + device_id + "/";
+    if (!topic.startsWith(prefix)) return;
+    String action = topic.substring(prefix.length());
+    
+    if (action == "commands") {
+        handleCommandBatch(payload);
+    } else {
+        dispatchAction(action, payload);
+    }
+}
+
+// Runs one action, named by its topic below devices/<id>/ ("control/green_led",
+// "config/sensors", ...). Returns false for unknown actions.
+bool dispatchAction(const String &action, String payload) {
+    if(action == "control/green_led") {
+        digitalWrite(GREEN_LED_PIN, payload.toInt());
+        publishControlResponse("green_led", payload.toInt() ? "on" : "off");
+    } else if(action == "control/blue_led") {
         digitalWrite(BLUE_LED_PIN, payload.toInt());
         publishControlResponse("blue_led", payload.toInt() ? "on" : "off");
-    }
-    
-    if(topic == "devices/" + device_id + "/control/toggle_geofence") {
+#if !PRODUCTION_BUILD
+    } else if(action == "control/toggle_geofence") {
         generateInsideGeofence = !generateInsideGeofence;
         lastGeofenceToggle = millis(); // Reset timer
         Serial.println("Manually toggled to: " + String(generateInsideGeofence ? "INSIDE" : "OUTSIDE"));
         generateGPSData(); // Generate new coordinates immediately
         publishControlResponse("toggle_geofence", generateInsideGeofence ? "inside" : "outside");
+#endif
+    } else if(action == "control/gps_replay") {
+        if (payload == "stop") {
+            stopGpsReplay("stopped");
+        } else {
+            startGpsReplay(payload);
+        }
+    } else if(action == "control/gps_capture") {
+        if (payload == "stop") {
+            stopGpsCapture("stopped");
+        } else {
+            startGpsCapture(payload);
+        }
+    } else if(action == "control/status") {
+        readSystemMetrics();
+        publishDeviceStatus();
+        publishControlResponse("status", "published");
+    } else if(action == "control/gps") {
+        publishGPSData();
+        publishControlResponse("gps", gpsValid ? "published" : "no_fix");
+    } else if(action == "control/restart") {
+        // Deferred so a command batch can still acknowledge
+        restartRequested = true;
+        publishControlResponse("restart", "scheduled");
+    } else if(action == "config/calibration") {
+        handleCalibrationUpdate(payload);
+    } else if(action == "discover") {
+        requestDiscovery(payload, false);
+    } else if(action == "ota/begin") {
+        handleOtaBegin(payload);
+    } else if(action == "ota/abort") {
+        handleOtaAbort("aborted by server");
+    } else if(action == "config/rules") {
+        handleRulesConfig(payload);
+    } else if(action == "config/sensors") {
+        handleSensorConfig(payload);
+    } else if(action == "config/power") {
+        handlePowerConfig(payload);
+    } else if(action == "config/lowpower") {
+        handleLowPowerConfig(payload);
+    } else if(action == "config/discovery") {
+        handleDiscoveryConfig(payload);
+    } else if(action == "history/request") {
+        startHistoryQuery(payload);
+    } else if(action == "config/brokers") {
+        handleBrokerConfig(payload);
+    } else {
+        return false;
     }
     
-    if(topic == "devices/" + device_id + "/config/calibration") {
-        handleCalibrationUpdate(payload);
+    if (restartRequested && !commandBatchActive) {
+        delay(200);
+        ESP.restart();
+    }
+    return true;
+}
+
+// Payload: {"request_id":"cmd_1","commands":[{"op":"green_led","value":1},
+//           {"op":"config/sensors","value":{"aggregate":false}},{"op":"status"}]}
+// Operations run in order. The per-control responses are collected into one
+// acknowledgement on control/response carrying the request_id. A bare op
+// name means control/<op>. The single-command form sent by
+// publishDeviceCommand ({"command":..,"parameters":{"value":..}}) is a
+// batch of one. A redelivered request_id gets the same ack, not a rerun.
+void handleCommandBatch(const String &payload) {
+    DynamicJsonDocument doc(4096);
+    DeserializationError error = deserializeJson(doc, payload);
+    if (error) {
+        Serial.println("Invalid command batch: " + String(error.c_str()));
+        return;
     }
     
-    if(topic == "devices/" + device_id + "/discover" || topic == "devices/discover/all") {
-        Serial.println("Discovery request received");
-        readSensors();
-        publishDeviceDiscovery();
+    String requestId = doc["request_id"] | "";
+    String responseTopic = "devices/" + device_id + "/control/response";
+    if (requestId.length() > 0 && requestId == lastCommandRequestId) {
+        publishMessage(responseTopic, lastCommandAck, false, 1);
+        return;
     }
     
-    if(topic == "devices/" + device_id + "/config/sensors") {
-        handleSensorConfig(payload);
+    // The server numbers batches per device; a gap is a batch that never
+    // arrived. A lower number means the server started over.
+    uint32_t seq = doc["seq"] | 0;
+    commandsReceived++;
+    if (lastCommandSeq > 0 && seq > lastCommandSeq + 1) {
+        commandsMissed += seq - lastCommandSeq - 1;
+    }
+    if (seq > 0) {
+        lastCommandSeq = seq;
+    }
+    
+    if (!doc.containsKey("commands") && doc.containsKey("command")) {
+        JsonObject op = doc.createNestedArray("commands").createNestedObject();
+        op["op"] = doc["command"];
+        JsonVariant parameters = doc["parameters"];
+        op["value"] = parameters.containsKey("value") ? parameters["value"] : parameters;
+    }
+    
+    DynamicJsonDocument ack(2048);
+    ack["device_id"] = device_id;
+    ack["request_id"] = requestId;
+    JsonArray results = ack.createNestedArray("results");
+    int succeeded = 0;
+    int count = 0;
+    
+    commandBatchActive = true;
+    for (JsonObject cmd : doc["commands"].as<JsonArray>()) {
+        if (count >= MAX_BATCH_COMMANDS) {
+            Serial.println("Command batch too long, ignoring remaining operations");
+            break;
+        }
+        count++;
+        
+        String op = cmd["op"] | "";
+        String action = op.indexOf('/') >= 0 || op == "discover" ? op : "control/" + op;
+        
+        // Handlers take the raw topic payload: strings as-is, anything else as JSON
+        String value;
+        JsonVariant v = cmd["value"];
+        if (v.is<const char*>()) {
+            value = v.as<const char*>();
+        } else if (!v.isNull()) {
+            serializeJson(v, value);
+        }
+        
+        commandBatchControl = "";
+        commandBatchValue = "";
+        bool known = dispatchAction(action, value);
+        bool ok = known && commandBatchValue != "invalid" && commandBatchValue != "error" &&
+                  commandBatchValue != "not_found";
+        
+        JsonObject result = results.createNestedObject();
+        result["op"] = op;
+        result["ok"] = ok;
+        result["value"] = known ? (commandBatchValue.length() ? commandBatchValue : String("done")) : String("unknown_op");
+        if (ok) succeeded++;
+    }
+    commandBatchActive = false;
+    
+    ack["status"] = succeeded == count ? "executed" : (succeeded > 0 ? "partial" : "failed");
+    ack["timestamp"] = millis() / 1000;
+    stampMessage(ack, OUT_CONTROL_RESPONSE);
+    
+    lastCommandAck = "";
+    serializeJson(ack, lastCommandAck);
+    lastCommandRequestId = requestId;
+    
+    publishMessage(responseTopic, lastCommandAck, false, 1);
+    Serial.println("Command batch " + requestId + ": " + String(succeeded) + "/" + String(count) + " ok");
+    
+    if (restartRequested) {
+        delay(200);
+        ESP.restart();
+    }
+}
+
+// Start receiver setup; serviceGpsSetup() carries it out from loop()
+void configureGPSReceiver() {
+    gpsSetupAccepted = true;
+    // The receiver may still run at the fast rate from an earlier boot (backup power)
+    gpsSetupListen(GPS_SETUP_FIND_FAST, GPS_TARGET_BAUD, 1200);
+}
+
+// One pass of receiver setup: bytes of the listen or reply wait in progress,
+// then the next step once it has its answer
+void serviceGpsSetup() {
+    if (gpsSetupStep == GPS_SETUP_IDLE) return;
+    unsigned long elapsed = millis() - gpsSetupAt;
+    
+    if (gpsSetupDuration > 0) {
+        // The first bytes after a baud change are line noise
+        while (gpsSerial.available() > 0) {
+            uint8_t c = gpsSerial.read();
+            if (elapsed >= GPS_SETUP_SETTLE) {
+                gpsSetupStats.feed(c);
+            }
+        }
+        if (elapsed >= GPS_SETUP_SETTLE + gpsSetupDuration) {
+            gpsSetupAdvance(gpsSetupStats.sentences() > 0);
+        }
+        return;
+    }
+    
+    if (gpsSetupStep == GPS_SETUP_BAUD) {
+        if (elapsed >= GPS_SETUP_BAUD_WAIT) {
+            gpsSetupAdvance(true);
+        }
+        return;
+    }
+    
+    while (gpsSerial.available() > 0) {
+        int result = gpsSetupScanner.feed(gpsSerial.read());
+        if (result != 0) {
+            gpsSetupAdvance(result > 0);
+            return;
+        }
+    }
+    if (elapsed >= GPS_REPLY_TIMEOUT) {
+        gpsSetupAdvance(false);
+    }
+}
+
+// The step in progress is over: ok is "heard NMEA" for a listen, "acknowledged" for a command
+void gpsSetupAdvance(bool ok) {
+    uint8_t frame[80];
+    size_t len;
+    
+    switch (gpsSetupStep) {
+    case GPS_SETUP_FIND_FAST:
+        if (!ok) {
+            gpsSetupListen(GPS_SETUP_FIND_DEFAULT, GPSBaud, 1200);
+            return;
+        }
+        gpsBaud = GPS_TARGET_BAUD;
+        break;
+    case GPS_SETUP_FIND_DEFAULT:
+        if (!ok) {
+            Serial.println("✗ No GPS receiver output, keeping defaults");
+            gpsSetupStep = GPS_SETUP_IDLE;
+            return;
+        }
+        gpsBaud = GPSBaud;
+        break;
+    case GPS_SETUP_PROBE_UBLOX:
+        if (ok) {
+            gpsReceiver = GPS_RECEIVER_UBLOX;
+            gpsSetupCommand = 0;
+            gpsSetupNextCommand();
+            return;
+        }
+        len = pmtkSentence("PMTK605", (char*)frame, sizeof(frame));
+        gpsSetupScanner.expectPmtk(605, "$PMTK705");
+        gpsSetupSend(GPS_SETUP_PROBE_MTK, frame, len);
+        return;
+    case GPS_SETUP_PROBE_MTK:
+        if (!ok) {
+            Serial.println("✗ Unknown GPS receiver, keeping defaults");
+            gpsSetupStep = GPS_SETUP_IDLE;
+            return;
+        }
+        gpsReceiver = GPS_RECEIVER_MTK;
+        gpsSetupCommand = 0;
+        gpsSetupNextCommand();
+        return;
+    case GPS_SETUP_COMMANDS:
+        gpsSetupAccepted &= ok;
+        gpsSetupNextCommand();
+        return;
+    case GPS_SETUP_BAUD:
+        // Verify what the receiver actually sends now
+        gpsSetupPreviousBaud = gpsBaud;
+        gpsSetupListen(GPS_SETUP_VERIFY_FAST, GPS_TARGET_BAUD, 2000);
+        return;
+    case GPS_SETUP_VERIFY_FAST:
+        if (!ok) {
+            // Baud change did not take; stay at the old rate
+            gpsSetupListen(GPS_SETUP_VERIFY_OLD, gpsSetupPreviousBaud, 2000);
+            return;
+        }
+        gpsBaud = GPS_TARGET_BAUD;
+        gpsSetupFinished();
+        return;
+    case GPS_SETUP_VERIFY_OLD:
+        gpsSetupFinished();
+        return;
+    default:
+        return;
+    }
+    
+    // Output found: u-blox answers a MON-VER poll, MediaTek answers PMTK605 with PMTK705
+    len = ubxFrame(UBX_CLASS_MON, UBX_MON_VER, nullptr, 0, frame);
+    gpsSetupScanner.expectUbx(UBX_CLASS_MON, UBX_MON_VER, false);
+    gpsSetupSend(GPS_SETUP_PROBE_UBLOX, frame, len);
+}
+
+// Send configuration command gpsSetupCommand of the detected receiver. The
+// last one changes the baud rate; its ACK is unreliable, the listen
+// afterwards verifies it.
+void gpsSetupNextCommand() {
+    uint8_t frame[80];
+    size_t len;
+    uint8_t n = gpsSetupCommand++;
+    bool last = false;
+    
+    if (gpsReceiver == GPS_RECEIVER_UBLOX) {
+        // Only RMC and GGA on this port
+        static const uint8_t rates[][2] = {{UBX_NMEA_GLL, 0}, {UBX_NMEA_GSA, 0}, {UBX_NMEA_GSV, 0},
+                                           {UBX_NMEA_VTG, 0}, {UBX_NMEA_RMC, 1}, {UBX_NMEA_GGA, 1}};
+        if (n < 6) {
+            len = ubxSetNmeaRate(rates[n][0], rates[n][1], frame);
+            gpsSetupScanner.expectUbx(UBX_CLASS_CFG, UBX_CFG_MSG, true);
+        } else if (n == 6) {
+            len = ubxSetNavRate(1000 / GPS_NAV_RATE_HZ, frame);
+            gpsSetupScanner.expectUbx(UBX_CLASS_CFG, UBX_CFG_RATE, true);
+        } else {
+            len = ubxSetBaud(GPS_TARGET_BAUD, frame);
+            last = true;
+        }
+    } else {
+        char body[24];
+        if (n == 0) {
+            // Field order: GLL, RMC, VTG, GGA, GSA, GSV, then reserved/chip specific
+            len = pmtkSentence("PMTK314,0,1,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0", (char*)frame, sizeof(frame));
+            gpsSetupScanner.expectPmtk(314);
+        } else if (n == 1) {
+            snprintf(body, sizeof(body), "PMTK220,%d", 1000 / GPS_NAV_RATE_HZ);
+            len = pmtkSentence(body, (char*)frame, sizeof(frame));
+            gpsSetupScanner.expectPmtk(220);
+        } else {
+            snprintf(body, sizeof(body), "PMTK251,%lu", (unsigned long)GPS_TARGET_BAUD);
+            len = pmtkSentence(body, (char*)frame, sizeof(frame));
+            last = true;
+        }
+    }
+    
+    if (last) {
+        // Goes out of the TX FIFO well within the wait before switching
+        gpsSerial.write(frame, len);
+        gpsSetupStep = GPS_SETUP_BAUD;
+        gpsSetupDuration = 0;
+        gpsSetupAt = millis();
+        return;
     }
+    gpsSetupSend(GPS_SETUP_COMMANDS, frame, len);
+}
+
+void gpsSetupFinished() {
+    gpsSetupStep = GPS_SETUP_IDLE;
+    
+    const NmeaSentenceStats &stats = gpsSetupStats;
+    uint32_t expectedRmc = GPS_NAV_RATE_HZ * 2;
+    gpsConfigVerified = gpsSetupAccepted && gpsBaud == GPS_TARGET_BAUD && stats.other == 0 &&
+                        stats.rmc * 10 >= expectedRmc * 8;
+    
+    Serial.println(String(gpsConfigVerified ? "✓" : "✗") + " GPS " +
+                   (gpsReceiver == GPS_RECEIVER_UBLOX ? "u-blox" : "MTK") + " at " + String(gpsBaud) +
+                   " baud: " + String(stats.rmc) + " RMC, " + String(stats.gga) + " GGA, " +
+                   String(stats.other) + " other in 2s");
+}
+
+// Send a command and wait for the reply gpsSetupScanner expects
+void gpsSetupSend(GpsSetupStep step, const uint8_t* data, size_t len) {
+    while (gpsSerial.available() > 0) {
+        gpsSerial.read();
+    }
+    gpsSerial.write(data, len);
+    gpsSetupStep = step;
+    gpsSetupDuration = 0;
+    gpsSetupAt = millis();
+}
+
+// Count sentences at a baud rate for a while
+void gpsSetupListen(GpsSetupStep step, uint32_t baud, unsigned long duration) {
+    gpsSerial.updateBaudRate(baud);
+    gpsSetupStats = NmeaSentenceStats();
+    gpsSetupStep = step;
+    gpsSetupDuration = duration;
+    gpsSetupAt = millis();
 }
 
 void readGPSData() {
+    // A trace replay stands in for the UART until it finishes
+    if (gpsReplayActive) {
+        readGPSReplay();
+        return;
+    }
+    
+#if !PRODUCTION_BUILD
     // For testing, we always use simulated GPS with geofence testing
     if (useSimulatedGPS) {
         // Change location every 30 seconds for more frequent updates
@@ -312,95 +1458,492 @@ void readGPSData() {
             generateGPSData();
             lastLocationChange = millis();
         }
-    } else {
-        // Try to read real GPS data (keeping original functionality)
-        bool realGpsData = false;
-        while (gpsSerial.available() > 0) {
-            if (gps.encode(gpsSerial.read())) {
-                if (gps.location.isValid()) {
-                    latitude = gps.location.lat();
-                    longitude = gps.location.lng();
-                    gpsValid = true;
-                    realGpsData = true;
-                    useSimulatedGPS = false;
-                    
-                    if (gps.altitude.isValid()) {
-                        altitude = gps.altitude.meters();
-                    }
-                    
-                    if (gps.speed.isValid()) {
-                        speed_kmh = gps.speed.kmph();
-                    }
-                    
-                    if (gps.satellites.isValid()) {
-                        satellites = gps.satellites.value();
-                    }
-                    
-                    if (gps.time.isValid() && gps.date.isValid()) {
-                        char timeBuffer[32];
-                        sprintf(timeBuffer, "%04d-%02d-%02d %02d:%02d:%02d", 
-                                gps.date.year(), gps.date.month(), gps.date.day(),
-                                gps.time.hour(), gps.time.minute(), gps.time.second());
-                        gpsTimestamp = String(timeBuffer);
-                    }
-                    
-                    Serial.println("=== REAL GPS Data ===");
-                    Serial.println("Latitude: " + String(latitude, 6));
-                    Serial.println("Longitude: " + String(longitude, 6));
-                    return;
-                }
-            }
+        return;
+    }
+#endif
+    
+    // Receiver setup reads the UART for its replies until it is done
+    if (gpsSetupStep != GPS_SETUP_IDLE) {
+        return;
+    }
+    
+    // Try to read real GPS data (keeping original functionality)
+    while (gpsSerial.available() > 0) {
+        char c = gpsSerial.read();
+        gpsUartBytes++;
+        if (gpsCaptureActive) {
+            captureGpsByte(c);
         }
-        
-        // If no real GPS, start simulation
-        if (!realGpsData && !useSimulatedGPS) {
-            Serial.println("No real GPS detected, starting simulation for testing...");
-            useSimulatedGPS = true;
-            generateGPSData();
-            lastLocationChange = millis();
+        if (gpsFeedByte(c)) {
+            return;
         }
     }
+    
+#if !PRODUCTION_BUILD
+    // If no real GPS, start simulation (not while recording the UART)
+    if (!gpsCaptureActive) {
+        Serial.println("No real GPS detected, starting simulation for testing...");
+        useSimulatedGPS = true;
+        generateGPSData();
+        lastLocationChange = millis();
+    }
+#endif
 }
 
-void generateGPSData() {
-    if (generateInsideGeofence) {
-        generateInsideXorafi();
-    } else {
-        generateOutsideXorafi();
+// Single ingestion path for UART and replayed NMEA; true when a fix was taken
+bool gpsFeedByte(char c) {
+    if (!gps.encode(c) || !gps.location.isValid()) {
+        return false;
     }
-    
-    generateGPSTimestamp();
+    handleGpsFix();
+    return true;
 }
 
-void generateInsideXorafi() {
-    // Updated coordinates for the new rectangular Xorafi polygon
-    // Based on your new geojson: lat range 39.495387 to 39.529577, lng range -107.744122 to -107.653999
+void handleGpsFix() {
+    latitude = gps.location.lat();
+    longitude = gps.location.lng();
+    gpsValid = true;
+    useSimulatedGPS = false;
     
-    // For a rectangle, we can generate points more efficiently
-    // Generate random point within bounding box (all points will be inside for a rectangle)
-    double testLat = XORAFI_MIN_LAT + (random(0, 1000001) / 1000000.0) * (XORAFI_MAX_LAT - XORAFI_MIN_LAT);
-    double testLng = XORAFI_MIN_LNG + (random(0, 1000001) / 1000000.0) * (XORAFI_MAX_LNG - XORAFI_MIN_LNG);
+    if (gps.altitude.isValid()) {
+        altitude = gps.altitude.meters();
+    }
     
-    // Since your new polygon is a rectangle, any point within the bounding box is guaranteed to be inside
-    latitude = testLat;
-    longitude = testLng;
+    if (gps.speed.isValid()) {
+        speed_kmh = gps.speed.kmph();
+    }
     
-    // Set Colorado-appropriate values
-    altitude = 2500.0 + random(-100, 101);  // 2400-2600m elevation (Colorado altitude)
-    speed_kmh = random(0, 31) / 10.0;       // 0-3 km/h (stationary to walking speed)
-    satellites = random(10, 15);            // Good satellite count for clear sky
-    gpsValid = true;
+    // Course over ground is noise at walking pace and below
+    gpsCourse = gps.course.isValid() && speed_kmh >= GPS_MOVING_KMH ? gps.course.deg() : NAN;
     
-    Serial.println("✓ INSIDE Xorafi rectangle generated");
-    Serial.println("GPS: " + String(latitude, 6) + ", " + String(longitude, 6) + " (INSIDE)");
-    Serial.println("Bounds: Lat[" + String(XORAFI_MIN_LAT, 6) + " to " + String(XORAFI_MAX_LAT, 6) + "] Lng[" + String(XORAFI_MIN_LNG, 6) + " to " + String(XORAFI_MAX_LNG, 6) + "]");
+    if (gps.satellites.isValid()) {
+        satellites = gps.satellites.value();
+    }
+    
+    if (gps.time.isValid() && gps.date.isValid()) {
+        // Replayed time is historical and must not touch the clock
+        if (!gpsReplayActive) {
+            syncClockFromGPS();
+        }
+        char timeBuffer[32];
+        sprintf(timeBuffer, "%04d-%02d-%02d %02d:%02d:%02d", 
+                gps.date.year(), gps.date.month(), gps.date.day(),
+                gps.time.hour(), gps.time.minute(), gps.time.second());
+        gpsTimestamp = String(timeBuffer);
+    }
+    
+    evaluateAlertRules(SENSOR_GPS);
+    
+    if (gpsReplayActive) {
+        gpsReplayFixes++;
+        return;
+    }
+    gpsUartFixes++;
+    
+    // RMC and GGA of one navigation epoch each end here; log the epoch once.
+    // Replayed fixes are historical and stay out of the history.
+    if (!gps.time.isValid() || gps.time.value() != historyGpsFixTime) {
+        historyGpsFixTime = gps.time.isValid() ? gps.time.value() : 0xffffffff;
+        logHistorySamples(SENSOR_GPS);
+    }
+    
+    Serial.println("=== REAL GPS Data ===");
+    Serial.println("Latitude: " + String(latitude, 6));
+    Serial.println("Longitude: " + String(longitude, 6));
+}
+
+bool mountGpsTraceFs() {
+    if (!gpsFsMounted) {
+        gpsFsMounted = LittleFS.begin(true);
+        if (!gpsFsMounted) {
+            Serial.println("✗ Failed to mount LittleFS for NMEA traces");
+        }
+    }
+    return gpsFsMounted;
 }
 
+bool historyRead(void* ctx, uint32_t offset, uint8_t* buf, size_t len) {
+    File &file = *(File*)ctx;
+    // Sectors past the end of the file were never written
+    if (offset + len > file.size()) return false;
+    return file.seek(offset) && file.read(buf, len) == len;
+}
 
-void generateOutsideXorafi() {
-    int locationChoice = random(0, 4);
+bool historyWrite(void* ctx, uint32_t offset, const uint8_t* buf, size_t len) {
+    File &file = *(File*)ctx;
+    return file.seek(offset) && file.write(buf, len) == len;
+}
+
+void startHistory() {
+    if (!mountGpsTraceFs()) return;
     
-    switch (locationChoice) {
+    historyFile = LittleFS.open(HISTORY_FILE, LittleFS.exists(HISTORY_FILE) ? "r+" : "w+");
+    if (!historyFile) {
+        Serial.println("✗ Failed to open " HISTORY_FILE);
+        return;
+    }
+    
+    historyReady = history.begin(&historyFile, historyIndex, HISTORY_SECTORS, SENSOR_SCHEMA_VERSION);
+    lastHistoryFlush = millis();
+    Serial.println("✓ History: " + String(history.storedRecords()) + " records in " +
+                   String(history.sectorsUsed()) + "/" + String(HISTORY_SECTORS) + " sectors");
+}
+
+// Every raw sample of a channel, in the precision it is published with.
+// Records are found by time, so nothing is logged before the clock is set.
+void logHistorySamples(int channel) {
+    if (!historyReady) return;
+    uint64_t now = epochMillis();
+    if (now == 0) return;
+    
+    forEachSensor<SENSOR_FIELD_COUNT>([&](auto i) {
+        constexpr const SensorDef &s = SENSORS[decltype(i)::value];
+        if (s.channel != channel) return;
+        double value = s.value();
+        if (isnan(value)) return;
+        
+        HistoryRecord record;
+        record.time = now / 1000;
+        record.ms = now % 1000;
+        record.field = decltype(i)::value;
+        record.value = (int32_t)llround(value * historyScale(s.decimals));
+        history.add(record);
+    });
+}
+
+void flushHistory() {
+    lastHistoryFlush = millis();
+    if (!history.flush()) {
+        Serial.println("✗ History write failed");
+    }
+    historyFile.flush();
+}
+
+// Payload: {"request_id":"h1","from":1718000000,"to":1718003600,
+//           "fields":["temperature","humidity"],"max_records":20000}
+// Times are epoch seconds, inclusive; no fields means all of them. Answered
+// on history/data in chunks of HISTORY_CHUNK_RECORDS, the last one with
+// "done" and the status.
+void startHistoryQuery(String payload) {
+    DynamicJsonDocument doc(1024);
+    DeserializationError error = deserializeJson(doc, payload);
+    String requestId = doc["request_id"] | "";
+    uint32_t from = doc["from"] | 0UL;
+    uint32_t to = doc["to"] | 0xffffffffUL;
+    
+    if (error || from > to) {
+        finishHistoryQuery(requestId, "invalid");
+        return;
+    }
+    if (!historyReady) {
+        finishHistoryQuery(requestId, "unavailable");
+        return;
+    }
+    if (historyQueryActive) {
+        finishHistoryQuery(requestId, "busy");
+        return;
+    }
+    
+    historyFieldMask = 0;
+    for (JsonVariant f : doc["fields"].as<JsonArray>()) {
+        forEachSensor<SENSOR_FIELD_COUNT>([&](auto i) {
+            if (strcmp(SENSORS[decltype(i)::value].sensorType, f | "") == 0) {
+                historyFieldMask |= 1UL << decltype(i)::value;
+            }
+        });
+    }
+    if (historyFieldMask == 0) {
+        historyFieldMask = 0xffffffffUL;
+    }
+    
+    // Include what is still buffered
+    flushHistory();
+    history.seek(historyCursor, from, to);
+    historyRequestId = requestId;
+    historyMaxRecords = doc["max_records"] | 0xffffffffUL;
+    historySent = 0;
+    historyChunk = 0;
+    historyQueryActive = true;
+    Serial.println("History request " + requestId + ": " + String(from) + ".." + String(to));
+}
+
+void sendHistoryChunk() {
+    // Fill the chunk with records of the requested fields
+    size_t count = 0;
+    uint32_t want = min((uint32_t)HISTORY_CHUNK_RECORDS, historyMaxRecords - historySent);
+    while (count < want && !historyCursor.done) {
+        size_t base = count;
+        size_t n = history.read(historyCursor, historyChunkBuffer + base, want - base);
+        for (size_t k = 0; k < n; k++) {
+            HistoryRecord r = historyChunkBuffer[base + k];
+            if (historyFieldMask & (1UL << r.field)) {
+                historyChunkBuffer[count++] = r;
+            }
+        }
+    }
+    historySent += count;
+    bool done = historyCursor.done || historySent >= historyMaxRecords;
+    
+    DynamicJsonDocument doc(512 + SENSOR_FIELD_COUNT * 64 + HISTORY_CHUNK_RECORDS * 48);
+    doc["device_id"] = device_id;
+    doc["request_id"] = historyRequestId;
+    doc["chunk"] = historyChunk;
+    
+    // Field numbers index this table; values are scaled by 10^decimals
+    if (historyChunk == 0) {
+        JsonArray fields = doc.createNestedArray("fields");
+        forEachSensor<SENSOR_FIELD_COUNT>([&](auto i) {
+            JsonArray field = fields.createNestedArray();
+            field.add(SENSORS[decltype(i)::value].sensorType);
+            field.add(SENSORS[decltype(i)::value].decimals);
+        });
+    }
+    
+    // Flat [ms after t0, field, value] triples
+    uint64_t t0 = count > 0 ? (uint64_t)historyChunkBuffer[0].time * 1000 + historyChunkBuffer[0].ms : 0;
+    doc["t0"] = t0;
+    JsonArray records = doc.createNestedArray("r");
+    for (size_t k = 0; k < count; k++) {
+        const HistoryRecord &r = historyChunkBuffer[k];
+        records.add((uint32_t)((uint64_t)r.time * 1000 + r.ms - t0));
+        records.add(r.field);
+        records.add(r.value);
+    }
+    
+    if (done) {
+        doc["done"] = true;
+        doc["total"] = historySent;
+        doc["status"] = historyCursor.done ? "complete" : "truncated";
+    }
+    
+    stampMessage(doc, OUT_HISTORY);
+    String jsonString;
+    serializeJson(doc, jsonString);
+    
+    String historyTopic = "devices/" + device_id + "/history/data";
+    if (!publishMessage(historyTopic, jsonString, false, 1)) {
+        Serial.println("✗ History chunk " + String(historyChunk) + " not sent, request dropped");
+        historyQueryActive = false;
+        return;
+    }
+    historyChunk++;
+    
+    if (done) {
+        historyQueryActive = false;
+        Serial.println("✓ History request " + historyRequestId + ": " + String(historySent) + " records in " +
+                       String(historyChunk) + " chunks");
+    }
+}
+
+// Answer a request that streams nothing
+void finishHistoryQuery(const String &requestId, const char* status) {
+    DynamicJsonDocument doc(256);
+    doc["device_id"] = device_id;
+    doc["request_id"] = requestId;
+    doc["chunk"] = 0;
+    doc["done"] = true;
+    doc["total"] = 0;
+    doc["status"] = status;
+    stampMessage(doc, OUT_HISTORY);
+    String jsonString;
+    serializeJson(doc, jsonString);
+    publishMessage("devices/" + device_id + "/history/data", jsonString, false, 1);
+    Serial.println("History request " + requestId + ": " + status);
+}
+
+// Payload: {"file":"/drive.nmea","speed":100,"loop":false}
+void startGpsReplay(String payload) {
+    DynamicJsonDocument doc(256);
+    if (deserializeJson(doc, payload) || !mountGpsTraceFs()) {
+        publishControlResponse("gps_replay", "error");
+        return;
+    }
+    
+    String path = doc["file"] | "/trace.nmea";
+    uint16_t speed = constrain((int)(doc["speed"] | 1), 1, 1000);
+    
+    if (gpsReplayActive) {
+        gpsReplayFile.close();
+    } else {
+        gpsReplayResumeSim = useSimulatedGPS;
+    }
+    gpsReplayFile = LittleFS.open(path, "r");
+    if (!gpsReplayFile || gpsReplayFile.size() == 0) {
+        Serial.println("✗ NMEA trace not found: " + path);
+        gpsReplayActive = false;
+        publishControlResponse("gps_replay", "not_found");
+        return;
+    }
+    
+    gpsReplayLoop = doc["loop"] | false;
+    gpsReplayPacer.begin(speed);
+    gpsReplayPending = false;
+    gpsReplayStart = millis();
+    gpsReplaySentences = 0;
+    gpsReplayFixes = 0;
+    gpsReplayChecksumBase = gps.failedChecksum();
+    gpsReplayActive = true;
+    useSimulatedGPS = false;
+    gpsValid = false;
+    
+    Serial.println("✓ Replaying " + path + " (" + String(gpsReplayFile.size()) + " bytes) at " + String(speed) + "x");
+    publishControlResponse("gps_replay", "started");
+}
+
+void readGPSReplay() {
+    unsigned long elapsed = millis() - gpsReplayStart;
+    
+    for (int n = 0; n < GPS_REPLAY_MAX_LINES; n++) {
+        if (!gpsReplayPending) {
+            if (!gpsReplayFile.available()) {
+                if (!gpsReplayLoop) {
+                    stopGpsReplay("finished");
+                    return;
+                }
+                gpsReplayFile.seek(0);
+                gpsReplayPacer.begin(gpsReplayPacer.speed());
+                gpsReplayStart = millis();
+                elapsed = 0;
+            }
+            
+            size_t len = gpsReplayFile.readBytesUntil('\n', gpsReplayLine, sizeof(gpsReplayLine) - 1);
+            if (len > 0 && gpsReplayLine[len - 1] == '\r') {
+                len--;
+            }
+            gpsReplayLine[len] = '\0';
+            gpsReplayDue = gpsReplayPacer.dueAt(gpsReplayLine);
+            gpsReplayPending = true;
+        }
+        
+        if (gpsReplayDue > elapsed) {
+            return;
+        }
+        
+        for (char* p = gpsReplayLine; *p; p++) {
+            gpsFeedByte(*p);
+        }
+        gpsFeedByte('\n');
+        gpsReplaySentences++;
+        gpsReplayPending = false;
+    }
+}
+
+void stopGpsReplay(String reason) {
+    if (!gpsReplayActive) return;
+    
+    gpsReplayActive = false;
+    gpsReplayFile.close();
+    useSimulatedGPS = gpsReplayResumeSim;
+    lastLocationChange = millis();
+    
+    unsigned long elapsed = millis() - gpsReplayStart;
+    Serial.println("Replay " + reason + ": " + String(gpsReplaySentences) + " sentences, " +
+                   String(gpsReplayFixes) + " fixes, " + String(gps.failedChecksum() - gpsReplayChecksumBase) +
+                   " bad checksums, " + String(gpsReplayPacer.traceElapsed() / 1000) + "s of trace in " +
+                   String(elapsed) + "ms");
+    publishControlResponse("gps_replay", reason);
+}
+
+// Payload: {"file":"/drive.nmea","max_bytes":262144}
+void startGpsCapture(String payload) {
+    DynamicJsonDocument doc(256);
+    if (deserializeJson(doc, payload) || !mountGpsTraceFs()) {
+        publishControlResponse("gps_capture", "error");
+        return;
+    }
+    
+    stopGpsCapture("restarted");
+    String path = doc["file"] | "/trace.nmea";
+    gpsCaptureFile = LittleFS.open(path, "w");
+    if (!gpsCaptureFile) {
+        Serial.println("✗ Cannot create " + path);
+        publishControlResponse("gps_capture", "error");
+        return;
+    }
+    
+    gpsCaptureLimit = doc["max_bytes"] | GPS_CAPTURE_MAX_BYTES;
+    gpsCaptureLen = 0;
+    gpsCaptureBytes = 0;
+    gpsCaptureActive = true;
+    // Recording needs the UART even when the simulator took over
+    useSimulatedGPS = false;
+    
+    Serial.println("✓ Capturing GPS UART to " + path);
+    publishControlResponse("gps_capture", "started");
+}
+
+void captureGpsByte(uint8_t c) {
+    gpsCaptureBuffer[gpsCaptureLen++] = c;
+    gpsCaptureBytes++;
+    if (gpsCaptureLen == sizeof(gpsCaptureBuffer)) {
+        if (gpsCaptureFile.write(gpsCaptureBuffer, gpsCaptureLen) != gpsCaptureLen) {
+            gpsCaptureLen = 0;
+            stopGpsCapture("flash_full");
+            return;
+        }
+        gpsCaptureLen = 0;
+    }
+    if (gpsCaptureBytes >= gpsCaptureLimit) {
+        stopGpsCapture("limit_reached");
+    }
+}
+
+void stopGpsCapture(String reason) {
+    if (!gpsCaptureActive) return;
+    
+    gpsCaptureActive = false;
+    if (gpsCaptureLen > 0) {
+        gpsCaptureFile.write(gpsCaptureBuffer, gpsCaptureLen);
+        gpsCaptureLen = 0;
+    }
+    gpsCaptureFile.close();
+    
+    Serial.println("Capture " + reason + ": " + String(gpsCaptureBytes) + " bytes");
+    publishControlResponse("gps_capture", reason);
+}
+
+#if !PRODUCTION_BUILD
+void generateGPSData() {
+    gpsCourse = NAN;
+    if (generateInsideGeofence) {
+        generateInsideXorafi();
+    } else {
+        generateOutsideXorafi();
+    }
+    
+    generateGPSTimestamp();
+    evaluateAlertRules(SENSOR_GPS);
+}
+
+void generateInsideXorafi() {
+    // Updated coordinates for the new rectangular Xorafi polygon
+    // Based on your new geojson: lat range 39.495387 to 39.529577, lng range -107.744122 to -107.653999
+    
+    // For a rectangle, we can generate points more efficiently
+    // Generate random point within bounding box (all points will be inside for a rectangle)
+    double testLat = XORAFI_MIN_LAT + (random(0, 1000001) / 1000000.0) * (XORAFI_MAX_LAT - XORAFI_MIN_LAT);
+    double testLng = XORAFI_MIN_LNG + (random(0, 1000001) / 1000000.0) * (XORAFI_MAX_LNG - XORAFI_MIN_LNG);
+    
+    // Since your new polygon is a rectangle, any point within the bounding box is guaranteed to be inside
+    latitude = testLat;
+    longitude = testLng;
+    
+    // Set Colorado-appropriate values
+    altitude = 2500.0 + random(-100, 101);  // 2400-2600m elevation (Colorado altitude)
+    speed_kmh = random(0, 31) / 10.0;       // 0-3 km/h (stationary to walking speed)
+    satellites = random(10, 15);            // Good satellite count for clear sky
+    gpsValid = true;
+    
+    Serial.println("✓ INSIDE Xorafi rectangle generated");
+    Serial.println("GPS: " + String(latitude, 6) + ", " + String(longitude, 6) + " (INSIDE)");
+    Serial.println("Bounds: Lat[" + String(XORAFI_MIN_LAT, 6) + " to " + String(XORAFI_MAX_LAT, 6) + "] Lng[" + String(XORAFI_MIN_LNG, 6) + " to " + String(XORAFI_MAX_LNG, 6) + "]");
+}
+
+
+void generateOutsideXorafi() {
+    int locationChoice = random(0, 4);
+    
+    switch (locationChoice) {
         case 0: // San Francisco
             latitude = SF_BASE_LAT + (random(-1000, 1001) / 100000.0);
             longitude = SF_BASE_LNG + (random(-1000, 1001) / 100000.0);
@@ -436,28 +1979,25 @@ void generateOutsideXorafi() {
     
     Serial.println("GPS: " + String(latitude, 6) + ", " + String(longitude, 6) + " (OUTSIDE)");
 }
+#endif
 
-// Ray casting algorithm to check if point is inside polygon
+// Points on the boundary count as inside, as on the server
 bool isPointInPolygon(double lat, double lng) {
-    int intersections = 0;
-    
-    for (int i = 0; i < XORAFI_COORD_COUNT - 1; i++) {
-        double x1 = XORAFI_COORDS[i][0];     // longitude
-        double y1 = XORAFI_COORDS[i][1];     // latitude
-        double x2 = XORAFI_COORDS[i + 1][0]; // longitude
-        double y2 = XORAFI_COORDS[i + 1][1]; // latitude
-        
-        // Check if ray crosses this edge
-        if (((y1 > lat) != (y2 > lat)) &&
-            (lng < (x2 - x1) * (lat - y1) / (y2 - y1) + x1)) {
-            intersections++;
-        }
-    }
-    
-    return (intersections % 2) == 1; // Odd number = inside
+    return fences.fenceCount > 0 && geofenceContains(fences, 0, lat, lng);
 }
 
 void generateGPSTimestamp() {
+    time_t now = time(nullptr);
+    if (now >= CLOCK_VALID_AFTER) {
+        struct tm utc;
+        char timeBuffer[32];
+        gmtime_r(&now, &utc);
+        strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", &utc);
+        gpsTimestamp = String(timeBuffer);
+        return;
+    }
+    
+    // Clock not set yet: uptime on a fixed date
     unsigned long currentTime = millis() / 1000;
     char timeBuffer[32];
     sprintf(timeBuffer, "2025-06-22 %02d:%02d:%02d", 
@@ -467,26 +2007,126 @@ void generateGPSTimestamp() {
     gpsTimestamp = String(timeBuffer);
 }
 
-void readSensors() {
-    // Read DHT22 sensor
-    humidity = dht.readHumidity();
-    temperature = dht.readTemperature();
-    
-    // Check if DHT22 readings are valid
-    if (isnan(humidity) || isnan(temperature)) {
-        Serial.println("Failed to read from DHT22 sensor!");
-        if (isnan(humidity)) humidity = -1;
-        if (isnan(temperature)) temperature = -999;
+void startClock() {
+    sntp_set_time_sync_notification_cb(onClockSynced);
+    configTime(0, 0, "pool.ntp.org", "time.google.com");
+}
+
+void onClockSynced(struct timeval* tv) {
+    clockSource = CLOCK_SNTP;
+    lastClockSync = millis();
+    Serial.println("✓ Clock synced via SNTP");
+}
+
+void syncClockFromGPS() {
+    // Only trust a sentence that was just parsed
+    if (gps.time.age() > 500 || gps.date.year() < 2020) {
+        return;
+    }
+    if (clockSource == CLOCK_GPS && millis() - lastClockSync < GPS_CLOCK_RESYNC) {
+        return;
     }
     
-    // Read photoresistor (light sensor)
-    int rawLight = analogRead(PHOTORESISTOR_PIN);
-    lightLevel = map(rawLight, 0, 4095, 0, 100);
-    
-    // Read potentiometer
-    int rawPot = analogRead(POTENTIOMETER_PIN);
-    potValue = map(rawPot, 0, 4095, 0, 100);
+    // Days since 1970-01-01 for the Gregorian date
+    int y = gps.date.year();
+    int m = gps.date.month();
+    int d = gps.date.day();
+    y -= m <= 2;
+    long era = y / 400;
+    long yoe = y - era * 400;
+    long doy = (153L * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = era * 146097 + doe - 719468;
+    
+    struct timeval tv;
+    tv.tv_sec = (time_t)days * 86400 + gps.time.hour() * 3600L + gps.time.minute() * 60L + gps.time.second();
+    // The fix time is the start of the reported second; add what has passed since
+    long usec = gps.time.centisecond() * 10000L + gps.time.age() * 1000L;
+    tv.tv_sec += usec / 1000000L;
+    tv.tv_usec = usec % 1000000L;
+    settimeofday(&tv, nullptr);
+    
+    if (clockSource != CLOCK_GPS) {
+        Serial.println("✓ Clock disciplined by GPS");
+    }
+    clockSource = CLOCK_GPS;
+    lastClockSync = millis();
+}
+
+// Epoch milliseconds, or 0 while the clock has never been set
+uint64_t epochMillis() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    if (tv.tv_sec < CLOCK_VALID_AFTER) {
+        return 0;
+    }
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// Add boot id, per-topic sequence number and send time right before publishing
+void stampMessage(JsonDocument &doc, OutboundTopic topic) {
+    doc["boot_id"] = bootId;
+    doc["seq"] = ++outboundSeq[topic];
+    doc["sent_at"] = epochMillis();
+}
+
+void readSensors() {
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        if (sensorSchedule[i].enabled) {
+            readSensor(i);
+        }
+    }
+    readSystemMetrics();
     
+    // Print sensor readings to Serial Monitor
+    Serial.println("=== Sensor Readings ===");
+    forEachSensor<SENSOR_FIELD_COUNT>([&](auto i) {
+        constexpr const SensorDef &s = SENSORS[decltype(i)::value];
+        if constexpr (s.sample != nullptr) {
+            Serial.println(String(s.sensorName) + ": " + String(s.value(), (unsigned int)s.decimals) + " " + s.unit);
+        }
+    });
+    Serial.println("WiFi Signal: " + String(wifiSignal) + " dBm");
+    Serial.println("========================");
+}
+
+// Run the channel's sampler, which fills every row it feeds. GPS is
+// stream-driven and ingested by readGPSData() every loop, so it has none.
+void readSensor(int channel) {
+    if (SENSOR_SAMPLERS[channel]) {
+        SENSOR_SAMPLERS[channel]();
+    }
+}
+
+void sampleTemperature() {
+    temperature = dht.readTemperature();
+    if (isnan(temperature)) {
+        Serial.println("Failed to read temperature from DHT22 sensor!");
+        temperature = -999;
+    } else {
+        temperature += tempOffset;
+    }
+}
+
+void sampleHumidity() {
+    humidity = dht.readHumidity();
+    if (isnan(humidity)) {
+        Serial.println("Failed to read humidity from DHT22 sensor!");
+        humidity = -1;
+    } else {
+        humidity += humOffset;
+    }
+}
+
+void sampleLight() {
+    lightLevel = map(analogRead(PHOTORESISTOR_PIN), 0, 4095, 0, 100);
+}
+
+void samplePotentiometer() {
+    potValue = map(analogRead(POTENTIOMETER_PIN), 0, 4095, 0, 100);
+}
+
+void readSystemMetrics() {
     // Read WiFi signal strength
     wifiSignal = WiFi.RSSI();
     
@@ -494,46 +2134,160 @@ void readSensors() {
     batteryLevel = max(10.0, batteryLevel - 0.01);
     if (batteryLevel <= 10.0) batteryLevel = 100.0;
     
-    // Apply calibration offsets
-    temperature += tempOffset;
-    humidity += humOffset;
+    updatePowerPolicy();
+}
+
+void runSensorSchedule(unsigned long now) {
+    uint32_t publishMask = 0;
     
-    // Print sensor readings to Serial Monitor
-    Serial.println("=== Sensor Readings ===");
-    Serial.println("Temperature: " + String(temperature) + "°C");
-    Serial.println("Humidity: " + String(humidity) + "%");
-    Serial.println("Light Level: " + String(lightLevel) + "%");
-    Serial.println("Potentiometer: " + String(potValue) + "%");
-    Serial.println("WiFi Signal: " + String(wifiSignal) + " dBm");
-    Serial.println("========================");
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        SensorSchedule &sched = sensorSchedule[i];
+        if (!sched.enabled) continue;
+        
+        if (sched.sampleInterval > 0 && now - sched.lastSample >= sched.sampleInterval * powerSampleScale) {
+            sched.lastSample = now;
+            samplesSaved += powerSampleScale - 1;
+            readSensor(i);
+            logHistorySamples(i);
+            
+            // Only published channels have a window to close
+            if (aggregationEnabled && sched.publishInterval > 0) {
+                accumulatorAdd(sensorWindow[i], sensorValue(i));
+            }
+            
+            evaluateAlertRules(i);
+        }
+        
+        // GPS has its own topic; its coordinates ride along with any data message
+        if (i != SENSOR_GPS && sched.publishInterval > 0 && now - sched.lastPublish >= sched.publishInterval * powerPublishScale) {
+            sched.lastPublish = now;
+            publishMask |= (1UL << i);
+        }
+    }
+    
+    if (publishMask) {
+        if (sensorSchedule[SENSOR_GPS].enabled) {
+            publishMask |= (1UL << SENSOR_GPS);
+        }
+        publishSensorData(publishMask);
+        publishesSaved += powerPublishScale - 1;
+        
+        for (int i = 0; i < SENSOR_COUNT; i++) {
+            if (publishMask & (1UL << i)) {
+                accumulatorReset(sensorWindow[i]);
+            }
+        }
+    }
+}
+
+// Make every enabled channel due and run the schedule once, so the first
+// readings go out as soon as the broker is up instead of a publish interval
+// after boot
+void publishFirstTelemetry() {
+    unsigned long now = millis();
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        SensorSchedule &sched = sensorSchedule[i];
+        sched.lastSample = now - sched.sampleInterval * powerSampleScale;
+        sched.lastPublish = now - sched.publishInterval * powerPublishScale;
+    }
+    runSensorSchedule(now);
+}
+
+// Current value of a channel, NAN when the last reading failed
+float sensorValue(int channel) {
+    float value = NAN;
+    forEachSensor<SENSOR_FIELD_COUNT>([&](auto i) {
+        constexpr const SensorDef &s = SENSORS[decltype(i)::value];
+        if constexpr (s.sample != nullptr) {
+            if (channel == s.channel) {
+                value = s.value();
+            }
+        }
+    });
+    return value;
+}
+
+// Replace the point value with the window summary when one is available
+void addWindowStats(JsonObject sensor, int channel) {
+    const SensorAccumulator &acc = sensorWindow[channel];
+    if (!aggregationEnabled || acc.count == 0) return;
+    
+    sensor["value"] = round(acc.mean * 100) / 100.0;
+    sensor["min"] = acc.minValue;
+    sensor["max"] = acc.maxValue;
+    sensor["stddev"] = round(sqrt(accumulatorVariance(acc)) * 1000) / 1000.0;
+    sensor["samples"] = acc.count;
+}
+
+int findSensorChannel(const char* sensorType) {
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        if (strcmp(sensorSchedule[i].sensorType, sensorType) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+unsigned long minSampleInterval(int channel) {
+    for (const SensorDef &s : SENSORS) {
+        if (s.channel == channel) return s.minSampleInterval;
+    }
+    return MIN_SAMPLE_INTERVAL;
 }
 
 void updateLCD() {
-    lcd.clear();
+    char line[LCD_COLS + 8];
     
     if (gpsValid) {
         // Show GPS coordinates and geofence status on LCD
-        lcd.setCursor(0, 0);
-        lcd.print("GPS: " + String(latitude, 4));
-        lcd.setCursor(0, 1);
-        String mode = generateInsideGeofence ? "IN" : "OUT";
-        lcd.print(mode + ": " + String(longitude, 4));
+        snprintf(line, sizeof(line), "GPS: %.4f", latitude);
+        lcdFrame.setLine(0, line);
+#if !PRODUCTION_BUILD
+        bool inside = generateInsideGeofence;
+#else
+        bool inside = isPointInPolygon(latitude, longitude);
+#endif
+        snprintf(line, sizeof(line), "%s: %.4f", inside ? "IN" : "OUT", longitude);
+        lcdFrame.setLine(1, line);
     } else {
-        // Show sensor data when GPS not available
-        lcd.setCursor(0, 0);
-        if (temperature != -999 && humidity != -1) {
-            lcd.print("T:" + String(temperature, 1) + "C H:" + String(humidity, 1) + "%");
-        } else {
-            lcd.print("DHT22 Error!");
-        }
+        // Show sensor data when GPS not available: registry rows with an
+        // LCD format, two per row, "T:--" for a failed reading
+        char rows[LCD_ROWS][LCD_COLS + 8] = {};
+        int slot = 0;
+        forEachSensor<SENSOR_FIELD_COUNT>([&](auto i) {
+            constexpr const SensorDef &s = SENSORS[decltype(i)::value];
+            if constexpr (s.lcdFormat != nullptr) {
+                if (slot >= LCD_ROWS * 2) return;
+                char item[LCD_COLS + 1];
+                double value = s.value();
+                if (isnan(value)) {
+                    const char* colon = strchr(s.lcdFormat, ':');
+                    snprintf(item, sizeof(item), "%.*s--", colon ? (int)(colon - s.lcdFormat + 1) : 0, s.lcdFormat);
+                } else {
+                    snprintf(item, sizeof(item), s.lcdFormat, value);
+                }
+                char* row = rows[slot / 2];
+                size_t used = strlen(row);
+                snprintf(row + used, sizeof(rows[0]) - used, slot % 2 ? " %s" : "%s", item);
+                slot++;
+            }
+        });
         
-        lcd.setCursor(0, 1);
-        lcd.print("L:" + String(lightLevel) + "% P:" + String(potValue) + "%");
+        for (uint8_t row = 0; row < LCD_ROWS; row++) {
+            lcdFrame.setLine(row, rows[row]);
+        }
     }
+    
+    lcdFrame.flush();
 }
 
-void publishSensorData() {
-    DynamicJsonDocument doc(4096);
+void publishSensorData(uint32_t channelMask) {
+    if (telemetryDictionary) {
+        publishCompactSensorData(channelMask);
+        return;
+    }
+    
+    DynamicJsonDocument doc(1024 + SENSOR_FIELD_COUNT * 384);
     
     // Device info
     doc["device_id"] = device_id;
@@ -543,74 +2297,156 @@ void publishSensorData() {
     // Create sensors array
     JsonArray sensors = doc.createNestedArray("sensors");
     
-    // GPS Latitude
-    JsonObject gpsLat = sensors.createNestedObject();
-    gpsLat["sensor_name"] = "GPS Latitude";
-    gpsLat["sensor_type"] = "gps_latitude";
-    gpsLat["value"] = latitude;
-    gpsLat["unit"] = "degrees";
-    gpsLat["accuracy"] = 95;
-    gpsLat["location"] = "Device";
-    gpsLat["enabled"] = true;
-    gpsLat["reading_timestamp"] = gpsTimestamp;
-    
-    // GPS Longitude
-    JsonObject gpsLng = sensors.createNestedObject();
-    gpsLng["sensor_name"] = "GPS Longitude";
-    gpsLng["sensor_type"] = "gps_longitude";
-    gpsLng["value"] = longitude;
-    gpsLng["unit"] = "degrees";
-    gpsLng["accuracy"] = 95;
-    gpsLng["location"] = "Device";
-    gpsLng["enabled"] = true;
-    gpsLng["reading_timestamp"] = gpsTimestamp;
-    
-    // GPS Altitude
-    JsonObject gpsAlt = sensors.createNestedObject();
-    gpsAlt["sensor_name"] = "GPS Altitude";
-    gpsAlt["sensor_type"] = "gps_altitude";
-    gpsAlt["value"] = altitude;
-    gpsAlt["unit"] = "meters";
-    gpsAlt["accuracy"] = 90;
-    gpsAlt["location"] = "Device";
-    gpsAlt["enabled"] = true;
-    gpsAlt["reading_timestamp"] = gpsTimestamp;
-    
-    // Temperature
-    JsonObject temp = sensors.createNestedObject();
-    temp["sensor_name"] = "Temperature";
-    temp["sensor_type"] = "temperature";
-    temp["value"] = temperature;
-    temp["unit"] = "°C";
-    temp["accuracy"] = 98;
-    temp["location"] = "Device";
-    temp["enabled"] = true;
-    temp["reading_timestamp"] = gpsTimestamp;
-    
-    // Humidity
-    JsonObject hum = sensors.createNestedObject();
-    hum["sensor_name"] = "Humidity";
-    hum["sensor_type"] = "humidity";
-    hum["value"] = humidity;
-    hum["unit"] = "%";
-    hum["accuracy"] = 95;
-    hum["location"] = "Device";
-    hum["enabled"] = true;
-    hum["reading_timestamp"] = gpsTimestamp;
+    forEachSensor<SENSOR_FIELD_COUNT>([&](auto i) {
+        constexpr const SensorDef &s = SENSORS[decltype(i)::value];
+        if (!(channelMask & (1UL << s.channel))) return;
+        
+        JsonObject sensor = sensors.createNestedObject();
+        sensor["sensor_name"] = s.sensorName;
+        sensor["sensor_type"] = s.sensorType;
+        sensor["value"] = s.value();
+        sensor["unit"] = s.unit;
+        sensor["accuracy"] = s.accuracy;
+        sensor["location"] = "Device";
+        sensor["enabled"] = true;
+        sensor["reading_timestamp"] = gpsTimestamp;
+        if constexpr (s.sample != nullptr) {
+            addWindowStats(sensor, s.channel);
+        }
+    });
     
     // Serialize and send
+    stampMessage(doc, OUT_DATA);
     String jsonString;
     serializeJson(doc, jsonString);
     
     String dataTopic = "devices/" + device_id + "/data";
-    if (client.publish(dataTopic, jsonString, false, 1)) {
+    if (publishTelemetry(dataTopic, jsonString)) {
         Serial.println("✓ Sensor data sent successfully");
+#if !PRODUCTION_BUILD
         Serial.println("Mode: " + String(generateInsideGeofence ? "INSIDE" : "OUTSIDE") + " Xorafi 1");
+#endif
+    } else {
+        Serial.println("✗ Failed to send sensor data");
+    }
+}
+
+// Dictionary mode: values by position in SENSORS, null where a row is not
+// part of this publish, then min, max, stddev and samples of each sampled
+// row, null without a window. The device is identified by the topic.
+void publishCompactSensorData(uint32_t channelMask) {
+    DynamicJsonDocument doc(256 + (SENSOR_FIELD_COUNT + SENSOR_WINDOW_FIELDS * 4) * 48);
+    
+    JsonArray values = doc.createNestedArray("d");
+    values.add(SENSOR_SCHEMA_VERSION);
+    values.add(epochMillis());
+    forEachSensor<SENSOR_FIELD_COUNT>([&](auto i) {
+        constexpr const SensorDef &s = SENSORS[decltype(i)::value];
+        double value = sensorFieldValue(s);
+        if (!(channelMask & (1UL << s.channel)) || isnan(value)) {
+            values.add(serialized("null"));
+        } else {
+            values.add(serialized(String(value, (unsigned int)s.decimals)));
+        }
+    });
+    forEachSensor<SENSOR_FIELD_COUNT>([&](auto i) {
+        constexpr const SensorDef &s = SENSORS[decltype(i)::value];
+        if constexpr (s.sample != nullptr) {
+            const SensorAccumulator &acc = sensorWindow[s.channel];
+            if (!(channelMask & (1UL << s.channel)) || !aggregationEnabled || acc.count == 0) {
+                for (uint8_t k = 0; k < 4; k++) {
+                    values.add(serialized("null"));
+                }
+                return;
+            }
+            values.add(serialized(String(acc.minValue, (unsigned int)s.decimals)));
+            values.add(serialized(String(acc.maxValue, (unsigned int)s.decimals)));
+            values.add(serialized(String(sqrt(accumulatorVariance(acc)), (unsigned int)s.decimals + 1)));
+            values.add(acc.count);
+        }
+    });
+    
+    stampMessage(doc, OUT_DATA);
+    String jsonString;
+    serializeJson(doc, jsonString);
+    
+    String dataTopic = "devices/" + device_id + "/data";
+    if (publishTelemetry(dataTopic, jsonString)) {
+        Serial.println("✓ Sensor data sent (" + String(jsonString.length()) + " bytes, schema v" +
+                       String(SENSOR_SCHEMA_VERSION) + ")");
     } else {
         Serial.println("✗ Failed to send sensor data");
     }
 }
 
+// Value of a registry row: the window mean when aggregating, NAN when unavailable
+double sensorFieldValue(const SensorDef &field) {
+    if (field.sample != nullptr) {
+        const SensorAccumulator &acc = sensorWindow[field.channel];
+        if (aggregationEnabled && acc.count > 0) {
+            return acc.mean;
+        }
+    }
+    return field.value();
+}
+
+// QoS 1 telemetry; over MQTT 5 the broker drops it once it is stale
+bool publishTelemetry(const String &topic, const String &payload) {
+    bool sent = publishMessage(topic, payload, false, 1, MQTT_TELEMETRY_EXPIRY);
+    if (sent && !bootFirstPublishMs) {
+        bootFirstPublishMs = millis();
+    }
+    return sent;
+}
+
+// Publish, compressing payloads of MQTT_COMPRESS_THRESHOLD bytes or more
+// when that makes them smaller. expiry only applies over MQTT 5.
+bool publishMessage(const String &topic, const String &payload, bool retained, int qos, uint32_t expiry) {
+    const uint8_t* data = (const uint8_t*)payload.c_str();
+    size_t length = payload.length();
+    
+#if MQTT_COMPRESS
+    if (compressionEnabled && length >= MQTT_COMPRESS_THRESHOLD && length <= LZ4_MAX_INPUT) {
+        unsigned long start = micros();
+        // Only worth sending when it saves more than the header costs
+        size_t packed = lz4Compress(data, length, compressBuffer + 3, min(sizeof(compressBuffer), length) - 3, compressTable);
+        compressMicros += micros() - start;
+        if (packed > 0) {
+            compressBuffer[0] = MQTT_COMPRESSED_MARKER;
+            compressBuffer[1] = length & 0xff;
+            compressBuffer[2] = length >> 8;
+            compressedMessages++;
+            compressRawBytes += length;
+            compressSentBytes += packed + 3;
+            data = compressBuffer;
+            length = packed + 3;
+        }
+    }
+#endif
+    
+    bool sessionUp = client.connected();
+#if MQTT_USE_V5
+    bool ok = client.publish(topic.c_str(), data, length, retained, qos, expiry);
+#else
+    bool ok = client.publish(topic.c_str(), (const char*)data, (int)length, retained, qos);
+#endif
+    // The loop fails over before the next cycle instead of waiting for keepalive.
+    // Publishes into a session that is already gone say nothing about the broker.
+    if (sessionUp && brokers.recordPublish(ok) && !brokerReconnectPending) {
+        brokerReconnectPending = true;
+        brokerFailed = true;
+    }
+    
+    // Radio wake and the reduced clock both show up here
+    if (ok && wakePublishPending) {
+        wakePublishPending = false;
+        unsigned long us = micros() - loopWakeAt;
+        wakeToPublishAvg = wakePublishes++ == 0 ? us / 1000.0 : wakeToPublishAvg * 0.9 + us / 1000.0 * 0.1;
+        wakeToPublishMax = max(wakeToPublishMax, us);
+    }
+    return ok;
+}
+
 void publishGPSData() {
     if (!gpsValid) return;
     
@@ -619,31 +2455,99 @@ void publishGPSData() {
     doc["device_id"] = device_id;
     doc["timestamp"] = gpsTimestamp;
     doc["simulated"] = useSimulatedGPS;
+    doc["replay"] = gpsReplayActive;
+#if !PRODUCTION_BUILD
     doc["geofence_mode"] = generateInsideGeofence ? "inside" : "outside";
+#endif
+    doc["trigger"] = GPS_TRIGGER_NAMES[gpsLastTrigger];
     
     JsonObject location = doc.createNestedObject("location");
     location["latitude"] = latitude;
     location["longitude"] = longitude;
     location["altitude"] = altitude;
     location["speed_kmh"] = speed_kmh;
+    if (!isnan(gpsCourse)) {
+        location["course"] = round(gpsCourse * 10) / 10.0;
+    }
     location["satellites"] = satellites;
     location["valid"] = gpsValid;
     
+    char geohash[GEOHASH_MAX_PRECISION + 1];
+    geohashEncode((int32_t)lround(latitude * 1e7), (int32_t)lround(longitude * 1e7), GPS_GEOHASH_PRECISION, geohash);
+    location["geohash"] = geohash;
+    
+    stampMessage(doc, OUT_GPS);
     String jsonString;
     serializeJson(doc, jsonString);
     
     String gpsTopic = "devices/" + device_id + "/gps";
-    if (client.publish(gpsTopic, jsonString, false, 1)) {
+    if (publishTelemetry(gpsTopic, jsonString)) {
         String gpsType = useSimulatedGPS ? "SIMULATED" : "REAL";
-        String mode = generateInsideGeofence ? "INSIDE" : "OUTSIDE";
-        Serial.println("✓ " + gpsType + " GPS data published (" + mode + ") - Lat:" + String(latitude, 6) + " Lng:" + String(longitude, 6));
+#if !PRODUCTION_BUILD
+        String mode = String(generateInsideGeofence ? "INSIDE" : "OUTSIDE") + ", ";
+#else
+        String mode = "";
+#endif
+        Serial.println("✓ " + gpsType + " GPS data published (" + mode + GPS_TRIGGER_NAMES[gpsLastTrigger] +
+                       ") - Lat:" + String(latitude, 6) + " Lng:" + String(longitude, 6));
     } else {
         Serial.println("✗ Failed to send GPS data");
     }
 }
 
+// Why the GPS channel should publish now, GPS_TRIGGER_NONE if it should not.
+// Heartbeats and the distance step stretch with the power policy.
+GpsTrigger gpsReportTrigger(unsigned long now) {
+    unsigned long since = now - lastGpsUpdate;
+    if (!gpsMotionAdaptive) {
+        return since > sensorSchedule[SENSOR_GPS].publishInterval * powerPublishScale ? GPS_TRIGGER_INTERVAL : GPS_TRIGGER_NONE;
+    }
+    if (!gpsReported) return GPS_TRIGGER_FIRST;
+    if (since < GPS_MIN_REPORT_GAP) return GPS_TRIGGER_NONE;
+    
+    bool moving = speed_kmh >= GPS_MOVING_KMH;
+    double moved = gpsDistanceMeters(gpsReportLat, gpsReportLng, latitude, longitude);
+    if (moved >= GPS_REPORT_DISTANCE * powerPublishScale) {
+        return GPS_TRIGGER_DISTANCE;
+    }
+    if (moving && !isnan(gpsCourse) && !isnan(gpsReportCourse) &&
+        gpsHeadingDelta(gpsReportCourse, gpsCourse) >= GPS_REPORT_HEADING) {
+        return GPS_TRIGGER_HEADING;
+    }
+    // One report where the asset came to rest, then silence
+    if (gpsReportMoving && !moving) {
+        return GPS_TRIGGER_STOPPED;
+    }
+    
+    unsigned long heartbeat = (moving ? GPS_MOVING_HEARTBEAT : GPS_PARKED_HEARTBEAT) * (unsigned long)powerPublishScale;
+    return since >= heartbeat ? GPS_TRIGGER_HEARTBEAT : GPS_TRIGGER_NONE;
+}
+
+void gpsMarkReported(GpsTrigger trigger) {
+    gpsReported = true;
+    gpsReportLat = latitude;
+    gpsReportLng = longitude;
+    gpsReportCourse = gpsCourse;
+    gpsReportMoving = speed_kmh >= GPS_MOVING_KMH;
+    gpsLastTrigger = trigger;
+    gpsTriggerCounts[trigger]++;
+}
+
+// Equirectangular approximation, well under 0.1% off at reporting distances
+double gpsDistanceMeters(double lat1, double lng1, double lat2, double lng2) {
+    double x = radians(lng2 - lng1) * cos(radians((lat1 + lat2) / 2));
+    double y = radians(lat2 - lat1);
+    return sqrt(x * x + y * y) * 6371000.0;
+}
+
+// Smallest angle between two courses, 0-180 degrees
+double gpsHeadingDelta(double from, double to) {
+    double delta = fmod(fabs(to - from), 360.0);
+    return delta > 180.0 ? 360.0 - delta : delta;
+}
+
 void publishDeviceStatus(String status) {
-    DynamicJsonDocument doc(512);
+    DynamicJsonDocument doc(4096);
     
     doc["device_id"] = device_id;
     doc["device_name"] = device_name;
@@ -655,24 +2559,177 @@ void publishDeviceStatus(String status) {
     doc["free_memory"] = ESP.getFreeHeap();
     doc["uptime"] = millis() / 1000;
     
+#if !PRODUCTION_BUILD
     // Add geofence testing info
     doc["geofence_test_mode"] = testGeofencing;
     doc["current_mode"] = generateInsideGeofence ? "inside" : "outside";
+#endif
     doc["gps_simulated"] = useSimulatedGPS;
+    doc["gps_replay"] = gpsReplayActive;
+    doc["gps_capture"] = gpsCaptureActive;
+    
+    // GPS receiver configuration and UART load
+    JsonObject receiver = doc.createNestedObject("gps_receiver");
+    receiver["type"] = gpsReceiver == GPS_RECEIVER_UBLOX ? "ublox" : (gpsReceiver == GPS_RECEIVER_MTK ? "mtk" : "unknown");
+    receiver["baud"] = gpsBaud;
+    receiver["nav_rate_hz"] = GPS_NAV_RATE_HZ;
+    receiver["verified"] = gpsConfigVerified;
+    receiver["bytes_per_fix"] = gpsUartFixes ? gpsUartBytes / gpsUartFixes : 0;
+    doc["lcd_i2c_bytes"] = lcdFrame.bytesLastFlush;
+    
+    // GPS reports by trigger since boot
+    JsonObject motion = doc.createNestedObject("gps_motion");
+    motion["adaptive"] = gpsMotionAdaptive;
+    motion["moving"] = speed_kmh >= GPS_MOVING_KMH;
+    JsonObject triggers = motion.createNestedObject("triggers");
+    for (int i = GPS_TRIGGER_FIRST; i < GPS_TRIGGER_COUNT; i++) {
+        if (gpsTriggerCounts[i]) {
+            triggers[GPS_TRIGGER_NAMES[i]] = gpsTriggerCounts[i];
+        }
+    }
     
+    // Last connection timing
+    JsonObject timing = doc.createNestedObject("connect_timing");
+    timing["wifi_assoc_ms"] = wifiAssocMs;
+    timing["wifi_dhcp_ms"] = wifiDhcpMs;
+    timing["mqtt_connect_ms"] = mqttConnectMs;
+    timing["fast_join"] = wifiFastJoinUsed;
+    
+    // Boot path of this run (ms since the app started)
+    JsonObject boot = doc.createNestedObject("boot");
+    boot["profile"] = PRODUCTION_BUILD ? "production" : "development";
+    boot["wifi_ms"] = bootWiFiMs;
+    boot["mqtt_ms"] = bootMqttMs;
+    boot["first_publish_ms"] = bootFirstPublishMs;
+    
+    // MQTT protocol in use and topic alias savings
+    JsonObject mqtt = doc.createNestedObject("mqtt");
+#if MQTT_USE_V5
+    mqtt["protocol"] = client.protocolVersion() == 5 ? "5.0" : "3.1.1";
+    mqtt["topic_alias_max"] = client.topicAliasMax();
+    mqtt["aliases"] = client.aliasesUsed();
+    mqtt["tx_bytes"] = client.bytesSent();
+    mqtt["alias_bytes_saved"] = client.aliasBytesSaved();
+#else
+    mqtt["protocol"] = "3.1.1";
+#endif
+    
+    // Payload compression totals; us_per_msg includes attempts that did not pay off
+    JsonObject compression = doc.createNestedObject("compression");
+    compression["enabled"] = MQTT_COMPRESS && compressionEnabled;
+    compression["messages"] = compressedMessages;
+    compression["raw_bytes"] = compressRawBytes;
+    compression["sent_bytes"] = compressSentBytes;
+    compression["us_per_msg"] = compressedMessages ? compressMicros / compressedMessages : 0;
+    
+    // Clock used for sent_at
+    JsonObject clock = doc.createNestedObject("clock");
+    clock["source"] = clockSource == CLOCK_GPS ? "gps" : (clockSource == CLOCK_SNTP ? "sntp" : "none");
+    clock["synced_ago"] = clockSource == CLOCK_NONE ? 0 : (millis() - lastClockSync) / 1000;
+    
+    // Duty cycle decisions and what they saved against full rate
+    JsonObject power = doc.createNestedObject("power");
+    power["enabled"] = powerPolicy.enabled;
+    power["battery"] = round(batteryLevel * 10) / 10.0;
+    power["rssi_avg"] = isnan(rssiAverage) ? 0 : (int)round(rssiAverage);
+    power["battery_tier"] = batteryTier;
+    power["link_tier"] = linkTier;
+    power["sample_scale"] = powerSampleScale;
+    power["publish_scale"] = powerPublishScale;
+    power["changes"] = powerChanges;
+    power["reduced_s"] = (powerReducedMs + (powerPublishScale > 1 ? millis() - powerChangedAt : 0)) / 1000;
+    power["samples_saved"] = samplesSaved;
+    power["publishes_saved"] = publishesSaved;
+    
+    // Flash history coverage
+    JsonObject hist = doc.createNestedObject("history");
+    hist["enabled"] = historyReady;
+    hist["records"] = history.storedRecords();
+    hist["sectors"] = history.sectorsUsed();
+    hist["oldest"] = history.oldestTime();
+    hist["written"] = history.recordsWritten;
+    hist["write_errors"] = history.writeErrors;
+    
+    // Connected low-power mode and what it costs in responsiveness
+    JsonObject lowpower = doc.createNestedObject("lowpower");
+    lowpower["enabled"] = lowPower.enabled;
+    lowpower["cpu_mhz"] = getCpuFrequencyMhz();
+    lowpower["keepalive"] = activeKeepAlive();
+    lowpower["active_s"] = (lowPowerMs + (lowPower.enabled ? millis() - lowPowerSince : 0)) / 1000;
+    lowpower["wake_to_publish_ms"] = round(wakeToPublishAvg * 10) / 10.0;
+    lowpower["wake_to_publish_max_ms"] = round(wakeToPublishMax / 100.0) / 10.0;
+    lowpower["commands_received"] = commandsReceived;
+    lowpower["commands_missed"] = commandsMissed;
+    lowpower["session_drops"] = sessionDrops;
+    
+    // Discovery pacing
+    JsonObject disc = doc.createNestedObject("discovery");
+    disc["window"] = discoveryWindowMs / 1000;
+    disc["min_interval"] = discovery.minInterval() / 1000;
+    disc["offset_ms"] = discovery.offset(discoveryWindowMs);
+    disc["requests"] = discovery.requests;
+    disc["coalesced"] = discovery.coalesced;
+    disc["answers"] = discovery.answers;
+    
+    // Reconnect backoff
+    JsonObject retries = doc.createNestedObject("retries");
+    addRetryStats(retries.createNestedObject("wifi"), wifiBackoff);
+    addRetryStats(retries.createNestedObject("mqtt"), mqttBackoff);
+    
+    // Broker in use and how it was chosen
+    JsonObject broker = doc.createNestedObject("broker");
+    if (brokers.active() >= 0) {
+        broker["host"] = brokers.entry(brokers.active()).host;
+        broker["port"] = brokers.entry(brokers.active()).port;
+    }
+    broker["failovers"] = brokers.failovers;
+    broker["switches"] = brokers.switches;
+    JsonArray candidates = broker.createNestedArray("candidates");
+    for (uint8_t i = 0; i < brokers.count(); i++) {
+        const BrokerEntry &e = brokers.entry(i);
+        JsonObject c = candidates.createNestedObject();
+        c["host"] = e.host;
+        c["port"] = e.port;
+        c["latency_ms"] = e.latencyMs == BROKER_LATENCY_UNKNOWN ? -1 : (long)e.latencyMs;
+        c["connect_ms"] = e.connectMs;
+        c["failures"] = e.totalFailures;
+    }
+    
+    // TLS handshake cost (resumed vs full)
+    JsonObject tls = doc.createNestedObject("tls");
+    tls["enabled"] = MQTT_USE_TLS != 0;
+#if MQTT_USE_TLS
+    tls["insecure"] = MQTT_TLS_INSECURE != 0;
+    tls["resumed"] = net.lastResumed;
+    tls["handshake_ms"] = net.lastHandshakeMs;
+    tls["handshake_heap"] = net.lastHandshakeHeap;
+    tls["full_handshakes"] = net.fullHandshakes;
+    tls["resumed_handshakes"] = net.resumedHandshakes;
+#endif
+    
+    stampMessage(doc, OUT_STATUS);
     String jsonString;
     serializeJson(doc, jsonString);
     
     String statusTopic = "devices/" + device_id + "/status";
-    if (client.publish(statusTopic, jsonString, true, 1)) {
+    if (publishMessage(statusTopic, jsonString, true, 1)) {
         Serial.println("✓ Status update sent (" + status + ")");
     } else {
         Serial.println("✗ Failed to send status update");
     }
 }
 
+void addRetryStats(JsonObject out, const RetryBackoff &backoff) {
+    out["retries"] = backoff.retries;
+    out["streak"] = backoff.streak;
+    out["max_streak"] = backoff.maxStreak;
+    out["backoff_ms"] = backoff.current();
+    out["waited_s"] = backoff.waitedMs / 1000;
+    out["resets"] = backoff.resets;
+}
+
 void publishDeviceDiscovery() {
-    DynamicJsonDocument doc(4096);
+    DynamicJsonDocument doc(2048 + SENSOR_FIELD_COUNT * 256);
     
     // Device Information
     doc["device_id"] = device_id;
@@ -681,24 +2738,24 @@ void publishDeviceDiscovery() {
     doc["firmware_version"] = firmware_version;
     doc["mac_address"] = WiFi.macAddress();
     doc["ip_address"] = WiFi.localIP().toString();
+#if !PRODUCTION_BUILD
     doc["geofence_testing"] = testGeofencing;
+#endif
     
     // Sensor Array
     JsonArray sensors = doc.createNestedArray("available_sensors");
     
-    // Temperature Sensor
-    JsonObject tempSensor = sensors.createNestedObject();
-    tempSensor["sensor_type"] = "temperature";
-    tempSensor["sensor_name"] = "DHT22 Temperature";
-    tempSensor["unit"] = "celsius";
-    tempSensor["value"] = round(temperature * 10) / 10.0;
-
-    // Humidity Sensor
-    JsonObject humSensor = sensors.createNestedObject();
-    humSensor["sensor_type"] = "humidity";
-    humSensor["sensor_name"] = "DHT22 Humidity";
-    humSensor["unit"] = "percent";
-    humSensor["value"] = round(humidity * 10) / 10.0;
+    // Hardware sensors from the registry
+    forEachSensor<SENSOR_FIELD_COUNT>([&](auto i) {
+        constexpr const SensorDef &s = SENSORS[decltype(i)::value];
+        if constexpr (s.sample != nullptr) {
+            JsonObject sensor = sensors.createNestedObject();
+            sensor["sensor_type"] = s.sensorType;
+            sensor["sensor_name"] = s.sensorName;
+            sensor["unit"] = s.unit;
+            sensor["value"] = s.value();
+        }
+    });
 
     // GPS Sensor
     JsonObject gpsSensor = sensors.createNestedObject();
@@ -709,20 +2766,115 @@ void publishDeviceDiscovery() {
     gpsSensor["longitude"] = longitude;
     gpsSensor["valid"] = gpsValid;
     gpsSensor["simulated"] = useSimulatedGPS;
+#if !PRODUCTION_BUILD
     gpsSensor["geofence_mode"] = generateInsideGeofence ? "inside" : "outside";
+#endif
+    
+    // Field table for compact telemetry ("d" arrays on the data topic)
+    JsonObject schema = doc.createNestedObject("telemetry_schema");
+    schema["version"] = SENSOR_SCHEMA_VERSION;
+    schema["enabled"] = telemetryDictionary;
+    JsonArray fields = schema.createNestedArray("fields");
+    for (const SensorDef &s : SENSORS) {
+        JsonObject field = fields.createNestedObject();
+        field["sensor_type"] = s.sensorType;
+        field["sensor_name"] = s.sensorName;
+        field["unit"] = s.unit;
+        field["accuracy"] = s.accuracy;
+        field["location"] = "Device";
+        if (s.sample) {
+            field["window"] = true;
+        }
+    }
+    // Columns after the values, per "window" field in field order
+    JsonArray windowStats = schema.createNestedArray("window_stats");
+    for (const char* stat : {"min", "max", "stddev", "samples"}) {
+        windowStats.add(stat);
+    }
     
+    stampMessage(doc, OUT_DISCOVERY);
     String jsonString;
-    serializeJsonPretty(doc, jsonString);
+    serializeJson(doc, jsonString);
     
+    // Sent or not, this was the answer; a failed publish is retried by the
+    // periodic republish rather than at the next loop pass
     String discoveryTopic = "devices/" + device_id + "/discovery/response";
-    client.publish(discoveryTopic, jsonString, false, 1);
+    publishMessage(discoveryTopic, jsonString, false, 1);
+    discovery.sent(millis());
     
     Serial.println("=== DEVICE DISCOVERY PUBLISHED ===");
+#if !PRODUCTION_BUILD
     Serial.println("Geofence Mode: " + String(generateInsideGeofence ? "INSIDE" : "OUTSIDE"));
+#endif
 }
 
-void publishControlResponse(String control, String value) {
+// Answers wait for this device's slot in the payload's "window" (s), which
+// the server sets on its fan-out after a broadcast; without one a broadcast
+// uses the configured window and a directed request is answered at once.
+// Values come from the sensor schedule, not a fresh read.
+void requestDiscovery(const String &payload, bool broadcast) {
+    uint32_t windowMs = broadcast ? discoveryWindowMs : 0;
+    DynamicJsonDocument doc(512);
+    if (!deserializeJson(doc, payload) && doc["window"].is<float>()) {
+        float seconds = doc["window"];
+        windowMs = seconds <= 0 ? 0 : seconds >= DISCOVERY_WINDOW_MAX_MS / 1000 ? DISCOVERY_WINDOW_MAX_MS : seconds * 1000;
+    }
+    
+    unsigned long now = millis();
+    String source = broadcast ? "Broadcast discovery request" : "Discovery request";
+    if (discovery.request(now, windowMs)) {
+        Serial.println(source + ", answering in " + String(discovery.dueIn(now)) + "ms");
+    } else {
+        Serial.println(source + " covered by the answer " + String(discovery.sinceLast(now)) + "ms ago");
+    }
+}
+
+// Payload: {"window":20,"min_interval":30}
+// Seconds. window (0..600) spreads the answers to a broadcast, min_interval
+// (0..3600) is the least time between two discovery documents.
+void handleDiscoveryConfig(String payload, bool persist) {
     DynamicJsonDocument doc(256);
+    DeserializationError error = deserializeJson(doc, payload);
+    long window = error ? -1 : doc["window"] | (long)(discoveryWindowMs / 1000);
+    long minInterval = error ? -1 : doc["min_interval"] | (long)(discovery.minInterval() / 1000);
+    if (error || window < 0 || window > (long)(DISCOVERY_WINDOW_MAX_MS / 1000) || minInterval < 0 || minInterval > 3600) {
+        Serial.println("Invalid discovery config");
+        publishControlResponse("discovery_config", "invalid");
+        return;
+    }
+    
+    discoveryWindowMs = window * 1000;
+    discovery.setMinInterval(minInterval * 1000);
+    Serial.println("Discovery: window " + String(window) + "s, min interval " + String(minInterval) + "s");
+    
+    if (persist) {
+        sensorPrefs.begin("sensor-cfg", false);
+        sensorPrefs.putString("discovery", payload);
+        sensorPrefs.end();
+        publishControlResponse("discovery_config", "updated");
+    }
+}
+
+void loadDiscoveryConfig() {
+    sensorPrefs.begin("sensor-cfg", true);
+    String payload = sensorPrefs.getString("discovery", "");
+    sensorPrefs.end();
+    
+    if (payload.length() > 0) {
+        handleDiscoveryConfig(payload, false);
+    }
+}
+
+void publishControlResponse(String control, String value) {
+    // Inside a command batch the result goes into the batch acknowledgement
+    if (commandBatchActive) {
+        commandBatchControl = control;
+        commandBatchValue = value;
+        Serial.println("Control response: " + control + " = " + value);
+        return;
+    }
+    
+    DynamicJsonDocument doc(384);
     
     doc["device_id"] = device_id;
     doc["control"] = control;
@@ -730,11 +2882,12 @@ void publishControlResponse(String control, String value) {
     doc["timestamp"] = millis() / 1000;
     doc["status"] = "executed";
     
+    stampMessage(doc, OUT_CONTROL_RESPONSE);
     String jsonString;
     serializeJson(doc, jsonString);
     
     String responseTopic = "devices/" + device_id + "/control/response";
-    client.publish(responseTopic, jsonString);
+    publishMessage(responseTopic, jsonString, false, 0);
     
     Serial.println("Control response: " + control + " = " + value);
 }
@@ -753,10 +2906,902 @@ void handleCalibrationUpdate(String payload) {
         Serial.println("Humidity offset updated: " + String(humOffset));
     }
     
+    saveSensorConfig();
+    
     publishControlResponse("calibration", "updated");
 }
 
+// Payload: {"aggregate":true,"dictionary":true,"sensors":[{"sensor_type":"humidity","sample_interval":60,"publish_interval":300,"enabled":true}]}
+// Intervals are in seconds; a publish_interval of 0 keeps the sensor local-only.
+// With aggregation on, each publish carries min/max/mean/stddev over the window.
 void handleSensorConfig(String payload) {
     Serial.println("Sensor configuration update: " + payload);
+    
+    DynamicJsonDocument doc(1024);
+    DeserializationError error = deserializeJson(doc, payload);
+    if (error) {
+        Serial.println("Invalid sensor config: " + String(error.c_str()));
+        publishControlResponse("sensor_config", "invalid");
+        return;
+    }
+    
+    if (doc.containsKey("aggregate")) {
+        aggregationEnabled = doc["aggregate"];
+    }
+    
+    // Compact telemetry; announce the table again so the server can decode it
+    if (doc.containsKey("dictionary")) {
+        bool enable = doc["dictionary"];
+        if (enable && !telemetryDictionary) {
+            telemetryDictionary = true;
+            publishDeviceDiscovery();
+        }
+        telemetryDictionary = enable;
+    }
+    
+    // LZ4 for payloads above MQTT_COMPRESS_THRESHOLD
+    if (doc.containsKey("compress")) {
+        compressionEnabled = doc["compress"];
+    }
+    
+    // Motion-aware GPS cadence, otherwise the GPS publish interval
+    if (doc.containsKey("gps_motion")) {
+        gpsMotionAdaptive = doc["gps_motion"];
+    }
+    
+    JsonArray sensors = doc["sensors"];
+    for (JsonObject cfg : sensors) {
+        int channel = findSensorChannel(cfg["sensor_type"] | "");
+        if (channel < 0) {
+            Serial.println("Unknown sensor type in config");
+            continue;
+        }
+        
+        SensorSchedule &sched = sensorSchedule[channel];
+        if (cfg.containsKey("sample_interval") && channel != SENSOR_GPS) {
+            sched.sampleInterval = max(minSampleInterval(channel), cfg["sample_interval"].as<unsigned long>() * 1000UL);
+        }
+        if (cfg.containsKey("publish_interval")) {
+            sched.publishInterval = cfg["publish_interval"].as<unsigned long>() * 1000UL;
+        }
+        if (cfg.containsKey("enabled")) {
+            sched.enabled = cfg["enabled"];
+        }
+        
+        Serial.println(String(sched.sensorType) + ": sample " + String(sched.sampleInterval) + "ms, publish " +
+                       String(sched.publishInterval) + "ms, " + (sched.enabled ? "enabled" : "disabled"));
+    }
+    
+    saveSensorConfig();
     publishControlResponse("sensor_config", "updated");
 }
+
+void loadSensorConfig() {
+    // Registry defaults, then whatever NVS holds
+    for (const SensorDef &s : SENSORS) {
+        SensorSchedule &sched = sensorSchedule[s.channel];
+        if (sched.sensorType) continue;
+        sched = {sensorChannelType(s), s.sampleInterval, s.publishInterval, true, 0, 0};
+    }
+    
+    sensorPrefs.begin("sensor-cfg", true);
+    
+    tempOffset = sensorPrefs.getFloat("temp_offset", 0.0);
+    humOffset = sensorPrefs.getFloat("hum_offset", 0.0);
+    aggregationEnabled = sensorPrefs.getBool("aggregate", true);
+    telemetryDictionary = sensorPrefs.getBool("dictionary", true);
+    gpsMotionAdaptive = sensorPrefs.getBool("gps_motion", true);
+    compressionEnabled = sensorPrefs.getBool("compress", true);
+    
+    // Schedules are stored by channel number; another channel layout (or
+    // firmware from before the layout was recorded) starts from the defaults
+    StoredSchedule stored[SENSOR_COUNT];
+    if (sensorPrefs.getUInt("sched_layout", 0) == SENSOR_CHANNEL_LAYOUT &&
+        sensorPrefs.getBytes("schedule", stored, sizeof(stored)) == sizeof(stored)) {
+        for (int i = 0; i < SENSOR_COUNT; i++) {
+            // Stored by firmware that allowed faster DHT reads
+            if (stored[i].sampleInterval < minSampleInterval(i)) {
+                stored[i].sampleInterval = minSampleInterval(i);
+            }
+            sensorSchedule[i].sampleInterval = stored[i].sampleInterval;
+            sensorSchedule[i].publishInterval = stored[i].publishInterval;
+            sensorSchedule[i].enabled = stored[i].enabled;
+        }
+        Serial.println("Sensor schedule restored from NVS");
+    }
+    
+    sensorPrefs.end();
+    Serial.println("Calibration: temp " + String(tempOffset) + ", hum " + String(humOffset));
+}
+
+void saveSensorConfig() {
+    StoredSchedule stored[SENSOR_COUNT];
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        stored[i].sampleInterval = sensorSchedule[i].sampleInterval;
+        stored[i].publishInterval = sensorSchedule[i].publishInterval;
+        stored[i].enabled = sensorSchedule[i].enabled;
+    }
+    
+    sensorPrefs.begin("sensor-cfg", false);
+    sensorPrefs.putFloat("temp_offset", tempOffset);
+    sensorPrefs.putFloat("hum_offset", humOffset);
+    sensorPrefs.putBool("aggregate", aggregationEnabled);
+    sensorPrefs.putBool("dictionary", telemetryDictionary);
+    sensorPrefs.putBool("gps_motion", gpsMotionAdaptive);
+    sensorPrefs.putBool("compress", compressionEnabled);
+    sensorPrefs.putBytes("schedule", stored, sizeof(stored));
+    sensorPrefs.putUInt("sched_layout", SENSOR_CHANNEL_LAYOUT);
+    sensorPrefs.end();
+}
+
+// Start a join without waiting for it: the cached BSSID/channel/lease when
+// there is one, a full scan otherwise. setup() calls this before bringing up
+// the peripherals so association runs alongside them.
+void beginWiFi() {
+    wifiFastJoinUsed = false;
+    wifiAssocMs = 0;
+    wifiDhcpMs = 0;
+    wifiJoinFast = wifiCacheValid;
+    
+    if (wifiJoinFast) {
+        Serial.println("Fast join (ch " + String(cachedChannel) + ")...");
+        WiFi.config(IPAddress(cachedIp), IPAddress(cachedGateway), IPAddress(cachedSubnet), IPAddress(cachedDns));
+        wifiBeginAt = millis();
+        WiFi.begin(ssid, pass, cachedChannel, cachedBssid);
+    } else {
+        wifiBeginAt = millis();
+        WiFi.begin(ssid, pass);
+    }
+    wifiJoinStarted = true;
+}
+
+// Wait for the join begun by beginWiFi() (or begin one) in setup(): the fast
+// join, then one full scan. After that serviceWiFi() keeps trying from loop().
+bool connectWiFi() {
+    if (!wifiJoinStarted) {
+        beginWiFi();
+    }
+    
+    if (wifiJoinFast) {
+        if (waitForWiFi(WIFI_FAST_JOIN_TIMEOUT)) {
+            wifiJoined();
+            return true;
+        }
+        wifiFullScan();
+    }
+    
+    if (waitForWiFi(WIFI_FULL_SCAN_TIMEOUT)) {
+        wifiJoined();
+        return true;
+    }
+    wifiJoinFailed();
+    return false;
+}
+
+// The join without blocking, every loop pass: watch the one in progress,
+// fall back from the fast join, begin the next once its backoff is over
+void serviceWiFi() {
+    if (WiFi.status() == WL_CONNECTED) {
+        if (wifiJoinStarted) {
+            Serial.println(" WiFi connected");
+            wifiJoined();
+        }
+        return;
+    }
+    
+    if (wifiJoinStarted) {
+        unsigned long timeout = wifiJoinFast ? WIFI_FAST_JOIN_TIMEOUT : WIFI_FULL_SCAN_TIMEOUT;
+        if (millis() - wifiBeginAt > timeout) {
+            if (wifiJoinFast) {
+                wifiFullScan();
+            } else {
+                wifiJoinFailed();
+            }
+        }
+        return;
+    }
+    
+    if (wifiRetryPending && (long)(millis() - wifiRetryAt) < 0) return;
+    wifiRetryPending = false;
+    Serial.print("WiFi down, joining...");
+    beginWiFi();
+}
+
+void wifiJoined() {
+    wifiJoinStarted = false;
+    if (wifiJoinFast) {
+        wifiFastJoinUsed = true;
+    } else {
+        saveWiFiCache();
+    }
+    if (!bootWiFiMs) bootWiFiMs = millis();
+}
+
+// The cached BSSID or lease went stale
+void wifiFullScan() {
+    Serial.print(" failed, falling back to full scan...");
+    WiFi.disconnect();
+    WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0));
+    invalidateWiFiCache();
+    wifiJoinFast = false;
+    wifiBeginAt = millis();
+    WiFi.begin(ssid, pass);
+}
+
+void wifiJoinFailed() {
+    WiFi.disconnect();
+    wifiJoinStarted = false;
+    // An AP restart brings every device back in the same scan otherwise
+    unsigned long wait = wifiBackoff.next();
+    wifiRetryAt = millis() + wait;
+    wifiRetryPending = true;
+    Serial.println(" retry in " + String(wait) + "ms");
+}
+
+// Counts from WiFi.begin(), so time spent elsewhere since counts too
+bool waitForWiFi(unsigned long timeout) {
+    while (WiFi.status() != WL_CONNECTED) {
+        if (millis() - wifiBeginAt > timeout) {
+            return false;
+        }
+        Serial.print(".");
+        delay(50);
+    }
+    return true;
+}
+
+void onWiFiEvent(arduino_event_id_t event) {
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+            wifiAssocMs = millis() - wifiBeginAt;
+            break;
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            wifiDhcpMs = millis() - wifiBeginAt - wifiAssocMs;
+            break;
+        default:
+            break;
+    }
+}
+
+void loadWiFiCache() {
+    wifiPrefs.begin("wifi-cache", true);
+    wifiCacheValid = wifiPrefs.getBytes("bssid", cachedBssid, sizeof(cachedBssid)) == sizeof(cachedBssid);
+    cachedChannel = wifiPrefs.getUChar("channel", 0);
+    cachedIp = wifiPrefs.getUInt("ip", 0);
+    cachedGateway = wifiPrefs.getUInt("gateway", 0);
+    cachedSubnet = wifiPrefs.getUInt("subnet", 0);
+    cachedDns = wifiPrefs.getUInt("dns", 0);
+    wifiPrefs.end();
+    
+    wifiCacheValid = wifiCacheValid && cachedChannel > 0 && cachedIp != 0 && cachedGateway != 0;
+    Serial.println("WiFi cache: " + String(wifiCacheValid ? "found" : "empty"));
+}
+
+void saveWiFiCache() {
+    uint8_t* bssid = WiFi.BSSID();
+    int32_t channel = WiFi.channel();
+    uint32_t ip = WiFi.localIP();
+    uint32_t gateway = WiFi.gatewayIP();
+    uint32_t subnet = WiFi.subnetMask();
+    uint32_t dns = WiFi.dnsIP();
+    
+    // Only touch NVS when something changed to spare flash wear
+    if (wifiCacheValid && memcmp(bssid, cachedBssid, sizeof(cachedBssid)) == 0 &&
+        channel == cachedChannel && ip == cachedIp && gateway == cachedGateway &&
+        subnet == cachedSubnet && dns == cachedDns) {
+        return;
+    }
+    
+    memcpy(cachedBssid, bssid, sizeof(cachedBssid));
+    cachedChannel = channel;
+    cachedIp = ip;
+    cachedGateway = gateway;
+    cachedSubnet = subnet;
+    cachedDns = dns;
+    
+    wifiPrefs.begin("wifi-cache", false);
+    wifiPrefs.putBytes("bssid", cachedBssid, sizeof(cachedBssid));
+    wifiPrefs.putUChar("channel", cachedChannel);
+    wifiPrefs.putUInt("ip", cachedIp);
+    wifiPrefs.putUInt("gateway", cachedGateway);
+    wifiPrefs.putUInt("subnet", cachedSubnet);
+    wifiPrefs.putUInt("dns", cachedDns);
+    wifiPrefs.end();
+    wifiCacheValid = true;
+    
+    Serial.println("\nWiFi cache updated: " + WiFi.BSSIDstr() + " ch " + String(cachedChannel));
+}
+
+void invalidateWiFiCache() {
+    if (!wifiCacheValid) return;
+    wifiCacheValid = false;
+    wifiPrefs.begin("wifi-cache", false);
+    wifiPrefs.clear();
+    wifiPrefs.end();
+}
+
+// Payload: {"rules":[{"id":"hot","sensor_type":"temperature","op":">","threshold":35,"duration":60},
+//                    {"id":"dry_fast","sensor_type":"humidity","op":"rate>","threshold":0.5},
+//                    {"id":"fence","sensor_type":"gps","op":"outside","fence":1}]}
+// Durations are in seconds. "fence" is a fence table id (XORAFI_FENCE_ID when
+// omitted); rules naming an unknown fence are dropped. The rule set replaces
+// the previous one.
+void handleRulesConfig(String payload, bool persist) {
+    if (!parseAlertRules(payload)) {
+        publishControlResponse("rules_config", "invalid");
+        return;
+    }
+    
+    if (persist) {
+        sensorPrefs.begin("sensor-cfg", false);
+        sensorPrefs.putString("rules", payload);
+        sensorPrefs.end();
+        publishControlResponse("rules_config", String(alertRuleCount) + " rules");
+    }
+}
+
+bool parseAlertRules(const String &payload) {
+    DynamicJsonDocument doc(2048);
+    DeserializationError error = deserializeJson(doc, payload);
+    if (error) {
+        Serial.println("Invalid rules config: " + String(error.c_str()));
+        return false;
+    }
+    
+    alertRuleCount = 0;
+    JsonArray rules = doc["rules"];
+    for (JsonObject cfg : rules) {
+        if (alertRuleCount >= MAX_ALERT_RULES) {
+            Serial.println("Rule table full, ignoring remaining rules");
+            break;
+        }
+        
+        int channel = findSensorChannel(cfg["sensor_type"] | "");
+        const char* op = cfg["op"] | "";
+        
+        AlertRule &rule = alertRules[alertRuleCount];
+        if (strcmp(op, ">") == 0) {
+            rule.kind = RULE_ABOVE;
+        } else if (strcmp(op, "<") == 0) {
+            rule.kind = RULE_BELOW;
+        } else if (strcmp(op, "rate>") == 0) {
+            rule.kind = RULE_RATE_ABOVE;
+        } else if (strcmp(op, "outside") == 0) {
+            rule.kind = RULE_OUTSIDE_FENCE;
+            channel = SENSOR_GPS;
+            rule.fenceId = cfg["fence"] | XORAFI_FENCE_ID;
+            int index = geofenceFind(fences, rule.fenceId);
+            if (index < 0) {
+                Serial.println("Rule names unknown fence " + String(rule.fenceId));
+                continue;
+            }
+            rule.fenceIndex = index;
+        } else {
+            Serial.println("Unknown rule op: " + String(op));
+            continue;
+        }
+        
+        if (channel < 0 || (channel == SENSOR_GPS && rule.kind != RULE_OUTSIDE_FENCE)) {
+            Serial.println("Rule has no usable sensor_type");
+            continue;
+        }
+        
+        strlcpy(rule.id, cfg["id"] | "rule", sizeof(rule.id));
+        rule.channel = channel;
+        rule.threshold = cfg["threshold"] | 0.0f;
+        rule.holdMs = (cfg["duration"] | 0UL) * 1000UL;
+        rule.conditionSince = 0;
+        rule.active = false;
+        rule.lastValue = NAN;
+        rule.lastValueAt = 0;
+        alertRuleCount++;
+    }
+    
+    Serial.println("Alert rules loaded: " + String(alertRuleCount));
+    return true;
+}
+
+void loadAlertRules() {
+    sensorPrefs.begin("sensor-cfg", true);
+    String payload = sensorPrefs.getString("rules", "");
+    sensorPrefs.end();
+    
+    if (payload.length() > 0) {
+        handleRulesConfig(payload, false);
+    }
+}
+
+// Payload: {"enabled":true,"battery_low":40,"battery_critical":15,"low_scale":2,"critical_scale":4,
+//           "battery_hysteresis":5,"rssi_weak":-75,"rssi_poor":-85,"weak_batch":2,"poor_batch":4,
+//           "rssi_hysteresis":5}
+// Omitted keys keep their current value. Scales are clamped to 1..16.
+void handlePowerConfig(String payload, bool persist) {
+    if (!parsePowerPolicy(payload)) {
+        publishControlResponse("power_config", "invalid");
+        return;
+    }
+    
+    // Apply right away instead of at the next status cycle
+    updatePowerPolicy();
+    
+    if (persist) {
+        sensorPrefs.begin("sensor-cfg", false);
+        sensorPrefs.putString("power", payload);
+        sensorPrefs.end();
+        publishControlResponse("power_config", powerPolicy.enabled ? "enabled" : "disabled");
+    }
+}
+
+bool parsePowerPolicy(const String &payload) {
+    DynamicJsonDocument doc(512);
+    DeserializationError error = deserializeJson(doc, payload);
+    if (error) {
+        Serial.println("Invalid power config: " + String(error.c_str()));
+        return false;
+    }
+    
+    PowerPolicy p = powerPolicy;
+    p.enabled = doc["enabled"] | p.enabled;
+    p.batteryLow = doc["battery_low"] | p.batteryLow;
+    p.batteryCritical = doc["battery_critical"] | p.batteryCritical;
+    p.lowScale = constrain(doc["low_scale"] | (int)p.lowScale, 1, 16);
+    p.criticalScale = constrain(doc["critical_scale"] | (int)p.criticalScale, 1, 16);
+    p.batteryHysteresis = doc["battery_hysteresis"] | p.batteryHysteresis;
+    p.rssiWeak = doc["rssi_weak"] | p.rssiWeak;
+    p.rssiPoor = doc["rssi_poor"] | p.rssiPoor;
+    p.weakBatch = constrain(doc["weak_batch"] | (int)p.weakBatch, 1, 16);
+    p.poorBatch = constrain(doc["poor_batch"] | (int)p.poorBatch, 1, 16);
+    p.rssiHysteresis = doc["rssi_hysteresis"] | p.rssiHysteresis;
+    
+    if (p.batteryCritical > p.batteryLow || p.rssiPoor > p.rssiWeak) {
+        Serial.println("Power config thresholds out of order");
+        return false;
+    }
+    
+    powerPolicy = p;
+    Serial.println("Power policy " + String(p.enabled ? "enabled" : "disabled") + ": battery " +
+                   String(p.batteryLow) + "/" + String(p.batteryCritical) + "%, rssi " +
+                   String(p.rssiWeak) + "/" + String(p.rssiPoor) + " dBm");
+    return true;
+}
+
+void loadPowerPolicy() {
+    sensorPrefs.begin("sensor-cfg", true);
+    String payload = sensorPrefs.getString("power", "");
+    sensorPrefs.end();
+    
+    if (payload.length() > 0) {
+        handlePowerConfig(payload, false);
+    }
+}
+
+// Payload: {"enabled":true,"idle_mhz":80,"keepalive":240}
+// Omitted keys keep their current value. idle_mhz is 80, 160 or 240; the
+// keepalive (s, 10..3600) belongs a little under the broker's or NAT's idle
+// timeout and is sent with CONNECT, so a change reconnects.
+void handleLowPowerConfig(String payload, bool persist) {
+    DynamicJsonDocument doc(256);
+    DeserializationError error = deserializeJson(doc, payload);
+    int idleMhz = error ? 0 : doc["idle_mhz"] | (int)lowPower.idleMhz;
+    int keepAlive = error ? 0 : doc["keepalive"] | (int)lowPower.keepAlive;
+    if (error || (idleMhz != 80 && idleMhz != 160 && idleMhz != 240) || keepAlive < 10 || keepAlive > 3600) {
+        Serial.println("Invalid low-power config");
+        publishControlResponse("lowpower_config", "invalid");
+        return;
+    }
+    
+    bool enabled = doc["enabled"] | lowPower.enabled;
+    unsigned long now = millis();
+    if (lowPower.enabled && !enabled) {
+        lowPowerMs += now - lowPowerSince;
+    } else if (!lowPower.enabled && enabled) {
+        lowPowerSince = now;
+    }
+    
+    uint16_t previousKeepAlive = activeKeepAlive();
+    lowPower.enabled = enabled;
+    lowPower.idleMhz = idleMhz;
+    lowPower.keepAlive = keepAlive;
+    applyLowPower();
+    if (activeKeepAlive() != previousKeepAlive && client.connected()) {
+        sessionSettingsChanged = true;
+        brokerReconnectPending = true;
+    }
+    Serial.println("Low-power mode " + String(enabled ? "on" : "off") + ": idle " + String(idleMhz) +
+                   " MHz, keepalive " + String(activeKeepAlive()) + "s");
+    
+    if (persist) {
+        sensorPrefs.begin("sensor-cfg", false);
+        sensorPrefs.putString("lowpower", payload);
+        sensorPrefs.end();
+        publishControlResponse("lowpower_config", enabled ? "enabled" : "disabled");
+    }
+}
+
+void loadLowPowerMode() {
+    sensorPrefs.begin("sensor-cfg", true);
+    String payload = sensorPrefs.getString("lowpower", "");
+    sensorPrefs.end();
+    
+    if (payload.length() > 0) {
+        handleLowPowerConfig(payload, false);
+    }
+}
+
+// Modem sleep wakes for every DTIM beacon, which keeps the association and
+// buffered inbound packets; the session survives as long as the keepalive does
+void applyLowPower() {
+    WiFi.setSleep(lowPower.enabled ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE);
+    updateCpuClock();
+}
+
+// Runs every loop pass: the idle clock unless something needs the full one
+void updateCpuClock() {
+    bool busy = !client.connected() || otaInProgress || gpsReplayActive;
+    uint32_t target = lowPower.enabled && !busy ? lowPower.idleMhz : FULL_CPU_MHZ;
+    if (getCpuFrequencyMhz() != target) {
+        setCpuFrequencyMhz(target);
+    }
+}
+
+uint16_t activeKeepAlive() {
+    return lowPower.enabled ? lowPower.keepAlive : DEFAULT_KEEPALIVE;
+}
+
+// Payload: {"brokers":[{"host":"mqtt-a.example","port":1883},{"host":"mqtt-b.example"}]}
+// Priority order, port defaults to mqtt_port. An empty list restores the
+// compiled-in broker. The connection stays up while its broker is listed.
+void handleBrokerConfig(String payload, bool persist) {
+    DynamicJsonDocument doc(1024);
+    DeserializationError error = deserializeJson(doc, payload);
+    JsonArray list = doc["brokers"];
+    bool valid = !error && !list.isNull() && list.size() <= BROKER_POOL_MAX;
+    for (JsonObject b : list) {
+        const char* host = b["host"] | "";
+        valid = valid && host[0] && strlen(host) < BROKER_HOST_MAX && (b["port"] | mqtt_port) > 0;
+    }
+    if (!valid) {
+        Serial.println("Invalid broker config");
+        publishControlResponse("broker_config", "invalid");
+        return;
+    }
+    
+    String activeHost = brokers.active() >= 0 ? brokers.entry(brokers.active()).host : "";
+    uint16_t activePort = brokers.active() >= 0 ? brokers.entry(brokers.active()).port : 0;
+    
+    brokers.clear();
+    for (JsonObject b : list) {
+        brokers.add(b["host"], b["port"] | mqtt_port);
+    }
+    if (brokers.count() == 0) {
+        brokers.add(mqtt_broker, mqtt_port);
+    }
+    brokers.setActive(brokers.find(activeHost.c_str(), activePort));
+    Serial.println("✓ " + String(brokers.count()) + " broker(s) configured");
+    
+    // Measure the new list on the next loop; leave a broker that was dropped
+    lastBrokerProbe = millis() - BROKER_PROBE_INTERVAL;
+    if (activeHost.length() > 0 && brokers.active() < 0) {
+        brokerReconnectPending = true;
+    }
+    
+    if (persist) {
+        sensorPrefs.begin("sensor-cfg", false);
+        sensorPrefs.putString("brokers", payload);
+        sensorPrefs.end();
+        publishControlResponse("broker_config", String(brokers.count()));
+    }
+}
+
+void loadBrokerList() {
+    sensorPrefs.begin("sensor-cfg", true);
+    String payload = sensorPrefs.getString("brokers", "");
+    sensorPrefs.end();
+    
+    if (payload.length() > 0) {
+        handleBrokerConfig(payload, false);
+    }
+    if (brokers.count() == 0) {
+        brokers.add(mqtt_broker, mqtt_port);
+    }
+}
+
+// TCP connect round trip to every listed broker. It is the handshake an MQTT
+// connect starts with, so it ranks brokers without logging in to each. The
+// first probe of a host also pays its DNS lookup.
+void probeBrokers() {
+    lastBrokerProbe = millis();
+    if (brokers.count() < 2 || WiFi.status() != WL_CONNECTED) return;
+    
+    for (uint8_t i = 0; i < brokers.count(); i++) {
+        const BrokerEntry &e = brokers.entry(i);
+        unsigned long start = millis();
+        if (probeNet.connect(e.host, e.port, BROKER_PROBE_TIMEOUT)) {
+            brokers.recordLatency(i, millis() - start);
+            Serial.println("✓ Broker " + String(e.host) + ":" + String(e.port) + " " + String(e.latencyMs) + "ms");
+        } else {
+            // The connected broker is judged by its publishes, not by a probe
+            if (i != brokers.active()) {
+                brokers.recordFailure(i, millis());
+            }
+            Serial.println("✗ Broker " + String(e.host) + ":" + String(e.port) + " unreachable");
+        }
+        probeNet.stop();
+    }
+}
+
+// Lower values are worse. Entering a tier needs value < threshold, leaving
+// it needs value >= threshold + hysteresis.
+uint8_t powerTier(float value, float low, float critical, float hysteresis, uint8_t current) {
+    uint8_t tier = value < critical ? 2 : (value < low ? 1 : 0);
+    if (tier < current) {
+        uint8_t held = value < critical + hysteresis ? 2 : (value < low + hysteresis ? 1 : 0);
+        tier = min(held, current);
+    }
+    return tier;
+}
+
+// Runs on every system metrics read
+void updatePowerPolicy() {
+    // Average RSSI so one bad reading does not change the publish rate
+    if (WiFi.status() == WL_CONNECTED && wifiSignal != 0) {
+        rssiAverage = isnan(rssiAverage) ? wifiSignal : rssiAverage * 0.75 + wifiSignal * 0.25;
+    }
+    
+    const PowerPolicy &p = powerPolicy;
+    uint8_t newBattery = 0;
+    uint8_t newLink = 0;
+    if (p.enabled) {
+        newBattery = powerTier(batteryLevel, p.batteryLow, p.batteryCritical, p.batteryHysteresis, batteryTier);
+        if (!isnan(rssiAverage)) {
+            newLink = powerTier(rssiAverage, p.rssiWeak, p.rssiPoor, p.rssiHysteresis, linkTier);
+        }
+    }
+    if (newBattery == batteryTier && newLink == linkTier) return;
+    
+    unsigned long now = millis();
+    if (powerPublishScale > 1) {
+        powerReducedMs += now - powerChangedAt;
+    }
+    powerChangedAt = now;
+    powerChanges++;
+    
+    batteryTier = newBattery;
+    linkTier = newLink;
+    const uint8_t sampleScales[3] = {1, p.lowScale, p.criticalScale};
+    const uint8_t batchScales[3] = {1, p.weakBatch, p.poorBatch};
+    powerSampleScale = sampleScales[batteryTier];
+    powerPublishScale = powerSampleScale * batchScales[linkTier];
+    
+    Serial.println("Power policy: battery tier " + String(batteryTier) + " (" + String(batteryLevel, 1) +
+                   "%), link tier " + String(linkTier) + " (" + String(rssiAverage, 0) + " dBm) -> sample x" +
+                   String(powerSampleScale) + ", publish x" + String(powerPublishScale));
+}
+
+// Runs after every sample of a channel; works only on the preparsed table
+void evaluateAlertRules(int channel) {
+    unsigned long now = millis();
+    
+    for (int i = 0; i < alertRuleCount; i++) {
+        AlertRule &rule = alertRules[i];
+        if (rule.channel != channel) continue;
+        
+        float value;
+        bool condition = false;
+        
+        if (rule.kind == RULE_OUTSIDE_FENCE) {
+            if (!gpsValid) continue;
+            value = geofenceContains(fences, rule.fenceIndex, latitude, longitude) ? 0 : 1;
+            condition = value > 0;
+        } else {
+            value = sensorValue(channel);
+            if (isnan(value)) continue;
+            
+            if (rule.kind == RULE_ABOVE) {
+                condition = value > rule.threshold;
+            } else if (rule.kind == RULE_BELOW) {
+                condition = value < rule.threshold;
+            } else if (rule.kind == RULE_RATE_ABOVE) {
+                if (!isnan(rule.lastValue) && now > rule.lastValueAt) {
+                    float rate = (value - rule.lastValue) * 1000.0 / (now - rule.lastValueAt);
+                    condition = fabs(rate) > rule.threshold;
+                }
+                rule.lastValue = value;
+                rule.lastValueAt = now;
+            }
+        }
+        
+        if (!condition) {
+            rule.conditionSince = 0;
+            if (rule.active) {
+                rule.active = false;
+                publishAlert(rule, value, false);
+            }
+            continue;
+        }
+        
+        if (rule.conditionSince == 0) {
+            rule.conditionSince = now;
+        }
+        
+        if (!rule.active && now - rule.conditionSince >= rule.holdMs) {
+            rule.active = true;
+            publishAlert(rule, value, true);
+        }
+    }
+}
+
+void publishAlert(const AlertRule &rule, float value, bool triggered) {
+    DynamicJsonDocument doc(512);
+    
+    doc["device_id"] = device_id;
+    doc["rule_id"] = rule.id;
+    doc["sensor_type"] = sensorSchedule[rule.channel].sensorType;
+    doc["state"] = triggered ? "triggered" : "cleared";
+    doc["value"] = value;
+    doc["threshold"] = rule.threshold;
+    doc["timestamp"] = gpsTimestamp;
+    
+    if (rule.channel == SENSOR_GPS) {
+        doc["fence"] = rule.fenceId;
+        doc["latitude"] = latitude;
+        doc["longitude"] = longitude;
+    }
+    
+    stampMessage(doc, OUT_ALERTS);
+    String jsonString;
+    serializeJson(doc, jsonString);
+    
+    // Alerts bypass the telemetry schedule and go out immediately
+    String alertTopic = "devices/" + device_id + "/alerts";
+    if (publishMessage(alertTopic, jsonString, false, 1)) {
+        Serial.println("🚨 Alert " + String(rule.id) + " " + (triggered ? "triggered" : "cleared"));
+    } else {
+        Serial.println("✗ Failed to send alert " + String(rule.id));
+    }
+}
+
+DeltaPatcher otaPatcher(otaReadSource, otaWriteTarget);
+
+bool otaReadSource(void* ctx, uint32_t offset, uint8_t* buf, size_t len) {
+    const esp_partition_t* source = (const esp_partition_t*)ctx;
+    if (offset + len > source->size) return false;
+    return esp_partition_read(source, offset, buf, len) == ESP_OK;
+}
+
+bool otaWriteTarget(void* ctx, const uint8_t* buf, size_t len) {
+    return Update.write((uint8_t*)buf, len) == len;
+}
+
+// Payload: {"version":"1.4.0","base_md5":"...","target_md5":"...","target_size":N,"patch_size":N}
+// base_md5 must match the running image, the patch is a delta against it.
+void handleOtaBegin(String payload) {
+    DynamicJsonDocument doc(512);
+    DeserializationError error = deserializeJson(doc, payload);
+    if (error) {
+        publishOtaProgress("error", "invalid begin message");
+        return;
+    }
+    
+    String version = doc["version"] | "";
+    uint32_t patchSize = doc["patch_size"] | 0UL;
+    uint32_t targetSize = doc["target_size"] | 0UL;
+    
+    // Same update announced again: resume instead of starting over
+    if (otaInProgress && version == otaVersion && patchSize == otaPatchSize) {
+        Serial.println("OTA resume at " + String(otaReceived) + "/" + String(otaPatchSize));
+        publishOtaProgress("receiving");
+        return;
+    }
+    
+    if (otaInProgress) {
+        Update.abort();
+        otaInProgress = false;
+    }
+    
+    String baseMd5 = doc["base_md5"] | "";
+    if (baseMd5.length() > 0 && baseMd5 != ESP.getSketchMD5()) {
+        publishOtaProgress("error", "base image mismatch");
+        return;
+    }
+    
+    if (patchSize == 0 || targetSize == 0 || !Update.begin(targetSize)) {
+        publishOtaProgress("error", String("cannot start update: ") + Update.errorString());
+        return;
+    }
+    
+    String targetMd5 = doc["target_md5"] | "";
+    if (targetMd5.length() > 0) {
+        Update.setMD5(targetMd5.c_str());
+    }
+    
+    otaSourcePartition = esp_ota_get_running_partition();
+    otaPatcher.begin((void*)otaSourcePartition);
+    otaVersion = version;
+    otaPatchSize = patchSize;
+    otaReceived = 0;
+    otaLastAck = 0;
+    otaInProgress = true;
+    
+    Serial.println("=== OTA STARTED: " + firmware_version + " -> " + otaVersion + " (" + String(patchSize) + " byte patch) ===");
+    publishOtaProgress("receiving");
+}
+
+// Chunk: 4-byte little-endian patch offset followed by patch bytes
+void handleOtaChunk(const uint8_t* data, int length) {
+    if (!otaInProgress || length < 4) return;
+    
+    uint32_t offset = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+    if (offset != otaReceived) {
+        // Out of order (lost or duplicated chunk): tell the sender where to resume
+        if (millis() - otaLastNack > 1000) {
+            otaLastNack = millis();
+            publishOtaProgress("receiving");
+        }
+        return;
+    }
+    
+    uint32_t len = length - 4;
+    if (otaReceived + len > otaPatchSize || !otaPatcher.feed(data + 4, len)) {
+        handleOtaAbort(otaPatcher.failed() ? otaPatcher.error() : "patch larger than announced");
+        return;
+    }
+    otaReceived += len;
+    
+    if (otaReceived < otaPatchSize) {
+        if (otaReceived - otaLastAck >= OTA_ACK_INTERVAL) {
+            otaLastAck = otaReceived;
+            publishOtaProgress("receiving");
+        }
+        return;
+    }
+    
+    if (!otaPatcher.finished()) {
+        handleOtaAbort("patch truncated");
+        return;
+    }
+    
+    if (!Update.end()) {
+        otaInProgress = false;
+        publishOtaProgress("error", Update.errorString());
+        return;
+    }
+    
+    otaInProgress = false;
+    publishOtaProgress("complete");
+    Serial.println("=== OTA COMPLETE, rebooting into " + otaVersion + " ===");
+    publishDeviceStatus("updating");
+    client.disconnect();
+    delay(500);
+    ESP.restart();
+}
+
+void handleOtaAbort(String reason) {
+    if (otaInProgress) {
+        Update.abort();
+        otaInProgress = false;
+    }
+    Serial.println("OTA aborted: " + reason);
+    publishOtaProgress("error", reason);
+}
+
+void publishOtaProgress(String state, String error) {
+    DynamicJsonDocument doc(512);
+    
+    doc["device_id"] = device_id;
+    doc["state"] = state;
+    doc["version"] = otaVersion;
+    doc["offset"] = otaReceived;
+    doc["patch_size"] = otaPatchSize;
+    doc["written"] = otaPatcher.written();
+    if (error.length() > 0) {
+        doc["error"] = error;
+    }
+    
+    stampMessage(doc, OUT_OTA_PROGRESS);
+    String jsonString;
+    serializeJson(doc, jsonString);
+    
+    String progressTopic = "devices/" + device_id + "/ota/progress";
+    client.publish(progressTopic, jsonString, false, 1);
+}
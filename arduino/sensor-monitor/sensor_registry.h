@@ -0,0 +1,169 @@
+// Compile-time sensor registry.
+//
+// The sketch declares every published value as one row of a constexpr
+// SensorDef table. forEachSensor() expands a callback once per row with the
+// row index as a compile-time constant, so the acquisition loop, the data
+// payloads, discovery and the LCD page become straight-line code: readers
+// and accessors are known functions the compiler inlines, rows without a
+// reader are dropped with `if constexpr`, and nothing is dispatched
+// virtually or looked up by name at runtime. Schedule channels come from
+// the rows too: rows naming the same channel are sampled and published
+// together, channels are numbered in order of first appearance, and the
+// rows of a channel carry its default intervals. sensorRegistry()
+// fills in each row's channel number; sensorRegistryValid() lets the sketch
+// reject a malformed table at compile time. It has no Arduino dependencies
+// and builds on the host (see tools/registry_check.cpp).
+
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+struct SensorDef {
+    const char* sensorType;   // key of the sensor on the server
+    const char* sensorName;
+    const char* unit;
+    uint8_t accuracy;
+    uint8_t decimals;         // precision of published values
+    const char* channelType;  // schedule channel, nullptr = one of its own named sensorType
+    uint32_t sampleInterval;  // channel defaults in ms: between samples, 0 = fed elsewhere (GPS)
+    uint32_t publishInterval; // ... between publishes, 0 = local only
+    uint32_t minSampleInterval;   // ... fastest the part may be read
+    void (*sample)();         // reads the hardware; nullptr when fed elsewhere (GPS)
+    double (*value)();        // last reading, NAN when unavailable
+    const char* lcdFormat;    // "T:%.1fC" on the sensor page, nullptr = not shown
+    uint8_t channel;          // set by sensorRegistry()
+};
+
+template <typename F, size_t... I>
+inline void sensorRegistryExpand(F&& f, std::index_sequence<I...>) {
+    (f(std::integral_constant<size_t, I>{}), ...);
+}
+
+// Calls f(std::integral_constant<size_t, I>{}) for I = 0 .. N-1, unrolled
+template <size_t N, typename F>
+inline void forEachSensor(F&& f) {
+    sensorRegistryExpand(f, std::make_index_sequence<N>{});
+}
+
+constexpr bool sensorStrEqual(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+constexpr const char* sensorChannelType(const SensorDef &s) {
+    return s.channelType ? s.channelType : s.sensorType;
+}
+
+// Is row i the first one of its channel?
+template <size_t N>
+constexpr bool sensorChannelFirst(const SensorDef (&table)[N], size_t i) {
+    for (size_t j = 0; j < i; j++) {
+        if (sensorStrEqual(sensorChannelType(table[j]), sensorChannelType(table[i]))) return false;
+    }
+    return true;
+}
+
+template <size_t N>
+constexpr uint8_t sensorChannelCount(const SensorDef (&table)[N]) {
+    uint8_t count = 0;
+    for (size_t i = 0; i < N; i++) {
+        if (sensorChannelFirst(table, i)) count++;
+    }
+    return count;
+}
+
+// Number of a channel, 0xff when no row names it
+template <size_t N>
+constexpr uint8_t sensorChannelOf(const SensorDef (&table)[N], const char* channelType) {
+    uint8_t channel = 0;
+    for (size_t i = 0; i < N; i++) {
+        if (!sensorChannelFirst(table, i)) continue;
+        if (sensorStrEqual(sensorChannelType(table[i]), channelType)) return channel;
+        channel++;
+    }
+    return 0xff;
+}
+
+// FNV-1a over the channel types in channel order: stored per-channel data
+// is only valid for the layout it was written under
+template <size_t N>
+constexpr uint32_t sensorChannelLayout(const SensorDef (&table)[N]) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < N; i++) {
+        if (!sensorChannelFirst(table, i)) continue;
+        const char* c = sensorChannelType(table[i]);
+        do {
+            hash = (hash ^ (uint8_t)*c) * 16777619u;
+        } while (*c++);
+    }
+    return hash;
+}
+
+// The table with each row's channel number filled in
+template <size_t N>
+constexpr std::array<SensorDef, N> sensorRegistry(const SensorDef (&table)[N]) {
+    std::array<SensorDef, N> rows = {};
+    for (size_t i = 0; i < N; i++) {
+        rows[i] = table[i];
+        rows[i].channel = sensorChannelOf(table, sensorChannelType(table[i]));
+    }
+    return rows;
+}
+
+// Sampler of each channel, nullptr where none (GPS): sampling a channel is
+// one indexed call, as with a hand-written switch
+template <size_t Channels, size_t N>
+constexpr std::array<void (*)(), Channels> sensorChannelSamplers(const SensorDef (&table)[N]) {
+    std::array<void (*)(), Channels> samplers = {};
+    for (size_t i = 0; i < N; i++) {
+        if (table[i].sample) {
+            samplers[sensorChannelOf(table, sensorChannelType(table[i]))] = table[i].sample;
+        }
+    }
+    return samplers;
+}
+
+// Rows with a sampler; each has a window summary in compact telemetry
+template <size_t N>
+constexpr size_t sensorSampledCount(const SensorDef (&table)[N]) {
+    size_t count = 0;
+    for (size_t i = 0; i < N; i++) {
+        if (table[i].sample) count++;
+    }
+    return count;
+}
+
+// Every row has a type and an accessor, sane precision, and no two rows
+// share a sensor type. Rows of a channel agree on its intervals and at most
+// one of them samples; a channel is sampled exactly when it has a sample
+// interval, which is no faster than its minimum.
+template <size_t N>
+constexpr bool sensorRegistryValid(const SensorDef (&table)[N]) {
+    for (size_t i = 0; i < N; i++) {
+        const SensorDef &s = table[i];
+        if (!s.sensorType || !s.sensorName || !s.unit || !s.value) return false;
+        if (s.decimals > 6 || s.accuracy > 100) return false;
+        for (size_t j = 0; j < i; j++) {
+            if (sensorStrEqual(table[j].sensorType, s.sensorType)) return false;
+        }
+
+        bool sampled = false;
+        for (size_t j = 0; j < N; j++) {
+            const SensorDef &o = table[j];
+            if (!sensorStrEqual(sensorChannelType(o), sensorChannelType(s))) continue;
+            if (o.sampleInterval != s.sampleInterval || o.publishInterval != s.publishInterval ||
+                o.minSampleInterval != s.minSampleInterval) return false;
+            if (o.sample && sampled) return false;
+            sampled = sampled || o.sample;
+        }
+        if (sampled != (s.sampleInterval > 0)) return false;
+        if (sampled && s.sampleInterval < s.minSampleInterval) return false;
+    }
+    return true;
+}
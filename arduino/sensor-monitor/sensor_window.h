@@ -0,0 +1,51 @@
+// Windowed aggregation: streaming min/max/mean/variance of one channel.
+//
+// Welford's update keeps the running mean and the sum of squared deviations
+// from it, so a window costs one pass and a few doubles whatever its length,
+// and the variance does not cancel catastrophically the way sum(x^2) -
+// n*mean^2 does for readings with a large offset (a 1013 hPa baseline, a
+// 3000-count ADC). NaN readings (a failed DHT read) are skipped. No Arduino
+// dependencies; it builds on the host (see tools/window_check.cpp).
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+struct SensorAccumulator {
+    uint32_t count;
+    float minValue;
+    float maxValue;
+    double mean;
+    double m2;   // sum of squared deviations from the running mean
+};
+
+inline void accumulatorReset(SensorAccumulator &acc) {
+    acc.count = 0;
+    acc.minValue = 0;
+    acc.maxValue = 0;
+    acc.mean = 0;
+    acc.m2 = 0;
+}
+
+inline void accumulatorAdd(SensorAccumulator &acc, float value) {
+    if (isnan(value)) return;
+
+    if (acc.count == 0) {
+        acc.minValue = value;
+        acc.maxValue = value;
+    } else {
+        if (value < acc.minValue) acc.minValue = value;
+        if (value > acc.maxValue) acc.maxValue = value;
+    }
+
+    acc.count++;
+    double delta = value - acc.mean;
+    acc.mean += delta / acc.count;
+    acc.m2 += delta * (value - acc.mean);
+}
+
+// Sample variance (n - 1); zero until there are two samples
+inline double accumulatorVariance(const SensorAccumulator &acc) {
+    return acc.count > 1 ? acc.m2 / (acc.count - 1) : 0.0;
+}
@@ -0,0 +1,336 @@
+// TLS transport for MQTTClient with session resumption across reconnects.
+//
+// WiFiClientSecure performs a full handshake on every connect and has no
+// hook for offering a saved session, so this wraps a plain WiFiClient in
+// mbedtls directly. After each handshake the negotiated session (ID or
+// ticket) is kept in RAM and, when it fits, serialized into RTC memory so
+// it also survives deep sleep. The next connect offers it; a server that
+// accepts skips the certificate exchange and key agreement.
+
+#pragma once
+
+#include <WiFi.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/net_sockets.h>
+
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+
+#define TLS_SESSION_BLOB_SIZE 1024
+#define TLS_HANDSHAKE_TIMEOUT 15000
+
+// Serialized session kept across deep sleep (not across power loss)
+RTC_DATA_ATTR uint8_t tlsSessionBlob[TLS_SESSION_BLOB_SIZE];
+RTC_DATA_ATTR size_t tlsSessionBlobLen = 0;
+
+class TlsSessionClient : public Client {
+public:
+    // Handshake statistics of the last connect
+    unsigned long lastHandshakeMs = 0;
+    // Approximate peak heap used by the handshake: free heap is sampled on
+    // every record sent or received and after each handshake call, so memory
+    // allocated and freed inside one step (the key exchange math) is missed.
+    // Read it as a lower bound.
+    uint32_t lastHandshakeHeap = 0;
+    bool lastResumed = false;
+    uint32_t fullHandshakes = 0;
+    uint32_t resumedHandshakes = 0;
+
+    TlsSessionClient() {
+        mbedtls_ssl_session_init(&session_);
+    }
+
+    // PEM CA certificate the server must chain to. Without one connect()
+    // fails unless setInsecure() was called.
+    void setCACert(const char* pem) {
+        caCert_ = pem;
+    }
+
+    // Skip server verification when no CA is set (bench testing only)
+    void setInsecure() {
+        insecure_ = true;
+    }
+
+    void clearSession() {
+        mbedtls_ssl_session_free(&session_);
+        mbedtls_ssl_session_init(&session_);
+        haveSession_ = false;
+        tlsSessionBlobLen = 0;
+    }
+
+    int connect(IPAddress ip, uint16_t port) {
+        return connect(ip.toString().c_str(), port);
+    }
+
+    int connect(IPAddress ip, uint16_t port, int32_t timeout) {
+        return connect(ip.toString().c_str(), port);
+    }
+
+    int connect(const char* host, uint16_t port, int32_t timeout) {
+        return connect(host, port);
+    }
+
+    int connect(const char* host, uint16_t port) {
+        stop();
+        if (!tcp_.connect(host, port)) {
+            return 0;
+        }
+        tcp_.setNoDelay(true);
+
+        heapBefore_ = ESP.getFreeHeap();
+        heapLow_ = heapBefore_;
+        unsigned long start = millis();
+
+        if (!setup(host)) {
+            stop();
+            return 0;
+        }
+
+        // Offer the cached session, restoring it from RTC memory after deep sleep
+        if (!haveSession_ && tlsSessionBlobLen > 0) {
+            haveSession_ = mbedtls_ssl_session_load(&session_, tlsSessionBlob, tlsSessionBlobLen) == 0;
+        }
+        bool offered = haveSession_ && mbedtls_ssl_set_session(&ssl_, &session_) == 0;
+        helloIdLen_ = 0;
+        captureHello_ = true;
+
+        int ret;
+        while ((ret = mbedtls_ssl_handshake(&ssl_)) != 0) {
+            if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                Serial.println("TLS handshake failed: -0x" + String(-ret, HEX));
+                // A rejected session must not poison the next attempt
+                clearSession();
+                stop();
+                return 0;
+            }
+            if (millis() - start > TLS_HANDSHAKE_TIMEOUT) {
+                Serial.println("TLS handshake timed out");
+                stop();
+                return 0;
+            }
+            sampleHeap();
+            delay(1);
+        }
+        sampleHeap();
+
+        lastHandshakeMs = millis() - start;
+        lastHandshakeHeap = heapBefore_ - heapLow_;
+
+        // Keep the new session. A server that resumes (by ID or ticket) echoes
+        // the session ID from our ClientHello in its ServerHello.
+        mbedtls_ssl_session_free(&session_);
+        mbedtls_ssl_session_init(&session_);
+        haveSession_ = mbedtls_ssl_get_session(&ssl_, &session_) == 0;
+        lastResumed = offered && haveSession_ && helloIdLen_ > 0 &&
+                      session_.MBEDTLS_PRIVATE(id_len) == helloIdLen_ &&
+                      memcmp(session_.MBEDTLS_PRIVATE(id), helloId_, helloIdLen_) == 0;
+        if (lastResumed) {
+            resumedHandshakes++;
+        } else {
+            fullHandshakes++;
+        }
+
+        size_t blobLen = 0;
+        if (haveSession_ && mbedtls_ssl_session_save(&session_, tlsSessionBlob, sizeof(tlsSessionBlob), &blobLen) == 0) {
+            tlsSessionBlobLen = blobLen;
+        } else {
+            tlsSessionBlobLen = 0;   // too large for RTC memory, kept in RAM only
+        }
+
+        active_ = true;
+        return 1;
+    }
+
+    size_t write(uint8_t b) {
+        return write(&b, 1);
+    }
+
+    size_t write(const uint8_t* buf, size_t size) {
+        if (!active_) return 0;
+        size_t sent = 0;
+        while (sent < size) {
+            int ret = mbedtls_ssl_write(&ssl_, buf + sent, size - sent);
+            if (ret > 0) {
+                sent += ret;
+            } else if ((ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_WANT_READ) || !tcp_.connected()) {
+                stop();
+                break;
+            } else {
+                delay(1);
+            }
+        }
+        return sent;
+    }
+
+    int available() {
+        if (!active_) return 0;
+        if (peeked_ >= 0) return 1 + mbedtls_ssl_get_bytes_avail(&ssl_);
+        // Process a pending record so decrypted bytes become visible
+        int ret = mbedtls_ssl_read(&ssl_, NULL, 0);
+        if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            stop();
+            return 0;
+        }
+        return mbedtls_ssl_get_bytes_avail(&ssl_);
+    }
+
+    int read() {
+        uint8_t b;
+        return read(&b, 1) == 1 ? b : -1;
+    }
+
+    int read(uint8_t* buf, size_t size) {
+        if (!active_ || size == 0) return -1;
+        size_t offset = 0;
+        if (peeked_ >= 0) {
+            buf[offset++] = (uint8_t)peeked_;
+            peeked_ = -1;
+            if (offset == size) return 1;
+        }
+        int ret = mbedtls_ssl_read(&ssl_, buf + offset, size - offset);
+        if (ret > 0) return offset + ret;
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            return offset > 0 ? (int)offset : -1;
+        }
+        stop();
+        return offset > 0 ? (int)offset : -1;
+    }
+
+    int peek() {
+        if (peeked_ < 0) {
+            uint8_t b;
+            if (read(&b, 1) == 1) peeked_ = b;
+        }
+        return peeked_;
+    }
+
+    void flush() {
+        tcp_.flush();
+    }
+
+    void stop() {
+        if (active_) {
+            mbedtls_ssl_close_notify(&ssl_);
+        }
+        if (initialized_) {
+            mbedtls_ssl_free(&ssl_);
+            mbedtls_ssl_config_free(&conf_);
+            mbedtls_ctr_drbg_free(&drbg_);
+            mbedtls_entropy_free(&entropy_);
+            mbedtls_x509_crt_free(&ca_);
+            initialized_ = false;
+        }
+        active_ = false;
+        peeked_ = -1;
+        tcp_.stop();
+    }
+
+    uint8_t connected() {
+        return active_ && (tcp_.connected() || available() > 0);
+    }
+
+    operator bool() {
+        return connected();
+    }
+
+private:
+    WiFiClient tcp_;
+    mbedtls_ssl_context ssl_;
+    mbedtls_ssl_config conf_;
+    mbedtls_ctr_drbg_context drbg_;
+    mbedtls_entropy_context entropy_;
+    mbedtls_x509_crt ca_;
+    mbedtls_ssl_session session_;
+    const char* caCert_ = nullptr;
+    bool insecure_ = false;
+    bool haveSession_ = false;
+    bool initialized_ = false;
+    bool active_ = false;
+    int peeked_ = -1;
+    uint32_t heapBefore_ = 0;
+    uint32_t heapLow_ = 0;
+    bool captureHello_ = false;
+    uint8_t helloId_[32];
+    size_t helloIdLen_ = 0;
+
+    bool setup(const char* host) {
+        mbedtls_ssl_init(&ssl_);
+        mbedtls_ssl_config_init(&conf_);
+        mbedtls_ctr_drbg_init(&drbg_);
+        mbedtls_entropy_init(&entropy_);
+        mbedtls_x509_crt_init(&ca_);
+        initialized_ = true;
+
+        if (mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_, NULL, 0) != 0) return false;
+        if (mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                        MBEDTLS_SSL_PRESET_DEFAULT) != 0) return false;
+
+        if (caCert_ && caCert_[0]) {
+            if (mbedtls_x509_crt_parse(&ca_, (const unsigned char*)caCert_, strlen(caCert_) + 1) != 0) return false;
+            mbedtls_ssl_conf_ca_chain(&conf_, &ca_, NULL);
+            mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_REQUIRED);
+        } else if (insecure_) {
+            mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_NONE);
+        } else {
+            Serial.println("TLS: no CA certificate set, refusing an unverified server");
+            return false;
+        }
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        // TLS 1.3 tickets arrive after the handshake; 1.2 gives a resumable session immediately
+        mbedtls_ssl_conf_max_tls_version(&conf_, MBEDTLS_SSL_VERSION_TLS1_2);
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        mbedtls_ssl_conf_session_tickets(&conf_, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+        mbedtls_ssl_conf_rng(&conf_, mbedtls_ctr_drbg_random, &drbg_);
+
+        if (mbedtls_ssl_setup(&ssl_, &conf_) != 0) return false;
+        if (mbedtls_ssl_set_hostname(&ssl_, host) != 0) return false;
+        mbedtls_ssl_set_bio(&ssl_, this, bioSend, bioRecv, NULL);
+        return true;
+    }
+
+    void sampleHeap() {
+        uint32_t freeHeap = ESP.getFreeHeap();
+        if (freeHeap < heapLow_) heapLow_ = freeHeap;
+    }
+
+    // Remember the session ID of the first ClientHello record:
+    // record header (5) + handshake header (4) + version (2) + random (32) + id length
+    void captureHelloId(const unsigned char* buf, size_t len) {
+        captureHello_ = false;
+        if (len < 44 || buf[0] != 0x16 || buf[5] != 0x01) return;
+        size_t idLen = buf[43];
+        if (idLen > sizeof(helloId_) || len < 44 + idLen) return;
+        memcpy(helloId_, buf + 44, idLen);
+        helloIdLen_ = idLen;
+    }
+
+    static int bioSend(void* ctx, const unsigned char* buf, size_t len) {
+        TlsSessionClient* self = (TlsSessionClient*)ctx;
+        self->sampleHeap();
+        if (self->captureHello_) {
+            self->captureHelloId(buf, len);
+        }
+        size_t sent = self->tcp_.write(buf, len);
+        if (sent == 0) {
+            return self->tcp_.connected() ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_CONN_RESET;
+        }
+        return sent;
+    }
+
+    static int bioRecv(void* ctx, unsigned char* buf, size_t len) {
+        TlsSessionClient* self = (TlsSessionClient*)ctx;
+        self->sampleHeap();
+        if (!self->tcp_.available()) {
+            return self->tcp_.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+        }
+        int n = self->tcp_.read(buf, len);
+        return n > 0 ? n : MBEDTLS_ERR_SSL_WANT_READ;
+    }
+};
@@ -0,0 +1,159 @@
+// Broker failover drill: BrokerPool and Mqtt5Client from the sketch against
+// local brokers.
+//
+//   broker_failover <host:port> <host:port> [...] [seconds]
+//
+// Build: g++ -std=c++17 -O2 -I.. -Ihost -o broker_failover broker_failover.cpp
+//
+// Two stand-ins are enough, e.g. `mosquitto -p 1883` and `mosquitto -p 1884`.
+// The tool probes the brokers, connects to the fastest and publishes a QoS 1
+// message every 100 ms, failing over the way the sketch does. Stop the
+// active broker while it runs: every failover is printed with the outage,
+// from the first failed publish to the first one accepted elsewhere.
+// Start it again to see it return to rotation once its cooldown is over.
+// Probes run every 5 s here instead of every 5 minutes.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "broker_pool.h"
+#include "mqtt5_client.h"
+
+static const unsigned long PUBLISH_INTERVAL = 100;
+static const unsigned long PROBE_INTERVAL = 5000;
+
+static BrokerPool pool;
+static Client net;
+static Client probeNet;
+static Mqtt5Client mqtt(1024);
+
+static double seconds() {
+    return millis() / 1000.0;
+}
+
+static const char* name(int8_t i) {
+    static char buf[BROKER_HOST_MAX + 8];
+    if (i < 0) return "-";
+    snprintf(buf, sizeof(buf), "%s:%u", pool.entry(i).host, pool.entry(i).port);
+    return buf;
+}
+
+static void probe() {
+    for (uint8_t i = 0; i < pool.count(); i++) {
+        const BrokerEntry &e = pool.entry(i);
+        unsigned long start = millis();
+        if (probeNet.connect(e.host, e.port)) {
+            pool.recordLatency(i, millis() - start);
+        } else if (i != pool.active()) {
+            pool.recordFailure(i, millis());
+        }
+        probeNet.stop();
+    }
+}
+
+// Same loop as the sketch's connect(): a lost session back to its broker
+// while that one is healthy, otherwise the best healthy broker; pace only
+// when nothing healthy is left
+static void connectBest(bool leaving, bool failed) {
+    int8_t previous = pool.active();
+    if (failed && previous >= 0) pool.recordFailure(previous, millis());
+    mqtt.disconnect();
+
+    while (true) {
+        uint8_t broker = !leaving && previous >= 0 && pool.healthy(previous, millis()) ? previous : pool.select(millis());
+        mqtt.setHost(pool.entry(broker).host, pool.entry(broker).port);
+        unsigned long start = millis();
+        if (mqtt.connect("broker-failover-drill")) {
+            pool.recordConnect(broker, millis() - start);
+            printf("%7.2fs connected to %s in %lu ms%s\n", seconds(), name(broker), millis() - start,
+                   previous >= 0 && previous != broker ? (failed ? " (failover)" : " (faster)") : "");
+            return;
+        }
+        pool.recordFailure(broker, millis());
+        printf("%7.2fs %s refused\n", seconds(), name(broker));
+        if (!pool.healthy(pool.select(millis()), millis())) delay(1000);
+    }
+}
+
+int main(int argc, char** argv) {
+    int duration = 60;
+    for (int i = 1; i < argc; i++) {
+        const char* colon = strrchr(argv[i], ':');
+        if (!colon) {
+            duration = atoi(argv[i]);
+            continue;
+        }
+        std::string host(argv[i], colon - argv[i]);
+        if (!pool.add(host.c_str(), atoi(colon + 1))) {
+            fprintf(stderr, "cannot add %s (at most %d brokers)\n", argv[i], BROKER_POOL_MAX);
+            return 2;
+        }
+    }
+    if (pool.count() < 2) {
+        fprintf(stderr, "usage: broker_failover <host:port> <host:port> [...] [seconds]\n");
+        return 2;
+    }
+
+    mqtt.begin(pool.entry(0).host, pool.entry(0).port, net);
+    mqtt.setKeepAlive(10);
+    probe();
+    connectBest(true, false);
+
+    unsigned published = 0, failed = 0;
+    unsigned long firstFailure = 0, worstOutage = 0, lastPublish = 0, lastProbe = millis();
+    bool reconnect = false, brokerFailed = false;
+
+    while (millis() < (unsigned long)duration * 1000) {
+        if (reconnect || !mqtt.connected()) {
+            connectBest(reconnect, brokerFailed);
+            reconnect = brokerFailed = false;
+        }
+        mqtt.loop();
+
+        unsigned long now = millis();
+        if (now - lastProbe > PROBE_INTERVAL) {
+            lastProbe = now;
+            probe();
+            if (pool.betterThanActive(millis()) >= 0) reconnect = true;
+        }
+
+        if (now - lastPublish >= PUBLISH_INTERVAL) {
+            lastPublish = now;
+            char payload[64];
+            snprintf(payload, sizeof(payload), "{\"seq\":%u}", published + failed);
+            bool sessionUp = mqtt.connected();
+            bool ok = mqtt.publish("devices/ESP32-DEV-001/status", payload, false, 1);
+            if (ok) {
+                published++;
+                if (firstFailure) {
+                    unsigned long outage = millis() - firstFailure;
+                    if (outage > worstOutage) worstOutage = outage;
+                    printf("%7.2fs publishing again on %s, outage %lu ms\n", seconds(), name(pool.active()), outage);
+                    firstFailure = 0;
+                }
+            } else {
+                failed++;
+                if (!firstFailure) {
+                    firstFailure = millis();
+                    printf("%7.2fs publish failed on %s\n", seconds(), name(pool.active()));
+                }
+            }
+            if (sessionUp && pool.recordPublish(ok)) reconnect = brokerFailed = true;
+        }
+        delay(1);
+    }
+
+    printf("\n%-24s %10s %10s %9s\n", "broker", "latency", "connect", "failures");
+    for (uint8_t i = 0; i < pool.count(); i++) {
+        const BrokerEntry &e = pool.entry(i);
+        char latency[16] = "-";
+        if (e.latencyMs != BROKER_LATENCY_UNKNOWN) snprintf(latency, sizeof(latency), "%u ms", e.latencyMs);
+        printf("%-24s %10s %7u ms %9u\n", name(i), latency, e.connectMs, e.totalFailures);
+    }
+    printf("published %u, failed %u, failovers %u, switches %u, worst outage %lu ms\n", published, failed,
+           pool.failovers, pool.switches, worstOutage);
+    mqtt.disconnect();
+    return 0;
+}
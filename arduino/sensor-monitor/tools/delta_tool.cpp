@@ -0,0 +1,257 @@
+// Host-side companion to delta_patch.h.
+//
+//   delta_tool diff  <old.bin> <new.bin> <out.patch>   build a patch
+//   delta_tool apply <old.bin> <in.patch> <out.bin>    apply a patch
+//   delta_tool check <old.bin> <new.bin>               diff, apply, compare
+//
+// Build: g++ -std=c++17 -O2 -I.. -o delta_tool delta_tool.cpp
+//
+// "apply" and "check" run the same DeltaPatcher the firmware uses, fed in
+// MQTT-sized chunks, so two build outputs are enough to validate a patch.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "delta_patch.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+static const size_t MATCH_KEY = 16;      // bytes hashed per index entry
+static const size_t MIN_MATCH = 32;      // shorter matches are sent as literals
+static const size_t MAX_CANDIDATES = 8;  // old offsets remembered per key
+static const size_t MIN_SKIP = 4;        // shorter equal runs stay inside a diff
+static const size_t CHUNK = 2048;        // same as the OTA chunk size
+
+static bool readFile(const char* path, Bytes &out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out.resize(size);
+    bool ok = fread(out.data(), 1, size, f) == (size_t)size;
+    fclose(f);
+    return ok;
+}
+
+static bool writeFile(const char* path, const Bytes &data) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok;
+}
+
+static void putVarint(Bytes &out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static uint64_t keyAt(const Bytes &b, size_t pos) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < MATCH_KEY; i++) {
+        h = (h ^ b[pos + i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// bsdiff-style forward extension: keep the length that maximises
+// 2 * matches - length, so mostly-equal regions (relocated code) still match.
+static size_t extendMatch(const Bytes &oldImg, size_t o, const Bytes &newImg, size_t n) {
+    long score = 0, best = 0;
+    size_t bestLen = 0;
+    for (size_t k = 0; o + k < oldImg.size() && n + k < newImg.size(); k++) {
+        score += oldImg[o + k] == newImg[n + k] ? 1 : -1;
+        if (score > best) {
+            best = score;
+            bestLen = k + 1;
+        }
+        if (k + 1 - bestLen > 64) break;
+    }
+    return bestLen;
+}
+
+static void emitInsert(Bytes &patch, const Bytes &newImg, size_t from, size_t to) {
+    if (to <= from) return;
+    patch.push_back('I');
+    putVarint(patch, to - from);
+    patch.insert(patch.end(), newImg.begin() + from, newImg.begin() + to);
+}
+
+static void emitMatch(Bytes &patch, const Bytes &oldImg, size_t o, const Bytes &newImg, size_t n, size_t len) {
+    bool exact = memcmp(&oldImg[o], &newImg[n], len) == 0;
+    patch.push_back(exact ? 'C' : 'A');
+    putVarint(patch, o);
+    putVarint(patch, len);
+    if (exact) return;
+
+    size_t k = 0;
+    while (k < len) {
+        size_t skip = 0;
+        while (k + skip < len && oldImg[o + k + skip] == newImg[n + k + skip]) skip++;
+        putVarint(patch, skip);
+        k += skip;
+        if (k == len) break;
+
+        // Diff run ends at the first equal run long enough to be worth a segment
+        size_t end = k;
+        while (end < len) {
+            size_t eq = 0;
+            while (end + eq < len && oldImg[o + end + eq] == newImg[n + end + eq]) eq++;
+            if (eq >= MIN_SKIP || end + eq == len) break;
+            end += eq + 1;
+        }
+        putVarint(patch, end - k);
+        for (size_t i = k; i < end; i++) {
+            patch.push_back((uint8_t)(newImg[n + i] - oldImg[o + i]));
+        }
+        k = end;
+    }
+}
+
+static Bytes makePatch(const Bytes &oldImg, const Bytes &newImg) {
+    std::unordered_map<uint64_t, std::vector<uint32_t>> index;
+    if (oldImg.size() >= MATCH_KEY) {
+        index.reserve(oldImg.size());
+        for (size_t i = 0; i + MATCH_KEY <= oldImg.size(); i++) {
+            std::vector<uint32_t> &slot = index[keyAt(oldImg, i)];
+            if (slot.size() < MAX_CANDIDATES) slot.push_back((uint32_t)i);
+        }
+    }
+
+    Bytes patch = {'D', 'P', 'T', '1'};
+    putVarint(patch, newImg.size());
+
+    size_t pos = 0, literalStart = 0;
+    size_t lastOld = 0;
+    while (pos + MATCH_KEY <= newImg.size()) {
+        size_t bestLen = 0, bestOld = 0;
+        auto it = index.find(keyAt(newImg, pos));
+        if (it != index.end()) {
+            for (uint32_t o : it->second) {
+                if (memcmp(&oldImg[o], &newImg[pos], MATCH_KEY) != 0) continue;
+                size_t len = extendMatch(oldImg, o, newImg, pos);
+                if (len > bestLen) {
+                    bestLen = len;
+                    bestOld = o;
+                }
+            }
+        }
+        // Also try continuing at the previous match's displacement
+        if (lastOld + MATCH_KEY <= oldImg.size()) {
+            size_t len = extendMatch(oldImg, lastOld, newImg, pos);
+            if (len > bestLen) {
+                bestLen = len;
+                bestOld = lastOld;
+            }
+        }
+
+        if (bestLen < MIN_MATCH) {
+            pos++;
+            continue;
+        }
+
+        emitInsert(patch, newImg, literalStart, pos);
+        emitMatch(patch, oldImg, bestOld, newImg, pos, bestLen);
+        pos += bestLen;
+        lastOld = bestOld + bestLen;
+        literalStart = pos;
+    }
+    emitInsert(patch, newImg, literalStart, newImg.size());
+    patch.push_back('E');
+    return patch;
+}
+
+struct ApplyContext {
+    const Bytes* source;
+    Bytes* target;
+};
+
+static bool readSource(void* ctx, uint32_t offset, uint8_t* buf, size_t len) {
+    const Bytes &src = *((ApplyContext*)ctx)->source;
+    if ((size_t)offset + len > src.size()) return false;
+    memcpy(buf, &src[offset], len);
+    return true;
+}
+
+static bool writeTarget(void* ctx, const uint8_t* buf, size_t len) {
+    Bytes &dst = *((ApplyContext*)ctx)->target;
+    dst.insert(dst.end(), buf, buf + len);
+    return true;
+}
+
+static bool applyPatch(const Bytes &oldImg, const Bytes &patch, Bytes &out) {
+    ApplyContext ctx = {&oldImg, &out};
+    DeltaPatcher patcher(readSource, writeTarget);
+    patcher.begin(&ctx);
+    out.clear();
+    for (size_t i = 0; i < patch.size(); i += CHUNK) {
+        size_t n = patch.size() - i < CHUNK ? patch.size() - i : CHUNK;
+        if (!patcher.feed(&patch[i], n)) {
+            fprintf(stderr, "patch failed at byte %zu: %s\n", i, patcher.error());
+            return false;
+        }
+    }
+    if (!patcher.finished()) {
+        fprintf(stderr, "patch truncated\n");
+        return false;
+    }
+    return true;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: delta_tool diff|apply|check <old.bin> <new.bin|patch> [out]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) return usage();
+    std::string mode = argv[1];
+
+    Bytes oldImg, second;
+    if (!readFile(argv[2], oldImg) || !readFile(argv[3], second)) {
+        fprintf(stderr, "cannot read input files\n");
+        return 1;
+    }
+
+    if (mode == "diff" && argc == 5) {
+        Bytes patch = makePatch(oldImg, second);
+        if (!writeFile(argv[4], patch)) return 1;
+        printf("patch: %zu bytes (%.1f%% of %zu byte image)\n",
+               patch.size(), 100.0 * patch.size() / second.size(), second.size());
+        return 0;
+    }
+
+    if (mode == "apply" && argc == 5) {
+        Bytes out;
+        if (!applyPatch(oldImg, second, out) || !writeFile(argv[4], out)) return 1;
+        printf("wrote %zu bytes\n", out.size());
+        return 0;
+    }
+
+    if (mode == "check" && argc == 4) {
+        auto t0 = std::chrono::steady_clock::now();
+        Bytes patch = makePatch(oldImg, second);
+        auto t1 = std::chrono::steady_clock::now();
+        Bytes out;
+        bool ok = applyPatch(oldImg, patch, out) && out == second;
+        auto t2 = std::chrono::steady_clock::now();
+
+        printf("old %zu, new %zu, patch %zu bytes (%.1f%%)\n",
+               oldImg.size(), second.size(), patch.size(), 100.0 * patch.size() / second.size());
+        printf("diff %.1f ms, apply %.1f ms\n",
+               std::chrono::duration<double, std::milli>(t1 - t0).count(),
+               std::chrono::duration<double, std::milli>(t2 - t1).count());
+        printf("%s\n", ok ? "OK: patched image matches" : "FAIL: patched image differs");
+        return ok ? 0 : 1;
+    }
+
+    return usage();
+}
@@ -0,0 +1,150 @@
+// Fleet simulation of discovery traffic, with and without DiscoveryPacer.
+//
+//   discovery_fleet [devices] [window_s]
+//
+// Build: g++ -std=c++17 -O2 -I.. -o discovery_fleet discovery_fleet.cpp
+//
+// Two events hit a fleet of devices named like the sketch's (ESP32-DEV-0001,
+// ...):
+//   - a broadcast on devices/discover/all, followed by the server's
+//     per-device fan-out from handleGlobalDiscovery (one directed request per
+//     device, published back to back, carrying the same window)
+//   - a broker restart, with every device reconnecting within a few seconds
+// Before is the old firmware (answer every request on the spot, and one
+// second after connecting); after is DiscoveryPacer in a 10 ms loop. The
+// window defaults to what the server picks for the fleet (devices / 20 per
+// second, at least 20 s). Prints the peak discovery documents per second and
+// per 100 ms arriving at the server, the total, and when the last one came.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "discovery_pacer.h"
+
+static const uint32_t LOOP_MS = 10;
+static const uint32_t SERVER_RATE = 20;        // answers per second the server sizes the window for
+static const uint32_t FANOUT_START_MS = 50;    // listener sees the broadcast and starts the fan-out
+static const uint32_t FANOUT_STEP_MS = 2;      // per publish in the fan-out loop
+static const uint32_t RECONNECT_SPREAD_MS = 3000;
+
+struct Request {
+    uint32_t at;
+    uint32_t windowMs;
+};
+
+struct Result {
+    uint32_t total;
+    uint32_t peakSecond;
+    uint32_t peak100;
+    uint32_t lastMs;
+};
+
+// Arrival times at the server, with a few ms of network in between
+static Result measure(std::vector<uint32_t> &arrivals) {
+    Result r = {(uint32_t)arrivals.size(), 0, 0, 0};
+    std::sort(arrivals.begin(), arrivals.end());
+    size_t lo1000 = 0, lo100 = 0;
+    for (size_t i = 0; i < arrivals.size(); i++) {
+        while (arrivals[i] - arrivals[lo1000] >= 1000) lo1000++;
+        while (arrivals[i] - arrivals[lo100] >= 100) lo100++;
+        r.peakSecond = std::max(r.peakSecond, (uint32_t)(i - lo1000 + 1));
+        r.peak100 = std::max(r.peak100, (uint32_t)(i - lo100 + 1));
+    }
+    if (!arrivals.empty()) r.lastMs = arrivals.back();
+    return r;
+}
+
+// Old firmware: an answer per request, straight away
+static std::vector<uint32_t> immediate(const std::vector<std::vector<Request>> &fleet, uint32_t answerDelayMs, std::mt19937 &rng) {
+    std::vector<uint32_t> arrivals;
+    for (const auto &requests : fleet) {
+        for (const Request &q : requests) {
+            arrivals.push_back(q.at + answerDelayMs + rng() % 40);
+        }
+    }
+    return arrivals;
+}
+
+// DiscoveryPacer polled from the loop like the sketch does
+static std::vector<uint32_t> paced(const std::vector<std::vector<Request>> &fleet, uint32_t untilMs, std::mt19937 &rng) {
+    std::vector<uint32_t> arrivals;
+    char id[32];
+    for (size_t d = 0; d < fleet.size(); d++) {
+        snprintf(id, sizeof(id), "ESP32-DEV-%04zu", d + 1);
+        DiscoveryPacer pacer;
+        pacer.begin(id);
+        // Boot long before the event, last periodic answer a while ago
+        uint32_t base = 10000000;
+        pacer.sent(base - DISCOVERY_MIN_INTERVAL_MS - 60000);
+
+        size_t next = 0;
+        const std::vector<Request> &requests = fleet[d];
+        for (uint32_t t = 0; t <= untilMs; t += LOOP_MS) {
+            while (next < requests.size() && requests[next].at <= t) {
+                pacer.request(base + requests[next].at, requests[next].windowMs);
+                next++;
+            }
+            if (pacer.due(base + t)) {
+                pacer.sent(base + t);
+                arrivals.push_back(t + rng() % 40);
+            }
+        }
+    }
+    return arrivals;
+}
+
+static void print(const char* label, const Result &r) {
+    printf("  %-8s %6u docs  peak %5u/s  %4u/100ms  last at %6.1f s\n",
+           label, r.total, r.peakSecond, r.peak100, r.lastMs / 1000.0);
+}
+
+int main(int argc, char** argv) {
+    uint32_t devices = argc > 1 ? atoi(argv[1]) : 1000;
+    uint32_t windowS = argc > 2 ? atoi(argv[2]) : std::max<uint32_t>(DISCOVERY_WINDOW_MS / 1000, (devices + SERVER_RATE - 1) / SERVER_RATE);
+    uint32_t windowMs = windowS * 1000;
+    uint32_t untilMs = windowMs + DISCOVERY_MIN_INTERVAL_MS + RECONNECT_SPREAD_MS + 5000;
+    std::mt19937 rng(3);
+
+    printf("%u devices, window %u s, min interval %u s\n", devices, windowS, DISCOVERY_MIN_INTERVAL_MS / 1000);
+
+    // Broadcast plus the fan-out
+    std::vector<std::vector<Request>> fleet(devices);
+    for (uint32_t d = 0; d < devices; d++) {
+        fleet[d].push_back({(uint32_t)(rng() % 20), windowMs});
+        fleet[d].push_back({FANOUT_START_MS + d * FANOUT_STEP_MS, windowMs});
+    }
+    printf("broadcast + per-device fan-out:\n");
+    std::vector<uint32_t> before = immediate(fleet, 0, rng);
+    print("before", measure(before));
+    std::vector<uint32_t> after = paced(fleet, untilMs, rng);
+    print("after", measure(after));
+
+    // Broker restart: everyone reconnects; the old firmware announced 1 s later
+    for (uint32_t d = 0; d < devices; d++) {
+        fleet[d].assign(1, {(uint32_t)(rng() % RECONNECT_SPREAD_MS), windowMs});
+    }
+    printf("broker restart, reconnect within %.1f s:\n", RECONNECT_SPREAD_MS / 1000.0);
+    before = immediate(fleet, 1000, rng);
+    print("before", measure(before));
+    after = paced(fleet, untilMs, rng);
+    print("after", measure(after));
+
+    // How even the hash spreads this fleet: the fullest second of the window
+    std::vector<uint32_t> perSecond(windowS ? windowS : 1, 0);
+    char id[32];
+    for (uint32_t d = 0; d < devices; d++) {
+        snprintf(id, sizeof(id), "ESP32-DEV-%04u", d + 1);
+        DiscoveryPacer pacer;
+        pacer.begin(id);
+        perSecond[pacer.offset(windowMs) / 1000]++;
+    }
+    printf("offsets: %u..%u devices per second of the window (%.1f even)\n",
+           *std::min_element(perSecond.begin(), perSecond.end()),
+           *std::max_element(perSecond.begin(), perSecond.end()),
+           (double)devices / perSecond.size());
+    return 0;
+}
@@ -0,0 +1,76 @@
+// Shared library exposing geofence.h to the PHP server through FFI.
+//
+// Build: g++ -std=c++17 -O2 -shared -fPIC -I.. -o libgeofence.so geofence_ffi.cpp
+//
+// Point GEOFENCE_FFI_LIBRARY in the server's .env at the result; without it
+// GeofencingService runs the same algorithm in PHP. The edge and fence
+// tables grow as polygons are added, so unlike the firmware there is no
+// fixed capacity.
+
+#include <cstdint>
+#include <vector>
+
+#include "geofence.h"
+
+struct geofence_set {
+    std::vector<Geofence> fences;
+    std::vector<GeofenceEdge> edges;
+    GeofenceSet set;
+};
+
+static void attach(geofence_set* s) {
+    uint32_t fenceCount = s->set.fenceCount;
+    uint32_t edgeCount = s->set.edgeCount;
+    geofenceInit(s->set, s->fences.data(), s->fences.size(), s->edges.data(), s->edges.size());
+    s->set.fenceCount = fenceCount;
+    s->set.edgeCount = edgeCount;
+}
+
+extern "C" {
+
+geofence_set* geofence_create(void) {
+    geofence_set* s = new geofence_set;
+    s->fences.resize(16);
+    s->edges.resize(1024);
+    geofenceInit(s->set, s->fences.data(), s->fences.size(), s->edges.data(), s->edges.size());
+    return s;
+}
+
+void geofence_free(geofence_set* s) {
+    delete s;
+}
+
+void geofence_clear(geofence_set* s) {
+    s->set.fenceCount = 0;
+    s->set.edgeCount = 0;
+}
+
+uint32_t geofence_count(const geofence_set* s) {
+    return s->set.fenceCount;
+}
+
+int geofence_add(geofence_set* s, int32_t id, const double* lngLat, const uint32_t* ringSizes, uint32_t ringCount) {
+    uint32_t edges = s->set.edgeCount + geofenceEdgesNeeded(lngLat, ringSizes, ringCount);
+    if (s->set.fenceCount >= s->fences.size() || edges > s->edges.size()) {
+        s->fences.resize(s->fences.size() * 2 > s->set.fenceCount + 1 ? s->fences.size() * 2 : s->set.fenceCount + 1);
+        s->edges.resize(s->edges.size() * 2 > edges ? s->edges.size() * 2 : edges);
+        attach(s);
+    }
+    return geofenceAdd(s->set, id, lngLat, ringSizes, ringCount);
+}
+
+int geofence_contains(const geofence_set* s, uint32_t fence, double lat, double lng) {
+    return fence < s->set.fenceCount && geofenceContains(s->set, fence, lat, lng);
+}
+
+void geofence_contains_pairs(const geofence_set* s, const double* lat, const double* lng, const uint32_t* fence,
+                             size_t count, uint8_t* inside) {
+    geofenceContainsPairs(s->set, lat, lng, fence, count, inside);
+}
+
+void geofence_contains_all(const geofence_set* s, const double* lat, const double* lng, size_t count,
+                           uint8_t* inside) {
+    geofenceContainsAll(s->set, lat, lng, count, inside);
+}
+
+}
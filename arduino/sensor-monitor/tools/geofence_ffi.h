@@ -0,0 +1,23 @@
+/* C interface to geofence.h for PHP FFI (App\Services\GeofenceNative).
+   Plain declarations only: the file is passed to FFI::cdef() as is.
+   Build: g++ -std=c++17 -O2 -shared -fPIC -I.. -o libgeofence.so geofence_ffi.cpp */
+
+typedef struct geofence_set geofence_set;
+
+geofence_set* geofence_create(void);
+void geofence_free(geofence_set* set);
+void geofence_clear(geofence_set* set);
+uint32_t geofence_count(const geofence_set* set);
+
+/* Rings of {lng, lat} pairs, outer ring first. Returns the fence index or -1. */
+int geofence_add(geofence_set* set, int32_t id, const double* lng_lat, const uint32_t* ring_sizes, uint32_t ring_count);
+
+int geofence_contains(const geofence_set* set, uint32_t fence, double lat, double lng);
+
+/* inside[i] = point i against fence[i] */
+void geofence_contains_pairs(const geofence_set* set, const double* lat, const double* lng,
+                             const uint32_t* fence, size_t count, uint8_t* inside);
+
+/* inside[i * geofence_count() + f] = point i against fence f */
+void geofence_contains_all(const geofence_set* set, const double* lat, const double* lng, size_t count,
+                           uint8_t* inside);
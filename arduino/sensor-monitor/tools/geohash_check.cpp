@@ -0,0 +1,125 @@
+// Checks geohash.h against reference geohashes.
+//
+//   geohash_check [random points]
+//
+// Build: g++ -std=c++17 -O2 -I.. -o geohash_check geohash_check.cpp
+//
+// First the fixed vectors below (the first three are the published
+// examples, the rest cover the Xorafi fence, hemispheres and range edges),
+// then random points against the textbook floating-point bisection. Exits
+// non-zero on any mismatch and prints the encode cost on this host.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "geohash.h"
+
+struct Vector {
+    double lat;
+    double lng;
+    const char* hash;
+};
+
+static const Vector VECTORS[] = {
+    {57.64911, 10.40744, "u4pruydqqvj"},
+    {42.6, -5.6, "ezs42"},
+    {-25.382708, -49.265506, "6gkzwgjzn820"},
+    {39.512345, -107.701234, "9x52v1n25"},
+    {39.495387, -107.744122, "9x52sjzj7cz8"},
+    {37.7749, -122.4194, "9q8yyk8yt"},
+    {-33.8688, 151.2093, "r3gx2f77"},
+    {0, 0, "s0000000"},
+    {51.4778, -0.0014, "gcpuzgnzzm"},
+    {35.6762, 139.6503, "xn76cyd"},
+    {-0.000001, -0.000001, "7zzzzz"},
+    {89.9999999, 179.9999999, "zzzzzzzzzzzz"},
+    {-90, -180, "000000"},
+    {90, 180, "zzzzzzzzzzzz"},
+};
+
+static int32_t toE7(double degrees) {
+    return (int32_t)llround(degrees * 1e7);
+}
+
+// Reference: bisect the ranges in doubles, one bit at a time
+static void referenceEncode(double lat, double lng, int precision, char* out) {
+    double latRange[2] = {-90, 90};
+    double lngRange[2] = {-180, 180};
+    bool even = true;
+    for (int c = 0; c < precision; c++) {
+        int value = 0;
+        for (int b = 0; b < 5; b++) {
+            double* range = even ? lngRange : latRange;
+            double v = even ? lng : lat;
+            double mid = (range[0] + range[1]) / 2;
+            value <<= 1;
+            if (v >= mid) {
+                value |= 1;
+                range[0] = mid;
+            } else {
+                range[1] = mid;
+            }
+            even = !even;
+        }
+        out[c] = GEOHASH_ALPHABET[value];
+    }
+    out[precision] = '\0';
+}
+
+int main(int argc, char** argv) {
+    int randomPoints = argc > 1 ? atoi(argv[1]) : 100000;
+    int failures = 0;
+    char hash[GEOHASH_MAX_PRECISION + 1];
+
+    for (const Vector &v : VECTORS) {
+        int precision = strlen(v.hash);
+        geohashEncode(toE7(v.lat), toE7(v.lng), precision, hash);
+        if (strcmp(hash, v.hash) != 0) {
+            printf("FAIL %.7f, %.7f: %s, expected %s\n", v.lat, v.lng, hash, v.hash);
+            failures++;
+        }
+    }
+    printf("reference vectors: %zu checked, %d failed\n", sizeof(VECTORS) / sizeof(VECTORS[0]), failures);
+
+    // Random fixes at GPS resolution: the integer path must match the bisection
+    // of the same value, and every shorter hash must be a prefix of the longer
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int32_t> latDist(-900000000, 900000000);
+    std::uniform_int_distribution<int32_t> lngDist(-1800000000, 1800000000);
+    int randomFailures = 0;
+    char expected[GEOHASH_MAX_PRECISION + 1];
+    for (int i = 0; i < randomPoints; i++) {
+        int32_t lat = latDist(rng);
+        int32_t lng = lngDist(rng);
+        geohashEncode(lat, lng, GEOHASH_MAX_PRECISION, hash);
+        referenceEncode(lat / 1e7, lng / 1e7, GEOHASH_MAX_PRECISION, expected);
+        bool ok = strcmp(hash, expected) == 0;
+
+        char shorter[GEOHASH_MAX_PRECISION + 1];
+        int precision = 1 + i % GEOHASH_MAX_PRECISION;
+        geohashEncode(lat, lng, precision, shorter);
+        ok = ok && strncmp(shorter, hash, precision) == 0;
+
+        if (!ok) {
+            if (randomFailures < 10) printf("FAIL %d, %d: %s, expected %s\n", lat, lng, hash, expected);
+            randomFailures++;
+        }
+    }
+    printf("random points: %d checked, %d failed\n", randomPoints, randomFailures);
+    failures += randomFailures;
+
+    const int rounds = 1000000;
+    volatile uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        sink += geohashBits(395123450 + i, -1077012340 - i, 9);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+    printf("encode (precision 9): %.1f ns on this host\n", ns);
+
+    return failures ? 1 : 0;
+}
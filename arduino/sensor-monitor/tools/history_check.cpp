@@ -0,0 +1,146 @@
+// Checks history_log.h on a memory-backed log.
+//
+//   history_check [samples]
+//
+// Build: g++ -std=c++17 -O2 -I.. -o history_check history_check.cpp
+//
+// Appends samples at a few per second over several passes around the ring,
+// "resets" now and then (a fresh HistoryLog over the same bytes, dropping the
+// unflushed records), and after each phase compares random time ranges with
+// the records that must still be on flash. Exits non-zero on any mismatch.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "history_log.h"
+
+static const uint16_t SECTORS = 23;
+static std::vector<uint8_t> flash;
+static uint32_t flashWrites = 0;
+
+static bool memRead(void*, uint32_t offset, uint8_t* buf, size_t len) {
+    if (offset + len > flash.size()) return false;
+    memcpy(buf, flash.data() + offset, len);
+    return true;
+}
+
+static bool memWrite(void*, uint32_t offset, const uint8_t* buf, size_t len) {
+    if (offset + len > flash.size()) flash.resize(offset + len, 0);
+    memcpy(flash.data() + offset, buf, len);
+    flashWrites++;
+    return true;
+}
+
+struct Expected {
+    uint32_t time;
+    uint16_t ms;
+    uint8_t field;
+    int32_t value;
+};
+
+int main(int argc, char** argv) {
+    int samples = argc > 1 ? atoi(argv[1]) : 200000;
+    std::mt19937 rng(7);
+    HistorySector index[SECTORS];
+    HistoryLog log(memRead, memWrite);
+    int failures = 0;
+
+    if (!log.begin(nullptr, index, SECTORS, 1)) {
+        printf("FAIL begin on an empty log\n");
+        return 1;
+    }
+
+    // What was flushed, in order; the log holds a suffix of it
+    std::vector<Expected> flushed;
+    std::vector<Expected> pending;
+    uint64_t timeMs = 1700000000000ULL;
+    int resets = 0;
+    int queries = 0;
+
+    for (int i = 0; i < samples; i++) {
+        timeMs += 100 + rng() % 400;
+        HistoryRecord r = {(uint32_t)(timeMs / 1000), (uint16_t)(timeMs % 1000), (uint8_t)(rng() % 7), 0, (int32_t)rng()};
+        pending.push_back({r.time, r.ms, r.field, r.value});
+        log.add(r);
+        if (log.pending() == 0) {
+            flushed.insert(flushed.end(), pending.begin(), pending.end());
+            pending.clear();
+        }
+
+        if (rng() % 5000 == 0) {
+            // Power loss: whatever was still buffered is gone
+            pending.clear();
+            HistoryLog fresh(memRead, memWrite);
+            fresh.begin(nullptr, index, SECTORS, 1);
+            log = fresh;
+            resets++;
+        }
+
+        if (i % 20000 == 19999 || i == samples - 1) {
+            log.flush();
+            flushed.insert(flushed.end(), pending.begin(), pending.end());
+            pending.clear();
+
+            size_t stored = log.storedRecords();
+            std::vector<Expected> onFlash(flushed.end() - std::min(stored, flushed.size()), flushed.end());
+            for (int q = 0; q < 50; q++) {
+                uint32_t first = flushed.front().time;
+                uint32_t last = flushed.back().time;
+                uint32_t from = first + rng() % (last - first + 1);
+                uint32_t to = from + rng() % 2000;
+                if (q == 0) {
+                    from = 0;
+                    to = 0xffffffff;
+                }
+
+                std::vector<Expected> want;
+                for (const Expected &e : onFlash) {
+                    if (e.time >= from && e.time <= to) want.push_back(e);
+                }
+
+                HistoryCursor cursor;
+                log.seek(cursor, from, to);
+                std::vector<Expected> got;
+                HistoryRecord chunk[128];
+                size_t n;
+                while ((n = log.read(cursor, chunk, 128)) > 0) {
+                    for (size_t k = 0; k < n; k++) {
+                        got.push_back({chunk[k].time, chunk[k].ms, chunk[k].field, chunk[k].value});
+                    }
+                }
+
+                bool same = got.size() == want.size();
+                for (size_t k = 0; same && k < got.size(); k++) {
+                    same = got[k].time == want[k].time && got[k].ms == want[k].ms &&
+                           got[k].field == want[k].field && got[k].value == want[k].value;
+                }
+                if (!same) {
+                    if (failures < 10) printf("FAIL range %u..%u: %zu records, expected %zu\n", from, to, got.size(), want.size());
+                    failures++;
+                }
+                queries++;
+            }
+        }
+    }
+
+    printf("%d samples, %d resets, %d range queries, %d failed\n", samples, resets, queries, failures);
+    printf("log: %u records in %u of %u sectors, %u writes for %zu flushed records\n",
+           log.storedRecords(), log.sectorsUsed(), SECTORS, flashWrites, flushed.size());
+
+    // Cost of a full-range read, the worst case for a history request
+    auto start = std::chrono::steady_clock::now();
+    HistoryCursor cursor;
+    log.seek(cursor, 0, 0xffffffff);
+    HistoryRecord chunk[128];
+    size_t total = 0;
+    size_t n;
+    while ((n = log.read(cursor, chunk, 128)) > 0) total += n;
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    printf("full read: %zu records in %.0f us on this host\n", total, us);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+// Arduino Client interface over a POSIX TCP socket, for host tools.
+
+#pragma once
+
+#include "WProgram.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class Client {
+public:
+    ~Client() { stop(); }
+
+    int connect(const char* host, uint16_t port) {
+        stop();
+        char service[8];
+        snprintf(service, sizeof(service), "%u", port);
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        if (getaddrinfo(host, service, &hints, &res) != 0) return 0;
+        for (addrinfo* ai = res; ai; ai = ai->ai_next) {
+            fd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd_ >= 0 && ::connect(fd_, ai->ai_addr, ai->ai_addrlen) == 0) break;
+            if (fd_ >= 0) ::close(fd_);
+            fd_ = -1;
+        }
+        freeaddrinfo(res);
+        if (fd_ < 0) return 0;
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        closed_ = false;
+        return 1;
+    }
+
+    size_t write(const uint8_t* buf, size_t size) {
+        if (fd_ < 0) return 0;
+        ssize_t n = ::send(fd_, buf, size, MSG_NOSIGNAL);
+        return n > 0 ? (size_t)n : 0;
+    }
+
+    int available() {
+        if (fd_ < 0) return 0;
+        int n = 0;
+        ioctl(fd_, FIONREAD, &n);
+        if (n == 0) {
+            // Zero readable bytes on a readable socket means the peer closed it
+            char probe;
+            if (recv(fd_, &probe, 1, MSG_PEEK | MSG_DONTWAIT) == 0) closed_ = true;
+        }
+        return n;
+    }
+
+    int read() {
+        uint8_t b;
+        return fd_ >= 0 && recv(fd_, &b, 1, 0) == 1 ? b : -1;
+    }
+
+    int read(uint8_t* buf, size_t size) {
+        if (fd_ < 0) return -1;
+        ssize_t n = recv(fd_, buf, size, MSG_DONTWAIT);
+        return n > 0 ? (int)n : -1;
+    }
+
+    void flush() {}
+
+    uint8_t connected() {
+        if (fd_ < 0) return 0;
+        available();
+        return !closed_;
+    }
+
+    void stop() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+private:
+    int fd_ = -1;
+    bool closed_ = true;
+};
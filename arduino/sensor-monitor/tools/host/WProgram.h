@@ -0,0 +1,32 @@
+// Minimal Arduino surface for building TinyGPS++ on the host.
+// TinyGPS++ includes "WProgram.h" when ARDUINO is not defined.
+
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+typedef uint8_t byte;
+
+#ifndef TWO_PI
+#define TWO_PI 6.283185307179586476925286766559
+#endif
+#define radians(deg) ((deg) * 0.017453292519943295769236907684886)
+#define degrees(rad) ((rad) * 57.295779513082320876798154814105)
+#define sq(x) ((x) * (x))
+
+inline unsigned long millis() {
+    static const auto start = std::chrono::steady_clock::now();
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+inline void delay(unsigned long ms) {
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < until) {}
+}
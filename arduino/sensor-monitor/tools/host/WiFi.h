@@ -0,0 +1,56 @@
+// WiFiClient and the bits of the ESP32 core tls_session_client.h uses,
+// over the host Client, for host tools.
+//
+// ESP.getFreeHeap() counts down from HOST_HEAP_SIZE by what malloc has
+// handed out (glibc mallinfo2), so free-heap deltas are real allocations.
+
+#pragma once
+
+#include "Client.h"
+
+#include <malloc.h>
+#include <string>
+
+#define RTC_DATA_ATTR
+#define HEX 16
+
+#ifndef HOST_HEAP_SIZE
+#define HOST_HEAP_SIZE (256UL * 1024 * 1024)
+#endif
+
+class String : public std::string {
+public:
+    String(const char* s = "") : std::string(s) {}
+    String(const std::string &s) : std::string(s) {}
+    String(long value, int base = 10) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", value);
+        assign(buf);
+    }
+};
+
+class IPAddress {
+public:
+    String toString() const { return String(addr_); }
+
+private:
+    const char* addr_ = "0.0.0.0";
+};
+
+class WiFiClient : public Client {
+public:
+    void setNoDelay(bool) {}   // Client already sets TCP_NODELAY
+};
+
+struct HostSerial {
+    void println(const std::string &s) { printf("%s\n", s.c_str()); }
+};
+static HostSerial Serial;
+
+struct HostEsp {
+    uint32_t getFreeHeap() {
+        struct mallinfo2 mi = mallinfo2();
+        return (uint32_t)(HOST_HEAP_SIZE - mi.uordblks);
+    }
+};
+static HostEsp ESP;
@@ -0,0 +1,198 @@
+// Counts the I2C traffic of lcd_frame.h against the old LiquidCrystal_I2C
+// path and checks what the panel ends up showing.
+//
+//   lcd_check [random updates]
+//
+// Build: g++ -std=c++17 -O2 -I.. -o lcd_check lcd_check.cpp
+//
+// The bus records every transaction and feeds the expander bytes to an
+// HD44780 model (4-bit mode, a nibble latched on each EN falling edge), so
+// the byte counts come with a check that DDRAM holds the wanted frame. The
+// old path is what updateLCD() did before the framebuffer: lcd.clear(), then
+// setCursor() and print() per row, with LiquidCrystal_I2C's single-byte
+// transaction per expander write (three per nibble) at the default 100 kHz.
+// Scenarios are those of the 16x2 sensor screen: a full redraw, one digit of
+// a reading changing, a GPS longitude step and an unchanged frame; then
+// random updates are checked against the model. Exits non-zero when the
+// panel differs from the frame.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "lcd_frame.h"
+
+static const uint8_t COLS = 16;
+static const uint8_t ROWS = 2;
+static const uint8_t ADDRESS = 0x27;
+
+// HD44780 behind the expander: DDRAM and the address counter
+struct Panel {
+    char ddram[0x80];
+    uint8_t address = 0;
+    bool highNibble = true;
+    uint8_t pending = 0;
+    uint8_t previous = 0;
+
+    Panel() { memset(ddram, ' ', sizeof(ddram)); }
+
+    void expander(uint8_t value) {
+        if ((previous & LCD_EN) && !(value & LCD_EN)) {
+            latch(previous >> 4, previous & LCD_RS);
+        }
+        previous = value;
+    }
+
+    void latch(uint8_t nibble, bool data) {
+        if (highNibble) {
+            pending = nibble << 4;
+            highNibble = false;
+            return;
+        }
+        highNibble = true;
+        uint8_t value = pending | nibble;
+        if (data) {
+            ddram[address] = value;
+            address = (address + 1) & 0x7f;
+        } else if (value & 0x80) {
+            address = value & 0x7f;
+        } else if (value == 0x01) {
+            memset(ddram, ' ', sizeof(ddram));
+            address = 0;
+        }
+    }
+
+    std::string row(uint8_t r) const { return std::string(ddram + (r ? 0x40 : 0x00), COLS); }
+};
+
+// Wire stand-in: counts transactions and bytes, drives the panel
+struct CountingBus {
+    Panel panel;
+    uint32_t transactions = 0;
+    uint32_t bytes = 0;
+
+    void beginTransmission(uint8_t) { transactions++; }
+    size_t write(const uint8_t* data, size_t length) {
+        for (size_t i = 0; i < length; i++) panel.expander(data[i]);
+        bytes += length;
+        return length;
+    }
+    uint8_t endTransmission() { return 0; }
+
+    void reset() { transactions = 0; bytes = 0; }
+
+    // Bus time: address + data bytes at 9 clocks each, plus start and stop
+    double micros(uint32_t hz) const { return ((bytes + transactions) * 9.0 + transactions * 2.0) * 1e6 / hz; }
+};
+
+// LiquidCrystal_I2C: expanderWrite() is one transaction per byte, a nibble
+// is expanderWrite(v) plus pulseEnable() (EN high, EN low)
+struct LegacyLcd {
+    CountingBus &bus;
+
+    void expanderWrite(uint8_t value) {
+        bus.beginTransmission(ADDRESS);
+        bus.write(&value, 1);
+        bus.endTransmission();
+    }
+    void write4bits(uint8_t value) {
+        expanderWrite(value);
+        expanderWrite(value | LCD_EN);
+        expanderWrite(value & ~LCD_EN);
+    }
+    void send(uint8_t value, uint8_t mode) {
+        write4bits((value & 0xF0) | mode | LCD_BACKLIGHT);
+        write4bits(((value << 4) & 0xF0) | mode | LCD_BACKLIGHT);
+    }
+
+    void render(const char* row0, const char* row1) {
+        send(0x01, 0);                        // clear(), then a 2 ms delay
+        send(0x80 | 0x00, 0);
+        for (const char* c = row0; *c; c++) send(*c, LCD_RS);
+        send(0x80 | 0x40, 0);
+        for (const char* c = row1; *c; c++) send(*c, LCD_RS);
+    }
+};
+
+static int failures = 0;
+
+static std::string padded(const char* text) {
+    std::string s(text);
+    s.resize(COLS, ' ');
+    return s.substr(0, COLS);
+}
+
+static void expectPanel(const char* label, const Panel &panel, const char* row0, const char* row1) {
+    if (panel.row(0) != padded(row0) || panel.row(1) != padded(row1)) {
+        failures++;
+        printf("FAIL %s: panel [%s][%s], want [%s][%s]\n", label, panel.row(0).c_str(), panel.row(1).c_str(),
+               padded(row0).c_str(), padded(row1).c_str());
+    }
+}
+
+// One screen update both ways; the framebuffer already shows `from`
+static void scenario(const char* label, const char* from0, const char* from1, const char* to0, const char* to1, bool redraw) {
+    CountingBus oldBus;
+    LegacyLcd legacy = {oldBus};
+    legacy.render(to0, to1);
+    expectPanel(label, oldBus.panel, to0, to1);
+
+    CountingBus newBus;
+    LcdFrame<CountingBus, COLS, ROWS> frame(newBus, ADDRESS);
+    frame.setLine(0, from0);
+    frame.setLine(1, from1);
+    frame.flush();
+    if (redraw) frame.invalidate();
+    newBus.reset();
+    frame.setLine(0, to0);
+    frame.setLine(1, to1);
+    frame.flush();
+    expectPanel(label, newBus.panel, to0, to1);
+
+    // The old path also sat out clear()'s 2 ms
+    printf("  %-22s before %3u txn %4u B %7.0f us   after %u txn %4u B %5.0f us\n", label,
+           oldBus.transactions, oldBus.bytes, oldBus.micros(100000) + 2000,
+           newBus.transactions, newBus.bytes, newBus.micros(400000));
+}
+
+int main(int argc, char** argv) {
+    int updates = argc > 1 ? atoi(argv[1]) : 20000;
+
+    printf("16x2 panel, before = clear + print at 100 kHz, after = framebuffer at 400 kHz:\n");
+    scenario("full redraw", "", "", "T:21.4C H:45.2%", "L:63% P:12%", true);
+    scenario("one reading digit", "T:21.4C H:45.2%", "L:63% P:12%", "T:21.5C H:45.2%", "L:63% P:12%", false);
+    scenario("two readings", "T:21.4C H:45.2%", "L:63% P:12%", "T:21.5C H:45.3%", "L:63% P:12%", false);
+    scenario("GPS longitude step", "GPS: 39.5123", "IN: -107.7012", "GPS: 39.5123", "IN: -107.7013", false);
+    scenario("unchanged", "T:21.4C H:45.2%", "L:63% P:12%", "T:21.4C H:45.2%", "L:63% P:12%", false);
+
+    // Random edits: a few cells at a time, sometimes whole rows
+    std::mt19937 rng(11);
+    CountingBus bus;
+    LcdFrame<CountingBus, COLS, ROWS> frame(bus, ADDRESS);
+    char rows[ROWS][COLS + 1];
+    memset(rows, ' ', sizeof(rows));
+    for (uint8_t r = 0; r < ROWS; r++) rows[r][COLS] = 0;
+    for (int u = 0; u < updates; u++) {
+        int edits = rng() % 4 == 0 ? COLS : 1 + rng() % 3;
+        for (int e = 0; e < edits; e++) {
+            rows[rng() % ROWS][rng() % COLS] = ' ' + rng() % 95;
+        }
+        // Shorter text leaves the rest of the row blank
+        if (rng() % 8 == 0) {
+            uint8_t r = rng() % ROWS;
+            rows[r][rng() % COLS] = 0;
+            frame.setLine(r, rows[r]);
+            for (uint8_t c = strlen(rows[r]); c < COLS; c++) rows[r][c] = ' ';
+            rows[r][COLS] = 0;
+        }
+        for (uint8_t r = 0; r < ROWS; r++) frame.setLine(r, rows[r]);
+        frame.flush();
+        expectPanel("random", bus.panel, rows[0], rows[1]);
+        if (failures > 5) break;
+    }
+
+    printf("%d random updates: %s\n", updates, failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
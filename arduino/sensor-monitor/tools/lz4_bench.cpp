@@ -0,0 +1,155 @@
+// Compression ratio and CPU cost of lz4_block.h on MQTT payloads.
+//
+//   lz4_bench [payload.json ...]
+//
+// Build: g++ -std=c++17 -O2 -I.. -o lz4_bench lz4_bench.cpp
+//
+// Without arguments it measures payloads shaped like the sketch's discovery,
+// verbose data and status messages; with arguments, the given files (e.g.
+// messages captured with mosquitto_sub -N). Every payload is round-tripped
+// through the decoder and compared. Timings are host timings: expect the
+// ESP32 at 240 MHz to be roughly 20-40x slower per byte.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "lz4_block.h"
+
+struct Payload {
+    std::string name;
+    std::string data;
+};
+
+static std::string sensorObject(const char* name, const char* type, const char* value, const char* unit, int accuracy) {
+    return std::string("{\"sensor_name\":\"") + name + "\",\"sensor_type\":\"" + type + "\",\"value\":" + value +
+           ",\"unit\":\"" + unit + "\",\"accuracy\":" + std::to_string(accuracy) +
+           ",\"location\":\"Device\",\"enabled\":true,\"reading_timestamp\":\"2026-10-18 09:41:07\"}";
+}
+
+static std::vector<Payload> builtinPayloads() {
+    std::vector<Payload> out;
+
+    std::string data = "{\"device_id\":\"ESP32-DEV-001\",\"device_name\":\"Environmental Sensor Monitor with GPS\","
+                       "\"timestamp\":\"2026-10-18 09:41:07\",\"sensors\":[";
+    data += sensorObject("GPS Latitude", "gps_latitude", "39.512345", "degrees", 95) + ",";
+    data += sensorObject("GPS Longitude", "gps_longitude", "-107.701234", "degrees", 95) + ",";
+    data += sensorObject("GPS Altitude", "gps_altitude", "1843.2", "meters", 90) + ",";
+    data += sensorObject("Temperature", "temperature", "21.43", "\\u00b0C", 98) + ",";
+    data += sensorObject("Humidity", "humidity", "44.8", "%", 95) + ",";
+    data += sensorObject("Light Level", "light", "63", "percent", 90) + ",";
+    data += sensorObject("Potentiometer", "potentiometer", "12", "percent", 99);
+    data += "],\"boot_id\":2893311234,\"seq\":1042,\"sent_at\":1792316467123}";
+    out.push_back({"data (verbose)", data});
+
+    std::string discovery =
+        "{\n  \"device_id\": \"ESP32-DEV-001\",\n  \"device_name\": \"Environmental Sensor Monitor with GPS\",\n"
+        "  \"device_type\": \"ESP32_ENVIRONMENTAL_GPS\",\n  \"firmware_version\": \"1.3.0\",\n"
+        "  \"mac_address\": \"24:6F:28:AB:CD:EF\",\n  \"ip_address\": \"192.168.1.57\",\n"
+        "  \"geofence_testing\": true,\n  \"available_sensors\": [\n";
+    const char* hw[][3] = {{"temperature", "Temperature", "\\u00b0C"}, {"humidity", "Humidity", "%"},
+                           {"light", "Light Level", "percent"}, {"potentiometer", "Potentiometer", "percent"}};
+    for (auto &s : hw) {
+        discovery += std::string("    {\n      \"sensor_type\": \"") + s[0] + "\",\n      \"sensor_name\": \"" + s[1] +
+                     "\",\n      \"unit\": \"" + s[2] + "\",\n      \"value\": 21.4\n    },\n";
+    }
+    discovery += "    {\n      \"sensor_type\": \"gps\",\n      \"sensor_name\": \"Geofence Testing GPS\",\n"
+                 "      \"unit\": \"coordinates\",\n      \"latitude\": 39.512345,\n      \"longitude\": -107.701234,\n"
+                 "      \"valid\": true,\n      \"simulated\": true,\n      \"geofence_mode\": \"inside\"\n    }\n  ],\n"
+                 "  \"telemetry_schema\": {\n    \"version\": 1,\n    \"enabled\": true,\n    \"fields\": [\n";
+    const char* fields[][4] = {{"gps_latitude", "GPS Latitude", "degrees", "95"}, {"gps_longitude", "GPS Longitude", "degrees", "95"},
+                               {"gps_altitude", "GPS Altitude", "meters", "90"}, {"temperature", "Temperature", "\\u00b0C", "98"},
+                               {"humidity", "Humidity", "%", "95"}, {"light", "Light Level", "percent", "90"},
+                               {"potentiometer", "Potentiometer", "percent", "99"}};
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        discovery += std::string("      {\n        \"sensor_type\": \"") + fields[i][0] + "\",\n        \"sensor_name\": \"" +
+                     fields[i][1] + "\",\n        \"unit\": \"" + fields[i][2] + "\",\n        \"accuracy\": " + fields[i][3] +
+                     ",\n        \"location\": \"Device\"\n      }" + (i + 1 < 7 ? ",\n" : "\n");
+    }
+    discovery += "    ]\n  },\n  \"boot_id\": 2893311234,\n  \"seq\": 3,\n  \"sent_at\": 1792316467123\n}";
+    out.push_back({"discovery", discovery});
+
+    std::string status =
+        "{\"device_id\":\"ESP32-DEV-001\",\"device_name\":\"Environmental Sensor Monitor with GPS\","
+        "\"device_type\":\"ESP32_ENVIRONMENTAL_GPS\",\"status\":\"online\",\"enabled\":true,"
+        "\"last_seen\":\"2026-10-18 09:41:07\",\"wifi_signal\":-67,\"free_memory\":182344,\"uptime\":86211,"
+        "\"geofence_test_mode\":true,\"current_mode\":\"inside\",\"gps_simulated\":true,\"gps_replay\":false,"
+        "\"gps_capture\":false,\"gps_receiver\":{\"type\":\"ublox\",\"baud\":115200,\"nav_rate_hz\":1,"
+        "\"verified\":true,\"bytes_per_fix\":142},\"lcd_i2c_bytes\":12,\"gps_motion\":{\"adaptive\":true,"
+        "\"moving\":false,\"triggers\":{\"first\":1,\"distance\":311,\"heartbeat\":14}},"
+        "\"connect_timing\":{\"wifi_assoc_ms\":212,\"wifi_dhcp_ms\":0,\"mqtt_connect_ms\":143,\"fast_join\":true},"
+        "\"mqtt\":{\"protocol\":\"5.0\",\"topic_alias_max\":10,\"aliases\":6,\"tx_bytes\":1843221,"
+        "\"alias_bytes_saved\":90112},\"power\":{\"enabled\":true,\"battery\":71.3,\"rssi_avg\":-66,"
+        "\"battery_tier\":0,\"link_tier\":0,\"sample_scale\":1,\"publish_scale\":1,\"changes\":2,\"reduced_s\":0,"
+        "\"samples_saved\":0,\"publishes_saved\":0},\"clock\":{\"source\":\"sntp\",\"synced_ago\":611},"
+        "\"tls\":{\"enabled\":false},\"boot_id\":2893311234,\"seq\":8621,\"sent_at\":1792316467123}";
+    out.push_back({"status", status});
+
+    return out;
+}
+
+static bool readFile(const char* path, std::string &out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::vector<Payload> payloads;
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            Payload p = {argv[i], ""};
+            if (!readFile(argv[i], p.data)) {
+                fprintf(stderr, "cannot read %s\n", argv[i]);
+                return 1;
+            }
+            payloads.push_back(p);
+        }
+    } else {
+        payloads = builtinPayloads();
+    }
+
+    static uint16_t table[LZ4_HASH_SIZE];
+    const int rounds = 2000;
+    size_t totalRaw = 0, totalPacked = 0;
+    bool ok = true;
+
+    printf("%-16s %7s %7s %6s %12s %12s\n", "payload", "raw", "lz4", "ratio", "compress", "decompress");
+    for (const Payload &p : payloads) {
+        const uint8_t* src = (const uint8_t*)p.data.data();
+        std::vector<uint8_t> packed(p.data.size() + p.data.size() / 255 + 16);
+        std::vector<uint8_t> restored(p.data.size());
+
+        size_t packedLen = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            packedLen = lz4Compress(src, p.data.size(), packed.data(), packed.size(), table);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        int restoredLen = 0;
+        for (int r = 0; r < rounds; r++) {
+            restoredLen = lz4Decompress(packed.data(), packedLen, restored.data(), restored.size());
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        bool same = packedLen > 0 && restoredLen == (int)p.data.size() &&
+                    memcmp(restored.data(), src, p.data.size()) == 0;
+        ok = ok && same;
+        double compressUs = std::chrono::duration<double, std::micro>(t1 - t0).count() / rounds;
+        double decompressUs = std::chrono::duration<double, std::micro>(t2 - t1).count() / rounds;
+        printf("%-16s %7zu %7zu %5.2fx %9.2f us %9.2f us%s\n", p.name.c_str(), p.data.size(), packedLen,
+               packedLen ? (double)p.data.size() / packedLen : 0.0, compressUs, decompressUs,
+               same ? "" : "  ROUND TRIP FAILED");
+        totalRaw += p.data.size();
+        totalPacked += packedLen;
+    }
+
+    printf("total: %zu -> %zu bytes (%.1f%% saved)\n", totalRaw, totalPacked,
+           totalRaw ? 100.0 * (totalRaw - totalPacked) / totalRaw : 0.0);
+    return ok ? 0 : 1;
+}
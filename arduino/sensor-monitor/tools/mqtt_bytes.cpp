@@ -0,0 +1,90 @@
+// Measure MQTT bytes per message with and without MQTT 5 topic aliases.
+//
+//   mqtt_bytes <broker host> [port] [messages per topic]
+//
+// Build: g++ -std=c++17 -O2 -I.. -Ihost -o mqtt_bytes mqtt_bytes.cpp
+//
+// Runs Mqtt5Client from the sketch over a host socket against a local
+// broker (e.g. mosquitto 2.x), publishing the device's periodic topics
+// first over 3.1.1 and then over MQTT 5, and prints what went on the wire.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "mqtt5_client.h"
+
+struct Sample {
+    const char* topic;
+    const char* payload;
+};
+
+// Shapes of the sketch's periodic messages
+static const Sample SAMPLES[] = {
+    {"devices/ESP32-DEV-001/sensors",
+     "{\"device_id\":\"ESP32-DEV-001\",\"sensors\":[{\"type\":\"temperature\",\"value\":21.4,\"unit\":\"C\"}],\"seq\":1}"},
+    {"devices/ESP32-DEV-001/gps",
+     "{\"device_id\":\"ESP32-DEV-001\",\"location\":{\"latitude\":39.51,\"longitude\":-107.70},\"seq\":1}"},
+    {"devices/ESP32-DEV-001/status",
+     "{\"device_id\":\"ESP32-DEV-001\",\"status\":\"online\",\"seq\":1}"},
+};
+
+struct Result {
+    bool ok;
+    uint8_t version;
+    uint32_t bytes;
+    uint32_t saved;
+    unsigned messages;
+};
+
+static Result run(const char* host, int port, uint8_t version, int count) {
+    Result r = {false, 0, 0, 0, 0};
+    Client net;
+    Mqtt5Client mqtt(1024);
+    mqtt.begin(host, port, net);
+    mqtt.setProtocolVersion(version);
+    if (!mqtt.connect(version == 5 ? "mqtt-bytes-v5" : "mqtt-bytes-v4")) {
+        fprintf(stderr, "connect failed (CONNACK %d)\n", mqtt.lastConnackCode());
+        return r;
+    }
+    r.version = mqtt.protocolVersion();
+    uint32_t afterConnect = mqtt.bytesSent();
+
+    for (int i = 0; i < count; i++) {
+        for (const Sample &s : SAMPLES) {
+            if (!mqtt.publish(s.topic, s.payload, false, 1, version == 5 ? 300 : 0)) {
+                fprintf(stderr, "publish failed on %s\n", s.topic);
+                return r;
+            }
+            r.messages++;
+        }
+        mqtt.loop();
+    }
+    r.bytes = mqtt.bytesSent() - afterConnect;
+    r.saved = mqtt.aliasBytesSaved();
+    r.ok = true;
+    mqtt.disconnect();
+    return r;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: mqtt_bytes <broker host> [port] [messages per topic]\n");
+        return 2;
+    }
+    const char* host = argv[1];
+    int port = argc > 2 ? atoi(argv[2]) : 1883;
+    int count = argc > 3 ? atoi(argv[3]) : 100;
+
+    Result v4 = run(host, port, 4, count);
+    Result v5 = run(host, port, 5, count);
+    if (!v4.ok || !v5.ok) return 1;
+
+    double perV4 = (double)v4.bytes / v4.messages;
+    double perV5 = (double)v5.bytes / v5.messages;
+    printf("MQTT 3.1.1: %u messages, %u bytes, %.1f bytes/message\n", v4.messages, v4.bytes, perV4);
+    printf("MQTT %s:   %u messages, %u bytes, %.1f bytes/message (aliases saved %u bytes)\n",
+           v5.version == 5 ? "5  " : "3.1.1 (fallback)", v5.messages, v5.bytes, perV5, v5.saved);
+    printf("saving: %.1f bytes/message (%.1f%%)\n", perV4 - perV5, 100.0 * (perV4 - perV5) / perV4);
+    return 0;
+}
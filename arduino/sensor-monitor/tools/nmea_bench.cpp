@@ -0,0 +1,150 @@
+// Host benchmark for recorded NMEA traces.
+//
+//   nmea_bench <trace.nmea> [speed]
+//
+// Build (TINYGPS = TinyGPSPlus library src directory):
+//   g++ -std=c++17 -O2 -I.. -Ihost -I$TINYGPS -o nmea_bench nmea_bench.cpp $TINYGPS/TinyGPS++.cpp
+//
+// Feeds the trace byte by byte through TinyGPS++ exactly like readGPSData(),
+// runs the Xorafi geofence test on every fix and reports how long the
+// firmware's replay mode would take at the given speed (default 1x).
+// The trace is parsed a second time reduced to RMC/GGA, the stream a
+// receiver sends after configureGPSReceiver(), to show the bytes per fix.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <TinyGPS++.h>
+#include "nmea_replay.h"
+#include "gps_config.h"
+#include "geofence.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// Same polygon as XORAFI_COORDS in sensor-monitor.ino ({lng, lat})
+static const double XORAFI_COORDS[][2] = {
+    {-107.744122, 39.495387},
+    {-107.744122, 39.529577},
+    {-107.653999, 39.529577},
+    {-107.653999, 39.495387},
+    {-107.744122, 39.495387}
+};
+static const int XORAFI_COORD_COUNT = 5;
+
+static GeofenceSet fences;
+
+static bool isPointInPolygon(double lat, double lng) {
+    return geofenceContains(fences, 0, lat, lng);
+}
+
+static double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct ParseResult {
+    std::vector<std::pair<double, double>> fixes;
+    unsigned long sentences;
+    unsigned long badChecksums;
+    double ms;
+};
+
+static ParseResult parseTrace(const std::string &trace) {
+    ParseResult result;
+    TinyGPSPlus gps;
+    auto t0 = Clock::now();
+    for (char c : trace) {
+        if (gps.encode(c) && gps.location.isValid() && gps.location.isUpdated()) {
+            result.fixes.push_back({gps.location.lat(), gps.location.lng()});
+        }
+    }
+    result.ms = msSince(t0);
+    result.sentences = gps.passedChecksum() + gps.failedChecksum();
+    result.badChecksums = gps.failedChecksum();
+    return result;
+}
+
+// Keep only the lines a receiver configured for RMC/GGA would send
+static std::string rmcGgaOnly(const std::string &trace) {
+    std::string out;
+    size_t start = 0;
+    while (start < trace.size()) {
+        size_t end = trace.find('\n', start);
+        end = end == std::string::npos ? trace.size() : end + 1;
+        NmeaSentenceStats stats;
+        for (size_t i = start; i < end && i < start + 8; i++) stats.feed(trace[i]);
+        if (stats.rmc || stats.gga) out.append(trace, start, end - start);
+        start = end;
+    }
+    return out;
+}
+
+static void printParse(const char* label, const std::string &trace, const ParseResult &r) {
+    printf("%s: %lu sentences (%lu bad checksum), %zu fixes in %.2f ms, %.0f ns/byte, %.0f bytes/fix\n",
+           label, r.sentences, r.badChecksums, r.fixes.size(), r.ms,
+           trace.empty() ? 0.0 : r.ms * 1e6 / trace.size(),
+           r.fixes.empty() ? 0.0 : (double)trace.size() / r.fixes.size());
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: nmea_bench <trace.nmea> [speed]\n");
+        return 2;
+    }
+    int speed = argc > 2 ? atoi(argv[2]) : 1;
+
+    static Geofence fenceTable[1];
+    static GeofenceEdge fenceEdges[8];
+    uint32_t xorafiSize = XORAFI_COORD_COUNT;
+    geofenceInit(fences, fenceTable, 1, fenceEdges, 8);
+    geofenceAdd(fences, 1, &XORAFI_COORDS[0][0], &xorafiSize, 1);
+
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    std::string trace;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) trace.append(buf, n);
+    fclose(f);
+
+    // Parsing and geofencing, timed separately
+    ParseResult parsed = parseTrace(trace);
+    std::string reduced = rmcGgaOnly(trace);
+    ParseResult parsedReduced = parseTrace(reduced);
+    const auto &fixes = parsed.fixes;
+
+    auto t0 = Clock::now();
+    size_t inside = 0;
+    for (const auto &fix : fixes) {
+        inside += isPointInPolygon(fix.first, fix.second);
+    }
+    double fenceMs = msSince(t0);
+
+    // Replay schedule as the firmware would pace it
+    NmeaReplayPacer pacer;
+    pacer.begin(speed);
+    uint32_t lastDue = 0;
+    size_t lines = 0, start = 0;
+    while (start < trace.size()) {
+        size_t end = trace.find('\n', start);
+        if (end == std::string::npos) end = trace.size();
+        std::string line = trace.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        lastDue = pacer.dueAt(line.c_str());
+        lines++;
+        start = end + 1;
+    }
+
+    printf("trace: %zu bytes, %zu lines, %.1f s of GPS time\n",
+           trace.size(), lines, pacer.traceElapsed() / 1000.0);
+    printParse("parse", trace, parsed);
+    printParse("parse RMC/GGA only", reduced, parsedReduced);
+    printf("geofence: %zu inside, %zu outside in %.3f ms (%.0f ns/fix)\n",
+           inside, fixes.size() - inside, fenceMs, fixes.empty() ? 0.0 : fenceMs * 1e6 / fixes.size());
+    printf("replay at %dx: %.1f s on the device\n", pacer.speed(), lastDue / 1000.0);
+    return 0;
+}
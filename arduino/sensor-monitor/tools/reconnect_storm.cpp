@@ -0,0 +1,510 @@
+// Reconnect storm: thousands of MQTT clients coming back after a broker
+// restart, with the old fixed retry delay and with RetryBackoff.
+//
+//   reconnect_storm [clients] [--rate N] [--queue N] [--down S]
+//   reconnect_storm [clients] --broker host:port [--seconds S]
+//
+// Build: g++ -std=c++17 -O2 -I.. -o reconnect_storm reconnect_storm.cpp
+//
+// Every client is a non-blocking socket that sends a real MQTT 3.1.1 CONNECT
+// and waits up to CONNACK_TIMEOUT_MS for the CONNACK, retrying the way the
+// sketch's connect() does: the old firmware reconnects at once after a drop
+// and every second after a failure, the new one waits RetryBackoff.next()
+// (the sketch's MQTT constants) in both cases.
+//
+// By default the broker is a stand-in on a loopback port, run from the same
+// poll loop. It is down for --down seconds (connections refused), then
+// handles --rate CONNECTs per second (default 200); up to --queue of them
+// (default 2000, a broker that takes everything) wait their turn and the rest
+// get CONNACK 3 (server unavailable). A queued CONNECT whose client gave up
+// before its turn still costs the broker its slot ("wasted"), which is what
+// keeps a lockstep fleet from ever getting ahead of it.
+//
+// With --broker the clients run against a real one (e.g. a local mosquitto)
+// for --seconds; restart it while the tool runs to see the storm. Raise the
+// open file limit for large fleets (ulimit -n).
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "retry_backoff.h"
+
+static const uint32_t CONNACK_TIMEOUT_MS = 2000;
+static const uint32_t FIXED_RETRY_MS = 1000;     // the old delay(1000)
+static const uint32_t STANDIN_LIMIT_MS = 120000;   // give up on a fleet that never settles
+
+static uint32_t nowMs() {
+    static const auto start = std::chrono::steady_clock::now();
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void nonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// ---- Stand-in broker ------------------------------------------------------
+
+struct Conn {
+    int fd = -1;
+    uint8_t buf[128];
+    size_t len = 0;
+    bool queued = false;
+    bool gone = false;       // client closed before its CONNECT was handled
+};
+
+class StandIn {
+public:
+    uint32_t received = 0;
+    uint32_t accepted = 0;
+    uint32_t rejected = 0;
+    uint32_t wasted = 0;
+
+    StandIn(uint32_t rate, uint32_t queueMax, uint32_t downMs) : rate_(rate), queueMax_(queueMax), downMs_(downMs) {}
+
+    // Reserve a port now; nothing listens on it until the broker comes up
+    bool reserve(uint16_t &port) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t size = sizeof(addr);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || getsockname(fd, (sockaddr*)&addr, &size) != 0) {
+            close(fd);
+            return false;
+        }
+        port_ = port = ntohs(addr.sin_port);
+        close(fd);
+        return true;
+    }
+
+    void start(uint32_t now) {
+        startedAt_ = now;
+        lastTick_ = now;
+        tokens_ = 0;
+    }
+
+    void stop() {
+        for (Conn &c : conns_) {
+            if (c.fd >= 0) close(c.fd);
+        }
+        conns_.clear();
+        queue_.clear();
+        if (listener_ >= 0) close(listener_);
+        listener_ = -1;
+    }
+
+    void addPollFds(std::vector<pollfd> &fds) {
+        if (listener_ >= 0) fds.push_back({listener_, POLLIN, 0});
+        for (Conn &c : conns_) {
+            if (c.fd >= 0 && !c.gone) fds.push_back({c.fd, POLLIN, 0});
+        }
+    }
+
+    void run(uint32_t now) {
+        if (listener_ < 0 && now - startedAt_ >= downMs_) listen_();
+        if (listener_ < 0) return;
+
+        while (true) {
+            int fd = accept(listener_, nullptr, nullptr);
+            if (fd < 0) break;
+            nonBlocking(fd);
+            if ((size_t)fd >= conns_.size()) conns_.resize(fd + 1);
+            conns_[fd] = Conn();
+            conns_[fd].fd = fd;
+        }
+
+        for (Conn &c : conns_) {
+            if (c.fd < 0 || c.gone) continue;
+            ssize_t n = recv(c.fd, c.buf + c.len, sizeof(c.buf) - c.len, 0);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                if (c.queued) {
+                    c.gone = true;
+                } else {
+                    drop(c);
+                }
+                continue;
+            }
+            if (n > 0 && !c.queued) {
+                c.len += n;
+                // CONNECT: type 1, one length byte for these small packets
+                if (c.len >= 2 && c.buf[0] == 0x10 && c.len >= (size_t)c.buf[1] + 2) {
+                    received++;
+                    if (queue_.size() >= queueMax_) {
+                        static const uint8_t UNAVAILABLE[] = {0x20, 0x02, 0x00, 0x03};
+                        send(c.fd, UNAVAILABLE, sizeof(UNAVAILABLE), MSG_NOSIGNAL);
+                        rejected++;
+                        drop(c);
+                    } else {
+                        c.queued = true;
+                        queue_.push_back(c.fd);
+                    }
+                }
+            }
+        }
+
+        // CONNECT handling at the configured rate, stale ones included
+        tokens_ += (now - lastTick_) * rate_ / 1000.0;
+        lastTick_ = now;
+        if (tokens_ > rate_ / 10.0) tokens_ = std::max(1.0, rate_ / 10.0);
+        while (tokens_ >= 1 && !queue_.empty()) {
+            tokens_--;
+            Conn &c = conns_[queue_.front()];
+            queue_.pop_front();
+            c.queued = false;
+            static const uint8_t ACCEPTED[] = {0x20, 0x02, 0x00, 0x00};
+            if (c.gone || send(c.fd, ACCEPTED, sizeof(ACCEPTED), MSG_NOSIGNAL) != sizeof(ACCEPTED)) {
+                wasted++;
+                drop(c);
+            } else {
+                accepted++;
+            }
+        }
+    }
+
+private:
+    void listen_() {
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port_);
+        if (bind(listener_, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener_, 4096) != 0) {
+            perror("stand-in broker");
+            exit(1);
+        }
+        nonBlocking(listener_);
+    }
+
+    void drop(Conn &c) {
+        close(c.fd);
+        c.fd = -1;
+        c.gone = false;
+        c.queued = false;
+    }
+
+    uint32_t rate_;
+    uint32_t queueMax_;
+    uint32_t downMs_;
+    uint16_t port_ = 0;
+    int listener_ = -1;
+    uint32_t startedAt_ = 0;
+    uint32_t lastTick_ = 0;
+    double tokens_ = 0;
+    std::vector<Conn> conns_;
+    std::deque<int> queue_;
+};
+
+// ---- Clients --------------------------------------------------------------
+
+enum ClientState { WAITING, CONNECTING, AWAIT_CONNACK, UP };
+
+struct SimClient {
+    int fd = -1;
+    ClientState state = WAITING;
+    uint32_t at = 0;           // next attempt, or the CONNACK deadline
+    uint8_t ack[4];
+    size_t ackLen = 0;
+    uint32_t upAt = 0;
+    uint32_t attempts = 0;
+    RetryBackoff backoff{RETRY_MQTT_BASE_MS, RETRY_MQTT_CAP_MS, RETRY_STABLE_MS};
+};
+
+struct Fleet {
+    bool jitter;
+    sockaddr_storage addr;
+    socklen_t addrLen;
+    std::vector<SimClient> clients;
+    std::vector<uint32_t> connectsPerSecond;
+    uint32_t connects = 0;
+    uint32_t refused = 0;
+    uint32_t timeouts = 0;
+    uint32_t drops = 0;
+    uint32_t startedAt = 0;
+
+    void fail(SimClient &c, uint32_t now) {
+        if (c.fd >= 0) close(c.fd);
+        c.fd = -1;
+        c.state = WAITING;
+        c.at = now + (jitter ? c.backoff.next() : FIXED_RETRY_MS);
+    }
+
+    // Lost an established session: the old firmware went straight back
+    void dropped(SimClient &c, uint32_t now) {
+        drops++;
+        fail(c, now);
+        if (!jitter) c.at = now;
+    }
+
+    void attempt(SimClient &c, size_t i, uint32_t now) {
+        c.fd = socket(addr.ss_family, SOCK_STREAM, 0);
+        if (c.fd < 0) {
+            perror("socket (raise ulimit -n)");
+            exit(1);
+        }
+        nonBlocking(c.fd);
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        c.attempts++;
+        c.ackLen = 0;
+        if (connect(c.fd, (sockaddr*)&addr, addrLen) == 0) {
+            sendConnect(c, i, now);
+        } else if (errno == EINPROGRESS) {
+            c.state = CONNECTING;
+            c.at = now + CONNACK_TIMEOUT_MS;
+        } else {
+            refused++;
+            fail(c, now);
+        }
+    }
+
+    void sendConnect(SimClient &c, size_t i, uint32_t now) {
+        char id[24];
+        int idLen = snprintf(id, sizeof(id), "ESP32-DEV-%04zu", i + 1);
+        uint8_t packet[64] = {0x10, (uint8_t)(12 + idLen), 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x00, 60,
+                              0x00, (uint8_t)idLen};
+        memcpy(packet + 14, id, idLen);
+        if (send(c.fd, packet, 14 + idLen, MSG_NOSIGNAL) != 14 + idLen) {
+            refused++;
+            fail(c, now);
+            return;
+        }
+        connects++;
+        uint32_t second = (now - startedAt) / 1000;
+        if (second >= connectsPerSecond.size()) connectsPerSecond.resize(second + 1, 0);
+        connectsPerSecond[second]++;
+        c.state = AWAIT_CONNACK;
+        c.at = now + CONNACK_TIMEOUT_MS;
+    }
+
+    void addPollFds(std::vector<pollfd> &fds, std::vector<size_t> &owners) {
+        for (size_t i = 0; i < clients.size(); i++) {
+            const SimClient &c = clients[i];
+            if (c.fd < 0) continue;
+            fds.push_back({c.fd, (short)(c.state == CONNECTING ? POLLOUT : POLLIN), 0});
+            owners.push_back(i);
+        }
+    }
+
+    void handle(size_t i, short revents, uint32_t now) {
+        SimClient &c = clients[i];
+        if (c.state == CONNECTING && (revents & (POLLOUT | POLLERR | POLLHUP))) {
+            int error = 0;
+            socklen_t size = sizeof(error);
+            getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &error, &size);
+            if (error) {
+                refused++;
+                fail(c, now);
+            } else {
+                sendConnect(c, i, now);
+            }
+            return;
+        }
+        if (!(revents & (POLLIN | POLLERR | POLLHUP))) return;
+
+        uint8_t buf[64];
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            if (c.state == UP) {
+                dropped(c, now);
+            } else {
+                refused++;
+                fail(c, now);
+            }
+            return;
+        }
+        if (c.state != AWAIT_CONNACK) return;
+        for (ssize_t k = 0; k < n && c.ackLen < sizeof(c.ack); k++) c.ack[c.ackLen++] = buf[k];
+        if (c.ackLen == sizeof(c.ack)) {
+            if (c.ack[0] == 0x20 && c.ack[3] == 0x00) {
+                c.state = UP;
+                c.upAt = now - startedAt;
+            } else {
+                refused++;
+                fail(c, now);
+            }
+        }
+    }
+
+    void timers(uint32_t now) {
+        for (size_t i = 0; i < clients.size(); i++) {
+            SimClient &c = clients[i];
+            if ((int32_t)(now - c.at) < 0) continue;
+            if (c.state == WAITING) {
+                attempt(c, i, now);
+            } else if (c.state == CONNECTING || c.state == AWAIT_CONNACK) {
+                timeouts++;
+                fail(c, now);
+            }
+        }
+    }
+
+    size_t up() const {
+        return std::count_if(clients.begin(), clients.end(), [](const SimClient &c) { return c.state == UP; });
+    }
+};
+
+static bool resolve(const char* hostPort, sockaddr_storage &addr, socklen_t &len) {
+    const char* colon = strrchr(hostPort, ':');
+    if (!colon) return false;
+    std::string host(hostPort, colon - hostPort);
+    addrinfo hints = {};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), colon + 1, &hints, &res) != 0 || !res) return false;
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+static void report(const char* label, Fleet &fleet, StandIn* broker) {
+    std::vector<uint32_t> times;
+    for (const SimClient &c : fleet.clients) {
+        if (c.state == UP) times.push_back(c.upAt);
+    }
+    std::sort(times.begin(), times.end());
+    // Time until a share of the whole fleet was up, "-" if it never was
+    char p50[16], p99[16], all[16];
+    auto at = [&](double q, char* out) {
+        size_t i = (size_t)(q * fleet.clients.size());
+        if (i >= fleet.clients.size()) i = fleet.clients.size() - 1;
+        if (i < times.size()) {
+            snprintf(out, 16, "%.1f s", times[i] / 1000.0);
+        } else {
+            strcpy(out, "-");
+        }
+    };
+    at(0.5, p50);
+    at(0.99, p99);
+    at(1.0, all);
+    uint32_t peak = fleet.connectsPerSecond.empty() ? 0 : *std::max_element(fleet.connectsPerSecond.begin(), fleet.connectsPerSecond.end());
+    uint16_t maxStreak = 0;
+    for (const SimClient &c : fleet.clients) maxStreak = std::max(maxStreak, c.backoff.maxStreak);
+
+    printf("%-10s %5zu/%-5zu %8s %8s %8s %9u %7u/s %8u %7u %8u",
+           label, times.size(), fleet.clients.size(), p50, p99, all,
+           fleet.connects, peak, fleet.timeouts, broker ? broker->rejected : fleet.refused, broker ? broker->wasted : 0);
+    if (fleet.jitter) printf("  (max streak %u)", maxStreak);
+    printf("\n");
+}
+
+static void runFleet(const char* label, bool jitter, size_t count, const char* brokerArg, uint32_t rate, uint32_t queueMax,
+                     uint32_t downMs, uint32_t seconds) {
+    Fleet fleet;
+    fleet.jitter = jitter;
+    fleet.clients.resize(count);
+    for (size_t i = 0; i < count; i++) fleet.clients[i].backoff.seed(0x5eed0000 + i * 7919);
+
+    StandIn standIn(rate, queueMax, downMs);
+    StandIn* broker = nullptr;
+    if (brokerArg) {
+        if (!resolve(brokerArg, fleet.addr, fleet.addrLen)) {
+            fprintf(stderr, "cannot resolve %s\n", brokerArg);
+            exit(2);
+        }
+    } else {
+        uint16_t port;
+        if (!standIn.reserve(port)) {
+            perror("reserve port");
+            exit(1);
+        }
+        char hostPort[32];
+        snprintf(hostPort, sizeof(hostPort), "127.0.0.1:%u", port);
+        resolve(hostPort, fleet.addr, fleet.addrLen);
+        broker = &standIn;
+    }
+
+    // Everyone just lost the session to the restart
+    uint32_t start = nowMs();
+    fleet.startedAt = start;
+    if (broker) broker->start(start);
+    for (SimClient &c : fleet.clients) fleet.dropped(c, start);
+    fleet.drops = 0;
+
+    uint32_t limit = brokerArg ? seconds * 1000 : STANDIN_LIMIT_MS;
+    std::vector<pollfd> fds;
+    std::vector<size_t> owners;
+    uint32_t now = start;
+    while (now - start < limit && (brokerArg || fleet.up() < count)) {
+        fds.clear();
+        owners.clear();
+        fleet.addPollFds(fds, owners);
+        size_t clientFds = fds.size();
+        if (broker) broker->addPollFds(fds);
+        poll(fds.data(), fds.size(), 2);
+
+        now = nowMs();
+        if (broker) broker->run(now);
+        for (size_t k = 0; k < clientFds; k++) {
+            if (fds[k].revents) fleet.handle(owners[k], fds[k].revents, now);
+        }
+        fleet.timers(now);
+    }
+
+    report(label, fleet, broker);
+    for (SimClient &c : fleet.clients) {
+        if (c.fd >= 0) close(c.fd);
+    }
+    if (broker) broker->stop();
+}
+
+int main(int argc, char** argv) {
+    size_t count = 2000;
+    const char* brokerArg = nullptr;
+    uint32_t rate = 200;
+    uint32_t queueMax = 2000;
+    double down = 5;
+    uint32_t seconds = 60;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--broker" && hasValue) {
+            brokerArg = argv[++i];
+        } else if (arg == "--rate" && hasValue) {
+            rate = atoi(argv[++i]);
+        } else if (arg == "--queue" && hasValue) {
+            queueMax = atoi(argv[++i]);
+        } else if (arg == "--down" && hasValue) {
+            down = atof(argv[++i]);
+        } else if (arg == "--seconds" && hasValue) {
+            seconds = atoi(argv[++i]);
+        } else if (arg[0] != '-') {
+            count = atoi(argv[i]);
+        } else {
+            fprintf(stderr, "usage: reconnect_storm [clients] [--rate N] [--queue N] [--down S] | [--broker host:port] [--seconds S]\n");
+            return 2;
+        }
+    }
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    if (brokerArg) {
+        printf("%zu clients against %s for %u s, CONNACK timeout %u ms\n", count, brokerArg, seconds, CONNACK_TIMEOUT_MS);
+    } else {
+        printf("%zu clients, stand-in broker down %.1f s, then %u CONNECT/s with %u queued at most, CONNACK timeout %u ms\n",
+               count, down, rate, queueMax, CONNACK_TIMEOUT_MS);
+    }
+    printf("%-10s %11s %8s %8s %8s %9s %9s %8s %7s %8s\n", "retry", "up", "p50", "p99", "all", "CONNECTs", "peak", "timeouts",
+           brokerArg ? "failed" : "rejected", "wasted");
+    runFleet("fixed 1 s", false, count, brokerArg, rate, queueMax, down * 1000, seconds);
+    runFleet("backoff", true, count, brokerArg, rate, queueMax, down * 1000, seconds);
+    return 0;
+}
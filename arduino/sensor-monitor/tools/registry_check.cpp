@@ -0,0 +1,244 @@
+// Builds a 24-row sensor registry with sensor_registry.h and compares the
+// code it generates with hand-written code for the same board.
+//
+//   registry_check [passes]
+//
+// Build: g++ -std=c++17 -O2 -I.. -o registry_check registry_check.cpp
+// Code size per variant: nm -S -C --size-sort registry_check | grep pass
+//
+// The registry is what a 20+ sensor board would declare: three GPS rows on
+// one stream-fed channel, a DHT-style part whose sampler feeds two rows,
+// and 19 single-row sensors. It is checked at compile time (validity,
+// channel count and numbering, the stored-schedule layout) together with
+// tables sensorRegistryValid() must reject. Each variant then runs the
+// sketch's two hot paths: readSensor(channel) for every channel, and the
+// values of a compact data row. The registry variant expands them the way
+// the sketch does. The hand-written variant has a switch per channel and
+// one line per value. The runtime variant loops over a table of function
+// pointers. The rows must come out byte-identical. Exits non-zero on a
+// mismatch.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "sensor_registry.h"
+
+// Fake hardware: each sampler advances its own reading
+static double readings[24];
+
+template <int K>
+void fakeSample() {
+    readings[K] = std::fmod(readings[K] * 1.0001 + K + 0.37, 1000.0);
+}
+
+// The DHT-style part: one read, two values
+void fakeSampleDht() {
+    readings[3] = std::fmod(readings[3] * 1.0001 + 0.11, 40.0);
+    readings[4] = std::fmod(readings[4] * 1.0001 + 0.23, 100.0);
+}
+
+template <int K>
+double fakeValue() {
+    return readings[K];
+}
+
+#define SENSOR_ROW(K, TYPE) {TYPE, TYPE, "u", 90, 2, nullptr, 1000, 60000, 1000, fakeSample<K>, fakeValue<K>, nullptr}
+
+constexpr SensorDef ROWS[] = {
+    {"gps_latitude",  "GPS Latitude",  "degrees", 95, 6, "gps", 0, 15000, 0,    nullptr,       fakeValue<0>, nullptr},
+    {"gps_longitude", "GPS Longitude", "degrees", 95, 6, "gps", 0, 15000, 0,    nullptr,       fakeValue<1>, nullptr},
+    {"gps_altitude",  "GPS Altitude",  "meters",  90, 1, "gps", 0, 15000, 0,    nullptr,       fakeValue<2>, nullptr},
+    {"temperature",   "Temperature",   "C",       98, 2, "dht", 2000, 60000, 2000, fakeSampleDht, fakeValue<3>, "T:%.1fC"},
+    {"humidity",      "Humidity",      "%",       95, 1, "dht", 2000, 60000, 2000, nullptr,       fakeValue<4>, "H:%.1f%%"},
+    SENSOR_ROW(5, "light"),         SENSOR_ROW(6, "potentiometer"), SENSOR_ROW(7, "pressure"),
+    SENSOR_ROW(8, "soil_moisture"), SENSOR_ROW(9, "soil_temp"),     SENSOR_ROW(10, "co2"),
+    SENSOR_ROW(11, "voc"),          SENSOR_ROW(12, "pm25"),         SENSOR_ROW(13, "pm10"),
+    SENSOR_ROW(14, "uv_index"),     SENSOR_ROW(15, "wind_speed"),   SENSOR_ROW(16, "wind_dir"),
+    SENSOR_ROW(17, "rain"),         SENSOR_ROW(18, "leaf_wetness"), SENSOR_ROW(19, "battery_v"),
+    SENSOR_ROW(20, "solar_v"),      SENSOR_ROW(21, "water_level"),  SENSOR_ROW(22, "ph"),
+    SENSOR_ROW(23, "conductivity"),
+};
+
+constexpr auto SENSORS = sensorRegistry(ROWS);
+constexpr size_t FIELDS = SENSORS.size();
+constexpr int CHANNELS = sensorChannelCount(ROWS);
+
+static_assert(FIELDS == 24, "a 20+ sensor board");
+static_assert(sensorRegistryValid(ROWS), "the board's table is valid");
+static_assert(CHANNELS == 21, "gps, dht and 19 single-row channels");
+static_assert(sensorChannelOf(ROWS, "gps") == 0 && sensorChannelOf(ROWS, "dht") == 1, "numbered by first appearance");
+static_assert(SENSORS[4].channel == 1 && SENSORS[5].channel == 2 && SENSORS[23].channel == 20, "rows get their channel");
+static_assert(sensorChannelOf(ROWS, "nope") == 0xff, "unknown channel");
+static_assert(sensorSampledCount(ROWS) == 20, "rows with a window");
+
+// Tables the registry must reject
+constexpr SensorDef TWO_SAMPLERS[] = {
+    {"a", "A", "u", 90, 2, "x", 1000, 0, 1000, fakeSample<0>, fakeValue<0>, nullptr},
+    {"b", "B", "u", 90, 2, "x", 1000, 0, 1000, fakeSample<1>, fakeValue<1>, nullptr},
+};
+constexpr SensorDef INTERVALS_DIFFER[] = {
+    {"a", "A", "u", 90, 2, "x", 1000, 0, 1000, fakeSample<0>, fakeValue<0>, nullptr},
+    {"b", "B", "u", 90, 2, "x", 2000, 0, 1000, nullptr,       fakeValue<1>, nullptr},
+};
+constexpr SensorDef TOO_FAST[] = {
+    {"a", "A", "u", 90, 2, nullptr, 1000, 0, 2000, fakeSample<0>, fakeValue<0>, nullptr},
+};
+constexpr SensorDef NO_SAMPLER[] = {
+    {"a", "A", "u", 90, 2, nullptr, 1000, 0, 1000, nullptr, fakeValue<0>, nullptr},
+};
+constexpr SensorDef DUPLICATE[] = {
+    {"a", "A", "u", 90, 2, nullptr, 1000, 0, 1000, fakeSample<0>, fakeValue<0>, nullptr},
+    {"a", "B", "u", 90, 2, nullptr, 1000, 0, 1000, fakeSample<1>, fakeValue<1>, nullptr},
+};
+static_assert(!sensorRegistryValid(TWO_SAMPLERS) && !sensorRegistryValid(INTERVALS_DIFFER) &&
+              !sensorRegistryValid(TOO_FAST) && !sensorRegistryValid(NO_SAMPLER) && !sensorRegistryValid(DUPLICATE),
+              "malformed tables are rejected");
+
+// Swapping two channels changes the stored-schedule layout
+constexpr SensorDef SWAPPED[] = {
+    {"light", "light", "u", 90, 2, nullptr, 1000, 60000, 1000, fakeSample<5>, fakeValue<5>, nullptr},
+    {"gps_latitude", "GPS Latitude", "degrees", 95, 6, "gps", 0, 15000, 0, nullptr, fakeValue<0>, nullptr},
+};
+constexpr SensorDef UNSWAPPED[] = {
+    {"gps_latitude", "GPS Latitude", "degrees", 95, 6, "gps", 0, 15000, 0, nullptr, fakeValue<0>, nullptr},
+    {"light", "light", "u", 90, 2, nullptr, 1000, 60000, 1000, fakeSample<5>, fakeValue<5>, nullptr},
+};
+static_assert(sensorChannelLayout(SWAPPED) != sensorChannelLayout(UNSWAPPED), "layout follows channel order");
+
+static size_t appendValue(char* out, size_t pos, double value, uint8_t decimals) {
+    if (std::isnan(value)) return pos + snprintf(out + pos, 32, "null,");
+    return pos + snprintf(out + pos, 32, "%.*f,", decimals, value);
+}
+
+// Registry: readSensor() and the compact row as the sketch expands them
+constexpr auto SAMPLERS = sensorChannelSamplers<CHANNELS>(ROWS);
+static_assert(SAMPLERS[0] == nullptr && SAMPLERS[1] == fakeSampleDht && SAMPLERS[20] == fakeSample<23>,
+              "one sampler per sampled channel");
+
+__attribute__((noinline)) void registryPassSample(int channel) {
+    if (SAMPLERS[channel]) {
+        SAMPLERS[channel]();
+    }
+}
+
+__attribute__((noinline)) size_t registryPassRow(char* out) {
+    size_t pos = 0;
+    forEachSensor<FIELDS>([&](auto i) {
+        constexpr const SensorDef &s = SENSORS[decltype(i)::value];
+        pos = appendValue(out, pos, s.value(), s.decimals);
+    });
+    return pos;
+}
+
+// Hand-written: what the sketch had per sensor before the registry
+__attribute__((noinline)) void handPassSample(int channel) {
+    switch (channel) {
+    case 1: fakeSampleDht(); break;
+    case 2: fakeSample<5>(); break;
+    case 3: fakeSample<6>(); break;
+    case 4: fakeSample<7>(); break;
+    case 5: fakeSample<8>(); break;
+    case 6: fakeSample<9>(); break;
+    case 7: fakeSample<10>(); break;
+    case 8: fakeSample<11>(); break;
+    case 9: fakeSample<12>(); break;
+    case 10: fakeSample<13>(); break;
+    case 11: fakeSample<14>(); break;
+    case 12: fakeSample<15>(); break;
+    case 13: fakeSample<16>(); break;
+    case 14: fakeSample<17>(); break;
+    case 15: fakeSample<18>(); break;
+    case 16: fakeSample<19>(); break;
+    case 17: fakeSample<20>(); break;
+    case 18: fakeSample<21>(); break;
+    case 19: fakeSample<22>(); break;
+    case 20: fakeSample<23>(); break;
+    }
+}
+
+__attribute__((noinline)) size_t handPassRow(char* out) {
+    size_t pos = 0;
+    pos = appendValue(out, pos, readings[0], 6);
+    pos = appendValue(out, pos, readings[1], 6);
+    pos = appendValue(out, pos, readings[2], 1);
+    pos = appendValue(out, pos, readings[3], 2);
+    pos = appendValue(out, pos, readings[4], 1);
+    for (int k = 5; k < 24; k++) {
+        pos = appendValue(out, pos, readings[k], 2);
+    }
+    return pos;
+}
+
+// Runtime table: the same rows behind function pointers, looked up per call
+static SensorDef runtimeRows[FIELDS];
+
+__attribute__((noinline)) void runtimePassSample(int channel) {
+    for (const SensorDef &s : runtimeRows) {
+        if (s.sample && s.channel == channel) s.sample();
+    }
+}
+
+__attribute__((noinline)) size_t runtimePassRow(char* out) {
+    size_t pos = 0;
+    for (const SensorDef &s : runtimeRows) {
+        pos = appendValue(out, pos, s.value(), s.decimals);
+    }
+    return pos;
+}
+
+typedef void (*SamplePass)(int);
+typedef size_t (*RowPass)(char*);
+
+struct Timing {
+    double sampleNs;
+    double rowNs;
+};
+
+static Timing run(SamplePass sample, RowPass row, int passes, char* out) {
+    memset(readings, 0, sizeof(readings));
+    auto start = std::chrono::steady_clock::now();
+    for (int p = 0; p < passes; p++) {
+        for (int c = 0; c < CHANNELS; c++) sample(c);
+    }
+    auto sampled = std::chrono::steady_clock::now();
+    size_t len = 0;
+    for (int p = 0; p < passes; p++) len = row(out);
+    auto done = std::chrono::steady_clock::now();
+    out[len] = 0;
+    return {std::chrono::duration<double, std::nano>(sampled - start).count() / passes,
+            std::chrono::duration<double, std::nano>(done - sampled).count() / passes};
+}
+
+int main(int argc, char** argv) {
+    int passes = argc > 1 ? atoi(argv[1]) : 200000;
+    for (size_t i = 0; i < FIELDS; i++) runtimeRows[i] = SENSORS[i];
+
+    char registryRow[1024], handRow[1024], runtimeRow[1024];
+    // Best of three per variant against scheduler noise
+    Timing best[3] = {{1e18, 1e18}, {1e18, 1e18}, {1e18, 1e18}};
+    for (int round = 0; round < 3; round++) {
+        Timing t[3] = {run(registryPassSample, registryPassRow, passes, registryRow),
+                       run(handPassSample, handPassRow, passes, handRow),
+                       run(runtimePassSample, runtimePassRow, passes, runtimeRow)};
+        for (int v = 0; v < 3; v++) {
+            if (t[v].sampleNs < best[v].sampleNs) best[v].sampleNs = t[v].sampleNs;
+            if (t[v].rowNs < best[v].rowNs) best[v].rowNs = t[v].rowNs;
+        }
+    }
+
+    bool same = strcmp(registryRow, handRow) == 0 && strcmp(registryRow, runtimeRow) == 0;
+    printf("%zu rows, %d channels, %zu B of rows in rodata\n", FIELDS, CHANNELS, sizeof(SENSORS));
+    printf("  %-13s %8s %10s\n", "ns per pass", "sample", "data row");
+    const char* names[3] = {"registry", "hand-written", "runtime table"};
+    for (int v = 0; v < 3; v++) {
+        printf("  %-13s %8.1f %10.1f\n", names[v], best[v].sampleNs, best[v].rowNs);
+    }
+    printf("rows %s\n", same ? "identical: ok" : "DIFFER");
+    if (!same) {
+        printf("  registry %s\n  hand     %s\n  runtime  %s\n", registryRow, handRow, runtimeRow);
+    }
+    return same ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+// Measure TLS handshake time and heap, full vs resumed session.
+//
+//   tls_handshake <broker host> [port] (--ca file.pem | --insecure) [--rounds N]
+//
+// Build: g++ -std=c++17 -O2 -I.. -Ihost -o tls_handshake tls_handshake.cpp -lmbedtls -lmbedx509 -lmbedcrypto
+// (needs the mbedtls headers, e.g. Debian's libmbedtls-dev)
+//
+// Runs TlsSessionClient from the sketch over a host socket against a local
+// TLS listener, e.g. mosquitto 2.x with
+//
+//   listener 8883
+//   cafile   ca.crt
+//   certfile server.crt
+//   keyfile  server.key
+//   allow_anonymous true
+//
+// Each round drops the cached session and connects once (full handshake),
+// then connects --rounds times offering the session kept from the previous
+// connect, the way the sketch reconnects. Every connect sends an MQTT CONNECT
+// and waits for the CONNACK so the broker sees a real client. Prints each
+// handshake's time and peak heap (TlsSessionClient::lastHandshakeHeap, a
+// lower bound; see tls_session_client.h) and the medians per kind.
+//
+// Times and heap are the host's: the ESP32 has hardware AES/SHA/bignum and
+// a different mbedtls config (record buffer sizes), so compare full against
+// resumed here, not these numbers against the board's status report.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "tls_session_client.h"
+
+#define CONNACK_TIMEOUT_MS 5000
+
+struct Result {
+    bool resumed;
+    unsigned long ms;
+    uint32_t heap;
+};
+
+static bool readFile(const char* path, std::string &out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+// MQTT 3.1.1 CONNECT (clean session, keepalive 60) and its CONNACK
+static bool mqttConnect(TlsSessionClient &net) {
+    static const uint8_t CONNECT[] = {
+        0x10, 25, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x00, 60,
+        0x00, 13, 't', 'l', 's', '-', 'h', 'a', 'n', 'd', 's', 'h', 'a', 'k', 'e',
+    };
+    if (net.write(CONNECT, sizeof(CONNECT)) != sizeof(CONNECT)) return false;
+    uint8_t connack[4];
+    size_t got = 0;
+    unsigned long start = millis();
+    while (got < sizeof(connack) && millis() - start < CONNACK_TIMEOUT_MS) {
+        if (!net.connected()) return false;
+        int n = net.read(connack + got, sizeof(connack) - got);
+        if (n > 0) got += n;
+        else delay(1);
+    }
+    return got == sizeof(connack) && connack[0] == 0x20 && connack[3] == 0;
+}
+
+static unsigned long median(std::vector<unsigned long> v) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+int main(int argc, char** argv) {
+    const char* host = nullptr;
+    uint16_t port = 8883;
+    const char* caPath = nullptr;
+    bool insecure = false;
+    int rounds = 5;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--ca") && i + 1 < argc) caPath = argv[++i];
+        else if (!strcmp(argv[i], "--insecure")) insecure = true;
+        else if (!strcmp(argv[i], "--rounds") && i + 1 < argc) rounds = atoi(argv[++i]);
+        else if (!host) host = argv[i];
+        else port = (uint16_t)atoi(argv[i]);
+    }
+    if (!host || (!caPath && !insecure) || rounds < 1) {
+        fprintf(stderr, "usage: %s <broker host> [port] (--ca file.pem | --insecure) [--rounds N]\n", argv[0]);
+        return 2;
+    }
+
+    std::string ca;
+    TlsSessionClient net;
+    if (caPath) {
+        if (!readFile(caPath, ca)) {
+            fprintf(stderr, "cannot read %s\n", caPath);
+            return 2;
+        }
+        net.setCACert(ca.c_str());
+    } else {
+        net.setInsecure();
+    }
+
+    std::vector<Result> results;
+    for (int r = 0; r < 2; r++) {
+        net.clearSession();
+        for (int i = 0; i <= rounds; i++) {
+            if (!net.connect(host, port)) {
+                fprintf(stderr, "connect to %s:%u failed\n", host, port);
+                return 1;
+            }
+            if (!mqttConnect(net)) {
+                fprintf(stderr, "no CONNACK from %s:%u\n", host, port);
+                net.stop();
+                return 1;
+            }
+            results.push_back({net.lastResumed, net.lastHandshakeMs, net.lastHandshakeHeap});
+            printf("%-8s %6lu ms %8u B heap\n", net.lastResumed ? "resumed" : "full",
+                   net.lastHandshakeMs, net.lastHandshakeHeap);
+            net.stop();
+        }
+    }
+
+    std::vector<unsigned long> fullMs, fullHeap, resumedMs, resumedHeap;
+    for (const Result &res : results) {
+        (res.resumed ? resumedMs : fullMs).push_back(res.ms);
+        (res.resumed ? resumedHeap : fullHeap).push_back(res.heap);
+    }
+    printf("\n%-8s %5s %10s %10s\n", "", "count", "median ms", "median B");
+    printf("%-8s %5zu %10lu %10lu\n", "full", fullMs.size(), median(fullMs), median(fullHeap));
+    printf("%-8s %5zu %10lu %10lu\n", "resumed", resumedMs.size(), median(resumedMs), median(resumedHeap));
+    if (resumedMs.empty()) {
+        printf("\nThe listener never resumed a session; check that it keeps a session cache or issues tickets.\n");
+        return 1;
+    }
+    return 0;
+}
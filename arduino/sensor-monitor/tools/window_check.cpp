@@ -0,0 +1,118 @@
+// Checks sensor_window.h against two-pass reference statistics.
+//
+//   window_check [random windows]
+//
+// Build: g++ -std=c++17 -O2 -I.. -o window_check window_check.cpp
+//
+// Feeds windows through the accumulator the way runSensorSchedule() does
+// (float readings, NaN for a failed read) and compares count, min, max, mean
+// and sample stddev with a two-pass computation in long double over the same
+// readings. The fixed cases cover the empty window, a single sample, two
+// samples, a constant window, NaN-only and NaN-interleaved windows, and a
+// large offset with small noise; then random windows of sensor-like values.
+// Exits non-zero on any mismatch.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "sensor_window.h"
+
+struct Reference {
+    uint32_t count;
+    double minValue;
+    double maxValue;
+    double mean;
+    double stddev;
+};
+
+static Reference twoPass(const std::vector<float> &values) {
+    Reference r = {0, 0, 0, 0, 0};
+    long double sum = 0;
+    for (float v : values) {
+        if (std::isnan(v)) continue;
+        if (r.count == 0 || v < r.minValue) r.minValue = v;
+        if (r.count == 0 || v > r.maxValue) r.maxValue = v;
+        sum += v;
+        r.count++;
+    }
+    if (r.count == 0) return r;
+    long double mean = sum / r.count;
+    long double squares = 0;
+    for (float v : values) {
+        if (std::isnan(v)) continue;
+        squares += (v - mean) * (v - mean);
+    }
+    r.mean = (double)mean;
+    r.stddev = r.count > 1 ? (double)std::sqrt(squares / (r.count - 1)) : 0.0;
+    return r;
+}
+
+static bool close(double got, double want, double scale) {
+    return std::fabs(got - want) <= 1e-9 * std::fmax(1.0, std::fabs(scale));
+}
+
+static int failures = 0;
+
+static void check(const char* label, const std::vector<float> &values) {
+    SensorAccumulator acc;
+    accumulatorReset(acc);
+    for (float v : values) accumulatorAdd(acc, v);
+    Reference want = twoPass(values);
+    double stddev = std::sqrt(accumulatorVariance(acc));
+
+    bool ok = acc.count == want.count && close(acc.mean, want.mean, want.mean) &&
+              close(stddev, want.stddev, want.mean) &&
+              (want.count == 0 || (acc.minValue == want.minValue && acc.maxValue == want.maxValue));
+    if (!ok) {
+        failures++;
+        printf("FAIL %s: n %u/%u  min %.7g/%.7g  max %.7g/%.7g  mean %.12g/%.12g  stddev %.12g/%.12g\n", label,
+               acc.count, want.count, acc.minValue, want.minValue, acc.maxValue, want.maxValue,
+               acc.mean, want.mean, stddev, want.stddev);
+    }
+}
+
+int main(int argc, char** argv) {
+    int windows = argc > 1 ? atoi(argv[1]) : 2000;
+    const float nan = NAN;
+
+    check("empty", {});
+    check("one sample", {21.5f});
+    check("two samples", {21.5f, 22.0f});
+    check("constant", std::vector<float>(120, 54.3f));
+    check("all NaN", {nan, nan, nan});
+    check("NaN then one", {nan, nan, 18.25f});
+    check("NaN interleaved", {20.1f, nan, 20.4f, nan, 19.8f, 21.0f, nan});
+    check("negative", {-12.5f, -3.25f, -40.0f, 0.0f});
+
+    // A pressure-like baseline with hundredths of noise: the case where
+    // sum(x^2) - n*mean^2 loses the variance
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 0.02f);
+    std::vector<float> offset;
+    for (int i = 0; i < 3600; i++) offset.push_back(1013.25f + noise(rng));
+    check("large offset", offset);
+
+    // Sensor-like windows: DHT temperature and humidity, 12-bit ADC counts
+    std::uniform_int_distribution<int> length(0, 400);
+    std::uniform_int_distribution<int> kind(0, 2);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int w = 0; w < windows; w++) {
+        int n = length(rng);
+        int k = kind(rng);
+        float base = k == 0 ? -10 + 50 * unit(rng) : (k == 1 ? 20 + 60 * unit(rng) : 4095 * unit(rng));
+        float spread = k == 2 ? 200 : 2;
+        std::vector<float> values;
+        for (int i = 0; i < n; i++) {
+            values.push_back(unit(rng) < 0.02f ? nan : base + spread * (unit(rng) - 0.5f));
+        }
+        char label[32];
+        snprintf(label, sizeof(label), "random %d", w);
+        check(label, values);
+    }
+
+    printf("%d fixed + %d random windows: %s\n", 9, windows, failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -35,4 +35,11 @@ return [
         ],
     ],
 
+    'geofence' => [
+        // libgeofence.so built from arduino/sensor-monitor/tools/geofence_ffi.cpp;
+        // unset (or ext-ffi missing) runs the same checks in PHP
+        'ffi_library' => env('GEOFENCE_FFI_LIBRARY'),
+        'ffi_header' => base_path('arduino/sensor-monitor/tools/geofence_ffi.h'),
+    ],
+
 ];
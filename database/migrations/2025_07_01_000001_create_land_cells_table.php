@@ -0,0 +1,31 @@
+<?php
+
+use Illuminate\Database\Migrations\Migration;
+use Illuminate\Database\Schema\Blueprint;
+use Illuminate\Support\Facades\Schema;
+
+return new class extends Migration
+{
+    /**
+     * Run the migrations.
+     */
+    public function up(): void
+    {
+        // Geohash cells covering each land's fence, so a fix is matched to
+        // candidate lands by an indexed prefix lookup before exact geometry
+        Schema::create('land_cells', function (Blueprint $table) {
+            $table->id();
+            $table->foreignId('land_id')->constrained()->onDelete('cascade');
+            $table->string('cell', 12)->index();
+            $table->unique(['land_id', 'cell']);
+        });
+    }
+
+    /**
+     * Reverse the migrations.
+     */
+    public function down(): void
+    {
+        Schema::dropIfExists('land_cells');
+    }
+};
@@ -0,0 +1,30 @@
+<?php
+
+use Illuminate\Database\Migrations\Migration;
+use Illuminate\Database\Schema\Blueprint;
+use Illuminate\Support\Facades\Schema;
+
+return new class extends Migration
+{
+    /**
+     * Run the migrations.
+     */
+    public function up(): void
+    {
+        // Summary of the sampling window behind the latest value (min, max,
+        // stddev, samples); null when the device published a point reading
+        Schema::table('sensors', function (Blueprint $table) {
+            $table->json('window_stats')->nullable()->after('value');
+        });
+    }
+
+    /**
+     * Reverse the migrations.
+     */
+    public function down(): void
+    {
+        Schema::table('sensors', function (Blueprint $table) {
+            $table->dropColumn('window_stats');
+        });
+    }
+};